@@ -0,0 +1,3 @@
+WRAP_CLASS("itk::StreamingMorphologicalWatershedImageFilter" POINTER)
+  WRAP_IMAGE_FILTER_COMBINATIONS("${WRAP_ITK_SCALAR}" "${WRAP_ITK_INT}")
+END_WRAP_CLASS()
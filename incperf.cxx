@@ -0,0 +1,149 @@
+#include "itkImageFileReader.h"
+
+#include "itkRegionalMinimaImageFilter.h"
+#include "itkHMinimaImageFilter.h"
+#include "itkConnectedComponentImageFilter.h"
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkInvertIntensityImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+#include "itkTimeProbe.h"
+#include "itkMultiThreader.h"
+#include <iomanip>
+#include <map>
+
+// time of an update after the edit of a single marker pixel in the smallest
+// basin, with the incremental flooding, compared to the time of a full
+// flooding of the image
+int main(int arglen, char * argv[])
+{
+  if( arglen < 2 )
+    {
+    std::cerr << "usage: " << argv[0] << " input2D [nbOfRuns]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  int nbOfRuns = 100;
+  if( arglen > 2 )
+    {
+    nbOfRuns = atoi( argv[2] );
+    }
+
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(1);
+
+  const int dim = 2;
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim >    IType;
+  typedef unsigned short LType;
+  typedef itk::Image< LType, dim >    LImageType;
+
+  // read the input image
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[1] );
+
+  // the image is more interesting inverted
+  typedef itk::InvertIntensityImageFilter< IType, IType > InvertType;
+  InvertType::Pointer invert = InvertType::New();
+  invert->SetInput( reader->GetOutput() );
+  invert->Update();
+
+  // remove some minima
+  typedef itk::HMinimaImageFilter< IType, IType > MinimaType;
+  MinimaType::Pointer minima = MinimaType::New();
+  minima->SetInput( invert->GetOutput() );
+  minima->SetHeight( 30 );
+
+  typedef itk::RegionalMinimaImageFilter< IType, LImageType > RMinType;
+  RMinType::Pointer rmin = RMinType::New();
+  rmin->SetInput( minima->GetOutput() );
+
+  typedef itk::ConnectedComponentImageFilter< LImageType, LImageType > ConnectedCompType;
+  ConnectedCompType::Pointer label = ConnectedCompType::New();
+  label->SetInput( rmin->GetOutput() );
+  label->Update();
+
+  // the markers are edited in place, so keep them out of the pipeline
+  LImageType::Pointer markers = label->GetOutput();
+  markers->DisconnectPipeline();
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, LImageType > MMWatershedType;
+
+  std::cout << "F" << "\t"
+            << "flooded" << "\t"
+            << "pixels" << "\t"
+            << "full" << "\t"
+            << "edit" << "\t"
+            << std::endl;
+
+  for(int F=0; F<=1; F++ )
+    {
+    MMWatershedType::Pointer mmws = MMWatershedType::New();
+    mmws->SetInput( invert->GetOutput() );
+    mmws->SetMarkerImage( markers );
+    mmws->SetFullyConnected( F );
+    mmws->SetMarkWatershedLine( false );
+    mmws->SetIncrementalFlooding( true );
+    mmws->Update();
+
+    // a pixel of the smallest basin which is not a marker
+    std::map< LType, unsigned long > areas;
+    typedef itk::ImageRegionConstIteratorWithIndex< LImageType > IteratorType;
+    IteratorType it( mmws->GetOutput(), mmws->GetOutput()->GetBufferedRegion() );
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+      {
+      areas[ it.Get() ]++;
+      }
+    LType newLabel = areas.rbegin()->first + 1;
+    LImageType::IndexType editIndex;
+    bool found = false;
+    unsigned long smallest = 0;
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+      {
+      if( markers->GetPixel( it.GetIndex() ) == 0 && ( !found || areas[ it.Get() ] < smallest ) )
+        {
+        smallest = areas[ it.Get() ];
+        editIndex = it.GetIndex();
+        found = true;
+        }
+      }
+    LImageType::SizeType editSize;
+    editSize.Fill( 1 );
+    LImageType::RegionType edit( editIndex, editSize );
+
+    itk::TimeProbe ftime;
+    itk::TimeProbe etime;
+    unsigned long flooded = 0;
+    for( int i=0; i<nbOfRuns; i++ )
+      {
+      // full flooding: the input is modified, so the workspace can't be
+      // used
+      invert->GetOutput()->Modified();
+      ftime.Start();
+      mmws->Update();
+      ftime.Stop();
+
+      // add and remove the marker pixel
+      for( int j=0; j<2; j++ )
+        {
+        markers->SetPixel( editIndex, j == 0 ? newLabel : 0 );
+        markers->Modified();
+        mmws->SetMarkerEditRegion( edit );
+        etime.Start();
+        mmws->Update();
+        etime.Stop();
+        flooded += mmws->GetNumberOfFloodedPixels();
+        }
+      }
+
+    std::cout << std::setprecision(3)
+              << F << "\t"
+              << flooded / ( 2 * nbOfRuns ) << "\t"
+              << mmws->GetOutput()->GetBufferedRegion().GetNumberOfPixels() << "\t"
+              << ftime.GetMeanTime() << "\t"
+              << etime.GetMeanTime() << "\t"
+              << std::endl;
+    }
+
+  return 0;
+}
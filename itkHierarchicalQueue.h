@@ -17,17 +17,196 @@
 #ifndef __itkHierarchicalQueue_h
 #define __itkHierarchicalQueue_h
 
-// #include <vector>
-#include <list>
+#include <vector>
 #include <map>
+#include <string.h>
 
 namespace itk
 {
+
+/** \class HierarchicalQueueChunkPool
+ *  \brief Store of the fixed size chunks used by the levels of a HierarchicalQueue
+ *
+ * The values pushed in a level of a HierarchicalQueue are stored in chunks of
+ * VChunkSize contiguous values. A chunk emptied by Pop() is not freed, but
+ * kept in this pool and given back to the next level which needs some space,
+ * so, once the queue has reached its maximum size, no more memory allocation
+ * is done - even across several runs of the same queue.
+ */
+template <typename TValue, unsigned int VChunkSize=256 >
+class HierarchicalQueueChunkPool
+{
+
+public:
+
+  /** Standard typedefs */
+  typedef HierarchicalQueueChunkPool      Self;
+
+  typedef TValue ValueType;
+
+  struct Chunk
+    {
+    ValueType      m_Values[VChunkSize];
+    unsigned int   m_Begin;
+    unsigned int   m_End;
+    Chunk *        m_Next;
+    };
+
+  /** return an empty chunk, from the free list if possible */
+  inline Chunk * Acquire()
+    {
+    Chunk * chunk = m_FreeList;
+    if( chunk != NULL )
+      {
+      m_FreeList = chunk->m_Next;
+      }
+    else
+      {
+      chunk = new Chunk;
+      }
+    chunk->m_Begin = 0;
+    chunk->m_End = 0;
+    chunk->m_Next = NULL;
+    return chunk;
+    }
+
+  /** put a chunk back in the free list */
+  inline void Release( Chunk * chunk )
+    {
+    chunk->m_Next = m_FreeList;
+    m_FreeList = chunk;
+    }
+
+  /** free the chunks of the free list */
+  void ReleaseMemory()
+    {
+    while( m_FreeList != NULL )
+      {
+      Chunk * chunk = m_FreeList;
+      m_FreeList = chunk->m_Next;
+      delete chunk;
+      }
+    }
+
+  HierarchicalQueueChunkPool()
+    {
+    m_FreeList = NULL;
+    }
+
+  ~HierarchicalQueueChunkPool()
+    {
+    this->ReleaseMemory();
+    }
+
+private:
+  HierarchicalQueueChunkPool(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  Chunk * m_FreeList;
+
+};
+
+
+/** \class HierarchicalQueueFifo
+ *  \brief FIFO used to store the values of a level of a HierarchicalQueue
+ *
+ * The values are stored in a linked list of chunks taken from a
+ * HierarchicalQueueChunkPool, so a push or a pop is only an array access
+ * most of the time. The pool is not stored in the FIFO to keep it as small
+ * as possible - there is one FIFO per key - and must be given to the methods
+ * which may need a new chunk or release one.
+ */
+template <typename TValue, unsigned int VChunkSize=256 >
+class HierarchicalQueueFifo
+{
+
+public:
+
+  /** Standard typedefs */
+  typedef HierarchicalQueueFifo      Self;
+
+  typedef TValue ValueType;
+
+  typedef HierarchicalQueueChunkPool< ValueType, VChunkSize > PoolType;
+  typedef typename PoolType::Chunk ChunkType;
+
+  /** return true if the FIFO is empty */
+  inline bool Empty() const
+    {
+    return m_Head == NULL;
+    }
+
+  /** return the first value of the FIFO */
+  inline const ValueType & Front() const
+    {
+    assert( !this->Empty() );
+    return m_Head->m_Values[ m_Head->m_Begin ];
+    }
+
+  /** push a value at the end of the FIFO */
+  inline void Push( const ValueType & v, PoolType & pool )
+    {
+    if( m_Tail == NULL )
+      {
+      m_Head = m_Tail = pool.Acquire();
+      }
+    else if( m_Tail->m_End == VChunkSize )
+      {
+      m_Tail->m_Next = pool.Acquire();
+      m_Tail = m_Tail->m_Next;
+      }
+    m_Tail->m_Values[ m_Tail->m_End++ ] = v;
+    }
+
+  /** remove the first value of the FIFO */
+  inline void Pop( PoolType & pool )
+    {
+    assert( !this->Empty() );
+    m_Head->m_Begin++;
+    if( m_Head->m_Begin == m_Head->m_End )
+      {
+      // the chunk is exhausted - give it back to the pool
+      ChunkType * chunk = m_Head;
+      m_Head = chunk->m_Next;
+      if( m_Head == NULL )
+        {
+        m_Tail = NULL;
+        }
+      pool.Release( chunk );
+      }
+    }
+
+  /** remove all the values of the FIFO */
+  inline void Clear( PoolType & pool )
+    {
+    while( m_Head != NULL )
+      {
+      ChunkType * chunk = m_Head;
+      m_Head = chunk->m_Next;
+      pool.Release( chunk );
+      }
+    m_Tail = NULL;
+    }
+
+  HierarchicalQueueFifo()
+    {
+    m_Head = NULL;
+    m_Tail = NULL;
+    }
+
+private:
+
+  ChunkType * m_Head;
+  ChunkType * m_Tail;
+
+};
+
+
 /** \class HierarchicalQueue
  *  \brief HierarchicalQueue class
  * 
- * This class implement a priority queue based on list and map or list and vector,
- * depending on the key type. Image analysis are making a particular
+ * This class implement a priority queue based on FIFO and map, FIFO and vector,
+ * or FIFO and radix heap, depending on the key type. Image analysis are making a particular
  * usage of priority queue: there is a restricted set of keys, but a
  * very high number of values. This particularity make classical priority
  * queue implementations (with heap and vector or deque, like in STL) highly inefficient.
@@ -35,6 +214,12 @@ namespace itk
  * values are returned in the same order they have been pushed in the queue.
  * This class gives both better performances for image analysis, and ensure
  * the output order of the values.
+ *
+ * The values of a key are stored in chunks of contiguous memory, instead of
+ * a std::list with one allocation per value. The chunks are recycled by the
+ * queue, and are kept by Clear(), so a queue reused for several runs
+ * doesn't allocate any memory once it has reached its maximum size.
+ * ReleaseMemory() frees them.
  */
 template <typename TKey, typename TValue, typename TCompare=typename std::less<TKey> >
 class HierarchicalQueue
@@ -49,9 +234,11 @@ public:
   typedef TKey KeyType;
   typedef TCompare CompareType;
 
-  typedef std::list<ValueType>      ValueListType;
+  // there may be a lot of keys with only a few values: small chunks are used
+  // to avoid wasting memory
+  typedef HierarchicalQueueFifo<ValueType, 8>   ValueListType;
+  typedef typename ValueListType::PoolType      PoolType;
   typedef std::map<KeyType, ValueListType, CompareType>  MapType;
-//   typedef std::Vector<ValueListType>  VectorType;
 
   /** return the current key */
   inline const KeyType & FrontKey() const
@@ -64,13 +251,13 @@ public:
   inline const ValueType & FrontValue() const
     {
     assert(!this->Empty());
-    return m_Map.begin()->second.front();
+    return m_Map.begin()->second.Front();
     }
 
   /** push a value in the queue */
   inline void Push( const KeyType & k, const ValueType & v)
     {
-    m_Map[k].push_back( v );
+    m_Map[k].Push( v, m_Pool );
     m_Size++;
     }
 
@@ -91,26 +278,56 @@ public:
     {
     assert(!this->Empty());
     ValueListType & valueList = m_Map.begin()->second;
-    valueList.pop_front();
-    if( valueList.empty() )
+    valueList.Pop( m_Pool );
+    if( valueList.Empty() )
       {
       m_Map.erase( m_Map.begin() );
       }
     m_Size--;
     }
 
+  /** remove all the elements of the queue, but keep the memory
+   * for the next use of the queue */
+  void Clear()
+    {
+    if( m_Size == 0 )
+      {
+      return;
+      }
+    for( typename MapType::iterator it=m_Map.begin(); it!=m_Map.end(); it++ )
+      {
+      it->second.Clear( m_Pool );
+      }
+    m_Map.clear();
+    m_Size = 0;
+    }
+
+  /** remove all the elements of the queue, and free the memory kept for
+   * the next use of the queue */
+  void ReleaseMemory()
+    {
+    this->Clear();
+    m_Pool.ReleaseMemory();
+    }
+
   HierarchicalQueue()
     {
     m_Size = 0;
     }
 
+  ~HierarchicalQueue()
+    {
+    this->Clear();
+    }
 
 protected:
 
 private:
+  HierarchicalQueue(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
 
+  PoolType m_Pool;
   MapType m_Map;
-//   VactorType m_Vector;
   unsigned long m_Size;
 
 };
@@ -130,7 +347,8 @@ public:
   typedef TKey KeyType;
   typedef TCompare CompareType;
 
-  typedef std::list<ValueType>      ValueListType;
+  typedef HierarchicalQueueFifo<ValueType>      ValueListType;
+  typedef typename ValueListType::PoolType      PoolType;
   typedef std::vector<ValueListType>  VectorType;
 
   // for code conciseness
@@ -147,7 +365,7 @@ public:
   inline const ValueType & FrontValue() const
     {
     assert(!this->Empty());
-    return m_Vector[ m_CurrentValue  - NT::NonpositiveMin() ].front();
+    return m_Vector[ m_CurrentValue  - NT::NonpositiveMin() ].Front();
     }
 
   /** push a value in the queue */
@@ -156,7 +374,7 @@ public:
       assert( (int)(k  - NT::NonpositiveMin()) < (int)m_Vector.size() );
     assert( k  - NT::NonpositiveMin() >= 0 );
 
-    m_Vector[ k  - NT::NonpositiveMin() ].push_back( v );
+    m_Vector[ k  - NT::NonpositiveMin() ].Push( v, m_Pool );
     if( this->Empty() || m_Compare( k, m_CurrentValue ) )
       {
       m_CurrentValue = k;
@@ -181,13 +399,13 @@ public:
     {
     assert(!this->Empty());
     ValueListType & valueList = m_Vector[ m_CurrentValue  - NT::NonpositiveMin() ];
-    valueList.pop_front();
+    valueList.Pop( m_Pool );
     m_Size--;
 
-    if( valueList.empty() && !this->Empty() )
+    if( valueList.Empty() && !this->Empty() )
       {
       // update the current key to a new value
-      while( m_Vector[ m_CurrentValue - NT::NonpositiveMin() ].empty() )
+      while( m_Vector[ m_CurrentValue - NT::NonpositiveMin() ].Empty() )
         {
         m_CurrentValue += m_Direction;
         }
@@ -195,6 +413,30 @@ public:
 
     }
 
+  /** remove all the elements of the queue, but keep the memory
+   * for the next use of the queue */
+  void Clear()
+    {
+    if( m_Size == 0 )
+      {
+      return;
+      }
+    for( typename VectorType::iterator it=m_Vector.begin(); it!=m_Vector.end(); it++ )
+      {
+      it->Clear( m_Pool );
+      }
+    m_Size = 0;
+    }
+
+  /** remove all the elements of the queue, and free the memory kept for
+   * the next use of the queue. The vector of the keys is kept: its size
+   * only depends on the key type. */
+  void ReleaseMemory()
+    {
+    this->Clear();
+    m_Pool.ReleaseMemory();
+    }
+
   VectorHierarchicalQueue()
     {
     m_Vector.resize( NT::max() - NT::NonpositiveMin() + 1 );
@@ -213,11 +455,18 @@ public:
     assert( m_Vector.size() != 0 );
     }
 
+  ~VectorHierarchicalQueue()
+    {
+    this->Clear();
+    }
 
 protected:
 
 private:
+  VectorHierarchicalQueue(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
 
+  PoolType m_Pool;
   VectorType m_Vector;
   unsigned long m_Size;
   TKey m_CurrentValue;
@@ -226,6 +475,352 @@ private:
 
 };
 
+/** \class RadixHierarchicalQueueKeyTraits
+ *  \brief Order preserving conversion of the 32 bits keys to unsigned integers
+ *
+ * Used by RadixHierarchicalQueue. ToRadix(a) < ToRadix(b) if and only if a < b,
+ * and FromRadix( ToRadix(k) ) == k.
+ */
+template <typename TKey>
+class RadixHierarchicalQueueKeyTraits
+{
+};
+
+template <>
+class RadixHierarchicalQueueKeyTraits<unsigned int>
+{
+public:
+  static inline unsigned int ToRadix( const unsigned int & k )
+    {
+    return k;
+    }
+  static inline unsigned int FromRadix( const unsigned int & r )
+    {
+    return r;
+    }
+};
+
+template <>
+class RadixHierarchicalQueueKeyTraits<int>
+{
+public:
+  static inline unsigned int ToRadix( const int & k )
+    {
+    // just flip the sign bit
+    return static_cast<unsigned int>( k ) ^ 0x80000000u;
+    }
+  static inline int FromRadix( const unsigned int & r )
+    {
+    return static_cast<int>( r ^ 0x80000000u );
+    }
+};
+
+template <>
+class RadixHierarchicalQueueKeyTraits<float>
+{
+public:
+  static inline unsigned int ToRadix( const float & k )
+    {
+    // -0 and 0 must be the same key
+    float key = k;
+    if( key == 0 )
+      {
+      key = 0;
+      }
+    unsigned int r;
+    memcpy( &r, &key, sizeof(r) );
+    // the positive values only need to be placed after the negative ones,
+    // but the order of the negative values must also be reversed
+    if( r & 0x80000000u )
+      {
+      return ~r;
+      }
+    return r | 0x80000000u;
+    }
+  static inline float FromRadix( const unsigned int & r )
+    {
+    unsigned int u;
+    if( r & 0x80000000u )
+      {
+      u = r & 0x7fffffffu;
+      }
+    else
+      {
+      u = ~r;
+      }
+    float k;
+    memcpy( &k, &u, sizeof(k) );
+    return k;
+    }
+};
+
+
+/** \class RadixHierarchicalQueue
+ *  \brief Hierarchical queue for the keys on 32 bits
+ *
+ * There are too many possible keys to use a vector of FIFOs, and a map
+ * is slow, so the keys are converted to unsigned integers and the elements
+ * are stored in a radix heap: the element is placed in the bucket numbered
+ * by the highest bit which differs between its key and the current key.
+ * When the bucket of the current key is empty, the next non empty bucket is
+ * redistributed in the lower buckets. An element is moved at most 32 times,
+ * so the cost of the queue is close to the one of the VectorHierarchicalQueue.
+ *
+ * The elements with the same key are always in the same bucket, and a bucket
+ * is redistributed in order, so the values of a key are returned in the
+ * same order they have been pushed.
+ *
+ * The radix heap is a monotone priority queue: it is efficient when the
+ * pushed keys are never before the current key, as in the morphological
+ * watershed. A key before the current one is still supported, but requires
+ * a redistribution of all the elements of the queue.
+ */
+template <typename TKey, typename TValue, typename TCompare >
+class RadixHierarchicalQueue
+{
+
+public:
+
+  /** Standard typedefs */
+  typedef RadixHierarchicalQueue      Self;
+
+  typedef TValue ValueType;
+  typedef TKey KeyType;
+  typedef TCompare CompareType;
+
+  typedef unsigned int RadixType;
+  typedef RadixHierarchicalQueueKeyTraits< KeyType > KeyTraitsType;
+
+  /** the elements are stored with their converted key, to be able to
+   * redistribute them */
+  struct ElementType
+    {
+    RadixType m_Radix;
+    ValueType m_Value;
+    };
+
+  typedef HierarchicalQueueFifo<ElementType>      ValueListType;
+  typedef typename ValueListType::PoolType        PoolType;
+  typedef std::vector<ElementType>                BufferType;
+
+  // for code conciseness
+  typedef NumericTraits< TKey > NT;
+
+  /** return the current key */
+  inline const KeyType & FrontKey() const
+    {
+    assert(!this->Empty());
+    this->Refill();
+    return m_CurrentValue;
+    }
+
+  /** return the current value */
+  inline const ValueType & FrontValue() const
+    {
+    assert(!this->Empty());
+    this->Refill();
+    return m_Buckets[0].Front().m_Value;
+    }
+
+  /** push a value in the queue */
+  inline void Push( const KeyType & k, const ValueType & v)
+    {
+    ElementType e;
+    e.m_Radix = this->ToRadix( k );
+    e.m_Value = v;
+    if( e.m_Radix < m_Last )
+      {
+      this->Rebase( e.m_Radix );
+      }
+    m_Buckets[ this->BucketNumber( e.m_Radix ) ].Push( e, m_Pool );
+    m_Size++;
+    }
+
+  /** return the size of the queue */
+  inline const unsigned long & Size() const
+    {
+    return m_Size;
+    }
+
+  /** return true if the queue is empty */
+  inline const bool Empty() const
+    {
+    return m_Size == 0;
+    }
+
+  /** remove the first element of the queue */
+  inline void Pop()
+    {
+    assert(!this->Empty());
+    this->Refill();
+    m_Buckets[0].Pop( m_Pool );
+    m_Size--;
+    if( m_Size == 0 )
+      {
+      // the next keys can be anywhere
+      this->SetLast( 0 );
+      }
+    }
+
+  /** remove all the elements of the queue, but keep the memory
+   * for the next use of the queue */
+  void Clear()
+    {
+    if( m_Size == 0 )
+      {
+      return;
+      }
+    for( unsigned int b=0; b<NumberOfBuckets; b++ )
+      {
+      m_Buckets[b].Clear( m_Pool );
+      }
+    m_Size = 0;
+    this->SetLast( 0 );
+    }
+
+  /** remove all the elements of the queue, and free the memory kept for
+   * the next use of the queue */
+  void ReleaseMemory()
+    {
+    this->Clear();
+    m_Pool.ReleaseMemory();
+    BufferType().swap( m_Buffer );
+    }
+
+  RadixHierarchicalQueue()
+    {
+    m_Reverse = m_Compare( NT::max(), NT::NonpositiveMin() );
+    m_Size = 0;
+    this->SetLast( 0 );
+    }
+
+  ~RadixHierarchicalQueue()
+    {
+    this->Clear();
+    }
+
+protected:
+
+private:
+  RadixHierarchicalQueue(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  /** one bucket for the current key, and one per bit */
+  enum { NumberOfBuckets = 33 };
+
+  inline RadixType ToRadix( const KeyType & k ) const
+    {
+    RadixType r = KeyTraitsType::ToRadix( k );
+    if( m_Reverse )
+      {
+      return ~r;
+      }
+    return r;
+    }
+
+  inline void SetLast( RadixType r ) const
+    {
+    m_Last = r;
+    if( m_Reverse )
+      {
+      m_CurrentValue = KeyTraitsType::FromRadix( ~r );
+      }
+    else
+      {
+      m_CurrentValue = KeyTraitsType::FromRadix( r );
+      }
+    }
+
+  /** the number of the highest bit which differs from the current key */
+  inline unsigned int BucketNumber( RadixType r ) const
+    {
+    RadixType diff = r ^ m_Last;
+    if( diff == 0 )
+      {
+      return 0;
+      }
+#if defined(__GNUC__)
+    return 32 - __builtin_clz( diff );
+#else
+    unsigned int b = 0;
+    while( diff != 0 )
+      {
+      diff >>= 1;
+      b++;
+      }
+    return b;
+#endif
+    }
+
+  /** make sure that the first bucket contains the smallest key */
+  inline void Refill() const
+    {
+    if( !m_Buckets[0].Empty() )
+      {
+      return;
+      }
+    unsigned int b = 1;
+    while( m_Buckets[b].Empty() )
+      {
+      b++;
+      }
+    // the elements of the bucket are moved in the buffer, in order, and
+    // the smallest key becomes the current one
+    m_Buffer.clear();
+    RadixType last = ~static_cast<RadixType>( 0 );
+    while( !m_Buckets[b].Empty() )
+      {
+      const ElementType & e = m_Buckets[b].Front();
+      if( e.m_Radix < last )
+        {
+        last = e.m_Radix;
+        }
+      m_Buffer.push_back( e );
+      m_Buckets[b].Pop( m_Pool );
+      }
+    this->Redistribute( last );
+    }
+
+  /** used when a key is pushed before the current key: all the buckets
+   * must be redistributed */
+  void Rebase( RadixType r )
+    {
+    m_Buffer.clear();
+    for( unsigned int b=0; b<NumberOfBuckets; b++ )
+      {
+      while( !m_Buckets[b].Empty() )
+        {
+        m_Buffer.push_back( m_Buckets[b].Front() );
+        m_Buckets[b].Pop( m_Pool );
+        }
+      }
+    this->Redistribute( r );
+    }
+
+  /** push back the elements of the buffer in their new buckets */
+  inline void Redistribute( RadixType last ) const
+    {
+    this->SetLast( last );
+    for( typename BufferType::const_iterator it=m_Buffer.begin(); it!=m_Buffer.end(); it++ )
+      {
+      m_Buckets[ this->BucketNumber( it->m_Radix ) ].Push( *it, m_Pool );
+      }
+    }
+
+  // the buckets are updated when the front element is needed, even in the
+  // const methods
+  mutable PoolType m_Pool;
+  mutable ValueListType m_Buckets[NumberOfBuckets];
+  mutable BufferType m_Buffer;
+  mutable RadixType m_Last;
+  mutable KeyType m_CurrentValue;
+  unsigned long m_Size;
+  TCompare m_Compare;
+  bool m_Reverse;
+
+};
+
+
 template <typename TValue, typename TCompare >
 class HierarchicalQueue<unsigned char, TValue, TCompare>
 : public VectorHierarchicalQueue<unsigned char, TValue, TCompare>
@@ -256,6 +851,24 @@ class HierarchicalQueue<bool, TValue, TCompare>
 {
 };
 
+template <typename TValue, typename TCompare >
+class HierarchicalQueue<int, TValue, TCompare>
+: public RadixHierarchicalQueue<int, TValue, TCompare>
+{
+};
+
+template <typename TValue, typename TCompare >
+class HierarchicalQueue<unsigned int, TValue, TCompare>
+: public RadixHierarchicalQueue<unsigned int, TValue, TCompare>
+{
+};
+
+template <typename TValue, typename TCompare >
+class HierarchicalQueue<float, TValue, TCompare>
+: public RadixHierarchicalQueue<float, TValue, TCompare>
+{
+};
+
 
 } // end namespace itk
 
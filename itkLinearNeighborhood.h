@@ -0,0 +1,367 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkLinearNeighborhood.h,v $
+  Language:  C++
+  Date:      $Date: 2007/01/15 10:42:17 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkLinearNeighborhood_h
+#define __itkLinearNeighborhood_h
+
+#include "itkSize.h"
+#include "itkOffset.h"
+#include <vector>
+
+namespace itk
+{
+
+/** \class LinearNeighborhood
+ *  \brief Neighbors of a pixel expressed as offsets in a raw image buffer
+ *
+ * Algorithms which are visiting the pixels in an unpredictable order, like
+ * the flooding of the morphological watershed, are spending most of their
+ * time in moving the neighborhood iterators to the next pixel. This class
+ * allow to work directly with the position of the pixels in the buffer: the
+ * neighbor i of the pixel at the linear offset p is at p + GetLinearOffset(i).
+ *
+ * Most of the pixels are not on the border of the buffer, and all their
+ * neighbors can be used without any check. IsOnBorder() tells if the pixel
+ * is on the border, and, in that case, IsInside() must be used to know
+ * which neighbors are really in the buffer.
+ *
+ * The neighbors are kept in the order they are given to Initialize(), so
+ * the neighbors of the Connectivity class are visited in the same order
+ * than with a ShapedNeighborhoodIterator.
+ *
+ * The buffer can also be padded with one pixel on each side. In that case,
+ * the offsets are the ones of a buffer of GetBufferSize(), with the first
+ * pixel of the image at GetFirstOffset(). The neighbors of all the pixels
+ * of the image are in the buffer, and IsOnBorder() always returns false.
+ * The pixels of the image can be visited in the raster order with Next().
+ */
+template < unsigned int VDimension >
+class LinearNeighborhood
+{
+
+public:
+
+  /** Standard typedefs */
+  typedef LinearNeighborhood      Self;
+
+  typedef Size< VDimension >      SizeType;
+  typedef Offset< VDimension >    OffsetType;
+  typedef typename OffsetType::OffsetValueType  OffsetValueType;
+
+  typedef std::vector< OffsetType >       OffsetContainerType;
+  typedef std::vector< OffsetValueType >  LinearOffsetContainerType;
+
+  /** compute the linear offsets of the neighbors in a buffer for an image
+   * of the given size, padded or not */
+  void Initialize( const SizeType & size, const OffsetContainerType & neighbors, bool padded=false )
+    {
+    m_Size = size;
+    m_Neighbors = neighbors;
+    m_Padded = padded;
+
+    for( unsigned int d=0; d<VDimension; d++ )
+      {
+      m_BufferSize[d] = m_Size[d] + ( padded ? 2 : 0 );
+      }
+
+    m_Strides[0] = 1;
+    for( unsigned int d=1; d<VDimension; d++ )
+      {
+      m_Strides[d] = m_Strides[d-1] * m_BufferSize[d-1];
+      }
+
+    m_FirstOffset = 0;
+    if( padded )
+      {
+      for( unsigned int d=0; d<VDimension; d++ )
+        {
+        m_FirstOffset += m_Strides[d];
+        }
+      }
+
+    m_LinearOffsets.resize( m_Neighbors.size() );
+    for( unsigned int i=0; i<m_Neighbors.size(); i++ )
+      {
+      m_LinearOffsets[i] = this->ComputeLinearOffset( m_Neighbors[i] );
+      }
+    }
+
+  /** return the number of neighbors */
+  inline unsigned int GetNumberOfNeighbors() const
+    {
+    return m_LinearOffsets.size();
+    }
+
+  /** return the offset of the neighbor i in the buffer */
+  inline const OffsetValueType & GetLinearOffset( unsigned int i ) const
+    {
+    return m_LinearOffsets[i];
+    }
+
+  /** return the offset of the neighbor i */
+  inline const OffsetType & GetOffset( unsigned int i ) const
+    {
+    return m_Neighbors[i];
+    }
+
+  /** return the size of the image */
+  inline const SizeType & GetSize() const
+    {
+    return m_Size;
+    }
+
+  /** return the size of the buffer, including the padding */
+  inline const SizeType & GetBufferSize() const
+    {
+    return m_BufferSize;
+    }
+
+  /** return the number of pixels in the buffer, including the padding */
+  inline OffsetValueType GetNumberOfBufferPixels() const
+    {
+    return m_Strides[VDimension-1] * m_BufferSize[VDimension-1];
+    }
+
+  /** return true if the buffer is padded */
+  inline bool GetPadded() const
+    {
+    return m_Padded;
+    }
+
+  /** return the offset in the buffer of the first pixel of the image */
+  inline OffsetValueType GetFirstOffset() const
+    {
+    return m_FirstOffset;
+    }
+
+  /** return the offset in the buffer of the pixel of the image which
+   * follows the pixel at the offset o in the raster order, and update its
+   * position in the image */
+  inline OffsetValueType Next( OffsetValueType o, OffsetType & position ) const
+    {
+    o++;
+    position[0]++;
+    for( unsigned int d=0; d<VDimension-1 && position[d] == (OffsetValueType)m_Size[d]; d++ )
+      {
+      position[d] = 0;
+      position[d+1]++;
+      // skip the padding
+      o += ( m_BufferSize[d] - m_Size[d] ) * m_Strides[d];
+      }
+    return o;
+    }
+
+  /** return the linear offset in the buffer of a position, relative to the
+   * first pixel of the buffer */
+  inline OffsetValueType ComputeLinearOffset( const OffsetType & position ) const
+    {
+    OffsetValueType o = 0;
+    for( unsigned int d=0; d<VDimension; d++ )
+      {
+      o += position[d] * m_Strides[d];
+      }
+    return o;
+    }
+
+  /** return the position, relative to the first pixel of the buffer, of
+   * a linear offset. When the buffer is padded, the position includes the
+   * padding. */
+  inline void ComputePosition( OffsetValueType o, OffsetType & position ) const
+    {
+    for( unsigned int d=VDimension-1; d>0; d-- )
+      {
+      position[d] = o / m_Strides[d];
+      o -= position[d] * m_Strides[d];
+      }
+    position[0] = o;
+    }
+
+  /** return true if some neighbors of the pixel may be outside the buffer.
+   * The position of the pixel is computed at the same time, to be used
+   * with IsInside() */
+  inline bool IsOnBorder( OffsetValueType o, OffsetType & position ) const
+    {
+    if( m_Padded )
+      {
+      return false;
+      }
+    this->ComputePosition( o, position );
+    return this->IsOnBorder( position );
+    }
+
+  /** return true if some neighbors of the pixel at the given position in
+   * the image may be outside the buffer */
+  inline bool IsOnBorder( const OffsetType & position ) const
+    {
+    if( m_Padded )
+      {
+      return false;
+      }
+    for( unsigned int d=0; d<VDimension; d++ )
+      {
+      if( position[d] == 0 || position[d] == (OffsetValueType)m_Size[d] - 1 )
+        {
+        return true;
+        }
+      }
+    return false;
+    }
+
+  /** return true if the neighbor i of the pixel at the given position is in
+   * the buffer */
+  inline bool IsInside( const OffsetType & position, unsigned int i ) const
+    {
+    const OffsetType & n = m_Neighbors[i];
+    for( unsigned int d=0; d<VDimension; d++ )
+      {
+      const OffsetValueType c = position[d] + n[d];
+      if( c < 0 || c >= (OffsetValueType)m_Size[d] )
+        {
+        return false;
+        }
+      }
+    return true;
+    }
+
+  /** return true if the pixel at the linear offset o is in the padding of
+   * the buffer */
+  inline bool IsInPadding( OffsetValueType o ) const
+    {
+    if( !m_Padded )
+      {
+      return false;
+      }
+    OffsetType position;
+    this->ComputePosition( o, position );
+    for( unsigned int d=0; d<VDimension; d++ )
+      {
+      if( position[d] == 0 || position[d] == (OffsetValueType)m_BufferSize[d] - 1 )
+        {
+        return true;
+        }
+      }
+    return false;
+    }
+
+  LinearNeighborhood()
+    {
+    m_Size.Fill( 0 );
+    m_BufferSize.Fill( 0 );
+    for( unsigned int d=0; d<VDimension; d++ )
+      {
+      m_Strides[d] = 0;
+      }
+    m_FirstOffset = 0;
+    m_Padded = false;
+    }
+
+protected:
+
+private:
+
+  SizeType m_Size;
+  SizeType m_BufferSize;
+  OffsetValueType m_Strides[VDimension];
+  OffsetValueType m_FirstOffset;
+  bool m_Padded;
+  OffsetContainerType m_Neighbors;
+  LinearOffsetContainerType m_LinearOffsets;
+
+};
+
+
+/** \class LinearNeighborhoodOffsets
+ *  \brief Linear offsets of a LinearNeighborhood with a number of neighbors
+ *  known at compile time
+ *
+ * The offsets are copied in an array of VNumberOfNeighbors elements, so
+ * the loops on the neighbors have a constant number of iterations and can
+ * be unrolled by the compiler, and the offsets don't have to be read
+ * again after each write in a buffer of pixels. The usual neighborhoods
+ * have 4 or 8 neighbors in 2D, and 6, 18 or 26 neighbors in 3D.
+ *
+ * With VNumberOfNeighbors set to 0, the offsets are the ones of the
+ * neighborhood, and their number is only known at run time.
+ */
+template < unsigned int VDimension, unsigned int VNumberOfNeighbors >
+class LinearNeighborhoodOffsets
+{
+
+public:
+
+  typedef LinearNeighborhood< VDimension >  LinearNeighborhoodType;
+  typedef typename LinearNeighborhoodType::OffsetValueType OffsetValueType;
+
+  /** the neighborhood must have VNumberOfNeighbors neighbors */
+  LinearNeighborhoodOffsets( const LinearNeighborhoodType & neighborhood )
+    {
+    for( unsigned int i=0; i<VNumberOfNeighbors; i++ )
+      {
+      m_Offsets[i] = neighborhood.GetLinearOffset( i );
+      }
+    }
+
+  /** return the number of neighbors */
+  inline unsigned int GetNumberOfNeighbors() const
+    {
+    return VNumberOfNeighbors;
+    }
+
+  /** return the offset of the neighbor i in the buffer */
+  inline const OffsetValueType & operator[]( unsigned int i ) const
+    {
+    return m_Offsets[i];
+    }
+
+private:
+
+  OffsetValueType m_Offsets[VNumberOfNeighbors];
+
+};
+
+template < unsigned int VDimension >
+class LinearNeighborhoodOffsets< VDimension, 0 >
+{
+
+public:
+
+  typedef LinearNeighborhood< VDimension >  LinearNeighborhoodType;
+  typedef typename LinearNeighborhoodType::OffsetValueType OffsetValueType;
+
+  LinearNeighborhoodOffsets( const LinearNeighborhoodType & neighborhood )
+    : m_Neighborhood( neighborhood )
+    {
+    }
+
+  inline unsigned int GetNumberOfNeighbors() const
+    {
+    return m_Neighborhood.GetNumberOfNeighbors();
+    }
+
+  inline const OffsetValueType & operator[]( unsigned int i ) const
+    {
+    return m_Neighborhood.GetLinearOffset( i );
+    }
+
+private:
+
+  const LinearNeighborhoodType & m_Neighborhood;
+
+};
+
+} // end namespace itk
+
+#endif
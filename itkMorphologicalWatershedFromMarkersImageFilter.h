@@ -3,6 +3,15 @@
 
 #include "itkImageToImageFilter.h"
 #include "itkConnectivity.h"
+#include "itkHierarchicalQueue.h"
+#include "itkLinearNeighborhood.h"
+#include "itkMultiThreader.h"
+#include "itkProgressReporter.h"
+#include "itkLabelMap.h"
+#include "itkLabelObject.h"
+#include <vector>
+#include <utility>
+#include <map>
 
 namespace itk {
 
@@ -17,6 +26,42 @@ namespace itk {
  * have a different value).
  * Labels of output image are the label of the marker image.
  *
+ * The flooding can use several threads - see SetNumberOfThreads(). The
+ * pixels with the same priority are extracted all together from the
+ * hierarchical queue, and, if there are at least MinimumParallelBatchSize
+ * of them, their neighborhoods are scanned in parallel. The labels and
+ * the new pixels in the queue are then set in the order of the queue, so
+ * the output is exactly the same than with a single thread. The images
+ * with a lot of different values, like the float images, don't have
+ * large enough batches to benefit from the threads.
+ * That sequential part takes about two thirds of the time of the flooding
+ * of a large batch, so the threads can't make the flooding much more than
+ * 1.5 times faster, and they make it slower when there are only a few of
+ * them: they are used only when there are at least
+ * MinimumParallelNumberOfThreads of them. wsmthreads measures the time
+ * of the flooding with 1 to 32 threads.
+ * The threads are not used by the compact and geodesic floodings - see
+ * Compactness, GeodesicPlateaus and UseImageSpacing.
+ *
+ * The region adjacency graph of the basins can be collected during the
+ * flooding - see ComputeAdjacencyGraph.
+ *
+ * When the markers are edited between two updates, only the basins changed
+ * by the edit can be flooded again - see IncrementalFlooding.
+ *
+ * The compact watershed adds the distance to the marker to the level of
+ * the pixels, which gives more regular basins - see Compactness.
+ *
+ * The lines can be put at the middle of the plateaus, by flooding their
+ * pixels in the order of their distance to the lower border of the
+ * plateau - see GeodesicPlateaus.
+ *
+ * The basins can also be produced as a LabelMap, built while the labels
+ * are written in the output - see ComputeLabelMap.
+ *
+ * The markers can be given as a LabelMap instead of an image - see
+ * SetMarkerLabelMap().
+ *
  * The morphological watershed transform algorithm is described in
  * Chapter 9.2 of Pierre Soille's book "Morphological Image Analysis:
  * Principles and Applications", Second Edition, Springer, 2003.
@@ -51,12 +96,21 @@ public:
   typedef typename LabelImageType::PixelType      LabelImagePixelType;
   
   typedef typename LabelImageType::IndexType      IndexType;
+  typedef typename LabelImageType::OffsetType     OffsetType;
+
+  /** Type used to store the position of a pixel in the buffers */
+  typedef typename OffsetType::OffsetValueType    OffsetValueType;
 
   /** ImageDimension constants */
   itkStaticConstMacro(ImageDimension, unsigned int,
                       TInputImage::ImageDimension);
 
   typedef Connectivity< ImageDimension > ConnectivityType;
+
+  /** the label map which can be produced with the output, or used as
+   * markers */
+  typedef LabelObject< LabelImagePixelType, ImageDimension > LabelObjectType;
+  typedef LabelMap< LabelObjectType >                        LabelMapType;
   
   /** Standard New method. */
   itkNewMacro(Self);  
@@ -73,10 +127,79 @@ public:
      this->SetNthInput( 1, const_cast<TLabelImage *>(input) );
      }
 
-  /** Get the marker image */
+  /** Get the marker image. Return NULL when the markers are given as a
+   * label map. */
   LabelImageType * GetMarkerImage()
     {
-    return static_cast<LabelImageType*>(const_cast<DataObject *>(this->ProcessObject::GetInput(1)));
+    return dynamic_cast<LabelImageType*>(const_cast<DataObject *>(this->ProcessObject::GetInput(1)));
+    }
+
+  /**
+   * Set the markers as a LabelMap, in place of the marker image - for
+   * example the output of BinaryImageToLabelMapFilter. The labels of the
+   * label objects are the labels of the markers, and the background value
+   * of the label map is not used. The flooding without the image spacing,
+   * compactness or geodesic plateaus is initialized directly from the lines of the
+   * label objects: the marker labels are written in the buffer of the
+   * labels, and only the marker pixels are visited to fill the queue, so
+   * no marker image is needed and the time of the initialization depends
+   * on the size of the markers rather than on the size of the image. The
+   * lines are visited in the raster order, so the output is the same than
+   * with the equivalent marker image. The other floodings write the
+   * markers in the output image and use it as marker image. The
+   * incremental flooding is not available with a marker label map.
+   */
+  void SetMarkerLabelMap(LabelMapType *input)
+     {
+     this->SetNthInput( 1, input );
+     }
+
+  /** Get the marker label map. Return NULL when the markers are given as
+   * an image. */
+  LabelMapType * GetMarkerLabelMap()
+    {
+    return dynamic_cast<LabelMapType*>(const_cast<DataObject *>(this->ProcessObject::GetInput(1)));
+    }
+
+  /**
+   * Set the mask image. The flooding is restricted to the pixels of the
+   * mask different from zero: the other pixels are never flooded, and
+   * are set to BackgroundValue in the output, like the watershed pixels.
+   * The buffers used by the flooding are allocated on the bounding box of
+   * the mask, and only the lines of the mask are copied, initialized and
+   * written back in the output, so, except for the allocation of the
+   * output, the time and the memory depend on the size of the mask rather
+   * than on the size of the image. The marker pixels outside the mask are
+   * ignored. The mask disables the incremental flooding. The mask is
+   * optional.
+   */
+  void SetMaskImage(LabelImageType *input)
+     {
+     this->SetNthInput( 2, input );
+     }
+
+  /** Get the mask image. Return NULL when there is no mask, or when the
+   * mask is given as a label map. */
+  LabelImageType * GetMaskImage()
+    {
+    return dynamic_cast<LabelImageType*>(const_cast<DataObject *>(this->ProcessObject::GetInput(2)));
+    }
+
+  /**
+   * Set the mask as a LabelMap, in place of the mask image. The pixels of
+   * all the label objects are in the mask, so the mask is read from the
+   * lines of the label objects without scanning an image.
+   */
+  void SetMaskLabelMap(LabelMapType *input)
+     {
+     this->SetNthInput( 2, input );
+     }
+
+  /** Get the mask label map. Return NULL when there is no mask, or when the
+   * mask is given as an image. */
+  LabelMapType * GetMaskLabelMap()
+    {
+    return dynamic_cast<LabelMapType*>(const_cast<DataObject *>(this->ProcessObject::GetInput(2)));
     }
 
    /** Set the input image */
@@ -132,10 +255,200 @@ public:
   itkGetConstReferenceMacro(MarkWatershedLine, bool);
   itkBooleanMacro(MarkWatershedLine);
 
+  /**
+   * Set/Get whether the spacing of the input image is used. In that case,
+   * the plateaus are flooded as with GeodesicPlateaus, with the physical
+   * length of the paths, so the watershed lines are at the middle of the
+   * plateaus even with an anisotropic spacing. With Compactness, the
+   * spacing is used in the distance to the markers. Default is false.
+   */
   itkSetMacro(UseImageSpacing, bool);
   itkGetConstReferenceMacro(UseImageSpacing, bool);
   itkBooleanMacro(UseImageSpacing);
 
+  /**
+   * Set/Get whether the flooding is done in buffers padded with one pixel
+   * on each side. The neighbors of the pixels can then be used without
+   * checking the image border, which makes the flooding faster, but the
+   * input and the labels are copied in the padded buffers. Default is
+   * true. The compact and geodesic floodings are always done in padded
+   * buffers.
+   * The padded copies cost one input image and one label image more than
+   * the flooding in the output buffer, and are kept in the workspace until
+   * ReleaseWorkspace() is called or the filter is destroyed: turn it off
+   * when the peak memory matters more than the speed.
+   */
+  itkSetMacro(PadImageBoundary, bool);
+  itkGetConstReferenceMacro(PadImageBoundary, bool);
+  itkBooleanMacro(PadImageBoundary);
+
+  /**
+   * Set/Get the minimum number of pixels with the same priority needed to
+   * scan their neighborhood with several threads. The smaller batches are
+   * processed by a single thread, because starting the threads would cost
+   * more than what they can save. Default is 16384.
+   */
+  itkSetMacro(MinimumParallelBatchSize, unsigned long);
+  itkGetConstReferenceMacro(MinimumParallelBatchSize, unsigned long);
+
+  /**
+   * Set/Get the minimum number of threads needed to scan the batches with
+   * several threads. With fewer threads, the time saved on the scan doesn't
+   * pay for the storage of its results, and the flooding is done by a
+   * single thread. Default is 8.
+   */
+  itkSetMacro(MinimumParallelNumberOfThreads, int);
+  itkGetConstReferenceMacro(MinimumParallelNumberOfThreads, int);
+
+  /**
+   * Free the memory of the workspace. The buffers used by the flooding -
+   * the padded images, the status of the pixels, the batches, the lines of
+   * the markers and of the mask, and the chunks of the hierarchical queues
+   * - are kept between the runs of the filter, so a filter run many times
+   * on images of the same size doesn't allocate them again. This method can
+   * be used to give that memory back when the filter is not used anymore
+   * for a while.
+   */
+  void ReleaseWorkspace();
+
+  /** an edge of the region adjacency graph */
+  struct AdjacencyType
+    {
+    // the number of contacts between the two basins
+    unsigned long ContactSize;
+    // the lowest level at which the two basins meet
+    InputImagePixelType Pass;
+    };
+
+  /** the region adjacency graph: the edges, indexed by the pair of labels
+   * of the basins, the smallest label first */
+  typedef std::pair< LabelImagePixelType, LabelImagePixelType > LabelPairType;
+  typedef std::map< LabelPairType, AdjacencyType > AdjacencyGraphType;
+
+  /**
+   * Set/Get whether the region adjacency graph of the basins is collected
+   * during the flooding. The basins are neighbors when they meet during
+   * the flooding, and the pass is the lowest level of the flooding at
+   * which they meet, so no other scan of the image is needed. Without
+   * watershed line, the contacts are the pairs of neighbor pixels on the
+   * border of the two basins, and they meet at the highest flooding level
+   * of the two pixels. With the watershed line, the contacts are the
+   * watershed pixels which have both basins in their neighborhood, and the
+   * basins meet there when the second one reaches the watershed pixel. In
+   * both cases, the pairs of neighbor pixels of two different markers are
+   * also contacts, at the highest value of the two pixels. The batches of
+   * pixels are not scanned with several threads when the graph is
+   * collected without watershed line. The graph can't be collected by the
+   * compact and geodesic floodings - with a compactness, the geodesic
+   * plateaus or the image spacing - and the filter throws an exception in
+   * that case. Default is false.
+   */
+  itkSetMacro(ComputeAdjacencyGraph, bool);
+  itkGetConstReferenceMacro(ComputeAdjacencyGraph, bool);
+  itkBooleanMacro(ComputeAdjacencyGraph);
+
+  /** Get the region adjacency graph computed by the last update */
+  const AdjacencyGraphType & GetAdjacencyGraph() const
+    {
+    return m_AdjacencyGraph;
+    }
+
+  /**
+   * Set/Get whether the filter keeps, in its workspace, what is needed to
+   * flood again only a part of the image when only the markers have
+   * changed since the last update: the labels, the level at which each
+   * pixel has been flooded, the pixel which has labeled it, and a copy of
+   * the markers. On the next update, the markers are compared with the
+   * previous ones, and only the connected parts of the basins which
+   * contain an edited marker pixel and their neighbors are flooded again.
+   * The pixels around that region are then checked: the order in which a
+   * full flooding takes the pixels from the queue is found from their
+   * levels and their parents, and when a pixel on one side of the border
+   * would have been labeled by its neighbor on the other side, the region
+   * is grown with the basin on the other side, and flooded again. The
+   * workspace uses about 10 more bytes per pixel. The output is
+   * always the one of a full flooding; the whole image is flooded again
+   * when the region gets too large, or when the input, the connectivity or
+   * the size of the image have changed. Only the pixels of the region are
+   * copied from the workspace to the output, unless the output buffer has
+   * been reallocated since the last update, or ComputeLabelMap is on, and
+   * the flooding is always done in padded buffers.
+   * Only used without watershed line, and without the adjacency graph.
+   * Default is false.
+   */
+  itkSetMacro(IncrementalFlooding, bool);
+  itkGetConstReferenceMacro(IncrementalFlooding, bool);
+  itkBooleanMacro(IncrementalFlooding);
+
+  /**
+   * Set/Get the region of the marker image which may have been edited since
+   * the last update. Only that region is compared with the previous
+   * markers with IncrementalFlooding. The region is reset after each update,
+   * and when it is empty, the whole marker image is compared.
+   */
+  itkSetMacro(MarkerEditRegion, LabelImageRegionType);
+  itkGetConstReferenceMacro(MarkerEditRegion, LabelImageRegionType);
+
+  /** Get the number of pixels flooded by the last update. It is lower than
+   * the number of pixels of the image when the flooding was incremental. */
+  itkGetConstMacro(NumberOfFloodedPixels, unsigned long);
+
+  /**
+   * Set/Get the compactness of the basins. When it is greater than 0, the
+   * pixels are flooded in the order of their level plus the compactness
+   * times their distance to the marker pixel the flooding comes from, as
+   * in the compact watershed of Neubert and Protzel. The basins are then
+   * more regular, like superpixels, and tend to stop at the middle between
+   * the markers in the flat areas. The distance is the euclidean distance
+   * to the marker pixel, with the spacing of the image when UseImageSpacing
+   * is on. The priority is kept on 32 bits floating point values in a radix
+   * hierarchical queue, so the cost stays close to the one of the regular
+   * flooding, but the threads, the adjacency graph and the incremental
+   * flooding are not available. A compactness of 0 is the regular
+   * watershed. Default is 0.
+   */
+  itkSetMacro(Compactness, double);
+  itkGetConstReferenceMacro(Compactness, double);
+
+  /**
+   * Set/Get whether the pixels of a plateau are flooded in the order of
+   * their distance to the lower border of the plateau. By default, the
+   * pixels with the same level are flooded in the order they have been
+   * put in the queue, which is the number of steps from the lower border:
+   * the points at the same number of steps from two markers can be a large
+   * area, given to the marker which has been put in the queue first, so
+   * the lines are biased on the large flat zones. When it is on, the pixels
+   * of a plateau are ordered by their geodesic distance to the lower border
+   * of the plateau, computed along the shortest paths inside the plateau,
+   * so the lines are at the middle of the plateaus, even when they are not
+   * convex, and with all the connectivities. The paths are made of straight
+   * segments around the corners of the plateau, and their length uses the
+   * spacing of the image when UseImageSpacing is on. The pixels
+   * of the current level are in a radix queue ordered by distance, and a
+   * pixel is labeled with the basin of the first of its neighbors to reach
+   * it. Not used when Compactness is greater than 0. Default is false.
+   */
+  itkSetMacro(GeodesicPlateaus, bool);
+  itkGetConstReferenceMacro(GeodesicPlateaus, bool);
+  itkBooleanMacro(GeodesicPlateaus);
+
+  /**
+   * Set/Get whether the basins are also produced as a LabelMap. The lines
+   * of the basins are added to the label map while the labels are copied
+   * from the padded buffers to the output, or with a single scan of the
+   * output when the flooding is done in the output, so the output doesn't
+   * need to be converted with LabelImageToLabelMapFilter. The background of
+   * the label map is BackgroundValue, so the watershed pixels are not in
+   * the label map. Default is false.
+   */
+  itkSetMacro(ComputeLabelMap, bool);
+  itkGetConstReferenceMacro(ComputeLabelMap, bool);
+  itkBooleanMacro(ComputeLabelMap);
+
+  /** Get the label map produced by the last update when ComputeLabelMap
+   * is on. A new label map is created by each update. */
+  itkGetObjectMacro(LabelMap, LabelMapType);
+
   /**
    * Get/Set the connectivity to be use by the watershed filter.
    */
@@ -185,10 +498,252 @@ private:
   bool m_PadImageBoundary;
   bool m_UseImageSpacing;
   LabelImagePixelType m_BackgroundValue;
+  unsigned long m_MinimumParallelBatchSize;
+  int m_MinimumParallelNumberOfThreads;
+  bool m_ComputeAdjacencyGraph;
+  AdjacencyGraphType m_AdjacencyGraph;
+  bool m_IncrementalFlooding;
+  LabelImageRegionType m_MarkerEditRegion;
+  unsigned long m_NumberOfFloodedPixels;
+  double m_Compactness;
+  bool m_GeodesicPlateaus;
+  bool m_ComputeLabelMap;
+  typename LabelMapType::Pointer m_LabelMap;
+
+  // the marker image used by the flooding during the update: the marker
+  // input, the output when a marker label map has been written in it, or
+  // NULL when the flooding reads the marker label map
+  LabelImagePointer m_MarkerImage;
+
+  // the region flooded during the update: the bounding box of the mask,
+  // or the whole image
+  LabelImageRegionType m_FloodRegion;
+
+  typedef LinearNeighborhood< ImageDimension > LinearNeighborhoodType;
+
+  // with the compactness, the queue stores the pixels with the marker
+  // pixel the flooding comes from, and their priority is the level of the
+  // pixel plus the weighted distance to that marker pixel
+  typedef std::pair< OffsetValueType, OffsetValueType > CompactElementType;
+  typedef HierarchicalQueue< float, CompactElementType > CompactHierarchicalQueueType;
+
+  // with the geodesic plateaus, the queue stores the pixels with the
+  // source of the last segment of their shortest path in the plateau, their
+  // geodesic distance and the label propagated. The pixels are ordered by
+  // level, and then by distance for the current level.
+  struct PlateauElementType
+    {
+    OffsetValueType Pixel;
+    OffsetValueType Source;
+    float Distance;
+    LabelImagePixelType Label;
+    };
+  typedef HierarchicalQueue< InputImagePixelType, PlateauElementType > PlateauLevelQueueType;
+  typedef HierarchicalQueue< float, PlateauElementType > PlateauDistanceQueueType;
+
+  // the status of the pixels in Meyer's algorithm: true when the pixel has
+  // already been put in the queue. A packed bitmap is used to keep it small
+  // and cache friendly.
+  typedef std::vector< bool > StatusType;
+
+  // FAH (in french: File d'Attente Hierarchique)
+  // it stores the linear offsets of the pixels in the buffers, and is kept
+  // between the runs of the filter to reuse its memory
+  typedef HierarchicalQueue< InputImagePixelType, OffsetValueType > HierarchicalQueueType;
+  HierarchicalQueueType m_HierarchicalQueue;
+
+  // the result of the scan of the neighbors of a part of a batch of pixels
+  // with the same priority, for a thread
+  struct BatchScanResult
+    {
+    // the neighbors to be checked again when the batch is applied
+    std::vector< OffsetValueType > Neighbors;
+    // the number of neighbors stored for each pixel. With the watershed line,
+    // there are two numbers: the unlabeled neighbors already in the queue,
+    // which may get a label from a previous pixel of the batch, and the
+    // neighbors not yet in the queue.
+    std::vector< unsigned int > NumberOfNeighbors;
+    // with the watershed line only: the label found in the neighborhood,
+    // and whether several labels were found
+    std::vector< LabelImagePixelType > Markers;
+    std::vector< char > Collisions;
+    };
+
+  // the data shared by the threads which are scanning a batch
+  struct BatchScanStruct
+    {
+    const std::vector< OffsetValueType > * Batch;
+    std::vector< BatchScanResult > * Results;
+    const LinearNeighborhoodType * Neighborhood;
+    const LabelImagePixelType * OutputBuffer;
+    const StatusType * Status;
+    LabelImagePixelType WatershedLabel;
+    bool MarkWatershedLine;
+    };
+
+  // a line of pixels of a marker given as a label map, or of the mask
+  struct LineType
+    {
+    // the offset of the first pixel in the image, used to sort the lines
+    // in the raster order, and its position in the flooded region
+    OffsetValueType Offset;
+    OffsetType Position;
+    OffsetValueType Length;
+    LabelImagePixelType Label;
+    bool operator<( const LineType & line ) const
+      {
+      return Offset < line.Offset;
+      }
+    };
+  typedef std::vector< LineType > LineContainerType;
 
-  typedef Image< float, ImageDimension > DistanceImageType;
-  typedef std::vector<typename DistanceImageType::PixelType> WeightType;
-  typedef typename DistanceImageType::PixelType DistancePixelType;
+  // the buffers used by the flooding, kept between the runs of the filter
+  // and only reallocated when the size of the image grows
+  struct Workspace
+    {
+    std::vector< InputImagePixelType > PaddedInput;
+    std::vector< LabelImagePixelType > PaddedLabels;
+    StatusType Status;
+    std::vector< OffsetValueType > Batch;
+    std::vector< BatchScanResult > Results;
+    CompactHierarchicalQueueType CompactQueue;
+    PlateauLevelQueueType PlateauLevelQueue;
+    PlateauDistanceQueueType PlateauDistanceQueue;
+    // the geodesic distance of the pixels of the current plateau, and the
+    // source of the last segment of their shortest path
+    std::vector< float > PlateauDistances;
+    std::vector< OffsetValueType > PlateauSources;
+    // the labels found in the neighborhood of a watershed pixel, and the
+    // watershed pixels already found
+    std::vector< LabelImagePixelType > CollisionLabels;
+    StatusType Collisions;
+    // the lines of the marker label map
+    LineContainerType MarkerLines;
+    // the lines of the mask, or a single line for the whole image when
+    // there is no mask
+    LineContainerType MaskLines;
+    // with the incremental flooding: the level at which each pixel has been
+    // taken from the queue, whether it has been taken from the queue, the
+    // pixel which has labeled it - a marker is its own parent - the
+    // pixels in the region flooded again, and the previous markers. The
+    // labels are the padded ones.
+    std::vector< InputImagePixelType > Levels;
+    StatusType Extracted;
+    std::vector< OffsetValueType > Parents;
+    StatusType InRegion;
+    std::vector< OffsetValueType > IncrementalRegion;
+    std::vector< LabelImagePixelType > Markers;
+    // the output buffer which holds the labels of the previous flooding
+    const LabelImagePixelType * OutputBuffer;
+    // what the previous flooding has been done with. The incremental
+    // flooding can only be used when they have not changed.
+    bool IncrementalValid;
+    unsigned long InputMTime;
+    InputImageRegionType InputRegion;
+    int CellDimension;
+    unsigned int NumberOfNeighbors;
+    LabelImagePixelType BackgroundValue;
+    };
+  Workspace m_Workspace;
+
+  // the usual flooding, done in the buffers. With
+  // VNumberOfNeighbors not 0, the number of neighbors is known at compile
+  // time.
+  template < unsigned int VNumberOfNeighbors >
+  void LinearFlood( const LabelImageRegionType & editRegion, ProgressReporter & progress,
+                    LabelImagePixelType bgLabel, LabelImagePixelType wsLabel );
+
+  // call the LinearFlood() compiled for the neighborhoods of the dimension
+  // of the image: 4 and 8 neighbors in 2D, 6, 18 and 26 in 3D, and the
+  // generic one otherwise. The overloads are selected at compile time, so
+  // the other neighborhoods are not instantiated.
+  void DispatchLinearFlood( const LabelImageRegionType & editRegion, ProgressReporter & progress,
+                            LabelImagePixelType bgLabel, LabelImagePixelType wsLabel,
+                            const ImageToImageFilterDetail::UnsignedIntDispatch< 2 > & );
+  void DispatchLinearFlood( const LabelImageRegionType & editRegion, ProgressReporter & progress,
+                            LabelImagePixelType bgLabel, LabelImagePixelType wsLabel,
+                            const ImageToImageFilterDetail::UnsignedIntDispatch< 3 > & );
+  void DispatchLinearFlood( const LabelImageRegionType & editRegion, ProgressReporter & progress,
+                            LabelImagePixelType bgLabel, LabelImagePixelType wsLabel,
+                            const ImageToImageFilterDetail::DispatchBase & );
+
+  // the compact watershed, with or without watershed line
+  void CompactFlood( ProgressReporter & progress,
+                     LabelImagePixelType bgLabel, LabelImagePixelType wsLabel );
+
+  // the flooding with the geodesic distance on the plateaus, with or
+  // without watershed line
+  void PlateauFlood( ProgressReporter & progress,
+                     LabelImagePixelType bgLabel, LabelImagePixelType wsLabel );
+
+  // collect the lines of a label map, in the raster order
+  void ComputeLines( const LabelMapType * labelMap, LineContainerType & lines );
+
+  // collect the lines of the mask and its bounding box in m_FloodRegion,
+  // and return the number of pixels in the mask
+  unsigned long ComputeMaskLines();
+
+  // keep only the parts of the marker lines which are in the mask
+  void ClipMarkerLines();
+
+  // write the marker label map in the output, and use the output as the
+  // marker image
+  void RasterizeMarkerLabelMap( LabelImagePixelType bgLabel );
+
+  // copy the labels of a buffer, padded or not, to the output, if it is
+  // not the buffer of the output, and add their lines to the label map
+  // when ComputeLabelMap is on
+  void WriteLabels( const LabelImagePixelType * buffer,
+                    const LinearNeighborhoodType & neighborhood,
+                    LabelImagePixelType wsLabel );
+
+  // scan the neighbors of the part of the batch associated to a thread,
+  // without modifying the images
+  static ITK_THREAD_RETURN_TYPE BatchScanThreaderCallback( void * arg );
+
+  // flood again the part of the image changed by an edit of the markers,
+  // without watershed line, in the IncrementalRegion of the workspace.
+  // Return false when the whole image must be flooded again.
+  bool IncrementalFlood( const LinearNeighborhoodType & neighborhood,
+                         const LabelImageRegionType & editRegion,
+                         LabelImagePixelType bgLabel, LabelImagePixelType wsLabel );
+
+  // return true if the pixel a has been taken from the queue before the
+  // pixel b by the flooding without watershed line, from the levels and
+  // the parents kept for the incremental flooding
+  bool IsExtractedBefore( OffsetValueType a, OffsetValueType b,
+                          const LinearNeighborhoodType & neighborhood ) const;
+
+  // the index of the neighbor q of p
+  unsigned int GetNeighborIndex( OffsetValueType p, OffsetValueType q,
+                                 const LinearNeighborhoodType & neighborhood ) const;
+
+  // copy the labels of the region flooded again by the incremental
+  // flooding to the output
+  void WriteIncrementalLabels( const LinearNeighborhoodType & neighborhood );
+
+  // add the connected part of a basin to the region flooded again by the
+  // incremental flooding
+  void AddToIncrementalRegion( OffsetValueType p, const LinearNeighborhoodType & neighborhood,
+                               std::vector< OffsetValueType > & region );
+
+  // add some contacts between two basins to the adjacency graph
+  void AddContact( LabelImagePixelType label1, LabelImagePixelType label2,
+                   const InputImagePixelType & pass, unsigned long contacts );
+
+  // add the contacts between all the basins in the neighborhood of a
+  // watershed pixel to the adjacency graph
+  void AddCollision( OffsetValueType p, const InputImagePixelType & level,
+                     const LinearNeighborhoodType & neighborhood,
+                     const LabelImagePixelType * outputBuffer,
+                     LabelImagePixelType wsLabel );
+
+  // add the contacts between the basin of a newly labeled pixel and the
+  // basins around the watershed pixels it reaches
+  void AddLineContacts( OffsetValueType p, const InputImagePixelType & level,
+                        const LinearNeighborhoodType & neighborhood,
+                        const LabelImagePixelType * outputBuffer,
+                        LabelImagePixelType wsLabel );
 
 } ; // end of class
 
@@ -21,12 +21,8 @@
 #include "itkProgressReporter.h"
 #include "itkImageRegionIterator.h"
 #include "itkImageRegionConstIteratorWithIndex.h"
-#include "itkShapedNeighborhoodIterator.h"
-#include "itkConstShapedNeighborhoodIterator.h"
-#include "itkConstantBoundaryCondition.h"
 #include "itkSize.h"
-#include "itkHierarchicalQueue.h"
-#include "itkImageDuplicator.h"
+#include <algorithm>
 
 namespace itk {
 
@@ -39,6 +35,17 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
   m_MarkWatershedLine = true;
   m_UseImageSpacing = false;
   m_BackgroundValue = NumericTraits< LabelImagePixelType >::Zero;
+  m_PadImageBoundary = true;
+  m_MinimumParallelBatchSize = 16384;
+  m_MinimumParallelNumberOfThreads = 8;
+  m_ComputeAdjacencyGraph = false;
+  m_IncrementalFlooding = false;
+  m_NumberOfFloodedPixels = 0;
+  m_Compactness = 0;
+  m_GeodesicPlateaus = false;
+  m_ComputeLabelMap = false;
+  m_Workspace.IncrementalValid = false;
+  m_Workspace.OutputBuffer = NULL;
 }
 
 
@@ -50,8 +57,11 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
   // call the superclass' implementation of this method
   Superclass::GenerateInputRequestedRegion();
   
-  // get pointers to the inputs
-  LabelImagePointer  markerPtr = this->GetMarkerImage();
+  // get pointers to the inputs - the markers may be an image or a label
+  // map
+  typedef ImageBase< ImageDimension > ImageBaseType;
+  ImageBaseType * markerPtr =
+    dynamic_cast< ImageBaseType * >( this->ProcessObject::GetInput(1) );
 
   InputImagePointer  inputPtr = 
     const_cast< InputImageType * >( this->GetInput() );
@@ -64,6 +74,14 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
   //
   markerPtr->SetRequestedRegion(markerPtr->GetLargestPossibleRegion());
   inputPtr->SetRequestedRegion(inputPtr->GetLargestPossibleRegion());
+
+  // the mask is optional
+  ImageBaseType * maskPtr =
+    dynamic_cast< ImageBaseType * >( this->ProcessObject::GetInput(2) );
+  if ( maskPtr )
+    {
+    maskPtr->SetRequestedRegion(maskPtr->GetLargestPossibleRegion());
+    }
 }
 
 
@@ -88,7 +106,7 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
 
   //---------------------------------------------------------------------------
   // declare the vars common to the 2 algorithms: constants, iterators,
-  // hierarchical queue, progress reporter, and status image
+  // hierarchical queue, progress reporter, and status
   // also allocate output images and verify preconditions
   //---------------------------------------------------------------------------
 
@@ -97,117 +115,355 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
   // the label used to mark the watershed line in the output image
   static const LabelImagePixelType wsLabel = m_BackgroundValue;
 
+  // mask and marker must have the same size
+  typedef ImageBase< ImageDimension > ImageBaseType;
+  const ImageBaseType * markerPtr =
+    dynamic_cast< const ImageBaseType * >( this->ProcessObject::GetInput(1) );
+  if ( markerPtr->GetRequestedRegion().GetSize() != this->GetInput()->GetRequestedRegion().GetSize() )
+    { itkExceptionMacro( << "Marker and input must have the same size." ); }
+  const ImageBaseType * maskPtr =
+    dynamic_cast< const ImageBaseType * >( this->ProcessObject::GetInput(2) );
+  if ( maskPtr && maskPtr->GetRequestedRegion().GetSize() != this->GetInput()->GetRequestedRegion().GetSize() )
+    { itkExceptionMacro( << "Mask and input must have the same size." ); }
+
+  // the adjacency graph is only collected by the linear flooding
+  if ( m_ComputeAdjacencyGraph && ( m_Compactness > 0 || m_GeodesicPlateaus || m_UseImageSpacing ) )
+    { itkExceptionMacro( << "The adjacency graph can't be computed with the compact and geodesic floodings." ); }
+
   this->AllocateOutputs();
+
+  // only the pixels of the mask are flooded
+  const unsigned long nbOfMaskPixels = this->ComputeMaskLines();
+  m_NumberOfFloodedPixels = nbOfMaskPixels;
+
   // Set up the progress reporter
   // we can't found the exact number of pixel to process in the 2nd pass, so we use the maximum number possible.
-  ProgressReporter progress(this, 0, this->GetMarkerImage()->GetRequestedRegion().GetNumberOfPixels()*2);
-  
-  // mask and marker must have the same size
-  if ( this->GetMarkerImage()->GetRequestedRegion().GetSize() != this->GetInput()->GetRequestedRegion().GetSize() )
-    { itkExceptionMacro( << "Marker and input must have the same size." ); }
-  
+  ProgressReporter progress(this, 0, nbOfMaskPixels*2);
 
-  // the radius which will be used for all the shaped iterators
-  Size< ImageDimension > radius;
-  radius.Fill(1);
-
-  // iterator for the marker image
-  typedef ConstShapedNeighborhoodIterator<LabelImageType> MarkerIteratorType;
-  typename MarkerIteratorType::ConstIterator nmIt;
-  MarkerIteratorType markerIt(radius, this->GetMarkerImage(), this->GetMarkerImage()->GetRequestedRegion());
-  // add a boundary constant to avoid adding pixels on the border in the fah
-  ConstantBoundaryCondition<LabelImageType> lcbc;
-  lcbc.SetConstant( NumericTraits<LabelImagePixelType>::max() );
-  markerIt.OverrideBoundaryCondition(&lcbc);
-  setConnectivity( &markerIt, m_Connectivity.GetPointer() );
-
-  // iterator for the input image
-  typedef ConstShapedNeighborhoodIterator<InputImageType> InputIteratorType;
-  InputIteratorType inputIt(radius, this->GetInput(), this->GetInput()->GetRequestedRegion());
-  typename InputIteratorType::ConstIterator niIt;
-  setConnectivity( &inputIt, m_Connectivity.GetPointer() );
-  
-  // iterator for the output image
-  typedef ShapedNeighborhoodIterator<LabelImageType> OutputIteratorType;
-  typedef typename OutputIteratorType::OffsetType OffsetType;
-  typename OutputIteratorType::Iterator noIt;
-  OutputIteratorType outputIt(radius, this->GetOutput(), this->GetOutput()->GetRequestedRegion());
-  setConnectivity( &outputIt, m_Connectivity.GetPointer() );
-
-  if (!m_UseImageSpacing)
-    {
-    // FAH (in french: File d'Attente Hierarchique)
-    typedef HierarchicalQueue< InputImagePixelType, IndexType > HierarchicalQueueType;
-    HierarchicalQueueType fah;
-    //---------------------------------------------------------------------------
-    // Meyer's algorithm
-    //---------------------------------------------------------------------------
-    if( m_MarkWatershedLine )
-      {
-      // first stage:
-      //  - set markers pixels to already processed status
-      //  - copy markers pixels to output image
-      //  - init FAH with indexes of background pixels with marker pixel(s) in their neighborhood
-      
-      ConstantBoundaryCondition<LabelImageType> lcbc2;
-      lcbc2.SetConstant( wsLabel ); // outside pixel are watershed so they won't be use to find real watershed  pixels
-      outputIt.OverrideBoundaryCondition(&lcbc2);
-      
-      // create a temporary image to store the state of each pixel (processed or not)
-      typedef Image< bool, ImageDimension > StatusImageType;
-      typename StatusImageType::Pointer statusImage = StatusImageType::New();
-      statusImage->SetRegions( this->GetMarkerImage()->GetLargestPossibleRegion() );
-      statusImage->Allocate();
+  // only the linear flooding can read the marker label map directly
+  m_MarkerImage = this->GetMarkerImage();
+  if( !m_MarkerImage && ( m_Compactness > 0 || m_GeodesicPlateaus || m_UseImageSpacing ) )
+    {
+    this->RasterizeMarkerLabelMap( bgLabel );
+    }
   
-      // iterator for the status image
-      typedef ShapedNeighborhoodIterator<StatusImageType> StatusIteratorType;
-      typename StatusIteratorType::Iterator nsIt;
-      StatusIteratorType statusIt(radius, statusImage, this->GetOutput()->GetRequestedRegion());
-      ConstantBoundaryCondition< StatusImageType > bcbc;
-      bcbc.SetConstant( true );  // outside pixel are already processed
-      statusIt.OverrideBoundaryCondition(&bcbc);
-      setConnectivity( &statusIt, m_Connectivity.GetPointer() );
-
-      // the status image must be initialized before the first stage. In the first stage, the
-      // set to true are the neighbors of the marker (and the marker) so it's difficult
-      // (impossible ?)to init the status image at the same time
-      // the overhead should be small
-      statusImage->FillBuffer( false );
-      
-      for ( markerIt.GoToBegin(), statusIt.GoToBegin(), outputIt.GoToBegin(), inputIt.GoToBegin();
-            !markerIt.IsAtEnd(); ++markerIt, ++outputIt)
-        {
-        LabelImagePixelType markerPixel = markerIt.GetCenterPixel();
+  m_AdjacencyGraph.clear();
+
+  // the lines are added to the label map when the labels are written in
+  // the output
+  m_LabelMap = NULL;
+  if( m_ComputeLabelMap )
+    {
+    m_LabelMap = LabelMapType::New();
+    m_LabelMap->CopyInformation( this->GetOutput() );
+    m_LabelMap->SetRegions( this->GetOutput()->GetBufferedRegion() );
+    m_LabelMap->SetBackgroundValue( wsLabel );
+    }
+
+  // the edit region is only valid for this update
+  const LabelImageRegionType editRegion = m_MarkerEditRegion;
+  m_MarkerEditRegion = LabelImageRegionType();
+
+  if( nbOfMaskPixels == 0 )
+    {
+    // nothing to flood
+    m_Workspace.IncrementalValid = false;
+    this->GetOutput()->FillBuffer( wsLabel );
+    }
+  else if( m_Compactness > 0 )
+    {
+    m_Workspace.IncrementalValid = false;
+    this->CompactFlood( progress, bgLabel, wsLabel );
+    }
+  else if( m_GeodesicPlateaus || m_UseImageSpacing )
+    {
+    // the distances on the plateaus are only meaningful with the spacing
+    // when they are geodesic
+    m_Workspace.IncrementalValid = false;
+    this->PlateauFlood( progress, bgLabel, wsLabel );
+    }
+  else
+    {
+    // the flooding is compiled for the usual neighborhoods in 2D and 3D, so
+    // the loops on the neighbors have a constant number of iterations. The
+    // dispatch on the dimension is done at compile time, so only the
+    // neighborhoods of the dimension of the image are instantiated.
+    this->DispatchLinearFlood( editRegion, progress, bgLabel, wsLabel,
+                               ImageToImageFilterDetail::UnsignedIntDispatch< ImageDimension >() );
+    }
+
+  m_MarkerImage = NULL;
+}
+
+
+
+template<class TInputImage, class TLabelImage>
+template<unsigned int VNumberOfNeighbors>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::LinearFlood( const LabelImageRegionType & editRegion, ProgressReporter & progress,
+               LabelImagePixelType bgLabel, LabelImagePixelType wsLabel )
+{
+  // the flooding is done directly in the buffers of the images. The pixels
+  // are identified by their offset in the buffers, and the neighbors are
+  // found with the precomputed offsets of the linear neighborhood.
+  // With a marker label map, there is no marker buffer: the markers are
+  // written in the label buffer, and only their lines are visited by the
+  // first stage.
+  const InputImagePixelType * inputBuffer = this->GetInput()->GetBufferPointer();
+  const LabelImagePixelType * markerBuffer = NULL;
+  if( m_MarkerImage )
+    {
+    markerBuffer = m_MarkerImage->GetBufferPointer();
+    }
+  LabelImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+
+  // with a mask, the flooding is done in padded buffers of the size of
+  // the bounding box of the mask, and the pixels outside the mask are
+  // handled like the padding
+  const bool masked = this->ProcessObject::GetInput(2) != NULL;
+
+  // the incremental flooding keeps the labels of the previous update in
+  // the padded buffers of the workspace, and needs the marker image to
+  // find the edited markers
+  const bool incremental = m_IncrementalFlooding && !m_MarkWatershedLine && !m_ComputeAdjacencyGraph && markerBuffer && !masked;
+  const bool padded = m_PadImageBoundary || incremental || masked;
+
+  LinearNeighborhoodType neighborhood;
+  neighborhood.Initialize( m_FloodRegion.GetSize(), m_Connectivity->GetNeighbors(), padded );
+  // the offsets used in the flooding loops, with a constant number of
+  // neighbors when VNumberOfNeighbors is not 0
+  const LinearNeighborhoodOffsets< ImageDimension, VNumberOfNeighbors > offsets( neighborhood );
+  const unsigned int nbOfNeighbors = offsets.GetNumberOfNeighbors();
+  const OffsetValueType nbOfPixels = m_FloodRegion.GetNumberOfPixels();
+  // the position of the current pixel, only used when it is on the border
+  OffsetType position;
+
+  if( incremental && m_Workspace.IncrementalValid
+      && this->GetInput()->GetMTime() == m_Workspace.InputMTime
+      && this->GetInput()->GetBufferedRegion() == m_Workspace.InputRegion
+      && m_Connectivity->GetCellDimension() == m_Workspace.CellDimension
+      && nbOfNeighbors == m_Workspace.NumberOfNeighbors
+      && bgLabel == m_Workspace.BackgroundValue )
+    {
+    if( this->IncrementalFlood( neighborhood, editRegion, bgLabel, wsLabel ) )
+      {
+      // the other pixels of the output still have the labels of the
+      // previous flooding, unless the output has been reallocated. The
+      // label map is a new one, so it is built from all the labels.
+      if( outputBuffer == m_Workspace.OutputBuffer && !m_ComputeLabelMap )
+        {
+        this->WriteIncrementalLabels( neighborhood );
+        }
+      else
+        {
+        this->WriteLabels( &m_Workspace.PaddedLabels[0], neighborhood, wsLabel );
+        m_Workspace.OutputBuffer = outputBuffer;
+        }
+      return;
+      }
+    }
+  m_Workspace.IncrementalValid = false;
+  m_Workspace.OutputBuffer = NULL;
+
+  // the pixels visited by the first stage: the lines of the mask with a
+  // marker image - the whole image without mask - or the lines of the
+  // marker label map in the mask
+  const LineContainerType & maskLines = m_Workspace.MaskLines;
+  const LineContainerType & markerLines = m_Workspace.MarkerLines;
+  if( !markerBuffer )
+    {
+    this->ComputeLines( this->GetMarkerLabelMap(), m_Workspace.MarkerLines );
+    if( masked )
+      {
+      this->ClipMarkerLines();
+      }
+    }
+  const LineContainerType & initLines = markerBuffer ? maskLines : markerLines;
+
+  // with the padding, the input and the markers are copied in buffers with
+  // one more pixel on each side, and the flooding is done in the padded
+  // label buffer. The pixels of the padding are never labeled or added to
+  // the queue, so the neighbors can be used without checking the border.
+  // With the watershed line, the padding is marked as watershed and
+  // already processed; without, it only needs to not be a background
+  // pixel. Only the lines of the mask are copied, so the pixels outside
+  // the mask are padding pixels.
+  // The buffers are the ones of the workspace, so they are only allocated
+  // again when the size of the image changes.
+  std::vector< InputImagePixelType > & paddedInput = m_Workspace.PaddedInput;
+  std::vector< LabelImagePixelType > & paddedLabels = m_Workspace.PaddedLabels;
+  if( padded )
+    {
+    LabelImagePixelType borderLabel = wsLabel;
+    if( !m_MarkWatershedLine )
+      {
+      if( wsLabel != NumericTraits< LabelImagePixelType >::max() )
+        { borderLabel = NumericTraits< LabelImagePixelType >::max(); }
+      else
+        { borderLabel = NumericTraits< LabelImagePixelType >::NonpositiveMin(); }
+      }
+    paddedInput.resize( neighborhood.GetNumberOfBufferPixels() );
+    paddedLabels.assign( neighborhood.GetNumberOfBufferPixels(), borderLabel );
+    if( incremental )
+      {
+      m_Workspace.Markers.assign( markerBuffer, markerBuffer + nbOfPixels );
+      }
+    for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+      {
+      position = lIt->Position;
+      OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+      const InputImagePixelType * inputLine = inputBuffer + lIt->Offset;
+      if( markerBuffer )
+        {
+        const LabelImagePixelType * markerLine = markerBuffer + lIt->Offset;
+        for ( OffsetValueType u=0; u<lIt->Length; u++, p=neighborhood.Next( p, position ) )
+          {
+          paddedInput[p] = inputLine[u];
+          paddedLabels[p] = markerLine[u];
+          }
+        }
+      else
+        {
+        for ( OffsetValueType u=0; u<lIt->Length; u++, p=neighborhood.Next( p, position ) )
+          {
+          paddedInput[p] = inputLine[u];
+          paddedLabels[p] = bgLabel;
+          }
+        }
+      }
+    inputBuffer = &paddedInput[0];
+    // the markers are read in the label buffer, like when the marker image
+    // use the same buffer than the output image
+    markerBuffer = &paddedLabels[0];
+    outputBuffer = &paddedLabels[0];
+    }
+  else if( !markerBuffer )
+    {
+    std::fill( outputBuffer, outputBuffer + nbOfPixels, bgLabel );
+    markerBuffer = outputBuffer;
+    }
+  if( !m_MarkerImage )
+    {
+    // write the lines of the marker label map in the label buffer. The
+    // lines are contiguous in the buffer, padded or not.
+    for( typename LineContainerType::const_iterator lIt=markerLines.begin(); lIt!=markerLines.end(); lIt++ )
+      {
+      LabelImagePixelType * line = outputBuffer + neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( lIt->Position );
+      std::fill( line, line + lIt->Length, lIt->Label );
+      }
+    }
+
+  // FAH (in french: File d'Attente Hierarchique)
+  HierarchicalQueueType & fah = m_HierarchicalQueue;
+  fah.Clear();
+
+  // the pixels with the same priority extracted from the queue
+  std::vector< OffsetValueType > & batch = m_Workspace.Batch;
+  batch.clear();
+  // set up the threads used to scan the large batches
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  int nbOfThreads = this->GetMultiThreader()->GetNumberOfThreads();
+  if( nbOfThreads < m_MinimumParallelNumberOfThreads )
+    {
+    nbOfThreads = 1;
+    }
+  std::vector< BatchScanResult > & results = m_Workspace.Results;
+  results.resize( nbOfThreads );
+  BatchScanStruct str;
+  str.Batch = &batch;
+  str.Results = &results;
+  str.Neighborhood = &neighborhood;
+  str.OutputBuffer = outputBuffer;
+  str.Status = NULL;
+  str.WatershedLabel = wsLabel;
+  str.MarkWatershedLine = m_MarkWatershedLine;
+  this->GetMultiThreader()->SetSingleMethod( this->BatchScanThreaderCallback, &str );
+
+  // the marker image may use the same buffer than the output image - see
+  // MorphologicalWatershedImageFilter and the padding above. The first
+  // stages of the two algorithms only write a pixel of the output after
+  // having read it in the marker image, and with the same value, so that
+  // case is supported.
+
+  //---------------------------------------------------------------------------
+  // Meyer's algorithm
+  //---------------------------------------------------------------------------
+  if( m_MarkWatershedLine )
+    {
+    // first stage:
+    //  - set markers pixels to already processed status
+    //  - copy markers pixels to output image
+    //  - init FAH with indexes of background pixels with marker pixel(s) in their neighborhood
+    
+    // the state of each pixel (already in the queue or not) is stored in
+    // a packed bitmap, with one bit per pixel
+    // the status must be initialized before the first stage. In the first stage, the
+    // set to true are the neighbors of the marker (and the marker) so it's difficult
+    // (impossible ?)to init the status at the same time
+    // the overhead should be small
+    // With the padding, the pixels of the padding and the pixels outside
+    // the mask are already processed.
+    StatusType & status = m_Workspace.Status;
+    status.assign( neighborhood.GetNumberOfBufferPixels(), padded );
+    if( padded )
+      {
+      for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+        {
+        position = lIt->Position;
+        OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+        for ( OffsetValueType u=0; u<lIt->Length; u++, p=neighborhood.Next( p, position ) )
+          {
+          status[p] = false;
+          }
+        }
+      }
+
+    // the watershed pixels already found, to add the contacts with the
+    // basins which reach them later
+    if( m_ComputeAdjacencyGraph )
+      {
+      m_Workspace.Collisions.assign( neighborhood.GetNumberOfBufferPixels(), false );
+      }
+    
+    for( typename LineContainerType::const_iterator lIt=initLines.begin(); lIt!=initLines.end(); lIt++ )
+      {
+      position = lIt->Position;
+      OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+      for ( OffsetValueType u=0; u<lIt->Length; u++, p=neighborhood.Next( p, position ) )
+        {
+        LabelImagePixelType markerPixel = markerBuffer[p];
         if ( markerPixel != bgLabel )
           {
-        
-          IndexType idx = markerIt.GetIndex();
-          
-          // move the iterators to the right place
-          OffsetType shift = idx - statusIt.GetIndex();
-          statusIt += shift;
-          inputIt += shift;
-          
           // this pixel belongs to a marker
           // mark it as already processed
-          statusIt.SetCenterPixel( true );
+          status[p] = true;
           // copy it to the output image
-          outputIt.SetCenterPixel( markerPixel );
+          outputBuffer[p] = markerPixel;
           // and increase progress because this pixel will not be used in the flooding stage.
           progress.CompletedPixel();
-          
+        
           // search the background pixels in the neighborhood
-          for ( nmIt= markerIt.Begin(), nsIt= statusIt.Begin(), niIt= inputIt.Begin();
-                nmIt != markerIt.End();
-                nmIt++, nsIt++, niIt++ )
+          // the pixels outside the image are never background pixels
+          const bool onBorder = neighborhood.IsOnBorder( position );
+          for ( unsigned int i=0; i<nbOfNeighbors; i++ )
             {
-            if ( !nsIt.Get() && nmIt.Get() == bgLabel )
+            if( onBorder && !neighborhood.IsInside( position, i ) )
+              { continue; }
+            const OffsetValueType q = p + offsets[i];
+            if ( !status[q] && markerBuffer[q] == bgLabel )
               {
               // this neighbor is a background pixel and is not already processed; add its
               // index to fah
-              fah.Push( niIt.Get(), markerIt.GetIndex() + nmIt.GetNeighborhoodOffset() );
+              fah.Push( inputBuffer[q], q );
               // mark it as already in the fah to avoid adding it several times
-              nsIt.Set( true );
+              status[q] = true;
+              }
+            else if ( m_ComputeAdjacencyGraph && markerPixel < markerBuffer[q] && markerBuffer[q] != wsLabel )
+              {
+              // two markers in contact - the contact is seen from the
+              // marker with the smallest label
+              this->AddContact( markerPixel, markerBuffer[q], std::max( inputBuffer[p], inputBuffer[q] ), 1 );
               }
             }
           }
@@ -215,39 +471,114 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
           {
           // Some pixels may be never processed so, by default, non marked pixels
           // must be marked as watershed
-          outputIt.SetCenterPixel( wsLabel );
+          outputBuffer[p] = wsLabel;
           }
         // one more pixel done in the init stage
         progress.CompletedPixel();
         }
-      // end of init stage
-      
-      // flooding
-      // init all the iterators
-      outputIt.GoToBegin();
-      statusIt.GoToBegin();
-      inputIt.GoToBegin();
-      
-      // and start flooding
-      while( !fah.Empty() )
-        {
-        // store the current vars
-        const InputImagePixelType & currentValue = fah.FrontKey();
-        const IndexType & idx = fah.FrontValue();
-        
-        // move the iterators to the right place
-        OffsetType shift = idx - outputIt.GetIndex();
-        outputIt += shift;
-        statusIt += shift;
-        inputIt += shift;
-        
+      }
+    // end of init stage
+    
+    // flooding
+    str.Status = &status;
+    while( !fah.Empty() )
+      {
+      // extract all the pixels with the current priority. The pixels pushed
+      // with the same priority while the batch is processed go in the next
+      // batch, so the pixels are processed in the same order than when they
+      // are taken one by one in the queue
+      const InputImagePixelType currentValue = fah.FrontKey();
+      batch.clear();
+      do
+        {
+        batch.push_back( fah.FrontValue() );
+        fah.Pop();
+        }
+      while( !fah.Empty() && fah.FrontKey() == currentValue );
+
+      if( nbOfThreads > 1 && batch.size() >= m_MinimumParallelBatchSize )
+        {
+        // the neighborhoods are scanned in parallel, and the labels are set
+        // in the order of the batch. The labels found by the threads are
+        // the ones set before the batch; the unlabeled neighbors already in
+        // the queue may have been labeled by a previous pixel of the batch,
+        // so they are checked again.
+        this->GetMultiThreader()->SingleMethodExecute();
+        unsigned long b = 0;
+        for( int t=0; t<nbOfThreads; t++ )
+          {
+          const BatchScanResult & result = results[t];
+          unsigned long k = 0;
+          for( unsigned long j=0; j<result.Markers.size(); j++, b++ )
+            {
+            const OffsetValueType p = batch[b];
+            const unsigned int nbOfLabelNeighbors = result.NumberOfNeighbors[2*j];
+            const unsigned int nbOfPushNeighbors = result.NumberOfNeighbors[2*j+1];
+            LabelImagePixelType marker = result.Markers[j];
+            bool collision = result.Collisions[j];
+            for ( unsigned int i=0; i<nbOfLabelNeighbors && !collision; i++ )
+              {
+              LabelImagePixelType o = outputBuffer[ result.Neighbors[k+i] ];
+              if( o != wsLabel )
+                {
+                if( marker != wsLabel && o != marker )
+                  { collision = true; }
+                else
+                  { marker = o; }
+                }
+              }
+            k += nbOfLabelNeighbors;
+            if( collision && m_ComputeAdjacencyGraph )
+              {
+              this->AddCollision( p, currentValue, neighborhood, outputBuffer, wsLabel );
+              }
+            if( !collision )
+              {
+              // set the marker value
+              outputBuffer[p] = marker;
+              if( m_ComputeAdjacencyGraph )
+                {
+                this->AddLineContacts( p, currentValue, neighborhood, outputBuffer, wsLabel );
+                }
+              // and propagate to the neighbors
+              for ( unsigned int i=0; i<nbOfPushNeighbors; i++ )
+                {
+                const OffsetValueType q = result.Neighbors[k+i];
+                if ( !status[q] )
+                  {
+                  const InputImagePixelType & grayVal = inputBuffer[q];
+                  if ( grayVal <= currentValue )
+                    { fah.Push( currentValue, q ); }
+                  else
+                    { fah.Push( grayVal, q ); }
+                  status[q] = true;
+                  }
+                }
+              }
+            k += nbOfPushNeighbors;
+            progress.CompletedPixel();
+            }
+          }
+        continue;
+        }
+
+      for( unsigned long b=0; b<batch.size(); b++ )
+        {
+        const OffsetValueType p = batch[b];
+
+        // the pixels outside the image are already processed and are
+        // not part of a marker
+        const bool onBorder = neighborhood.IsOnBorder( p, position );
+
         // iterate over the neighbors. If there is only one marker value, give that value
         // to the pixel, else keep it as is (watershed line)
         LabelImagePixelType marker = wsLabel;
         bool collision = false;
-        for (noIt = outputIt.Begin(); noIt != outputIt.End(); noIt++)
+        for ( unsigned int i=0; i<nbOfNeighbors; i++ )
           {
-          LabelImagePixelType o = noIt.Get();
+          if( onBorder && !neighborhood.IsInside( position, i ) )
+            { continue; }
+          LabelImagePixelType o = outputBuffer[ p + offsets[i] ];
           if( o != wsLabel )
             {
             if( marker != wsLabel && o != marker )
@@ -259,77 +590,134 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
               { marker = o; }
             }
           }
+        if( collision && m_ComputeAdjacencyGraph )
+          {
+          this->AddCollision( p, currentValue, neighborhood, outputBuffer, wsLabel );
+          }
         if( !collision )
           {
           // set the marker value
-          outputIt.SetCenterPixel( marker );
+          outputBuffer[p] = marker;
+          if( m_ComputeAdjacencyGraph )
+            {
+            this->AddLineContacts( p, currentValue, neighborhood, outputBuffer, wsLabel );
+            }
           // and propagate to the neighbors
-          for (niIt = inputIt.Begin(), nsIt = statusIt.Begin();
-              niIt != inputIt.End();
-              niIt++, nsIt++)
+          for ( unsigned int i=0; i<nbOfNeighbors; i++ )
             {
-            if ( !nsIt.Get() )
+            if( onBorder && !neighborhood.IsInside( position, i ) )
+              { continue; }
+            const OffsetValueType q = p + offsets[i];
+            if ( !status[q] )
               {
               // the pixel is not yet processed. add it to the fah
-              InputImagePixelType grayVal = niIt.Get();
+              const InputImagePixelType & grayVal = inputBuffer[q];
               if ( grayVal <= currentValue )
-                { fah.Push( currentValue, inputIt.GetIndex() + niIt.GetNeighborhoodOffset() ); }
+                { fah.Push( currentValue, q ); }
               else
-                { fah.Push( grayVal, inputIt.GetIndex() + niIt.GetNeighborhoodOffset() ); }
+                { fah.Push( grayVal, q ); }
               // mark it as already in the fah
-              nsIt.Set( true );
+              status[q] = true;
               }
             }
           }
         // one more pixel in the flooding stage
         progress.CompletedPixel();
-        // remove the processed pixel of the queue
-        fah.Pop();
         }
       }
+    }
 
 
-    //---------------------------------------------------------------------------
-    // Beucher's algorithm
-    //---------------------------------------------------------------------------
-    else
+  //---------------------------------------------------------------------------
+  // Beucher's algorithm
+  //---------------------------------------------------------------------------
+  else
+    {
+    // first stage:
+    //  - copy markers pixels to output image
+    //  - init FAH with indexes of pixels with background pixel in their neighborhood
+    
+    // with the incremental flooding, the level at which each pixel is
+    // taken from the queue and the pixel which has labeled it are kept for
+    // the next update
+    std::vector< InputImagePixelType > & levels = m_Workspace.Levels;
+    StatusType & extracted = m_Workspace.Extracted;
+    std::vector< OffsetValueType > & parents = m_Workspace.Parents;
+    if( incremental )
+      {
+      levels.resize( neighborhood.GetNumberOfBufferPixels() );
+      parents.resize( neighborhood.GetNumberOfBufferPixels() );
+      extracted.assign( neighborhood.GetNumberOfBufferPixels(), false );
+      m_Workspace.InRegion.assign( neighborhood.GetNumberOfBufferPixels(), false );
+      }
+
+    // with a mask, the contacts with the pixels outside the mask, which
+    // are not in the padding, are not collected: the pixels of the mask
+    // are marked in the status
+    StatusType & inMask = m_Workspace.Status;
+    if( masked && m_ComputeAdjacencyGraph )
+      {
+      inMask.assign( neighborhood.GetNumberOfBufferPixels(), false );
+      for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+        {
+        const OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( lIt->Position );
+        for ( OffsetValueType u=0; u<lIt->Length; u++ )
+          {
+          inMask[p+u] = true;
+          }
+        }
+      }
+
+    for( typename LineContainerType::const_iterator lIt=initLines.begin(); lIt!=initLines.end(); lIt++ )
       {
-      // first stage:
-      //  - copy markers pixels to output image
-      //  - init FAH with indexes of pixels with background pixel in their neighborhood
-      
-      ConstantBoundaryCondition<LabelImageType> lcbc2;
-      lcbc2.SetConstant( NumericTraits< LabelImagePixelType >::max() ); // outside pixel are watershed so they won't be use to find real watershed  pixels
-      outputIt.OverrideBoundaryCondition(&lcbc2);
-      
-      for ( markerIt.GoToBegin(), outputIt.GoToBegin(), inputIt.GoToBegin();
-            !markerIt.IsAtEnd();
-            ++markerIt, ++outputIt ) 
-        {
-        LabelImagePixelType markerPixel = markerIt.GetCenterPixel();
+      position = lIt->Position;
+      OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+      for ( OffsetValueType u=0; u<lIt->Length; u++, p=neighborhood.Next( p, position ) )
+        {
+        LabelImagePixelType markerPixel = markerBuffer[p];
         if ( markerPixel != bgLabel )
           {
-          IndexType idx = markerIt.GetIndex();
-          OffsetType shift = idx - inputIt.GetIndex();
-          inputIt += shift;
-          
           // this pixels belongs to a marker
           // copy it to the output image
-          outputIt.SetCenterPixel( markerPixel );
+          outputBuffer[p] = markerPixel;
+          if( incremental )
+            {
+            parents[p] = p;
+            }
           // search if it has background pixel in its neighborhood
+          // the pixels outside the image are never background pixels
+          const bool onBorder = neighborhood.IsOnBorder( position );
           bool haveBgNeighbor = false;
-          for ( nmIt= markerIt.Begin(); nmIt != markerIt.End(); nmIt++ )
+          for ( unsigned int i=0; i<nbOfNeighbors; i++ )
             {
-            if ( nmIt.Get() == bgLabel )
+            if( onBorder && !neighborhood.IsInside( position, i ) )
+              { continue; }
+            if ( markerBuffer[ p + offsets[i] ] == bgLabel )
               { 
               haveBgNeighbor = true; 
               break;
               }
             }
+          if ( m_ComputeAdjacencyGraph && !haveBgNeighbor )
+            {
+            // the contacts with the other markers are found when the pixels
+            // are taken from the queue, but this one is not put in the
+            // queue. Each contact is counted twice - see below.
+            for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+              {
+              if( onBorder && !neighborhood.IsInside( position, i ) )
+                { continue; }
+              const OffsetValueType q = p + offsets[i];
+              if ( markerBuffer[q] != markerPixel && ( masked ? inMask[q] : !neighborhood.IsInPadding( q ) ) )
+                {
+                this->AddContact( markerPixel, markerBuffer[q], std::max( inputBuffer[p], inputBuffer[q] ), 1 );
+                }
+              }
+            }
           if ( haveBgNeighbor )
             {
             // there is a background pixel in the neighborhood; add to fah
-            fah.Push( inputIt.GetCenterPixel(), markerIt.GetIndex() );
+            fah.Push( inputBuffer[p], p );
             }
           else
             {
@@ -339,247 +727,1530 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
           }
         else
           {
-          outputIt.SetCenterPixel( wsLabel );
+          outputBuffer[p] = wsLabel;
           }
         progress.CompletedPixel();
         }
-      // end of init stage
-      
-      // flooding
-      // init all the iterators
-      outputIt.GoToBegin();
-      inputIt.GoToBegin();
-      
-      // and start flooding
-      while( !fah.Empty() )
-        {
-        // store the current vars
-        const InputImagePixelType & currentValue = fah.FrontKey();
-        const IndexType & idx = fah.FrontValue();
-        
-        // move the iterators to the right place
-        OffsetType shift = idx - outputIt.GetIndex();
-        outputIt += shift;
-        inputIt += shift;
-        
-        LabelImagePixelType currentMarker = outputIt.GetCenterPixel();
-        // get the current value of the pixel
-        // iterate over neighbors to propagate the marker
-        for (noIt = outputIt.Begin(), niIt = inputIt.Begin();
-            noIt != outputIt.End();
-            noIt++, niIt++)
-          {
-          if ( noIt.Get() == wsLabel )
-            {
-            // the pixel is not yet processed. It can be labeled with the current label
-            noIt.Set( currentMarker );
-            const InputImagePixelType & grayVal = niIt.Get();
-            if ( grayVal <= currentValue )
-              { fah.Push( currentValue, inputIt.GetIndex() + niIt.GetNeighborhoodOffset() ); }
-            else
-              { fah.Push( grayVal, inputIt.GetIndex() + niIt.GetNeighborhoodOffset() ); }
-            progress.CompletedPixel();
-            }
-          }
-        // remove the processed pixel of the queue
-        fah.Pop();
-        }
       }
-    }
-  else
-    {
-    // This is the image integration method that is able to account
-    // for image spacing
-    // We need a distance image, lets assume that it is floating point
-    typename InputImageType::SpacingType spacing;
-    typename DistanceImageType::Pointer distanceImage = DistanceImageType::New();
-    distanceImage->SetRegions( this->GetMarkerImage()->GetLargestPossibleRegion() );
-    distanceImage->Allocate();
-    // set distance image to infinity
-    distanceImage->FillBuffer(itk::NumericTraits<DistancePixelType>::max());
-    // recconstructed image
-    typedef typename itk::ImageDuplicator<InputImageType> DupType;
-    typename DupType::Pointer duplicator = DupType::New();
-    duplicator->SetInputImage(this->GetInput());
-    duplicator->Update();
-    typename InputImageType::Pointer reconImage = duplicator->GetOutput();
+    // end of init stage
     
-    typedef ShapedNeighborhoodIterator<InputImageType> InputIteratorType2;
-    InputIteratorType2 inputIt2(radius, reconImage, this->GetInput()->GetRequestedRegion());
-    typename InputIteratorType2::Iterator niIt;
-    setConnectivity( &inputIt2, m_Connectivity.GetPointer() );
-
-    // FAH (in french: File d'Attente Hierarchique)
-    typedef HierarchicalQueue< InputImagePixelType, IndexType > HierarchicalQueueType;
-    HierarchicalQueueType fah;
-    // iterator for the distance image
-    typedef ShapedNeighborhoodIterator<DistanceImageType> DistanceIteratorType;
-    typename DistanceIteratorType::Iterator ndIt;
-    DistanceIteratorType distanceIt(radius, distanceImage, this->GetOutput()->GetRequestedRegion());
-    setConnectivity( &distanceIt, m_Connectivity.GetPointer() );
-    // a boundary condition for the distance image - set to a minimum
-    // because we are always looking to reduce the current value
-    ConstantBoundaryCondition<DistanceImageType> dcbc;
-    dcbc.SetConstant( NumericTraits<DistancePixelType>::NonpositiveMin() );
-    distanceIt.OverrideBoundaryCondition(&dcbc);
-    // set up the weights
-    WeightType weights;
-    spacing = this->GetInput()->GetSpacing();
-    for (noIt = outputIt.Begin(); noIt != outputIt.End(); ++noIt)
-      {
-      OffsetType offset = noIt.GetNeighborhoodOffset();
-      float w = 0;
-      for (unsigned i=0;i<ImageDimension;i++)
-        {
-        w += pow(offset[i]*spacing[i],2);
-        }
-      weights.push_back(sqrt(w));
-//      std::cout << sqrt(w) << std::endl;
-      }
-    if (m_MarkWatershedLine)
-      {
-      
-      }
-    else
+    // flooding
+    while( !fah.Empty() )
       {
-      ConstantBoundaryCondition<LabelImageType> lcbc2;
-      lcbc2.SetConstant( NumericTraits< LabelImagePixelType >::max() ); // outside pixel are watershed so they won't be use to find real watershed  pixels
-      outputIt.OverrideBoundaryCondition(&lcbc2);
+      // extract all the pixels with the current priority - see Meyer's
+      // algorithm above
+      const InputImagePixelType currentValue = fah.FrontKey();
+      batch.clear();
+      do
+        {
+        batch.push_back( fah.FrontValue() );
+        fah.Pop();
+        }
+      while( !fah.Empty() && fah.FrontKey() == currentValue );
 
-      // initialization
-      for ( markerIt.GoToBegin(), distanceIt.GoToBegin(), outputIt.GoToBegin(), 
-              inputIt2.GoToBegin();
-            !markerIt.IsAtEnd(); ++markerIt, ++outputIt)
+      // the contacts are found while the batch is applied, so the graph
+      // is collected by a single thread
+      if( nbOfThreads > 1 && batch.size() >= m_MinimumParallelBatchSize && !m_ComputeAdjacencyGraph )
         {
-        LabelImagePixelType markerPixel = markerIt.GetCenterPixel();
-        if ( markerPixel != bgLabel )
+        // the threads are finding the unlabeled neighbors of the pixels.
+        // A previous pixel of the batch may have labeled them, so they are
+        // checked again when applied in the order of the batch.
+        this->GetMultiThreader()->SingleMethodExecute();
+        unsigned long b = 0;
+        for( int t=0; t<nbOfThreads; t++ )
           {
-          IndexType idx = markerIt.GetIndex();
-          // move the iterators to the right place
-          OffsetType shift = idx - inputIt2.GetIndex();
-          distanceIt += shift;
-          inputIt2 += shift;
-          // perhaps we should initialize these points to zero
-          distanceIt.SetCenterPixel(0);  
-          //distanceIt.SetCenterPixel(inputIt2.GetCenterPixel() );  
-          // copy it to the output image
-          outputIt.SetCenterPixel( markerPixel );
-          // Check the neighbors
-          // test whether there is a background pixel in the neighborhood
-          bool haveBgNeighbor = false;
-          for ( nmIt= markerIt.Begin(); nmIt != markerIt.End(); nmIt++ )
+          const BatchScanResult & result = results[t];
+          unsigned long k = 0;
+          for( unsigned long j=0; j<result.NumberOfNeighbors.size(); j++, b++ )
             {
-            if ( nmIt.Get() == bgLabel )
-              { 
-              haveBgNeighbor = true; 
-              break;
+            const OffsetValueType p = batch[b];
+            const unsigned int nbOfLabelNeighbors = result.NumberOfNeighbors[j];
+            LabelImagePixelType currentMarker = outputBuffer[p];
+            if( incremental )
+              {
+              levels[p] = currentValue;
+              extracted[p] = true;
               }
+            for ( unsigned int i=0; i<nbOfLabelNeighbors; i++ )
+              {
+              const OffsetValueType q = result.Neighbors[k+i];
+              if ( outputBuffer[q] == wsLabel )
+                {
+                outputBuffer[q] = currentMarker;
+                if( incremental )
+                  {
+                  parents[q] = p;
+                  }
+                const InputImagePixelType & grayVal = inputBuffer[q];
+                if ( grayVal <= currentValue )
+                  { fah.Push( currentValue, q ); }
+                else
+                  { fah.Push( grayVal, q ); }
+                progress.CompletedPixel();
+                }
+              }
+            k += nbOfLabelNeighbors;
             }
-          if ( haveBgNeighbor )
-            {
-            // there is a background pixel in the neighborhood; add to
-            // fah. All marker pixels should have the same priority???
-            fah.Push(NumericTraits<InputImagePixelType>::NonpositiveMin(), markerIt.GetIndex() );
-            }
-          else
-            {
-            //increase progress because this pixel will not be used in the flooding stage.
-            progress.CompletedPixel();
-            }
-          
           }
-        else
+        continue;
+        }
+
+      for( unsigned long b=0; b<batch.size(); b++ )
+        {
+        const OffsetValueType p = batch[b];
+
+        // the pixels outside the image are never labeled
+        const bool onBorder = neighborhood.IsOnBorder( p, position );
+
+        LabelImagePixelType currentMarker = outputBuffer[p];
+        if( incremental )
           {
-          // Some pixels may be never processed so, by default, non marked pixels
-          // must be marked as watershed
-          outputIt.SetCenterPixel( wsLabel );	
+          levels[p] = currentValue;
+          extracted[p] = true;
           }
-        progress.CompletedPixel();
-        }
-      // now for flooding
-      // init all the iterators
-      outputIt.GoToBegin();
-      inputIt2.GoToBegin();
-      distanceIt.GoToBegin();
-
-      while( !fah.Empty() )
-        {
-        // store the current vars
-        const InputImagePixelType & StoredVal = fah.FrontKey();
-        const IndexType & idx = fah.FrontValue();
-        // move the iterators to the right place
-        OffsetType shift = idx - outputIt.GetIndex();
-        outputIt += shift;
-        inputIt2 += shift;
-        distanceIt += shift;
-        float ThisDistance = distanceIt.GetCenterPixel();
-        LabelImagePixelType currentMarker = outputIt.GetCenterPixel();
-
-        // visit neighbors
-        unsigned i;
-        for (noIt = outputIt.Begin(), niIt = inputIt2.Begin(), 
-              ndIt = distanceIt.Begin(), i=0;
-            noIt != outputIt.End();
-            noIt++, niIt++, ++ndIt, i++)
-          {
-          float NewDistance, NeighDistance = ndIt.Get();
-          InputImagePixelType priority = StoredVal, NeighVal = niIt.Get();
-          // need to be very careful about the reconstruction
-          // component - how do we make sure reconstruction is
-          // happening implicitly without allowing labels to flood
-          // downhill over already labelled regions unnecessarily. One
-          // possibility is to have a copy of the input image
-          if (NeighVal == StoredVal)
-            {
-            // we are on the same plateau
-            NewDistance = ThisDistance + weights[i];
-            priority = StoredVal;
-            }
-          else
+        // get the current value of the pixel
+        // iterate over neighbors to propagate the marker
+        for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+          {
+          if( onBorder && !neighborhood.IsInside( position, i ) )
+            { continue; }
+          const OffsetValueType q = p + offsets[i];
+          if ( outputBuffer[q] == wsLabel )
             {
-            if (NeighVal > StoredVal)
+            // the pixel is not yet processed. It can be labeled with the current label
+            outputBuffer[q] = currentMarker;
+            if( incremental )
               {
-              // new plateau
-              NewDistance = weights[i]; //0.0; //ThisDistance + weights[i];
-              priority = NeighVal;
+              parents[q] = p;
               }
+            const InputImagePixelType & grayVal = inputBuffer[q];
+            if ( grayVal <= currentValue )
+              { fah.Push( currentValue, q ); }
             else
-              {
-              // either a reconstruction or falling onto an already
-              // flooded area
-              LabelImagePixelType NMarker = noIt.Get();
-              if (NMarker == wsLabel)
-                {
-                // reconstruction
-                niIt.Set(StoredVal);
-                NewDistance = ThisDistance + weights[i];
-                priority = StoredVal;
-                }
-              else
-                {
-                // Going somewhere we've been -- set the cost high so
-                // we don't do anythin
-                NewDistance = NumericTraits<DistancePixelType>::max();
-                }
-              }
+              { fah.Push( grayVal, q ); }
+            progress.CompletedPixel();
             }
-          if (NewDistance < NeighDistance)
+          else if ( m_ComputeAdjacencyGraph && outputBuffer[q] != currentMarker && ( masked ? inMask[q] : !neighborhood.IsInPadding( q ) ) )
             {
-            // found a cheaper way of getting to the target pixel
-            noIt.Set(currentMarker);
-            ndIt.Set(NewDistance);
-            fah.Push(priority, idx + niIt.GetNeighborhoodOffset());
+            // the neighbor has been labeled by another basin. Its level
+            // is the highest of its value and of a level not higher than
+            // the current one, so the pass between the two pixels is
+            // known without storing the levels.
+            this->AddContact( currentMarker, outputBuffer[q], std::max( currentValue, inputBuffer[q] ), 1 );
             }
-          progress.CompletedPixel();
           }
-        // remove the processed pixel from the queue
-        fah.Pop();	
         }
       }
+
+    if( m_ComputeAdjacencyGraph )
+      {
+      // a pair of neighbor pixels of two basins is seen from both pixels,
+      // when they are taken from the queue, or in the first stage for the
+      // marker pixels which are not put in the queue
+      for( typename AdjacencyGraphType::iterator it=m_AdjacencyGraph.begin(); it!=m_AdjacencyGraph.end(); it++ )
+        {
+        it->second.ContactSize /= 2;
+        }
+      }
+
+    if( incremental )
+      {
+      m_Workspace.IncrementalValid = true;
+      m_Workspace.InputMTime = this->GetInput()->GetMTime();
+      m_Workspace.InputRegion = this->GetInput()->GetBufferedRegion();
+      m_Workspace.CellDimension = m_Connectivity->GetCellDimension();
+      m_Workspace.NumberOfNeighbors = nbOfNeighbors;
+      m_Workspace.BackgroundValue = bgLabel;
+      }
+    }
+
+  // with the padding, the output buffer is the padded label buffer
+  this->WriteLabels( outputBuffer, neighborhood, wsLabel );
+  if( incremental )
+    {
+    m_Workspace.OutputBuffer = this->GetOutput()->GetBufferPointer();
     }
 }
 
 
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::DispatchLinearFlood( const LabelImageRegionType & editRegion, ProgressReporter & progress,
+                       LabelImagePixelType bgLabel, LabelImagePixelType wsLabel,
+                       const ImageToImageFilterDetail::UnsignedIntDispatch< 2 > & )
+{
+  const unsigned int nbOfNeighbors = m_Connectivity->GetNeighbors().size();
+  if( nbOfNeighbors == 4 )
+    { this->template LinearFlood< 4 >( editRegion, progress, bgLabel, wsLabel ); }
+  else if( nbOfNeighbors == 8 )
+    { this->template LinearFlood< 8 >( editRegion, progress, bgLabel, wsLabel ); }
+  else
+    { this->template LinearFlood< 0 >( editRegion, progress, bgLabel, wsLabel ); }
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::DispatchLinearFlood( const LabelImageRegionType & editRegion, ProgressReporter & progress,
+                       LabelImagePixelType bgLabel, LabelImagePixelType wsLabel,
+                       const ImageToImageFilterDetail::UnsignedIntDispatch< 3 > & )
+{
+  const unsigned int nbOfNeighbors = m_Connectivity->GetNeighbors().size();
+  if( nbOfNeighbors == 6 )
+    { this->template LinearFlood< 6 >( editRegion, progress, bgLabel, wsLabel ); }
+  else if( nbOfNeighbors == 18 )
+    { this->template LinearFlood< 18 >( editRegion, progress, bgLabel, wsLabel ); }
+  else if( nbOfNeighbors == 26 )
+    { this->template LinearFlood< 26 >( editRegion, progress, bgLabel, wsLabel ); }
+  else
+    { this->template LinearFlood< 0 >( editRegion, progress, bgLabel, wsLabel ); }
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::DispatchLinearFlood( const LabelImageRegionType & editRegion, ProgressReporter & progress,
+                       LabelImagePixelType bgLabel, LabelImagePixelType wsLabel,
+                       const ImageToImageFilterDetail::DispatchBase & )
+{
+  this->template LinearFlood< 0 >( editRegion, progress, bgLabel, wsLabel );
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::CompactFlood( ProgressReporter & progress, LabelImagePixelType bgLabel, LabelImagePixelType wsLabel )
+{
+  // the flooding is done in padded buffers. A pixel is labeled when it is
+  // taken from the queue for the first time, with the label of the marker
+  // pixel the flooding comes from, so the queue stores both pixels. A pixel
+  // is put in the queue by each of its neighbors flooded before it, because
+  // its priority depends on the marker pixel.
+  const InputImagePixelType * imageBuffer = this->GetInput()->GetBufferPointer();
+  const LabelImagePixelType * markerBuffer = m_MarkerImage->GetBufferPointer();
+
+  // with a mask, the buffers have the size of its bounding box, and only
+  // the lines of the mask are copied
+  LinearNeighborhoodType neighborhood;
+  neighborhood.Initialize( m_FloodRegion.GetSize(), m_Connectivity->GetNeighbors(), true );
+  const unsigned int nbOfNeighbors = neighborhood.GetNumberOfNeighbors();
+  const LineContainerType & maskLines = m_Workspace.MaskLines;
+  OffsetType position;
+
+  // the weight of the distance on each axis
+  const float compactness = m_Compactness;
+  double spacing[ImageDimension];
+  for( unsigned int d=0; d<ImageDimension; d++ )
+    {
+    spacing[d] = 1;
+    if( m_UseImageSpacing )
+      {
+      spacing[d] = this->GetInput()->GetSpacing()[d];
+      }
+    }
+
+  // the status is true for the pixels already flooded, the marker pixels
+  // and the padding, which are never put in the queue
+  std::vector< InputImagePixelType > & inputBuffer = m_Workspace.PaddedInput;
+  std::vector< LabelImagePixelType > & outputBuffer = m_Workspace.PaddedLabels;
+  StatusType & status = m_Workspace.Status;
+  inputBuffer.resize( neighborhood.GetNumberOfBufferPixels() );
+  outputBuffer.assign( neighborhood.GetNumberOfBufferPixels(), wsLabel );
+  status.assign( neighborhood.GetNumberOfBufferPixels(), true );
+  for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+    {
+    position = lIt->Position;
+    OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+    for ( OffsetValueType u=lIt->Offset; u<lIt->Offset+lIt->Length; u++, p=neighborhood.Next( p, position ) )
+      {
+      inputBuffer[p] = imageBuffer[u];
+      if( markerBuffer[u] != bgLabel )
+        {
+        outputBuffer[p] = markerBuffer[u];
+        }
+      else
+        {
+        status[p] = false;
+        }
+      }
+    }
+
+  CompactHierarchicalQueueType & fah = m_Workspace.CompactQueue;
+  fah.Clear();
+
+  // the position of the pixel and of its marker pixel, and of the neighbor
+  OffsetType markerPosition;
+  OffsetType neighborPosition;
+
+  // first stage: with the watershed line, the background neighbors of the
+  // markers are put in the queue at their own level, as in Meyer's
+  // algorithm. Without, the markers are put in the queue at their level,
+  // as in Beucher's algorithm.
+  for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+    {
+    position = lIt->Position;
+    OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+    for ( OffsetValueType u=0; u<lIt->Length; u++, p=neighborhood.Next( p, position ) )
+      {
+      if ( outputBuffer[p] != wsLabel )
+        {
+        bool haveBgNeighbor = false;
+        for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+          {
+          const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+          if ( !status[q] )
+            {
+            haveBgNeighbor = true;
+            if( !m_MarkWatershedLine )
+              { break; }
+            const OffsetType & n = neighborhood.GetOffset( i );
+            double distance = 0;
+            for( unsigned int d=0; d<ImageDimension; d++ )
+              {
+              distance += n[d] * spacing[d] * n[d] * spacing[d];
+              }
+            fah.Push( inputBuffer[q] + compactness * sqrt( distance ), CompactElementType( q, p ) );
+            }
+          }
+        if ( haveBgNeighbor && !m_MarkWatershedLine )
+          {
+          fah.Push( inputBuffer[p], CompactElementType( p, p ) );
+          }
+        progress.CompletedPixel();
+        }
+      progress.CompletedPixel();
+      }
+    }
+
+  // flooding
+  while( !fah.Empty() )
+    {
+    const float currentValue = fah.FrontKey();
+    const OffsetValueType p = fah.FrontValue().first;
+    const OffsetValueType m = fah.FrontValue().second;
+    fah.Pop();
+
+    if( p != m )
+      {
+      if( status[p] )
+        {
+        // already flooded with a lower priority
+        continue;
+        }
+      status[p] = true;
+      progress.CompletedPixel();
+      const LabelImagePixelType marker = outputBuffer[m];
+      if( m_MarkWatershedLine )
+        {
+        // the pixel is on the watershed line if another basin is in its
+        // neighborhood
+        bool collision = false;
+        for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+          {
+          const LabelImagePixelType & o = outputBuffer[ p + neighborhood.GetLinearOffset( i ) ];
+          if( o != wsLabel && o != marker )
+            {
+            collision = true;
+            break;
+            }
+          }
+        if( collision )
+          { continue; }
+        }
+      outputBuffer[p] = marker;
+      }
+
+    // propagate to the neighbors not yet flooded
+    neighborhood.ComputePosition( p, position );
+    neighborhood.ComputePosition( m, markerPosition );
+    for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+      {
+      const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+      if ( !status[q] )
+        {
+        const OffsetType & n = neighborhood.GetOffset( i );
+        double distance = 0;
+        for( unsigned int d=0; d<ImageDimension; d++ )
+          {
+          const double v = ( position[d] + n[d] - markerPosition[d] ) * spacing[d];
+          distance += v * v;
+          }
+        float priority = inputBuffer[q] + compactness * sqrt( distance );
+        if ( priority < currentValue )
+          { priority = currentValue; }
+        fah.Push( priority, CompactElementType( q, m ) );
+        }
+      }
+    }
+
+  this->WriteLabels( &outputBuffer[0], neighborhood, wsLabel );
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::PlateauFlood( ProgressReporter & progress, LabelImagePixelType bgLabel, LabelImagePixelType wsLabel )
+{
+  // the flooding is done in padded buffers, like the compact watershed. The
+  // level queue stores the pixels at the level they are reached with; the
+  // pixels of the current level are then moved in the distance queue, and
+  // taken from it in the order of their geodesic distance to the lower
+  // border of their plateau. A pixel is labeled when it is taken from the
+  // distance queue for the first time, with the label of the neighbor it
+  // has been reached from.
+  //
+  // The geodesic distance is computed with the shortest paths in the
+  // plateau, which are made of straight segments between the corners of
+  // the plateau: each flooded pixel keeps the source of its last segment,
+  // and its distance is the distance of the source plus the euclidean
+  // distance to the source. A neighbor keeps the same source when the
+  // pixel one step closer to the source on the segment between them has
+  // already been flooded from that source, so the segment stays in the
+  // plateau; otherwise the pixel it is reached from becomes the source of a
+  // new segment, around a corner of the plateau. The pixels lower than the
+  // current level reached from the plateau are flooded with it.
+  const InputImagePixelType * imageBuffer = this->GetInput()->GetBufferPointer();
+  const LabelImagePixelType * markerBuffer = m_MarkerImage->GetBufferPointer();
+
+  LinearNeighborhoodType neighborhood;
+  neighborhood.Initialize( m_FloodRegion.GetSize(), m_Connectivity->GetNeighbors(), true );
+  const unsigned int nbOfNeighbors = neighborhood.GetNumberOfNeighbors();
+  const LineContainerType & maskLines = m_Workspace.MaskLines;
+  OffsetType position;
+
+  // the squared spacing, and the length of the offsets of the neighbors
+  double spacing2[ImageDimension];
+  for( unsigned int d=0; d<ImageDimension; d++ )
+    {
+    spacing2[d] = 1;
+    if( m_UseImageSpacing )
+      {
+      spacing2[d] = this->GetInput()->GetSpacing()[d] * this->GetInput()->GetSpacing()[d];
+      }
+    }
+  std::vector< float > weights( nbOfNeighbors );
+  for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+    {
+    const OffsetType & n = neighborhood.GetOffset( i );
+    double distance = 0;
+    for( unsigned int d=0; d<ImageDimension; d++ )
+      {
+      distance += n[d] * n[d] * spacing2[d];
+      }
+    weights[i] = sqrt( distance );
+    }
+
+  // the status is true for the pixels already flooded, the marker pixels
+  // and the padding, which are never put in the queue. The distance is the
+  // one of the pixels flooded at the current level, and the smallest one
+  // found so far for the pixels in the distance queue. It is 0 for the
+  // markers and for the pixels flooded at the previous levels, which are
+  // the lower border of the next plateaus, and are their own source.
+  std::vector< InputImagePixelType > & inputBuffer = m_Workspace.PaddedInput;
+  std::vector< LabelImagePixelType > & outputBuffer = m_Workspace.PaddedLabels;
+  StatusType & status = m_Workspace.Status;
+  std::vector< float > & distances = m_Workspace.PlateauDistances;
+  std::vector< OffsetValueType > & sources = m_Workspace.PlateauSources;
+  inputBuffer.resize( neighborhood.GetNumberOfBufferPixels() );
+  outputBuffer.assign( neighborhood.GetNumberOfBufferPixels(), wsLabel );
+  status.assign( neighborhood.GetNumberOfBufferPixels(), true );
+  distances.assign( neighborhood.GetNumberOfBufferPixels(), NumericTraits< float >::max() );
+  sources.assign( neighborhood.GetNumberOfBufferPixels(), -1 );
+  for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+    {
+    position = lIt->Position;
+    OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+    for ( OffsetValueType u=lIt->Offset; u<lIt->Offset+lIt->Length; u++, p=neighborhood.Next( p, position ) )
+      {
+      inputBuffer[p] = imageBuffer[u];
+      if( markerBuffer[u] != bgLabel )
+        {
+        outputBuffer[p] = markerBuffer[u];
+        distances[p] = 0;
+        sources[p] = p;
+        }
+      else
+        {
+        status[p] = false;
+        }
+      }
+    }
+
+  PlateauLevelQueueType & levelQueue = m_Workspace.PlateauLevelQueue;
+  PlateauDistanceQueueType & distanceQueue = m_Workspace.PlateauDistanceQueue;
+  levelQueue.Clear();
+  distanceQueue.Clear();
+  // the pixels flooded at the current level
+  std::vector< OffsetValueType > & flooded = m_Workspace.Batch;
+  flooded.clear();
+
+  // first stage: the background neighbors of the markers are put in the
+  // queue at their own level, as in Meyer's algorithm
+  PlateauElementType element;
+  for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+    {
+    position = lIt->Position;
+    OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+    for ( OffsetValueType u=0; u<lIt->Length; u++, p=neighborhood.Next( p, position ) )
+      {
+      if ( outputBuffer[p] != wsLabel )
+        {
+        element.Source = p;
+        element.Label = outputBuffer[p];
+        for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+          {
+          const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+          if ( !status[q] )
+            {
+            element.Pixel = q;
+            element.Distance = weights[i];
+            levelQueue.Push( inputBuffer[q], element );
+            }
+          }
+        progress.CompletedPixel();
+        }
+      progress.CompletedPixel();
+      }
+    }
+
+  // flooding
+  OffsetType sourcePosition;
+  OffsetType step;
+  while( !levelQueue.Empty() )
+    {
+    // all the pixels of the lowest level go in the distance queue, which
+    // is always empty at this point. They have been reached from the lower
+    // border of the plateau, at the distance of their neighbor.
+    const InputImagePixelType currentLevel = levelQueue.FrontKey();
+    do
+      {
+      element = levelQueue.FrontValue();
+      levelQueue.Pop();
+      if( element.Distance < distances[element.Pixel] )
+        {
+        distances[element.Pixel] = element.Distance;
+        sources[element.Pixel] = element.Source;
+        distanceQueue.Push( element.Distance, element );
+        }
+      }
+    while( !levelQueue.Empty() && levelQueue.FrontKey() == currentLevel );
+
+    while( !distanceQueue.Empty() )
+      {
+      const float currentDistance = distanceQueue.FrontKey();
+      const PlateauElementType current = distanceQueue.FrontValue();
+      distanceQueue.Pop();
+
+      const OffsetValueType p = current.Pixel;
+      if( status[p] )
+        {
+        // already flooded from a closer pixel
+        continue;
+        }
+      status[p] = true;
+      sources[p] = current.Source;
+      flooded.push_back( p );
+      progress.CompletedPixel();
+      if( m_MarkWatershedLine )
+        {
+        // the pixel is on the watershed line if another basin is in its
+        // neighborhood
+        bool collision = false;
+        for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+          {
+          const LabelImagePixelType & o = outputBuffer[ p + neighborhood.GetLinearOffset( i ) ];
+          if( o != wsLabel && o != current.Label )
+            {
+            collision = true;
+            break;
+            }
+          }
+        if( collision )
+          { continue; }
+        }
+      outputBuffer[p] = current.Label;
+
+      // propagate to the neighbors not yet flooded. The higher ones are
+      // reached from the lower border of their plateau.
+      element.Label = current.Label;
+      neighborhood.ComputePosition( current.Source, sourcePosition );
+      for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+        if ( status[q] )
+          { continue; }
+        element.Pixel = q;
+        if ( inputBuffer[q] > currentLevel )
+          {
+          element.Source = p;
+          element.Distance = weights[i];
+          levelQueue.Push( inputBuffer[q], element );
+          continue;
+          }
+
+        // the step from q toward the source, along the dimensions where the
+        // segment moves by at least half the largest move
+        neighborhood.ComputePosition( q, position );
+        OffsetValueType largest = 0;
+        for( unsigned int d=0; d<ImageDimension; d++ )
+          {
+          position[d] = sourcePosition[d] - position[d];
+          largest = std::max( largest, position[d] < 0 ? -position[d] : position[d] );
+          }
+        double length = 0;
+        for( unsigned int d=0; d<ImageDimension; d++ )
+          {
+          step[d] = 0;
+          if( 2 * position[d] >= largest )
+            { step[d] = 1; }
+          else if( -2 * position[d] >= largest )
+            { step[d] = -1; }
+          length += position[d] * position[d] * spacing2[d];
+          }
+        const OffsetValueType r = q + neighborhood.ComputeLinearOffset( step );
+        double distance;
+        if( sources[r] == current.Source )
+          {
+          element.Source = current.Source;
+          distance = distances[current.Source] + sqrt( length );
+          }
+        else
+          {
+          element.Source = p;
+          distance = currentDistance + weights[i];
+          }
+        if ( distance < currentDistance )
+          { distance = currentDistance; }
+        if( distance < distances[q] )
+          {
+          distances[q] = distance;
+          sources[q] = element.Source;
+          element.Distance = distances[q];
+          distanceQueue.Push( distances[q], element );
+          }
+        }
+      }
+
+    // the pixels of the plateau are now on the lower border of the next
+    // plateaus
+    for( typename std::vector< OffsetValueType >::const_iterator it=flooded.begin(); it!=flooded.end(); it++ )
+      {
+      distances[*it] = 0;
+      sources[*it] = *it;
+      }
+    flooded.clear();
+    }
+
+  this->WriteLabels( &outputBuffer[0], neighborhood, wsLabel );
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::ComputeLines( const LabelMapType * labelMap, LineContainerType & lines )
+{
+  const IndexType & startIndex = this->GetOutput()->GetBufferedRegion().GetIndex();
+  const typename LabelImageType::SizeType & size = this->GetOutput()->GetBufferedRegion().GetSize();
+
+  lines.clear();
+  typedef typename LabelMapType::LabelObjectContainerType LabelObjectContainerType;
+  typedef typename LabelObjectType::LineContainerType ObjectLineContainerType;
+  const LabelObjectContainerType & objects = labelMap->GetLabelObjectContainer();
+  for( typename LabelObjectContainerType::const_iterator it=objects.begin(); it!=objects.end(); it++ )
+    {
+    const ObjectLineContainerType & objectLines = it->second->GetLineContainer();
+    for( typename ObjectLineContainerType::const_iterator lIt=objectLines.begin(); lIt!=objectLines.end(); lIt++ )
+      {
+      LineType line;
+      line.Position = lIt->GetIndex() - startIndex;
+      line.Length = lIt->GetLength();
+      line.Label = it->first;
+      bool inside = line.Length > 0 && line.Position[0] + line.Length <= (OffsetValueType)size[0];
+      for( unsigned int d=0; d<ImageDimension; d++ )
+        {
+        inside = inside && line.Position[d] >= 0 && line.Position[d] < (OffsetValueType)size[d];
+        }
+      if( !inside )
+        { itkExceptionMacro( << "The line at " << lIt->GetIndex() << " of the label object " << static_cast<typename NumericTraits<LabelImagePixelType>::PrintType>(line.Label) << " is outside the image." ); }
+      line.Offset = 0;
+      for( int d=ImageDimension-1; d>=0; d-- )
+        {
+        line.Offset = line.Offset * size[d] + line.Position[d];
+        }
+      lines.push_back( line );
+      }
+    }
+  // the lines are visited in the raster order, like the pixels of an
+  // image, so the queue is filled in the same order
+  std::sort( lines.begin(), lines.end() );
+}
+
+
+template<class TInputImage, class TLabelImage>
+unsigned long
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::ComputeMaskLines()
+{
+  const LabelImageRegionType & region = this->GetOutput()->GetBufferedRegion();
+  const typename LabelImageType::SizeType & size = region.GetSize();
+  const OffsetValueType nbOfPixels = region.GetNumberOfPixels();
+  LineContainerType & maskLines = m_Workspace.MaskLines;
+  maskLines.clear();
+
+  const LabelImageType * maskImage = this->GetMaskImage();
+  const LabelMapType * maskLabelMap = this->GetMaskLabelMap();
+  if( !maskImage && !maskLabelMap )
+    {
+    // the whole image is flooded. The line goes from one row to the next
+    // one, so it must be visited with LinearNeighborhood::Next().
+    LineType line;
+    line.Offset = 0;
+    line.Position.Fill( 0 );
+    line.Length = nbOfPixels;
+    line.Label = m_BackgroundValue;
+    maskLines.push_back( line );
+    m_FloodRegion = region;
+    return nbOfPixels;
+    }
+
+  if( maskLabelMap )
+    {
+    this->ComputeLines( maskLabelMap, maskLines );
+    }
+  else
+    {
+    // the runs of pixels different from zero along the first dimension
+    const LabelImagePixelType * maskBuffer = maskImage->GetBufferPointer();
+    const LabelImagePixelType zero = NumericTraits< LabelImagePixelType >::Zero;
+    const OffsetValueType rowSize = size[0];
+    LineType line;
+    line.Label = m_BackgroundValue;
+    line.Position.Fill( 0 );
+    for( OffsetValueType r=0; r<nbOfPixels; r+=rowSize )
+      {
+      const LabelImagePixelType * row = maskBuffer + r;
+      OffsetValueType x = 0;
+      while( x < rowSize )
+        {
+        if( row[x] == zero )
+          {
+          x++;
+          continue;
+          }
+        line.Position[0] = x;
+        line.Offset = r + x;
+        while( x < rowSize && row[x] != zero )
+          { x++; }
+        line.Length = r + x - line.Offset;
+        maskLines.push_back( line );
+        }
+      // the position of the next row
+      for( unsigned int d=1; d<ImageDimension; d++ )
+        {
+        line.Position[d]++;
+        if( line.Position[d] < (OffsetValueType)size[d] )
+          { break; }
+        line.Position[d] = 0;
+        }
+      }
+    }
+
+  // the bounding box of the lines. The positions of the lines are then
+  // moved in the bounding box, which is the region flooded.
+  unsigned long nbOfMaskPixels = 0;
+  OffsetType minPosition;
+  OffsetType maxPosition;
+  for( unsigned int d=0; d<ImageDimension; d++ )
+    {
+    minPosition[d] = size[d];
+    maxPosition[d] = -1;
+    }
+  for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+    {
+    for( unsigned int d=0; d<ImageDimension; d++ )
+      {
+      minPosition[d] = std::min( minPosition[d], lIt->Position[d] );
+      maxPosition[d] = std::max( maxPosition[d], lIt->Position[d] );
+      }
+    maxPosition[0] = std::max( maxPosition[0], lIt->Position[0] + lIt->Length - 1 );
+    nbOfMaskPixels += lIt->Length;
+    }
+  if( nbOfMaskPixels == 0 )
+    {
+    m_FloodRegion = LabelImageRegionType();
+    return 0;
+    }
+  for( typename LineContainerType::iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+    {
+    lIt->Position = lIt->Position - minPosition;
+    }
+  typename LabelImageType::SizeType floodSize;
+  for( unsigned int d=0; d<ImageDimension; d++ )
+    {
+    floodSize[d] = maxPosition[d] - minPosition[d] + 1;
+    }
+  m_FloodRegion.SetIndex( region.GetIndex() + minPosition );
+  m_FloodRegion.SetSize( floodSize );
+  return nbOfMaskPixels;
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::ClipMarkerLines()
+{
+  // both containers are sorted in the raster order, and the lines of the
+  // mask never go from one row to the next one, so the parts of the marker
+  // lines in the mask are found with a single scan of both containers
+  const LineContainerType & maskLines = m_Workspace.MaskLines;
+  const LineContainerType & markerLines = m_Workspace.MarkerLines;
+  LineContainerType clippedLines;
+  typename LineContainerType::const_iterator mIt = markerLines.begin();
+  typename LineContainerType::const_iterator kIt = maskLines.begin();
+  while( mIt != markerLines.end() && kIt != maskLines.end() )
+    {
+    const OffsetValueType begin = std::max( mIt->Offset, kIt->Offset );
+    const OffsetValueType markerEnd = mIt->Offset + mIt->Length;
+    const OffsetValueType maskEnd = kIt->Offset + kIt->Length;
+    const OffsetValueType end = std::min( markerEnd, maskEnd );
+    if( begin < end )
+      {
+      // the position is the one in the bounding box of the mask
+      LineType line;
+      line.Offset = begin;
+      line.Position = kIt->Position;
+      line.Position[0] += begin - kIt->Offset;
+      line.Length = end - begin;
+      line.Label = mIt->Label;
+      clippedLines.push_back( line );
+      }
+    if( markerEnd < maskEnd )
+      { mIt++; }
+    else
+      { kIt++; }
+    }
+  m_Workspace.MarkerLines.swap( clippedLines );
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::RasterizeMarkerLabelMap( LabelImagePixelType bgLabel )
+{
+  // the marker image shares the buffer of the output - the floodings
+  // support that case. The lines are sorted in the raster order, so the
+  // background is only written between them, and each pixel of the output
+  // is written once.
+  LabelImageType * output = this->GetOutput();
+  this->ComputeLines( this->GetMarkerLabelMap(), m_Workspace.MarkerLines );
+  const LineContainerType & markerLines = m_Workspace.MarkerLines;
+  LabelImagePixelType * outputBuffer = output->GetBufferPointer();
+  const OffsetValueType nbOfPixels = output->GetBufferedRegion().GetNumberOfPixels();
+  OffsetValueType end = 0;
+  for( typename LineContainerType::const_iterator lIt=markerLines.begin(); lIt!=markerLines.end(); lIt++ )
+    {
+    if( lIt->Offset > end )
+      {
+      std::fill( outputBuffer + end, outputBuffer + lIt->Offset, bgLabel );
+      }
+    std::fill( outputBuffer + lIt->Offset, outputBuffer + lIt->Offset + lIt->Length, lIt->Label );
+    end = std::max( end, lIt->Offset + lIt->Length );
+    }
+  std::fill( outputBuffer + end, outputBuffer + nbOfPixels, bgLabel );
+
+  m_MarkerImage = LabelImageType::New();
+  m_MarkerImage->CopyInformation( output );
+  m_MarkerImage->SetRegions( output->GetBufferedRegion() );
+  m_MarkerImage->SetPixelContainer( output->GetPixelContainer() );
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::WriteLabels( const LabelImagePixelType * buffer,
+               const LinearNeighborhoodType & neighborhood,
+               LabelImagePixelType wsLabel )
+{
+  LabelImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+  const bool copy = buffer != outputBuffer;
+  if( !copy && !m_ComputeLabelMap )
+    { return; }
+
+  // only the lines of the mask are written; the other pixels are not
+  // flooded, and are set to the watershed label between the lines, so each
+  // pixel of the output is written once. Without mask, there is a single
+  // line for the whole image.
+  const bool masked = this->ProcessObject::GetInput(2) != NULL;
+  const OffsetValueType nbOfPixels = this->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
+  OffsetValueType end = 0;
+  const LineContainerType & maskLines = m_Workspace.MaskLines;
+  const IndexType & startIndex = m_FloodRegion.GetIndex();
+  LabelMapType * labelMap = m_LabelMap;
+
+  // the runs are the pixels with the same label along the first dimension.
+  // A run is added to the label map when the label changes, at the
+  // beginning of a row or of a line of the mask, and at the end.
+  OffsetType position;
+  OffsetType runStart;
+  runStart.Fill( 0 );
+  LabelImagePixelType runLabel = wsLabel;
+  unsigned long runLength = 0;
+  for( typename LineContainerType::const_iterator lIt=maskLines.begin(); lIt!=maskLines.end(); lIt++ )
+    {
+    if( masked && lIt->Offset > end )
+      {
+      std::fill( outputBuffer + end, outputBuffer + lIt->Offset, wsLabel );
+      }
+    end = std::max( end, lIt->Offset + lIt->Length );
+    position = lIt->Position;
+    OffsetValueType p = neighborhood.GetFirstOffset() + neighborhood.ComputeLinearOffset( position );
+    LabelImagePixelType * outputLine = outputBuffer + lIt->Offset;
+    for ( OffsetValueType u=0; u<lIt->Length; u++, p=neighborhood.Next( p, position ) )
+      {
+      const LabelImagePixelType label = buffer[p];
+      if( copy )
+        {
+        outputLine[u] = label;
+        }
+      if( m_ComputeLabelMap )
+        {
+        if( label != runLabel || u == 0 || position[0] == 0 )
+          {
+          if( runLabel != wsLabel )
+            {
+            labelMap->SetLine( startIndex + runStart, runLength, runLabel );
+            }
+          runStart = position;
+          runLabel = label;
+          runLength = 0;
+          }
+        runLength++;
+        }
+      }
+    }
+  if( masked )
+    {
+    std::fill( outputBuffer + end, outputBuffer + nbOfPixels, wsLabel );
+    }
+  if( m_ComputeLabelMap && runLabel != wsLabel )
+    {
+    labelMap->SetLine( startIndex + runStart, runLength, runLabel );
+    }
+}
+
+
+template<class TInputImage, class TLabelImage>
+ITK_THREAD_RETURN_TYPE
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::BatchScanThreaderCallback( void * arg )
+{
+  MultiThreader::ThreadInfoStruct * info = static_cast< MultiThreader::ThreadInfoStruct * >( arg );
+  const int threadId = info->ThreadID;
+  const int threadCount = info->NumberOfThreads;
+  const BatchScanStruct * str = static_cast< BatchScanStruct * >( info->UserData );
+
+  // each thread takes a contiguous part of the batch, so the results of the
+  // threads can be applied one after the other in the order of the batch
+  const std::vector< OffsetValueType > & batch = *str->Batch;
+  const unsigned long begin = batch.size() * threadId / threadCount;
+  const unsigned long end = batch.size() * ( threadId + 1 ) / threadCount;
+
+  BatchScanResult & result = (*str->Results)[threadId];
+  result.Neighbors.clear();
+  result.NumberOfNeighbors.clear();
+  result.Markers.clear();
+  result.Collisions.clear();
+
+  const LinearNeighborhoodType & neighborhood = *str->Neighborhood;
+  const unsigned int nbOfNeighbors = neighborhood.GetNumberOfNeighbors();
+  const LabelImagePixelType * outputBuffer = str->OutputBuffer;
+  // the status is only used with the watershed line
+  const StatusType * status = str->Status;
+  const LabelImagePixelType wsLabel = str->WatershedLabel;
+  OffsetType position;
+
+  for( unsigned long b=begin; b<end; b++ )
+    {
+    const OffsetValueType p = batch[b];
+    const bool onBorder = neighborhood.IsOnBorder( p, position );
+
+    if( str->MarkWatershedLine )
+      {
+      // the labels already set in the neighborhood, and the unlabeled
+      // neighbors already in the queue: only them can be labeled by the
+      // previous pixels of the batch
+      LabelImagePixelType marker = wsLabel;
+      bool collision = false;
+      unsigned int nbOfLabelNeighbors = 0;
+      for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+        LabelImagePixelType o = outputBuffer[q];
+        if( o != wsLabel )
+          {
+          if( marker != wsLabel && o != marker )
+            {
+            collision = true;
+            break;
+            }
+          else
+            { marker = o; }
+          }
+        else if( (*status)[q] )
+          {
+          result.Neighbors.push_back( q );
+          nbOfLabelNeighbors++;
+          }
+        }
+
+      unsigned int nbOfPushNeighbors = 0;
+      if( collision )
+        {
+        // the pixel is on the watershed line - nothing more to do with it
+        result.Neighbors.resize( result.Neighbors.size() - nbOfLabelNeighbors );
+        nbOfLabelNeighbors = 0;
+        }
+      else
+        {
+        // the neighbors which may be added to the queue. The status of the
+        // other ones can't change during the batch.
+        for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+          {
+          if( onBorder && !neighborhood.IsInside( position, i ) )
+            { continue; }
+          const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+          if ( !(*status)[q] )
+            {
+            result.Neighbors.push_back( q );
+            nbOfPushNeighbors++;
+            }
+          }
+        }
+      result.NumberOfNeighbors.push_back( nbOfLabelNeighbors );
+      result.NumberOfNeighbors.push_back( nbOfPushNeighbors );
+      result.Markers.push_back( marker );
+      result.Collisions.push_back( collision );
+      }
+    else
+      {
+      // the unlabeled neighbors. The labeled ones can't change.
+      unsigned int nbOfLabelNeighbors = 0;
+      for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+        if ( outputBuffer[q] == wsLabel )
+          {
+          result.Neighbors.push_back( q );
+          nbOfLabelNeighbors++;
+          }
+        }
+      result.NumberOfNeighbors.push_back( nbOfLabelNeighbors );
+      }
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+template<class TInputImage, class TLabelImage>
+bool
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::IncrementalFlood( const LinearNeighborhoodType & neighborhood,
+                    const LabelImageRegionType & editRegion,
+                    LabelImagePixelType bgLabel, LabelImagePixelType wsLabel )
+{
+  const LabelImageType * markerImage = m_MarkerImage;
+  const InputImagePixelType * inputBuffer = &m_Workspace.PaddedInput[0];
+  LabelImagePixelType * labels = &m_Workspace.PaddedLabels[0];
+  std::vector< InputImagePixelType > & levels = m_Workspace.Levels;
+  StatusType & extracted = m_Workspace.Extracted;
+  std::vector< OffsetValueType > & parents = m_Workspace.Parents;
+  StatusType & inRegion = m_Workspace.InRegion;
+  std::vector< LabelImagePixelType > & markers = m_Workspace.Markers;
+  const unsigned int nbOfNeighbors = neighborhood.GetNumberOfNeighbors();
+  const OffsetValueType nbOfPixels = markers.size();
+
+  // the markers are not padded. The offsets in the marker buffer are
+  // computed with a neighborhood without padding.
+  LinearNeighborhoodType markerNeighborhood;
+  markerNeighborhood.Initialize( neighborhood.GetSize(), m_Connectivity->GetNeighbors() );
+  OffsetType position;
+
+  // find the edited marker pixels, and keep the new markers
+  std::vector< OffsetValueType > & region = m_Workspace.IncrementalRegion;
+  region.clear();
+  const LabelImageRegionType & bufferedRegion = markerImage->GetBufferedRegion();
+  LabelImageRegionType compareRegion = bufferedRegion;
+  bool compare = true;
+  if( editRegion.GetNumberOfPixels() != 0 )
+    {
+    compareRegion = editRegion;
+    compare = compareRegion.Crop( bufferedRegion );
+    }
+  if( compare )
+    {
+    ImageRegionConstIteratorWithIndex< LabelImageType > markerIt( markerImage, compareRegion );
+    for ( markerIt.GoToBegin(); !markerIt.IsAtEnd(); ++markerIt )
+      {
+      position = markerIt.GetIndex() - bufferedRegion.GetIndex();
+      LabelImagePixelType & marker = markers[ markerNeighborhood.ComputeLinearOffset( position ) ];
+      if( marker != markerIt.Get() )
+        {
+        marker = markerIt.Get();
+        for( unsigned int d=0; d<ImageDimension; d++ )
+          {
+          position[d]++;
+          }
+        const OffsetValueType p = neighborhood.ComputeLinearOffset( position );
+        if( !inRegion[p] )
+          {
+          this->AddToIncrementalRegion( p, neighborhood, region );
+          }
+        }
+      }
+    }
+
+  // the basins of the edited pixels are flooded again with their neighbors,
+  // which are the ones which can take the place of a removed marker
+  const unsigned long nbOfEditedPixels = region.size();
+  for( unsigned long k=0; k<nbOfEditedPixels; k++ )
+    {
+    const OffsetValueType p = region[k];
+    for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+      {
+      const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+      if( !inRegion[q] && !neighborhood.IsInPadding( q ) )
+        {
+        this->AddToIncrementalRegion( q, neighborhood, region );
+        }
+      }
+    }
+
+  // flood the region, and check that the order of the flooding on both
+  // sides of its border is the same than in a full flooding. If not, the
+  // region is grown and flooded again.
+  HierarchicalQueueType & fah = m_HierarchicalQueue;
+  std::vector< OffsetValueType > seeds;
+  std::vector< OffsetValueType > grow;
+  bool done = region.empty();
+  while( !done && (OffsetValueType)region.size() <= nbOfPixels / 2 )
+    {
+    // the marker pixels of the region are put in the queue in the raster
+    // order, like in the first stage of the full flooding
+    seeds.clear();
+    for( unsigned long k=0; k<region.size(); k++ )
+      {
+      const OffsetValueType p = region[k];
+      neighborhood.ComputePosition( p, position );
+      for( unsigned int d=0; d<ImageDimension; d++ )
+        {
+        position[d]--;
+        }
+      const LabelImagePixelType & marker = markers[ markerNeighborhood.ComputeLinearOffset( position ) ];
+      labels[p] = marker;
+      extracted[p] = false;
+      if( marker != bgLabel )
+        {
+        parents[p] = p;
+        seeds.push_back( p );
+        }
+      }
+    std::sort( seeds.begin(), seeds.end() );
+
+    fah.Clear();
+    for( unsigned long k=0; k<seeds.size(); k++ )
+      {
+      const OffsetValueType p = seeds[k];
+      neighborhood.ComputePosition( p, position );
+      for( unsigned int d=0; d<ImageDimension; d++ )
+        {
+        position[d]--;
+        }
+      const OffsetValueType u = markerNeighborhood.ComputeLinearOffset( position );
+      const bool onBorder = markerNeighborhood.IsOnBorder( position );
+      for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !markerNeighborhood.IsInside( position, i ) )
+          { continue; }
+        if( markers[ u + markerNeighborhood.GetLinearOffset( i ) ] == bgLabel )
+          {
+          fah.Push( inputBuffer[p], p );
+          break;
+          }
+        }
+      }
+
+    // Beucher's algorithm, restricted to the region
+    while( !fah.Empty() )
+      {
+      const InputImagePixelType currentValue = fah.FrontKey();
+      const OffsetValueType p = fah.FrontValue();
+      fah.Pop();
+      levels[p] = currentValue;
+      extracted[p] = true;
+      for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+        if ( inRegion[q] && labels[q] == wsLabel )
+          {
+          labels[q] = labels[p];
+          parents[q] = p;
+          const InputImagePixelType & grayVal = inputBuffer[q];
+          if ( grayVal <= currentValue )
+            { fah.Push( currentValue, q ); }
+          else
+            { fah.Push( grayVal, q ); }
+          }
+        }
+      }
+
+    // in a full flooding, a pixel is labeled by its first neighbor taken
+    // from the queue. For each pair of neighbors on both sides of the
+    // border of the region, the pixel outside the region must not be taken
+    // from the queue before the pixel which has labeled the one inside, and
+    // conversely; otherwise, the region is grown with the basin on the
+    // other side.
+    grow.clear();
+    for( unsigned long k=0; k<region.size(); k++ )
+      {
+      const OffsetValueType p = region[k];
+      for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        const OffsetValueType q = p + neighborhood.GetLinearOffset( i );
+        if( inRegion[q] || neighborhood.IsInPadding( q ) )
+          { continue; }
+        if( labels[p] == wsLabel )
+          {
+          // not reached from the markers of the region
+          grow.push_back( q );
+          break;
+          }
+        // q must not take p
+        if( parents[p] != p && extracted[q] && this->IsExtractedBefore( q, parents[p], neighborhood ) )
+          {
+          grow.push_back( q );
+          continue;
+          }
+        // p must not take q. The markers are their own parent.
+        if( extracted[p] && ( labels[q] == wsLabel
+                              || ( parents[q] != q
+                                   && ( inRegion[ parents[q] ] || this->IsExtractedBefore( p, parents[q], neighborhood ) ) ) ) )
+          {
+          grow.push_back( q );
+          }
+        }
+      }
+    done = grow.empty();
+    for( unsigned long k=0; k<grow.size(); k++ )
+      {
+      if( !inRegion[ grow[k] ] )
+        {
+        this->AddToIncrementalRegion( grow[k], neighborhood, region );
+        }
+      }
+    }
+
+  for( unsigned long k=0; k<region.size(); k++ )
+    {
+    inRegion[ region[k] ] = false;
+    }
+  if( !done )
+    {
+    // the region is too large: the whole image is flooded again
+    return false;
+    }
+  m_NumberOfFloodedPixels = region.size();
+  return true;
+}
+
+
+template<class TInputImage, class TLabelImage>
+bool
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::IsExtractedBefore( OffsetValueType a, OffsetValueType b,
+                     const LinearNeighborhoodType & neighborhood ) const
+{
+  // without watershed line, the queue is a FIFO for each level. At a
+  // level, the pixels are taken from the queue in the order of their
+  // number of steps from a pixel of a lower level or from a marker - a
+  // pixel pushed by a pixel of the same level comes after it - then in the
+  // order of the pixels which have labeled them, and of the neighbors for
+  // the pixels labeled by the same pixel. The markers come before the
+  // other pixels of their level, in the raster order.
+  const std::vector< InputImagePixelType > & levels = m_Workspace.Levels;
+  const std::vector< OffsetValueType > & parents = m_Workspace.Parents;
+  for(;;)
+    {
+    if( levels[a] != levels[b] )
+      { return levels[a] < levels[b]; }
+
+    // go up the two paths on the level, one step at a time, to compare
+    // their lengths
+    const InputImagePixelType level = levels[a];
+    OffsetValueType childA = a;
+    OffsetValueType childB = b;
+    for(;;)
+      {
+      const bool firstA = parents[a] == a || levels[ parents[a] ] != level;
+      const bool firstB = parents[b] == b || levels[ parents[b] ] != level;
+      if( firstA != firstB )
+        { return firstA; }
+      if( firstA )
+        { break; }
+      childA = a;
+      childB = b;
+      a = parents[a];
+      b = parents[b];
+      if( a == b )
+        { return this->GetNeighborIndex( a, childA, neighborhood ) < this->GetNeighborIndex( a, childB, neighborhood ); }
+      }
+
+    // the paths have the same length: compare their first pixels
+    const bool markerA = parents[a] == a;
+    const bool markerB = parents[b] == b;
+    if( markerA || markerB )
+      {
+      if( markerA && markerB )
+        { return a < b; }
+      return markerA;
+      }
+    if( parents[a] == parents[b] )
+      { return this->GetNeighborIndex( parents[a], a, neighborhood ) < this->GetNeighborIndex( parents[a], b, neighborhood ); }
+    a = parents[a];
+    b = parents[b];
+    }
+}
+
+
+template<class TInputImage, class TLabelImage>
+unsigned int
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::GetNeighborIndex( OffsetValueType p, OffsetValueType q,
+                    const LinearNeighborhoodType & neighborhood ) const
+{
+  unsigned int i = 0;
+  while( p + neighborhood.GetLinearOffset( i ) != q )
+    {
+    i++;
+    }
+  return i;
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::WriteIncrementalLabels( const LinearNeighborhoodType & neighborhood )
+{
+  // the region is in the padded buffer: the position of a pixel in the
+  // output is its padded position minus one in each dimension
+  const LabelImagePixelType * labels = &m_Workspace.PaddedLabels[0];
+  const std::vector< OffsetValueType > & region = m_Workspace.IncrementalRegion;
+  LabelImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+  LinearNeighborhoodType outputNeighborhood;
+  outputNeighborhood.Initialize( m_FloodRegion.GetSize(), m_Connectivity->GetNeighbors() );
+  OffsetType position;
+  for( unsigned long k=0; k<region.size(); k++ )
+    {
+    const OffsetValueType p = region[k];
+    neighborhood.ComputePosition( p, position );
+    for( unsigned int d=0; d<ImageDimension; d++ )
+      {
+      position[d]--;
+      }
+    outputBuffer[ outputNeighborhood.ComputeLinearOffset( position ) ] = labels[p];
+    }
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::AddToIncrementalRegion( OffsetValueType p, const LinearNeighborhoodType & neighborhood,
+                          std::vector< OffsetValueType > & region )
+{
+  // the pixels connected to p with the same label. The other pixels of the
+  // region have already been relabeled, so they are not used.
+  const LabelImagePixelType * labels = &m_Workspace.PaddedLabels[0];
+  StatusType & inRegion = m_Workspace.InRegion;
+  const LabelImagePixelType label = labels[p];
+  unsigned long k = region.size();
+  region.push_back( p );
+  inRegion[p] = true;
+  for( ; k<region.size(); k++ )
+    {
+    const OffsetValueType r = region[k];
+    for ( unsigned int i=0; i<neighborhood.GetNumberOfNeighbors(); i++ )
+      {
+      const OffsetValueType q = r + neighborhood.GetLinearOffset( i );
+      if( !inRegion[q] && labels[q] == label && !neighborhood.IsInPadding( q ) )
+        {
+        region.push_back( q );
+        inRegion[q] = true;
+        }
+      }
+    }
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::AddContact( LabelImagePixelType label1, LabelImagePixelType label2,
+              const InputImagePixelType & pass, unsigned long contacts )
+{
+  if( label2 < label1 )
+    {
+    std::swap( label1, label2 );
+    }
+  const LabelPairType pair( label1, label2 );
+  typename AdjacencyGraphType::iterator it = m_AdjacencyGraph.find( pair );
+  if( it == m_AdjacencyGraph.end() )
+    {
+    AdjacencyType & adjacency = m_AdjacencyGraph[ pair ];
+    adjacency.ContactSize = contacts;
+    adjacency.Pass = pass;
+    }
+  else
+    {
+    it->second.ContactSize += contacts;
+    if( pass < it->second.Pass )
+      {
+      it->second.Pass = pass;
+      }
+    }
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::AddCollision( OffsetValueType p, const InputImagePixelType & level,
+                const LinearNeighborhoodType & neighborhood,
+                const LabelImagePixelType * outputBuffer,
+                LabelImagePixelType wsLabel )
+{
+  // the distinct labels in the neighborhood. There are only a few of them,
+  // so a small vector is enough.
+  std::vector< LabelImagePixelType > & labels = m_Workspace.CollisionLabels;
+  labels.clear();
+  OffsetType position;
+  const bool onBorder = neighborhood.IsOnBorder( p, position );
+  for ( unsigned int i=0; i<neighborhood.GetNumberOfNeighbors(); i++ )
+    {
+    if( onBorder && !neighborhood.IsInside( position, i ) )
+      { continue; }
+    const LabelImagePixelType & o = outputBuffer[ p + neighborhood.GetLinearOffset( i ) ];
+    if( o != wsLabel && std::find( labels.begin(), labels.end(), o ) == labels.end() )
+      {
+      labels.push_back( o );
+      }
+    }
+  for( unsigned int i=0; i<labels.size(); i++ )
+    {
+    for( unsigned int j=i+1; j<labels.size(); j++ )
+      {
+      this->AddContact( labels[i], labels[j], level, 1 );
+      }
+    }
+  m_Workspace.Collisions[p] = true;
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::AddLineContacts( OffsetValueType p, const InputImagePixelType & level,
+                   const LinearNeighborhoodType & neighborhood,
+                   const LabelImagePixelType * outputBuffer,
+                   LabelImagePixelType wsLabel )
+{
+  // the basin of p reaches the watershed pixels already found around it.
+  // When no other neighbor of such a pixel is in that basin, it meets the
+  // basins already around that pixel at the current level.
+  const StatusType & collisions = m_Workspace.Collisions;
+  const LabelImagePixelType label = outputBuffer[p];
+  std::vector< LabelImagePixelType > & labels = m_Workspace.CollisionLabels;
+  const unsigned int nbOfNeighbors = neighborhood.GetNumberOfNeighbors();
+  OffsetType position;
+  OffsetType wPosition;
+  const bool onBorder = neighborhood.IsOnBorder( p, position );
+  for ( unsigned int i=0; i<nbOfNeighbors; i++ )
+    {
+    if( onBorder && !neighborhood.IsInside( position, i ) )
+      { continue; }
+    const OffsetValueType w = p + neighborhood.GetLinearOffset( i );
+    if( !collisions[w] )
+      { continue; }
+    labels.clear();
+    bool found = false;
+    const bool wOnBorder = neighborhood.IsOnBorder( w, wPosition );
+    for ( unsigned int j=0; j<nbOfNeighbors && !found; j++ )
+      {
+      if( wOnBorder && !neighborhood.IsInside( wPosition, j ) )
+        { continue; }
+      const OffsetValueType q = w + neighborhood.GetLinearOffset( j );
+      const LabelImagePixelType & o = outputBuffer[q];
+      if( q == p || o == wsLabel )
+        { continue; }
+      if( o == label )
+        { found = true; }
+      else if( std::find( labels.begin(), labels.end(), o ) == labels.end() )
+        { labels.push_back( o ); }
+      }
+    for( unsigned int j=0; j<labels.size() && !found; j++ )
+      {
+      this->AddContact( label, labels[j], level, 1 );
+      }
+    }
+}
+
+
+template<class TInputImage, class TLabelImage>
+void
+MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
+::ReleaseWorkspace()
+{
+  // swap with empty containers to really give the memory back
+  std::vector< InputImagePixelType >().swap( m_Workspace.PaddedInput );
+  std::vector< LabelImagePixelType >().swap( m_Workspace.PaddedLabels );
+  StatusType().swap( m_Workspace.Status );
+  std::vector< OffsetValueType >().swap( m_Workspace.Batch );
+  std::vector< BatchScanResult >().swap( m_Workspace.Results );
+  std::vector< LabelImagePixelType >().swap( m_Workspace.CollisionLabels );
+  StatusType().swap( m_Workspace.Collisions );
+  std::vector< InputImagePixelType >().swap( m_Workspace.Levels );
+  StatusType().swap( m_Workspace.Extracted );
+  std::vector< OffsetValueType >().swap( m_Workspace.Parents );
+  StatusType().swap( m_Workspace.InRegion );
+  std::vector< OffsetValueType >().swap( m_Workspace.IncrementalRegion );
+  std::vector< LabelImagePixelType >().swap( m_Workspace.Markers );
+  LineContainerType().swap( m_Workspace.MarkerLines );
+  LineContainerType().swap( m_Workspace.MaskLines );
+  std::vector< float >().swap( m_Workspace.PlateauDistances );
+  std::vector< OffsetValueType >().swap( m_Workspace.PlateauSources );
+  // the queues can't be swapped, but can free their chunks
+  m_Workspace.CompactQueue.ReleaseMemory();
+  m_Workspace.PlateauLevelQueue.ReleaseMemory();
+  m_Workspace.PlateauDistanceQueue.ReleaseMemory();
+  m_HierarchicalQueue.ReleaseMemory();
+  m_Workspace.IncrementalValid = false;
+  m_Workspace.OutputBuffer = NULL;
+}
+
 
 template<class TInputImage, class TLabelImage>
 void
@@ -592,6 +2263,16 @@ MorphologicalWatershedFromMarkersImageFilter<TInputImage, TLabelImage>
   m_Connectivity->Print( os, indent );
   os << indent << "MarkWatershedLine: "  << m_MarkWatershedLine << std::endl;
   os << indent << "UseImageSpacing: "  << m_UseImageSpacing << std::endl;
+  os << indent << "PadImageBoundary: "  << m_PadImageBoundary << std::endl;
+  os << indent << "MinimumParallelBatchSize: "  << m_MinimumParallelBatchSize << std::endl;
+  os << indent << "MinimumParallelNumberOfThreads: "  << m_MinimumParallelNumberOfThreads << std::endl;
+  os << indent << "ComputeAdjacencyGraph: "  << m_ComputeAdjacencyGraph << std::endl;
+  os << indent << "IncrementalFlooding: "  << m_IncrementalFlooding << std::endl;
+  os << indent << "MarkerEditRegion: "  << m_MarkerEditRegion << std::endl;
+  os << indent << "NumberOfFloodedPixels: "  << m_NumberOfFloodedPixels << std::endl;
+  os << indent << "Compactness: "  << m_Compactness << std::endl;
+  os << indent << "GeodesicPlateaus: "  << m_GeodesicPlateaus << std::endl;
+  os << indent << "ComputeLabelMap: "  << m_ComputeLabelMap << std::endl;
   os << indent << "BackgroundValue: "  << static_cast<typename NumericTraits<LabelImagePixelType>::PrintType>(m_BackgroundValue) << std::endl;
 }
   
@@ -18,6 +18,13 @@
 #define __itkMorphologicalWatershedImageFilter_h
 
 #include "itkImageToImageFilter.h"
+#include "itkConnectivity.h"
+#include "itkLinearNeighborhood.h"
+#include "itkWatershedMergeTree.h"
+#include "itkCommand.h"
+#include "itkLabelMap.h"
+#include "itkLabelObject.h"
+#include <vector>
 
 namespace itk {
 
@@ -35,6 +42,29 @@ namespace itk {
  * labels such that object labels are consecutive and sorted based on object
  * size by passing the output of this filter to a RelabelComponentImageFilter.
  *
+ * The regional minima are found and labeled directly in the output
+ * image, in the same order than ConnectedComponentImageFilter would do,
+ * and then used as markers by MorphologicalWatershedFromMarkersImageFilter
+ * in the same buffer. When Level is not 0, the markers are the regional
+ * minima of the h-minima transform of the input, but they are found during
+ * the same traversal, without computing that transform. No intermediate
+ * image of the size of the input is allocated: only one bit per pixel, and
+ * a pixel and a value for each regional minimum of the input when Level is
+ * not 0.
+ *
+ * When ComputeMergeTree is on, the watershed is computed with all the
+ * regional minima, and a WatershedMergeTree of the catchment basins is
+ * built. The markers at Level are then taken from the tree, and the image
+ * is flooded again from them, so the output is the same than without the
+ * tree, but the h-minima transform is never computed. The tree is kept by
+ * the filter, so when only the Level is changed, the filter doesn't flood
+ * the image from all the minima again: it only floods it once from the
+ * markers of the new Level. The tree can also be cut directly at several
+ * levels with GetMergeTree(), without flooding the image again, but that
+ * cut only approximates the segmentation at a level.
+ *
+ * With ComputeLabelMap, the basins are also produced as a LabelMap.
+ *
  * The morphological watershed transform algorithm is described in
  * Chapter 9.2 of Pierre Soille's book "Morphological Image Analysis:
  * Principles and Applications", Second Edition, Springer, 2003.
@@ -74,6 +104,12 @@ public:
   itkStaticConstMacro(OutputImageDimension, unsigned int,
                       TOutputImage::ImageDimension);
 
+  typedef WatershedMergeTree< TInputImage, TOutputImage > MergeTreeType;
+
+  /** the label map which can be produced with the output */
+  typedef LabelObject< OutputImagePixelType, InputImageDimension > LabelObjectType;
+  typedef LabelMap< LabelObjectType >                              LabelMapType;
+
   /** Standard New method. */
   itkNewMacro(Self);  
 
@@ -110,6 +146,34 @@ public:
   itkSetMacro(WatershedLabel, OutputImagePixelType);
   itkGetMacro(WatershedLabel, OutputImagePixelType);
 
+  /**
+   * Set/Get whether the merge tree of the catchment basins is computed and
+   * used to produce the output. Default is false.
+   */
+  itkSetMacro(ComputeMergeTree, bool);
+  itkGetConstReferenceMacro(ComputeMergeTree, bool);
+  itkBooleanMacro(ComputeMergeTree);
+
+  /**
+   * Get the merge tree of the catchment basins, computed during the last
+   * update when ComputeMergeTree is on.
+   */
+  itkGetObjectMacro(MergeTree, MergeTreeType);
+
+  /**
+   * Set/Get whether the basins are also produced as a LabelMap, with
+   * WatershedLabel as background. The label map is built by
+   * MorphologicalWatershedFromMarkersImageFilter while it writes the
+   * output. Default is false.
+   */
+  itkSetMacro(ComputeLabelMap, bool);
+  itkGetConstReferenceMacro(ComputeLabelMap, bool);
+  itkBooleanMacro(ComputeLabelMap);
+
+  /** Get the label map produced by the last update when ComputeLabelMap
+   * is on. A new label map is created by each update. */
+  itkGetObjectMacro(LabelMap, LabelMapType);
+
 protected:
   MorphologicalWatershedImageFilter();
   ~MorphologicalWatershedImageFilter() {};
@@ -129,6 +193,23 @@ protected:
   
 
 private:
+  typedef Connectivity< InputImageDimension > ConnectivityType;
+  typedef LinearNeighborhood< InputImageDimension > LinearNeighborhoodType;
+  typedef typename LinearNeighborhoodType::OffsetType OffsetType;
+  typedef typename LinearNeighborhoodType::OffsetValueType OffsetValueType;
+
+  /** label the regional minima of the h-minima transform of the input at
+   * the given level in the output, and set the other pixels to
+   * WatershedLabel. The progress goes from 0 to weight. */
+  void LabelRegionalMinima( const InputImagePixelType & level, float weight );
+
+  /** flood the image from the minima labeled in the output. The progress
+   * goes from initialProgress to initialProgress + weight. */
+  void Flood( float initialProgress, float weight );
+
+  /** forward the progress of the flooding to this filter */
+  void ReportFloodProgress( Object * object, const EventObject & event );
+
   MorphologicalWatershedImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
@@ -140,6 +221,22 @@ private:
 
   InputImagePixelType m_Level;
 
+  bool m_ComputeMergeTree;
+
+  bool m_ComputeLabelMap;
+  typename LabelMapType::Pointer m_LabelMap;
+
+  // the range of the progress of the current flooding
+  float m_FloodInitialProgress;
+  float m_FloodProgressWeight;
+
+  // the tree, and the parameters used to build it, to know if it can be
+  // reused in the next update
+  typename MergeTreeType::Pointer m_MergeTree;
+  bool m_MergeTreeFullyConnected;
+  bool m_MergeTreeMarkWatershedLine;
+  OutputImagePixelType m_MergeTreeWatershedLabel;
+
 } ; // end of class
 
 } // end namespace itk
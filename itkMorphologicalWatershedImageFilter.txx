@@ -18,11 +18,11 @@
 #define __itkMorphologicalWatershedImageFilter_txx
 
 #include "itkMorphologicalWatershedImageFilter.h"
-#include "itkRegionalMinimaImageFilter.h"
-#include "itkHMinimaImageFilter.h"
-#include "itkConnectedComponentImageFilter.h"
 #include "itkMorphologicalWatershedFromMarkersImageFilter.h"
 #include "itkNumericTraits.h"
+#include "itkProgressReporter.h"
+#include <queue>
+#include <algorithm>
 
 namespace itk {
 
@@ -34,6 +34,14 @@ MorphologicalWatershedImageFilter<TInputImage, TOutputImage>
   m_MarkWatershedLine = true;
   m_Level = NumericTraits< InputImagePixelType >::Zero;
   m_WatershedLabel = NumericTraits< OutputImagePixelType >::Zero;
+  m_ComputeMergeTree = false;
+  m_MergeTree = MergeTreeType::New();
+  m_MergeTreeFullyConnected = false;
+  m_MergeTreeMarkWatershedLine = true;
+  m_MergeTreeWatershedLabel = m_WatershedLabel;
+  m_ComputeLabelMap = false;
+  m_FloodInitialProgress = 0.0f;
+  m_FloodProgressWeight = 1.0f;
 }
 
 template <class TInputImage, class TOutputImage>
@@ -67,66 +75,97 @@ void
 MorphologicalWatershedImageFilter<TInputImage, TOutputImage>
 ::GenerateData()
 {
-  // Create a process accumulator for tracking the progress of this minipipeline
-  ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
-  progress->SetMiniPipelineFilter(this);
-
   // Allocate the output
   this->AllocateOutputs();
-  
-  // h-minima filter to remove the smallest minima
-  typedef HMinimaImageFilter<TInputImage, TInputImage> HMinimaType;
-  typename HMinimaType::Pointer hmin;
-
-  // Delegate to a R-Min filter to find the regional minima
-  typedef RegionalMinimaImageFilter<TInputImage, TOutputImage> RMinType;
-  typename RMinType::Pointer rmin = RMinType::New();
-  rmin->SetInput( this->GetInput() );
-  rmin->SetFullyConnected( m_FullyConnected );
-  rmin->SetBackgroundValue( NumericTraits< OutputImagePixelType >::Zero );
-  rmin->SetForegroundValue( NumericTraits< OutputImagePixelType >::max() );
-
-  // label the components
-  typedef ConnectedComponentImageFilter< TOutputImage, TOutputImage > ConnectedCompType;
-  typename ConnectedCompType::Pointer label = ConnectedCompType::New();
-  label->SetFullyConnected( m_FullyConnected );
-  label->SetInput( rmin->GetOutput() );
-  label->SetBackgroundValue( m_WatershedLabel );
+  m_LabelMap = NULL;
+
+  if( m_ComputeMergeTree )
+    {
+    // the tree is built from the basins of all the minima. It is only built
+    // again if the input or the parameters of the flooding have changed
+    // since the last time; otherwise, the image is not flooded again.
+    if( m_MergeTree->GetNumberOfNodes() == 0
+        || this->GetInput()->GetMTime() > m_MergeTree->GetMTime()
+        || m_MergeTreeFullyConnected != m_FullyConnected
+        || m_MergeTreeMarkWatershedLine != m_MarkWatershedLine
+        || m_MergeTreeWatershedLabel != m_WatershedLabel )
+      {
+      this->LabelRegionalMinima( NumericTraits< InputImagePixelType >::Zero, 0.1f );
+      if( m_Level != NumericTraits< InputImagePixelType >::Zero )
+        {
+        this->Flood( 0.1f, 0.45f );
+        }
+      else
+        {
+        this->Flood( 0.1f, 0.9f );
+        }
+
+      typename ConnectivityType::Pointer connectivity = ConnectivityType::New();
+      connectivity->SetFullyConnected( m_FullyConnected );
+      m_MergeTree->Build( this->GetInput(), this->GetOutput(), connectivity, m_WatershedLabel );
+      m_MergeTreeFullyConnected = m_FullyConnected;
+      m_MergeTreeMarkWatershedLine = m_MarkWatershedLine;
+      m_MergeTreeWatershedLabel = m_WatershedLabel;
+
+      // the basins of all the minima are already the output at level 0
+      if( m_Level == NumericTraits< InputImagePixelType >::Zero )
+        {
+        return;
+        }
+      m_MergeTree->ComputeMarkers( m_Level, this->GetOutput() );
+      this->Flood( 0.55f, 0.45f );
+      return;
+      }
+
+    // the markers at Level are the regional minima of the h-minima of
+    // the input, so the image is flooded from them like without the tree
+    m_MergeTree->ComputeMarkers( m_Level, this->GetOutput() );
+    this->Flood( 0.0f, 1.0f );
+    return;
+    }
+
+  // the markers are the regional minima of the input, or of the h-minima
+  // of the input if the smallest minima must be removed
+  this->LabelRegionalMinima( m_Level, 0.1f );
+  this->Flood( 0.1f, 0.9f );
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+MorphologicalWatershedImageFilter<TInputImage, TOutputImage>
+::Flood( float initialProgress, float weight )
+{
+  // the marker image is a new image which use the buffer of the output,
+  // so the labeled minima are not copied and the pipeline doesn't see
+  // the output of this filter as an input of the watershed filter
+  OutputImagePointer markers = OutputImageType::New();
+  markers->CopyInformation( this->GetOutput() );
+  markers->SetRegions( this->GetOutput()->GetBufferedRegion() );
+  markers->SetPixelContainer( this->GetOutput()->GetPixelContainer() );
 
   // the watershed
   typedef MorphologicalWatershedFromMarkersImageFilter< TInputImage, TOutputImage > WatershedType;
   typename WatershedType::Pointer wshed = WatershedType::New();
   wshed->SetInput( this->GetInput() );
-  wshed->SetMarkerImage( label->GetOutput() );
+  wshed->SetMarkerImage( markers );
   wshed->SetFullyConnected( m_FullyConnected );
   wshed->SetMarkWatershedLine( m_MarkWatershedLine );
   wshed->SetBackgroundValue( m_WatershedLabel );
+  // the flooding is done in the output buffer: the padded copies of the
+  // input and of the labels would double the memory used by this filter
+  wshed->SetPadImageBoundary( false );
+  wshed->SetComputeLabelMap( m_ComputeLabelMap );
 
-
-  if( m_Level != NumericTraits< InputImagePixelType >::Zero )
-    {
-    // insert a h-minima filter to remove the smallest minima
-    //
-    hmin = HMinimaType::New();
-    hmin->SetInput( this->GetInput() );
-    hmin->SetHeight( m_Level );
-    hmin->SetFullyConnected( m_FullyConnected );
-    // replace the input of the r-min filter
-    rmin->SetInput( hmin->GetOutput() );
-
-    progress->RegisterInternalFilter(hmin,0.4f);
-    progress->RegisterInternalFilter(rmin,0.1f);
-    progress->RegisterInternalFilter(label,.2f);
-    progress->RegisterInternalFilter(wshed,.3f);
-   }
-  else
-    {
-    // don't insert the h-minima to save some ressources
-    progress->RegisterInternalFilter(rmin,0.167f);
-    progress->RegisterInternalFilter(label,.333f);
-    progress->RegisterInternalFilter(wshed,.5f);
-    }
-
+  // the progress of the flooding follows the one of the markers, so it is
+  // forwarded with an offset: a ProgressAccumulator only sums the progress
+  // of the internal filters
+  m_FloodInitialProgress = initialProgress;
+  m_FloodProgressWeight = weight;
+  typedef MemberCommand< Self > CommandType;
+  typename CommandType::Pointer command = CommandType::New();
+  command->SetCallbackFunction( this, &Self::ReportFloodProgress );
+  wshed->AddObserver( ProgressEvent(), command );
 
   // run the algorithm
   // graft our output to the watershed filter to force the proper regions
@@ -139,6 +178,260 @@ MorphologicalWatershedImageFilter<TInputImage, TOutputImage>
   // output. this is needed to get the appropriate regions passed
   // back.
   this->GraftOutput( wshed->GetOutput() );
+  m_LabelMap = wshed->GetLabelMap();
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+MorphologicalWatershedImageFilter<TInputImage, TOutputImage>
+::ReportFloodProgress( Object * object, const EventObject & )
+{
+  const ProcessObject * wshed = dynamic_cast< const ProcessObject * >( object );
+  this->UpdateProgress( m_FloodInitialProgress + m_FloodProgressWeight * wshed->GetProgress() );
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+MorphologicalWatershedImageFilter<TInputImage, TOutputImage>
+::LabelRegionalMinima( const InputImagePixelType & level, float weight )
+{
+  // the regional minima are the plateaus without any lower neighbor. Each
+  // plateau is visited from its first pixel in the raster order, so the
+  // minima are labeled in the same order than with
+  // ConnectedComponentImageFilter.
+  // The plateau is flooded with a fifo, which only keeps the front of the
+  // flooding, and its pixels are given the provisional label
+  // WatershedLabel in the output. When the plateau is a minimum, it is
+  // flooded a second time to write its label, with the provisional label
+  // used to find the pixels not yet labeled.
+  //
+  // With a level, the regional minimum of the h-minima transform which
+  // comes from a minimum at value v is the connected component of the
+  // pixels lower or equal to v + level which contains it, when that
+  // component has no pixel lower than v. The minima are kept during the
+  // traversal, and the components are flooded from them in the order of
+  // their value. A flooding stops as soon as it reaches a lower pixel or a
+  // pixel flooded from another minimum: the component then contains a
+  // lower pixel, or is the same than the one of a minimum with the same
+  // value. So each pixel is flooded from at most one minimum, and the
+  // components which are not stopped are the markers. They can't touch
+  // each other, so they are labeled in the raster order in a last
+  // traversal, like the regional minima of the h-minima transform would be.
+  typename ConnectivityType::Pointer connectivity = ConnectivityType::New();
+  connectivity->SetFullyConnected( m_FullyConnected );
+
+  const InputImageType * image = this->GetInput();
+  LinearNeighborhoodType neighborhood;
+  neighborhood.Initialize( image->GetBufferedRegion().GetSize(), connectivity->GetNeighbors() );
+  const unsigned int nbOfNeighbors = neighborhood.GetNumberOfNeighbors();
+  const OffsetValueType nbOfPixels = image->GetBufferedRegion().GetNumberOfPixels();
+  OffsetType position;
+
+  const InputImagePixelType * inputBuffer = image->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+
+  const bool hminima = level != NumericTraits< InputImagePixelType >::Zero;
+  ProgressReporter progress( this, 0, hminima ? 2 * nbOfPixels : nbOfPixels, 100, 0.0f, weight );
+
+  std::vector< bool > visited( nbOfPixels, false );
+  std::queue< OffsetValueType > fifo;
+  OutputImagePixelType label = NumericTraits< OutputImagePixelType >::Zero;
+  // the value and the first pixel of the minima, with a level
+  std::vector< std::pair< InputImagePixelType, OffsetValueType > > minima;
+
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    progress.CompletedPixel();
+    if( visited[p] )
+      { continue; }
+
+    // flood the plateau, and look for a lower neighbor
+    const InputImagePixelType value = inputBuffer[p];
+    bool isMinimum = true;
+    fifo.push( p );
+    visited[p] = true;
+    outputBuffer[p] = m_WatershedLabel;
+    while( !fifo.empty() )
+      {
+      const OffsetValueType q = fifo.front();
+      fifo.pop();
+      const bool onBorder = neighborhood.IsOnBorder( q, position );
+      for( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType r = q + neighborhood.GetLinearOffset( i );
+        const InputImagePixelType & v = inputBuffer[r];
+        if( v < value )
+          {
+          isMinimum = false;
+          }
+        else if( v == value && !visited[r] )
+          {
+          visited[r] = true;
+          outputBuffer[r] = m_WatershedLabel;
+          fifo.push( r );
+          }
+        }
+      }
+
+    if( !isMinimum )
+      { continue; }
+
+    if( hminima )
+      {
+      minima.push_back( std::make_pair( value, p ) );
+      continue;
+      }
+
+    do
+      {
+      if( label == NumericTraits< OutputImagePixelType >::max() )
+        { itkExceptionMacro( << "The output pixel type is too small for the number of minima." ); }
+      label++;
+      }
+    while( label == m_WatershedLabel );
+
+    // the pixels of the plateau are the neighbors with the same value: the
+    // ones of the other plateaus with the same value are not connected
+    fifo.push( p );
+    outputBuffer[p] = label;
+    while( !fifo.empty() )
+      {
+      const OffsetValueType q = fifo.front();
+      fifo.pop();
+      const bool onBorder = neighborhood.IsOnBorder( q, position );
+      for( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType r = q + neighborhood.GetLinearOffset( i );
+        if( inputBuffer[r] == value && outputBuffer[r] == m_WatershedLabel )
+          {
+          outputBuffer[r] = label;
+          fifo.push( r );
+          }
+        }
+      }
+    }
+
+  if( !hminima )
+    { return; }
+
+  // flood the components from the minima, in the order of their value. The
+  // pixels of the current flooding have a provisional label, and the ones
+  // of the previous floodings are visited. Once the flooding is done, its
+  // pixels are flooded again to give them the label of the markers, or
+  // WatershedLabel if the flooding has been stopped, so only the front of
+  // the flooding is kept in the fifo.
+  std::sort( minima.begin(), minima.end() );
+  std::fill( visited.begin(), visited.end(), false );
+  OutputImagePixelType markerLabel = NumericTraits< OutputImagePixelType >::max();
+  if( markerLabel == m_WatershedLabel )
+    { markerLabel--; }
+  OutputImagePixelType floodLabel = markerLabel;
+  floodLabel--;
+  if( floodLabel == m_WatershedLabel )
+    { floodLabel--; }
+  for( unsigned long m=0; m<minima.size(); m++ )
+    {
+    const InputImagePixelType & value = minima[m].first;
+    const OffsetValueType p = minima[m].second;
+    if( visited[p] )
+      { continue; }
+    const double top = static_cast< double >( value ) + static_cast< double >( level );
+    bool isMarker = true;
+    fifo.push( p );
+    visited[p] = true;
+    outputBuffer[p] = floodLabel;
+    while( !fifo.empty() && isMarker )
+      {
+      const OffsetValueType q = fifo.front();
+      fifo.pop();
+      const bool onBorder = neighborhood.IsOnBorder( q, position );
+      for( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType r = q + neighborhood.GetLinearOffset( i );
+        const InputImagePixelType & v = inputBuffer[r];
+        if( static_cast< double >( v ) > top || outputBuffer[r] == floodLabel )
+          { continue; }
+        if( v < value || visited[r] )
+          {
+          isMarker = false;
+          break;
+          }
+        visited[r] = true;
+        outputBuffer[r] = floodLabel;
+        fifo.push( r );
+        }
+      }
+    while( !fifo.empty() )
+      { fifo.pop(); }
+
+    const OutputImagePixelType newLabel = isMarker ? markerLabel : m_WatershedLabel;
+    fifo.push( p );
+    outputBuffer[p] = newLabel;
+    while( !fifo.empty() )
+      {
+      const OffsetValueType q = fifo.front();
+      fifo.pop();
+      const bool onBorder = neighborhood.IsOnBorder( q, position );
+      for( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType r = q + neighborhood.GetLinearOffset( i );
+        if( outputBuffer[r] == floodLabel )
+          {
+          outputBuffer[r] = newLabel;
+          fifo.push( r );
+          }
+        }
+      }
+    }
+
+  // label the markers in the raster order
+  std::fill( visited.begin(), visited.end(), false );
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    progress.CompletedPixel();
+    if( visited[p] || outputBuffer[p] == m_WatershedLabel )
+      { continue; }
+
+    do
+      {
+      if( label == NumericTraits< OutputImagePixelType >::max() )
+        { itkExceptionMacro( << "The output pixel type is too small for the number of minima." ); }
+      label++;
+      }
+    while( label == m_WatershedLabel );
+
+    fifo.push( p );
+    visited[p] = true;
+    outputBuffer[p] = label;
+    while( !fifo.empty() )
+      {
+      const OffsetValueType q = fifo.front();
+      fifo.pop();
+      const bool onBorder = neighborhood.IsOnBorder( q, position );
+      for( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType r = q + neighborhood.GetLinearOffset( i );
+        if( !visited[r] && outputBuffer[r] != m_WatershedLabel )
+          {
+          visited[r] = true;
+          outputBuffer[r] = label;
+          fifo.push( r );
+          }
+        }
+      }
+    }
 }
 
 
@@ -152,6 +445,8 @@ MorphologicalWatershedImageFilter<TInputImage, TOutputImage>
   os << indent << "FullyConnected: "  << m_FullyConnected << std::endl;
   os << indent << "MarkWatershedLine: "  << m_MarkWatershedLine << std::endl;
   os << indent << "Level: "  << static_cast<typename NumericTraits<InputImagePixelType>::PrintType>(m_Level) << std::endl;
+  os << indent << "ComputeMergeTree: "  << m_ComputeMergeTree << std::endl;
+  os << indent << "ComputeLabelMap: "  << m_ComputeLabelMap << std::endl;
 }
   
 }// end namespace itk
@@ -0,0 +1,55 @@
+#ifndef __itkReconstructionByDilationImageFilter_h
+#define __itkReconstructionByDilationImageFilter_h
+
+#include "itkReconstructionImageFilter.h"
+
+#include "itkNumericTraits.h"
+
+namespace itk {
+/** \class ReconstructionByDilationImageFilter
+ * \brief A grayscale reconstruction by dilation: the marker is dilated
+ * under the mask until stability. No incremental option
+ * available. Uses the algorithms of ReconstructionImageFilter. The marker
+ * must be lower or equal to the mask.
+ * \author Richard Beare. Department of Medicine, Monash University,
+ * Melbourne, Australia.
+ * \sa ReconstructionByErosionImageFilter
+ * \ingroup MathematicalMorphologyImageFilters
+*/
+
+template <class TInputImage, class TOutputImage>
+class ITK_EXPORT ReconstructionByDilationImageFilter :
+    public
+    ReconstructionImageFilter<TInputImage, TOutputImage, std::greater<typename TOutputImage::PixelType> >
+{
+public:
+  typedef ReconstructionByDilationImageFilter Self;
+  typedef ReconstructionImageFilter<TInputImage, TOutputImage, std::greater<typename TOutputImage::PixelType> > Superclass;
+
+  typedef SmartPointer<Self>   Pointer;
+  typedef SmartPointer<const Self>  ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+
+protected:
+  ReconstructionByDilationImageFilter()
+  {
+    this->SetMarkerValue(NumericTraits<typename TOutputImage::PixelType>::NonpositiveMin());
+  }
+  virtual ~ReconstructionByDilationImageFilter() {}
+
+private:
+  ReconstructionByDilationImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+
+
+}; // end ReconstructionByDilationImageFilter
+
+
+
+}
+
+#endif
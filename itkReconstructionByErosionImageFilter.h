@@ -36,7 +36,7 @@ public:
 protected:
   ReconstructionByErosionImageFilter()
   {
-    SetMarkerValue(NumericTraits<typename TOutputImage::PixelType>::max());
+    this->SetMarkerValue(NumericTraits<typename TOutputImage::PixelType>::max());
   }
   virtual ~ReconstructionByErosionImageFilter() {}
 
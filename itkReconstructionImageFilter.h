@@ -7,19 +7,14 @@
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
 #include "itkProgressReporter.h"
-#include <queue>
-
-//#define BASIC
-//#define FACES
-#define COPY
-
-#ifdef FACES
-#include "itkNeighborhoodAlgorithm.h"
-#endif
-
-#ifdef COPY
 #include "itkNeighborhoodAlgorithm.h"
-#endif
+#include "itkConnectivity.h"
+#include "itkLinearNeighborhood.h"
+#include "itkMultiThreader.h"
+#include "itkHierarchicalQueue.h"
+#include "itkReconstructionRasterKernel.h"
+#include <queue>
+#include <vector>
 
 namespace itk {
 
@@ -33,6 +28,57 @@ namespace itk {
  * applications and efficient algorithms" -- IEEE Transactions on
  * Image processing, Vol 2, No 2, pp 176-201, April 1993
  *
+ * Several implementations of the algorithm are available, selected at run
+ * time with SetAlgorithm():
+ *  - BASIC checks the image boundary for all the pixels;
+ *  - FACES does the raster passes without boundary checks on the inside
+ *    region of the image, and puts all the pixels of the faces on the fifo;
+ *  - COPY gives the same output as a padding of the marker and of the
+ *    mask with the MarkerValue, without making the padded copies. It
+ *    works in the buffers of the images, as PARALLEL with a single slab:
+ *    only the pixels on the border of the image check their neighbors,
+ *    and the MarkerValue is put in these pixels, clamped by the mask,
+ *    before the raster passes;
+ *  - PARALLEL works directly in the buffers of the images, and splits
+ *    the image in slabs of at least two slices along the last dimension,
+ *    one per thread. Each thread does the raster passes and the fifo
+ *    propagation in its slab. The values are then propagated across the
+ *    borders of the slabs, by all the threads: each slab gives the pixels
+ *    changed on its last slice to the fifo of the next slab, then the
+ *    pixels changed on its first slice to the fifo of the previous slab,
+ *    and the slabs process their fifo again in parallel, until nothing
+ *    changes. After as many rounds as slabs, the pixels left in the fifos
+ *    are propagated by a single thread in the whole image. The neighbors
+ *    outside the image are not read:
+ *    when the MarkerValue is not the neutral value of the comparison set
+ *    by the subclasses, it is put, clamped by the mask, in the pixels on
+ *    the border of the image before the raster passes, as a padding with
+ *    the MarkerValue would do;
+ *  - DOWNHILL is the downhill filter of Robinson and Whelan: the pixels
+ *    which can propagate their value are put in a HierarchicalQueue, and
+ *    are processed from the highest value to the lowest one for a
+ *    reconstruction by dilation. A pixel is final when it is taken from
+ *    the queue, so each pixel is propagated only once, and the raster
+ *    passes are not needed. A pixel raised after it has been put in the
+ *    queue is put again at its new value, and its old entry is skipped.
+ *    The queue is a vector of FIFOs for the 8 and 16 bits images, so
+ *    this algorithm is best suited to them. The MarkerValue is used at the
+ *    border of the image as with PARALLEL. DOWNHILL is never selected
+ *    by AUTO. "Efficient morphological reconstruction: a downhill
+ *    filter", K. Robinson and P. F. Whelan, Pattern Recognition Letters,
+ *    2004.
+ * AUTO, the default, selects COPY, the algorithm used by the filter before
+ * the others were added: PARALLEL must be selected explicitly. The
+ * algorithm used by the last update is given by GetSelectedAlgorithm(). All
+ * the algorithms produce the same output.
+ *
+ * With the face connectivity, COPY and PARALLEL do their raster passes row
+ * by row for the reconstructions by dilation and by erosion of the 8 and
+ * 16 bits and float images: the propagation from the other rows and the
+ * search of the pixels to put in the fifo use SSE2 or AVX2, as found at
+ * run time by ReconstructionRasterInstructionSet. The other cases are
+ * processed pixel by pixel.
+ *
  * \author Richard Beare. Department of Medicine, Monash University,
  * Melbourne, Australia.
  *
@@ -116,11 +162,38 @@ public:
   itkBooleanMacro(FullyConnected);
   
   /**
-   * Set/Get the value of the border - used in boundary condition.
+   * Set/Get the value of the border - used in boundary condition. It is
+   * the value of the pixels outside the image for all the algorithms.
    */
   itkSetMacro(MarkerValue, typename TInputImage::PixelType);
   itkGetConstReferenceMacro(MarkerValue, typename TInputImage::PixelType);
 
+  /** define values used to determine which algorithm to use */
+  enum AlgorithmType {
+    AUTO = 0,
+    BASIC = 1,
+    FACES = 2,
+    COPY = 3,
+    PARALLEL = 4,
+    DOWNHILL = 5 } ;
+
+  /**
+   * Set/Get the algorithm used to compute the reconstruction - see
+   * AlgorithmType. Default is AUTO.
+   */
+  itkSetMacro(Algorithm, int);
+  itkGetConstMacro(Algorithm, int);
+
+  /**
+   * Get the algorithm used by the last update. It is the one selected
+   * from the image when Algorithm is AUTO.
+   */
+  itkGetConstMacro(SelectedAlgorithm, int);
+
+  /**
+   * Return the algorithm selected in AUTO mode for a region.
+   */
+  int SelectAlgorithm( const OutputImageRegionType & region ) const;
  
 protected:
   ReconstructionImageFilter();
@@ -143,8 +216,9 @@ private:
   void operator=(const Self&); //purposely not implemented
   typename TInputImage::PixelType m_MarkerValue;
   bool                m_FullyConnected;
+  int                 m_Algorithm;
+  int                 m_SelectedAlgorithm;
 
-#ifdef FACES
   TCompare compare;
 
 
@@ -156,6 +230,10 @@ private:
   typedef typename FaceCalculatorType::FaceListType FaceListType;
   typedef typename FaceCalculatorType::FaceListType::iterator FaceListTypeIt;
 
+  void GenerateDataBasic(ProgressReporter &progress);
+
+  void GenerateDataFaces(ProgressReporter &progress);
+
   void processRegion(ProgressReporter &progress,
 		     const OutputImageRegionType thisRegion,
 		     const ISizeType kernelRadius,
@@ -166,6 +244,8 @@ private:
 
   void buildFifo(ProgressReporter &progress,
 		 const OutputImageRegionType thisRegion,
+		 const ISizeType kernelRadius,
+		 MaskImageConstPointer   maskImage,
 		 OutputImagePointer &output,
 		 FifoType &IndexFifo);
 
@@ -177,21 +257,6 @@ private:
 		   OutputImagePointer &output,
 		   FifoType &IndexFifo);
 
-  void fillFaces(FaceListType faceList,
-		 OutputImagePointer &output);
-  
-  void copyFaces(FaceListType faceList,
-		 MarkerImageConstPointer markerImage,
-		 OutputImagePointer &output);
-		 
-#endif
-
-#ifdef COPY
-  typedef typename itk::NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<OutputImageType> FaceCalculatorType;
-
-  typedef typename FaceCalculatorType::FaceListType FaceListType;
-  typedef typename FaceCalculatorType::FaceListType::iterator FaceListTypeIt;
-#endif
   typedef ImageRegionConstIterator<InputImageType> InputIteratorType;
   typedef ImageRegionIterator<OutputImageType> OutputIteratorType;
 
@@ -200,6 +265,83 @@ private:
   typedef ConstShapedNeighborhoodIterator<InputImageType> CNInputIterator;
   typedef ShapedNeighborhoodIterator<OutputImageType> NOutputIterator;
 
+  // the raw buffer version
+  typedef Connectivity< OutputImageDimension > ConnectivityType;
+  typedef LinearNeighborhood< OutputImageDimension > LinearNeighborhoodType;
+  typedef typename LinearNeighborhoodType::OffsetType LinearOffsetType;
+  typedef typename LinearNeighborhoodType::OffsetValueType OffsetValueType;
+  typedef ReconstructionRasterKernel< InputImagePixelType, OutputImagePixelType, TCompare > RasterKernelType;
+
+  // a part of the image processed by a thread, from the slice FirstSlice
+  // to the slice LastSlice included, at the offsets from Begin to End
+  // excluded. Border stores the pixels of the first and the last slices
+  // which must be propagated in the neighbor slabs.
+  struct SlabType
+    {
+    OffsetValueType FirstSlice;
+    OffsetValueType LastSlice;
+    OffsetValueType Begin;
+    OffsetValueType End;
+    std::queue< OffsetValueType > Fifo;
+    std::vector< OffsetValueType > Border;
+    };
+
+  std::vector< SlabType > m_Slabs;
+  LinearNeighborhoodType m_Neighborhood;
+  std::vector< unsigned int > m_PreviousNeighbors;
+  std::vector< unsigned int > m_LaterNeighbors;
+  // the step done by the threads in their slab
+  enum SlabStepType {
+    SCAN_SLABS,
+    PROCESS_SLAB_FIFOS,
+    PROPAGATE_FORWARD,
+    PROPAGATE_BACKWARD };
+  SlabStepType m_SlabStep;
+  ProgressReporter * m_Progress;
+
+  void GenerateDataParallel(ProgressReporter &progress, int numberOfThreads);
+
+  void GenerateDataDownhill(ProgressReporter &progress);
+
+  // the raster passes and the fifo propagation in a slab
+  void ScanSlab(SlabType &slab);
+  void RasterSlab(SlabType &slab);
+  void RasterSlabRows(SlabType &slab);
+  void ProcessSlabFifo(SlabType &slab);
+
+  // put the MarkerValue, clamped by the mask, in the pixels on the border
+  // of the image between the offsets begin and end
+  void ApplyMarkerValue(OffsetValueType begin, OffsetValueType end);
+
+  // propagate the pixels of the last slice of the slab s in the next slab
+  // when forward is true, or the ones of its first slice in the previous
+  // slab
+  void PropagateSlabBorder(unsigned long s, bool forward);
+
+  // process the slabs of a thread
+  static ITK_THREAD_RETURN_TYPE SlabThreaderCallback( void * arg );
+
+  // return true if the neighbor i of the pixel at the position is in the
+  // slab, when the pixel is on the border of the image or of the slab
+  inline bool IsInSlab( const SlabType &slab, const LinearOffsetType &position, unsigned int i ) const
+    {
+    if( !m_Neighborhood.IsInside( position, i ) )
+      {
+      return false;
+      }
+    const OffsetValueType slice = position[OutputImageDimension-1] + m_Neighborhood.GetOffset(i)[OutputImageDimension-1];
+    return slice >= slab.FirstSlice && slice <= slab.LastSlice;
+    }
+
+  // return true if some neighbors of the pixel at the position may be
+  // outside the image or the slab
+  inline bool IsOnSlabBorder( const SlabType &slab, const LinearOffsetType &position ) const
+    {
+    return m_Neighborhood.IsOnBorder( position )
+      || position[OutputImageDimension-1] == slab.FirstSlice
+      || position[OutputImageDimension-1] == slab.LastSlice;
+    }
+
 } ; // end of class
 
 } // end namespace itk
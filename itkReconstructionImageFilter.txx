@@ -8,14 +8,8 @@
 #include "itkProgressReporter.h"
 #include "itkConstantBoundaryCondition.h"
 #include "itkConnectedComponentAlgorithm.h"
+#include <algorithm>
 
-#ifdef COPY
-#include "itkConstantPadImageFilter.h"
-#include "itkCropImageFilter.h"
-#endif
-#ifdef FACES
-#include "itkImageDuplicator.h"
-#endif
 namespace itk {
 
 template <class TInputImage, class TOutputImage, class TCompare>
@@ -23,6 +17,10 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
 ::ReconstructionImageFilter()
 {
   m_FullyConnected = false;
+  m_Algorithm = AUTO;
+  m_SelectedAlgorithm = AUTO;
+  m_SlabStep = SCAN_SLABS;
+  m_Progress = NULL;
 }
 
 template <class TInputImage, class TOutputImage, class TCompare>
@@ -88,9 +86,6 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>::GetMaskImage()
   return this->GetInput(1);
 }
 
-#ifdef BASIC
-// this is the basic version - it works and is a lot faster than the
-// existing reconstruction routines in itk
 template <class TInputImage, class TOutputImage, class TCompare>
 void
 ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
@@ -104,6 +99,57 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
   // often than pixels?
   ProgressReporter progress(this, 0, this->GetOutput()->GetRequestedRegion().GetNumberOfPixels()*3);
 
+  m_SelectedAlgorithm = m_Algorithm;
+  if( m_SelectedAlgorithm == AUTO )
+    {
+    m_SelectedAlgorithm = this->SelectAlgorithm( this->GetOutput()->GetRequestedRegion() );
+    }
+
+  switch( m_SelectedAlgorithm )
+    {
+    case BASIC:
+      this->GenerateDataBasic( progress );
+      break;
+    case FACES:
+      this->GenerateDataFaces( progress );
+      break;
+    case COPY:
+      // the buffer version in a single slab has no boundary check in the
+      // raster passes, without the padded copies
+      this->GenerateDataParallel( progress, 1 );
+      break;
+    case PARALLEL:
+      this->GenerateDataParallel( progress, this->GetNumberOfThreads() );
+      break;
+    case DOWNHILL:
+      this->GenerateDataDownhill( progress );
+      break;
+    default:
+      itkExceptionMacro( << "Unknown algorithm: " << m_Algorithm );
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TCompare>
+int
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::SelectAlgorithm( const OutputImageRegionType & itkNotUsed(region) ) const
+{
+  // COPY is the algorithm the filter has always used, and the buffer
+  // versions check the neighbors of the pixels on the border of the image
+  // only. PARALLEL changes the order of the propagation and starts the
+  // threads for every update, including the ones done by the filters built
+  // on the reconstruction, like HMinimaImageFilter: it is not selected until
+  // reconperf gives a size above which it is faster on the target machines.
+  return COPY;
+}
+
+// this is the basic version - it works and is a lot faster than the
+// existing reconstruction routines in itk
+template <class TInputImage, class TOutputImage, class TCompare>
+void
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::GenerateDataBasic(ProgressReporter &progress)
+{
   typedef ImageRegionConstIterator<InputImageType> InputIteratorType;
   typedef ImageRegionIterator<OutputImageType> OutputIteratorType;
   
@@ -111,8 +157,6 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
   MaskImageConstPointer   maskImage = this->GetMaskImage();
   OutputImagePointer      output = this->GetOutput();
 
-  TCompare compare;
-
   InputIteratorType inIt( markerImage,
 			  output->GetRequestedRegion() );
   OutputIteratorType outIt( output,
@@ -120,8 +164,6 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
   inIt.GoToBegin();
   outIt.GoToBegin();
 
-  // declare our queue type
-  typedef typename std::queue<OutputImageIndexType> FifoType;
   FifoType IndexFifo;
 
   // copy marker to output - isn't there a better way?
@@ -281,38 +323,19 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
     }
   
 }
-#endif
-#ifdef FACES
-// this is the version which we use to experiment with the face
-// calculator to optimize the performance. The basic idea will be to
-// operate on the inside region in the normal way and then put all of
-// the faces on the fifo
+
+// this is the version which uses the face calculator to optimize the
+// performance. The raster passes are done on the inside region, where the
+// neighbors don't need to be checked, and all the face pixels are then put
+// on the fifo
 template <class TInputImage, class TOutputImage, class TCompare>
 void
 ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
-::GenerateData()
+::GenerateDataFaces(ProgressReporter &progress)
 {
-  // Allocate the output
-  this->AllocateOutputs();
-  // there are 2 passes that use all pixels and a 3rd that uses some
-  // subset of the pixels. We'll just pretend that the third pass
-  // takes the same as each of the others. Is it OK to update more
-  // often than pixels?
-  ProgressReporter progress(this, 0, this->GetOutput()->GetRequestedRegion().GetNumberOfPixels()*3);
-  
   MarkerImageConstPointer markerImage = this->GetMarkerImage();
   MaskImageConstPointer   maskImage = this->GetMaskImage();
   OutputImagePointer      output = this->GetOutput();
-  
-  typename ImageDuplicator<MaskImageType>::Pointer dup = ImageDuplicator<MaskImageType>::New();
-
-  dup->SetInputImage(maskImage);
-  dup->Update();
-  MaskImagePointer maskImageCopy = dup->GetOutput();
-  MaskImageConstPointer maskImageConstCopy = dup->GetOutput();
-  // seems that we need a copy of the mask image for the face based
-  // optimization to work -- basically because we need to set the
-  // borders of the mask too
 
   FifoType IndexFifo;
 
@@ -327,79 +350,49 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
   faceList = faceCalculator(output, output->GetRequestedRegion(),
 			    kernelRadius);
   
-  // We will process the centre "block" first. This will require
-  // setting the face regions to the marker value and copying the real
-  // values in later
+  // copy the marker clamped by the mask, so the face pixels have a valid
+  // value before the raster passes
   InputIteratorType inIt( markerImage,
 			  output->GetRequestedRegion());
+  InputIteratorType mskIt( maskImage,
+			   output->GetRequestedRegion());
   OutputIteratorType outIt( output,
 			    output->GetRequestedRegion());
-  // copy the body
   while ( !outIt.IsAtEnd() )
     {
-    MarkerImagePixelType currentValue = inIt.Get();
-    outIt.Set( static_cast<OutputImagePixelType>( currentValue ) );
+    OutputImagePixelType V = static_cast<OutputImagePixelType>( inIt.Get() );
+    OutputImagePixelType iV = static_cast<OutputImagePixelType>( mskIt.Get() );
+    if (compare(V, iV))
+      {
+      V = iV;
+      }
+    outIt.Set( V );
     ++inIt;
+    ++mskIt;
     ++outIt;
     }
 
-
-  // now do the raster passes over the faces to build the fifo
-  for (fit = faceList.begin();fit != faceList.end();++fit)
-    {  
+  // the raster passes over the inside region. The pixels put in the fifo
+  // are the ones which can propagate their value in the inside region or
+  // in the faces
+  fit = faceList.begin();
+  if (fit->GetNumberOfPixels() > 0)
+    {
     processRegion(progress, *fit, kernelRadius,
 		  markerImage, maskImage, output, IndexFifo);
     }
-  // process the fifo with boundary checks re-enabled
-  processFifo(progress, output->GetRequestedRegion(), kernelRadius,
-	      markerImage, maskImage, output, IndexFifo);
-
-
-}
-
-template <class TInputImage, class TOutputImage, class TCompare>
-void
-ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
-::fillFaces(FaceListType faceList,
-	    OutputImagePointer &output)
-{
-  typename FaceCalculatorType::FaceListType::iterator fit;
-  fit = faceList.begin();
-  ++fit;  // don't fill the body
 
-  for (;fit != faceList.end();++fit)
+  // the face pixels take the value of their neighbors, and are all put on
+  // the fifo
+  for (++fit; fit != faceList.end(); ++fit)
     {
-      OutputIteratorType outIt(output,
-			       *fit);
-      for (outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt)
-	{
-	outIt.Set(m_MarkerValue);
-	}
+    buildFifo(progress, *fit, kernelRadius, maskImage, output, IndexFifo);
     }
-}
 
-template <class TInputImage, class TOutputImage, class TCompare>
-void
-ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
-::copyFaces(FaceListType faceList,
-	    MarkerImageConstPointer markerImage,
-	    OutputImagePointer &output)
-{
-  typename FaceCalculatorType::FaceListType::iterator fit;
-  fit = faceList.begin();
-  ++fit;  // don't fill the body
+  // process the fifo with boundary checks re-enabled
+  processFifo(progress, output->GetRequestedRegion(), kernelRadius,
+	      markerImage, maskImage, output, IndexFifo);
 
-  for (;fit != faceList.end();++fit)
-    {
-      OutputIteratorType outIt(output,
-			       *fit);
-      InputIteratorType inIt(markerImage,
-			     *fit);
-      for (outIt.GoToBegin(), inIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt, ++inIt)
-	{
-	outIt.Set(inIt.Get());
-	}
-    }
 }
 
 template <class TInputImage, class TOutputImage, class TCompare>
@@ -521,17 +514,50 @@ void
 ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
 ::buildFifo(ProgressReporter &progress,
 	    const OutputImageRegionType thisRegion,
+	    const ISizeType kernelRadius,
+	    MaskImageConstPointer   maskImage,
 	    OutputImagePointer &output,
 	    FifoType &IndexFifo)
 {
-  OutputIteratorType outIt( output,
-			    thisRegion );
-  for (outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt)
+  // the face pixels haven't been scanned: they take the value of all their
+  // neighbors, clamped by the mask. The neighbors which are changed later
+  // propagate their value with the fifo.
+  NOutputIterator outNIt(kernelRadius,
+			 output,
+			 thisRegion );
+  setConnectivity( &outNIt, m_FullyConnected );
+
+  ConstantBoundaryCondition<OutputImageType> oBC;
+  oBC.SetConstant(m_MarkerValue);
+  outNIt.OverrideBoundaryCondition(&oBC);
+
+  InputIteratorType mskIt( maskImage,
+			   thisRegion );
+
+  for (outNIt.GoToBegin(),mskIt.GoToBegin();!outNIt.IsAtEnd(); ++outNIt,++mskIt)
     {
-    IndexFifo.push(outIt.GetIndex());
+    OutputImagePixelType V = outNIt.GetCenterPixel();
+    typename NOutputIterator::ConstIterator sIt;
+    for (sIt = outNIt.Begin(); !sIt.IsAtEnd();++sIt)
+      {
+      OutputImagePixelType VN = sIt.Get();
+      if (compare(VN, V)) 
+	{
+	V = VN;
+	}
+      }
+    // this step clamps to the mask 
+    OutputImagePixelType iV = static_cast<OutputImagePixelType>(mskIt.Get());
+    if (compare(V, iV))
+      {
+      V = iV;
+      }
+    outNIt.SetCenterPixel(V);
+    IndexFifo.push(outNIt.GetIndex());
     progress.CompletedPixel();
     }
 }
+
 template <class TInputImage, class TOutputImage, class TCompare>
 void
 ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
@@ -606,232 +632,663 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
   
 }
 
-#endif
-#ifdef COPY
-// a version that takes a padded copy of mask and marker
+// a version working in the image buffers, with the image split in slabs
+// processed in parallel
 template <class TInputImage, class TOutputImage, class TCompare>
 void
 ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
-::GenerateData()
+::GenerateDataParallel(ProgressReporter &progress, int numberOfThreads)
 {
-  // Allocate the output
-  this->AllocateOutputs();
-  // there are 2 passes that use all pixels and a 3rd that uses some
-  // subset of the pixels. We'll just pretend that the third pass
-  // takes the same as each of the others. Is it OK to update more
-  // often than pixels?
-  ProgressReporter progress(this, 0, this->GetOutput()->GetRequestedRegion().GetNumberOfPixels()*3);
+  const OutputImageRegionType region = this->GetOutput()->GetRequestedRegion();
+  const unsigned int last = OutputImageDimension - 1;
+
+  typename ConnectivityType::Pointer connectivity = ConnectivityType::New();
+  connectivity->SetFullyConnected( m_FullyConnected );
+  m_Neighborhood.Initialize( region.GetSize(), connectivity->GetNeighbors() );
+
+  // the previous neighbors are before the pixel in the raster order, and
+  // the later ones after it
+  m_PreviousNeighbors.clear();
+  m_LaterNeighbors.clear();
+  for( unsigned int i=0; i<m_Neighborhood.GetNumberOfNeighbors(); i++ )
+    {
+    if( m_Neighborhood.GetLinearOffset( i ) < 0 )
+      {
+      m_PreviousNeighbors.push_back( i );
+      }
+    else
+      {
+      m_LaterNeighbors.push_back( i );
+      }
+    }
 
-  typedef ImageRegionConstIterator<InputImageType> InputIteratorType;
-  typedef ImageRegionIterator<OutputImageType> OutputIteratorType;
-  
-  MarkerImageConstPointer markerImage = this->GetMarkerImage();
-  MaskImageConstPointer   maskImage = this->GetMaskImage();
-  OutputImagePointer      output = this->GetOutput();
+  // one slab per thread, with the same number of slices. A slab has at
+  // least two slices, so its first and last slices are not the same, and
+  // the borders of the slabs can be propagated in parallel.
+  const OffsetValueType nbOfSlices = region.GetSize()[last];
+  const OffsetValueType sliceSize = region.GetNumberOfPixels() / nbOfSlices;
+  this->GetMultiThreader()->SetNumberOfThreads( numberOfThreads );
+  const OffsetValueType nbOfSlabs = std::max( (OffsetValueType)1,
+    std::min( nbOfSlices / 2, (OffsetValueType)this->GetMultiThreader()->GetNumberOfThreads() ) );
+  m_Slabs.clear();
+  m_Slabs.resize( nbOfSlabs );
+  for( OffsetValueType s=0; s<nbOfSlabs; s++ )
+    {
+    SlabType & slab = m_Slabs[s];
+    slab.FirstSlice = nbOfSlices * s / nbOfSlabs;
+    slab.LastSlice = nbOfSlices * ( s + 1 ) / nbOfSlabs - 1;
+    slab.Begin = slab.FirstSlice * sliceSize;
+    slab.End = ( slab.LastSlice + 1 ) * sliceSize;
+    }
 
+  // the progress is reported by the first slab only: the reporter can't
+  // be shared by the threads
+  m_Progress = &progress;
+
+  // the raster passes and the fifo propagation in each slab
+  this->GetMultiThreader()->SetNumberOfThreads( nbOfSlabs );
+  this->GetMultiThreader()->SetSingleMethod( this->SlabThreaderCallback, this );
+  m_SlabStep = SCAN_SLABS;
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  // propagate across the borders of the slabs until nothing changes. A
+  // value needs a round for each border it crosses, so more rounds than
+  // slabs are only needed by the paths which go back and forth across
+  // the borders, with little work in each round. The test images need at
+  // most half as many rounds as slabs.
+  for( OffsetValueType round=0; ; round++ )
+    {
+    m_SlabStep = PROPAGATE_FORWARD;
+    this->GetMultiThreader()->SingleMethodExecute();
+    m_SlabStep = PROPAGATE_BACKWARD;
+    this->GetMultiThreader()->SingleMethodExecute();
 
+    bool changed = false;
+    for( OffsetValueType s=0; s<nbOfSlabs; s++ )
+      {
+      changed = changed || !m_Slabs[s].Fifo.empty();
+      }
+    if( !changed )
+      {
+      break;
+      }
 
-  // create padded versions of the marker image and the mask image
-  typedef typename itk::ConstantPadImageFilter<InputImageType, InputImageType> PadType;
-  
-  typename PadType::Pointer MaskPad = PadType::New();
-  typename PadType::Pointer MarkerPad = PadType::New();
+    if( round == nbOfSlabs )
+      {
+      // the remaining pixels are propagated by a single thread, in a slab
+      // made of the whole image
+      SlabType & whole = m_Slabs[0];
+      for( OffsetValueType s=1; s<nbOfSlabs; s++ )
+        {
+        while( !m_Slabs[s].Fifo.empty() )
+          {
+          whole.Fifo.push( m_Slabs[s].Fifo.front() );
+          m_Slabs[s].Fifo.pop();
+          }
+        }
+      whole.LastSlice = m_Slabs[nbOfSlabs-1].LastSlice;
+      whole.End = m_Slabs[nbOfSlabs-1].End;
+      m_Slabs.resize( 1 );
+      this->ProcessSlabFifo( whole );
+      break;
+      }
 
-  ISizeType padSize;
-  padSize.Fill( 1 );
+    m_SlabStep = PROCESS_SLAB_FIFOS;
+    this->GetMultiThreader()->SingleMethodExecute();
+    }
 
-  MaskPad->SetConstant(m_MarkerValue);
-  MarkerPad->SetConstant(m_MarkerValue);
-  MaskPad->SetPadLowerBound( padSize.m_Size );
-  MaskPad->SetPadUpperBound( padSize.m_Size );
-  MarkerPad->SetPadLowerBound( padSize.m_Size );
-  MarkerPad->SetPadUpperBound( padSize.m_Size );
+  m_Slabs.clear();
+  m_Progress = NULL;
+}
+
+template <class TInputImage, class TOutputImage, class TCompare>
+void
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::ScanSlab(SlabType &slab)
+{
+  if( !m_FullyConnected && OutputImageDimension > 1
+      && RasterKernelType::IsVectorized( ReconstructionRasterInstructionSet::Get() ) )
+    {
+    // the neighbors in the other rows are at the same position in their
+    // row: the rows are processed at once, with SIMD instructions. The
+    // slabs are made of whole rows, except in 1D.
+    this->RasterSlabRows( slab );
+    }
+  else
+    {
+    this->RasterSlab( slab );
+    }
 
-  MaskPad->SetInput(maskImage);
-  MarkerPad->SetInput(markerImage);
-  MaskPad->Update();
-  MarkerPad->Update();
+  this->ProcessSlabFifo( slab );
 
-  MarkerImageConstPointer markerImageP = MarkerPad->GetOutput();
-  MaskImageConstPointer   maskImageP = MaskPad->GetOutput();
+  // all the pixels of the borders of the slab can be propagated in the
+  // neighbor slabs
+  slab.Border.clear();
+  const OffsetValueType sliceSize = ( slab.End - slab.Begin ) / ( slab.LastSlice - slab.FirstSlice + 1 );
+  for( OffsetValueType p=slab.Begin; p<slab.Begin+sliceSize; p++ )
+    {
+    slab.Border.push_back( p );
+    }
+  for( OffsetValueType p=std::max( slab.Begin+sliceSize, slab.End-sliceSize ); p<slab.End; p++ )
+    {
+    slab.Border.push_back( p );
+    }
+}
 
+// the neighbors outside the image are ignored by the algorithms working
+// in the buffers. They would have the MarkerValue, and would never be
+// changed: their only effect is to propagate the MarkerValue, clamped by
+// the mask, in the pixels on the border of the image, which is done here.
+template <class TInputImage, class TOutputImage, class TCompare>
+void
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::ApplyMarkerValue(OffsetValueType begin, OffsetValueType end)
+{
   TCompare compare;
+  const OutputImagePixelType markerValue = static_cast<OutputImagePixelType>( m_MarkerValue );
+  if( !compare( markerValue, NumericTraits<OutputImagePixelType>::NonpositiveMin() )
+      && !compare( markerValue, NumericTraits<OutputImagePixelType>::max() ) )
+    {
+    // the MarkerValue never wins the comparison: nothing to do
+    return;
+    }
 
-  FaceCalculatorType faceCalculator;
-
-  FaceListType faceList;
-  FaceListTypeIt fit;
+  const InputImagePixelType * maskBuffer = this->GetMaskImage()->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+  const typename LinearNeighborhoodType::SizeType & size = m_Neighborhood.GetSize();
+  const OffsetValueType rowSize = size[0];
 
-  ISizeType kernelRadius;
-  kernelRadius.Fill(1);
+  LinearOffsetType position;
+  m_Neighborhood.ComputePosition( begin, position );
+  OffsetValueType x = position[0];
+  for( OffsetValueType p=begin; p<end; )
+    {
+    // all the pixels of the row are on the border if the row is on the
+    // border of one of the other dimensions
+    bool rowOnBorder = false;
+    for( unsigned int d=1; d<OutputImageDimension; d++ )
+      {
+      rowOnBorder = rowOnBorder || position[d] == 0 || position[d] == (OffsetValueType)size[d] - 1;
+      }
+    for( ; x<rowSize && p<end; x++, p++ )
+      {
+      if( rowOnBorder || x == 0 || x == rowSize - 1 )
+        {
+        OutputImagePixelType V = outputBuffer[p];
+        if( compare( markerValue, V ) )
+          {
+          V = markerValue;
+          }
+        const OutputImagePixelType iV = static_cast<OutputImagePixelType>( maskBuffer[p] );
+        if( compare( V, iV ) )
+          {
+          V = iV;
+          }
+        outputBuffer[p] = V;
+        }
+      }
+    // next row
+    x = 0;
+    for( unsigned int d=1; d<OutputImageDimension; d++ )
+      {
+      if( ++position[d] < (OffsetValueType)size[d] )
+        {
+        break;
+        }
+      position[d] = 0;
+      }
+    }
+}
 
-  faceList = faceCalculator(maskImageP, maskImageP->GetLargestPossibleRegion(),
-			    kernelRadius);
-  // we will only be processing the body region
-  fit = faceList.begin();
+// the raster passes in a slab, pixel by pixel
+template <class TInputImage, class TOutputImage, class TCompare>
+void
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::RasterSlab(SlabType &slab)
+{
+  const InputImagePixelType * markerBuffer = this->GetMarkerImage()->GetBufferPointer();
+  const InputImagePixelType * maskBuffer = this->GetMaskImage()->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+  ProgressReporter * progress = &slab == &m_Slabs[0] ? m_Progress : NULL;
 
-  // declare our queue type
-  typedef typename std::queue<OutputImageIndexType> FifoType;
-  FifoType IndexFifo;
+  // copy the marker clamped by the mask
+  for( OffsetValueType p=slab.Begin; p<slab.End; p++ )
+    {
+    OutputImagePixelType V = static_cast<OutputImagePixelType>( markerBuffer[p] );
+    OutputImagePixelType iV = static_cast<OutputImagePixelType>( maskBuffer[p] );
+    if (compare(V, iV))
+      {
+      V = iV;
+      }
+    outputBuffer[p] = V;
+    }
+  this->ApplyMarkerValue( slab.Begin, slab.End );
 
-  NOutputIterator outNIt(kernelRadius,
-			 markerImageP,
-			 *fit );
-  setConnectivityPrevious( &outNIt, m_FullyConnected );
-  
-  ConstantBoundaryCondition<OutputImageType> oBC;
-  oBC.SetConstant(m_MarkerValue);
-  outNIt.OverrideBoundaryCondition(&oBC);
-  
-  InputIteratorType mskIt( maskImageP,
-			   *fit );
-  
-  mskIt.GoToBegin();
   // scan in forward raster order
-  for (outNIt.GoToBegin(),mskIt.GoToBegin();!outNIt.IsAtEnd(); ++outNIt,++mskIt)
+  LinearOffsetType position;
+  m_Neighborhood.ComputePosition( slab.Begin, position );
+  position[0]--;
+  for( OffsetValueType p=slab.Begin; p<slab.End; p++ )
     {
-    InputImagePixelType V = outNIt.GetCenterPixel();
-    // visit the previous neighbours
-    typename NOutputIterator::ConstIterator sIt;
-    for (sIt = outNIt.Begin(); !sIt.IsAtEnd();++sIt)
+    // the position is updated without the divisions of ComputePosition()
+    position[0]++;
+    for( unsigned int d=0; d<OutputImageDimension-1 && position[d] == (OffsetValueType)m_Neighborhood.GetSize()[d]; d++ )
       {
-      InputImagePixelType VN = sIt.Get();
-      if (compare(VN, V)) 
-	{
-	outNIt.SetCenterPixel(VN);
-	V = VN;
-	}
+      position[d] = 0;
+      position[d+1]++;
       }
-    // this step clamps to the mask 
-    InputImagePixelType iV = static_cast<OutputImagePixelType>(mskIt.Get());
+    const bool onBorder = this->IsOnSlabBorder( slab, position );
+    OutputImagePixelType V = outputBuffer[p];
+    for( unsigned int n=0; n<m_PreviousNeighbors.size(); n++ )
+      {
+      const unsigned int i = m_PreviousNeighbors[n];
+      if( onBorder && !this->IsInSlab( slab, position, i ) )
+        { continue; }
+      const OutputImagePixelType & VN = outputBuffer[ p + m_Neighborhood.GetLinearOffset( i ) ];
+      if (compare(VN, V))
+        {
+        V = VN;
+        }
+      }
+    // this step clamps to the mask
+    OutputImagePixelType iV = static_cast<OutputImagePixelType>( maskBuffer[p] );
     if (compare(V, iV))
       {
-      outNIt.SetCenterPixel(iV);
+      V = iV;
+      }
+    outputBuffer[p] = V;
+    if( progress )
+      {
+      progress->CompletedPixel();
       }
-    progress.CompletedPixel();
     }
+
   // now for the reverse raster order pass
-  // reset the neighborhood
-  setConnectivityLater( &outNIt, m_FullyConnected );
-  outNIt.OverrideBoundaryCondition(&oBC);
-  outNIt.GoToEnd();
-  //mskIt.GoToEnd();
-  
-  ConstantBoundaryCondition<InputImageType> iBC;
-  iBC.SetConstant(m_MarkerValue);
-  CNInputIterator mskNIt(kernelRadius,
-			 maskImageP,
-			 *fit );
-  
-  setConnectivityLater( &mskNIt, m_FullyConnected );
-  mskNIt.OverrideBoundaryCondition(&iBC);
-  
-  typename NOutputIterator::IndexListType oIndexList, mIndexList;
-  typename NOutputIterator::IndexListType::const_iterator oLIt, mLIt;
-  
-  oIndexList = outNIt.GetActiveIndexList();
-  mIndexList = mskNIt.GetActiveIndexList();
-  
-  mskNIt.GoToEnd();
-  while (!outNIt.IsAtBegin())
+  m_Neighborhood.ComputePosition( slab.End - 1, position );
+  position[0]++;
+  for( OffsetValueType p=slab.End-1; p>=slab.Begin; p-- )
     {
-    --outNIt;
-    --mskNIt;
-    InputImagePixelType V = outNIt.GetCenterPixel();
-    typename NOutputIterator::ConstIterator sIt;
-    for (sIt = outNIt.Begin(); !sIt.IsAtEnd();++sIt)
+    position[0]--;
+    for( unsigned int d=0; d<OutputImageDimension-1 && position[d] < 0; d++ )
       {
-      InputImagePixelType VN = sIt.Get();
-      if (compare(VN, V)) 
-	{
-	outNIt.SetCenterPixel(VN);
-	V = VN;
-	}
+      position[d] = m_Neighborhood.GetSize()[d] - 1;
+      position[d+1]--;
+      }
+    const bool onBorder = this->IsOnSlabBorder( slab, position );
+    OutputImagePixelType V = outputBuffer[p];
+    for( unsigned int n=0; n<m_LaterNeighbors.size(); n++ )
+      {
+      const unsigned int i = m_LaterNeighbors[n];
+      if( onBorder && !this->IsInSlab( slab, position, i ) )
+        { continue; }
+      const OutputImagePixelType & VN = outputBuffer[ p + m_Neighborhood.GetLinearOffset( i ) ];
+      if (compare(VN, V))
+        {
+        V = VN;
+        }
       }
-    InputImagePixelType iV = mskNIt.GetCenterPixel();
+    // this step clamps to the mask
+    OutputImagePixelType iV = static_cast<OutputImagePixelType>( maskBuffer[p] );
     if (compare(V, iV))
       {
-      outNIt.SetCenterPixel(iV);
       V = iV;
       }
+    outputBuffer[p] = V;
 
     // now put indexes in the fifo
-    //typename CNInputIterator::ConstIterator mIt;
-    for (oLIt = oIndexList.begin(), mLIt = mIndexList.begin(); oLIt != oIndexList.end();++oLIt, ++mLIt)
+    for( unsigned int n=0; n<m_LaterNeighbors.size(); n++ )
       {
-      
-      //std::cout << " " << outNIt.GetIndex(*oLIt);
-      InputImagePixelType VN = outNIt.GetPixel(*oLIt);
-      InputImagePixelType iN = mskNIt.GetPixel(*mLIt);
-      if (compare(V, VN) && compare(iN, VN)) 
-	{
-	IndexFifo.push(outNIt.GetIndex());
-	break;
-	}
+      const unsigned int i = m_LaterNeighbors[n];
+      if( onBorder && !this->IsInSlab( slab, position, i ) )
+        { continue; }
+      const OffsetValueType q = p + m_Neighborhood.GetLinearOffset( i );
+      const OutputImagePixelType & VN = outputBuffer[q];
+      OutputImagePixelType iN = static_cast<OutputImagePixelType>( maskBuffer[q] );
+      if (compare(V, VN) && compare(iN, VN))
+        {
+        slab.Fifo.push( p );
+        break;
+        }
+      }
+    if( progress )
+      {
+      progress->CompletedPixel();
       }
-    progress.CompletedPixel();
     }
+}
 
-  
-  // Now we want to check the full neighborhood
-  setConnectivity( &outNIt, m_FullyConnected );
-  setConnectivity( &mskNIt, m_FullyConnected );
-  mskNIt.OverrideBoundaryCondition(&iBC);
-  outNIt.OverrideBoundaryCondition(&oBC);
-  oIndexList = outNIt.GetActiveIndexList();
-  mIndexList = mskNIt.GetActiveIndexList();
-  // now process the fifo - this fill the parts that weren't dealt
-  // with by the raster and anti-raster passes
-  //typename NOutputIterator::Iterator sIt;
-  typename CNInputIterator::ConstIterator mIt;
-  
-  while (!IndexFifo.empty())
+// the raster passes in a slab, row by row, with the face connectivity. The
+// propagation from the other rows and the search of the pixels to put in
+// the fifo are done with SIMD instructions.
+template <class TInputImage, class TOutputImage, class TCompare>
+void
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::RasterSlabRows(SlabType &slab)
+{
+  const InputImagePixelType * markerBuffer = this->GetMarkerImage()->GetBufferPointer();
+  const InputImagePixelType * maskBuffer = this->GetMaskImage()->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+  ProgressReporter * progress = &slab == &m_Slabs[0] ? m_Progress : NULL;
+  const int instructionSet = ReconstructionRasterInstructionSet::Get();
+  const unsigned int last = OutputImageDimension - 1;
+  const OffsetValueType rowSize = m_Neighborhood.GetSize()[0];
+
+  // the distance between two neighbor rows in each dimension
+  OffsetValueType strides[OutputImageDimension];
+  strides[0] = 1;
+  for( unsigned int d=1; d<OutputImageDimension; d++ )
     {
-    InputImageIndexType I = IndexFifo.front();
-    IndexFifo.pop();
-    // reposition the iterators
-    outNIt += I - outNIt.GetIndex();
-    mskNIt += I - mskNIt.GetIndex();
-    InputImagePixelType V = outNIt.GetCenterPixel();
-    for (oLIt = oIndexList.begin(), mLIt = mIndexList.begin(); 
-	 oLIt != oIndexList.end();
-	 ++oLIt, ++mLIt)
+    strides[d] = strides[d-1] * m_Neighborhood.GetSize()[d-1];
+    }
+
+  // copy the marker clamped by the mask
+  RasterKernelType::ClampRow( outputBuffer + slab.Begin, markerBuffer + slab.Begin, maskBuffer + slab.Begin,
+                              slab.End - slab.Begin, instructionSet );
+  this->ApplyMarkerValue( slab.Begin, slab.End );
+
+  // scan in forward raster order
+  LinearOffsetType position;
+  m_Neighborhood.ComputePosition( slab.Begin, position );
+  for( OffsetValueType p=slab.Begin; p<slab.End; p+=rowSize )
+    {
+    OutputImagePixelType * row = outputBuffer + p;
+    for( unsigned int d=1; d<OutputImageDimension; d++ )
+      {
+      if( position[d] > ( d == last ? slab.FirstSlice : 0 ) )
+        {
+        RasterKernelType::DominateRow( row, row - strides[d], rowSize, instructionSet );
+        }
+      }
+    RasterKernelType::ForwardRow( row, maskBuffer + p, rowSize );
+    if( progress )
+      {
+      for( OffsetValueType x=0; x<rowSize; x++ )
+        {
+        progress->CompletedPixel();
+        }
+      }
+    // move to the next row
+    for( unsigned int d=1; d<OutputImageDimension; d++ )
+      {
+      if( ++position[d] < (OffsetValueType)m_Neighborhood.GetSize()[d] || d == last )
+        { break; }
+      position[d] = 0;
+      }
+    }
+
+  // now for the reverse raster order pass
+  const OutputImagePixelType * later[OutputImageDimension];
+  const InputImagePixelType * laterMask[OutputImageDimension];
+  m_Neighborhood.ComputePosition( slab.End - rowSize, position );
+  for( OffsetValueType p=slab.End-rowSize; p>=slab.Begin; p-=rowSize )
+    {
+    OutputImagePixelType * row = outputBuffer + p;
+    unsigned int nbOfLater = 0;
+    for( unsigned int d=1; d<OutputImageDimension; d++ )
+      {
+      if( position[d] < ( d == last ? slab.LastSlice : (OffsetValueType)m_Neighborhood.GetSize()[d] - 1 ) )
+        {
+        RasterKernelType::DominateRow( row, row + strides[d], rowSize, instructionSet );
+        later[nbOfLater] = row + strides[d];
+        laterMask[nbOfLater] = maskBuffer + p + strides[d];
+        nbOfLater++;
+        }
+      }
+    RasterKernelType::BackwardRow( row, maskBuffer + p, rowSize );
+
+    // now put indexes in the fifo
+    RasterKernelType::PushCandidates( row, maskBuffer + p, later, laterMask, nbOfLater,
+                                      rowSize, p, slab.Fifo, instructionSet );
+    if( progress )
+      {
+      for( OffsetValueType x=0; x<rowSize; x++ )
+        {
+        progress->CompletedPixel();
+        }
+      }
+    // move to the previous row
+    for( unsigned int d=1; d<OutputImageDimension; d++ )
       {
-      InputImagePixelType VN = outNIt.GetPixel(*oLIt);
-      InputImagePixelType iN = mskNIt.GetPixel(*mLIt);
+      if( position[d]-- > 0 || d == last )
+        { break; }
+      position[d] = m_Neighborhood.GetSize()[d] - 1;
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TCompare>
+void
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::ProcessSlabFifo(SlabType &slab)
+{
+  const InputImagePixelType * maskBuffer = this->GetMaskImage()->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+  ProgressReporter * progress = &slab == &m_Slabs[0] ? m_Progress : NULL;
+
+  LinearOffsetType position;
+  while (!slab.Fifo.empty())
+    {
+    const OffsetValueType p = slab.Fifo.front();
+    slab.Fifo.pop();
+    m_Neighborhood.ComputePosition( p, position );
+    const bool onBorder = this->IsOnSlabBorder( slab, position );
+    if( position[OutputImageDimension-1] == slab.FirstSlice || position[OutputImageDimension-1] == slab.LastSlice )
+      {
+      // the pixel may also be propagated in the neighbor slab
+      slab.Border.push_back( p );
+      }
+    const OutputImagePixelType V = outputBuffer[p];
+    for( unsigned int i=0; i<m_Neighborhood.GetNumberOfNeighbors(); i++ )
+      {
+      if( onBorder && !this->IsInSlab( slab, position, i ) )
+        { continue; }
+      const OffsetValueType q = p + m_Neighborhood.GetLinearOffset( i );
+      const OutputImagePixelType VN = outputBuffer[q];
+      const OutputImagePixelType iN = static_cast<OutputImagePixelType>( maskBuffer[q] );
       // candidate for dilation via flooding
       if (compare(V, VN) && (iN != VN))
 	{
 	if (compare(iN, V)) 
 	  {
 	  // not clamped by the mask, propogate the center value
-	  outNIt.SetPixel(*oLIt, V);
+	  outputBuffer[q] = V;
 	  }
 	else
 	  {
 	  // apply the clamping
-	  outNIt.SetPixel(*oLIt, iN);
+	  outputBuffer[q] = iN;
 	  }
-	 IndexFifo.push(outNIt.GetIndex(*oLIt));
+	slab.Fifo.push( q );
 	}
-      }     
-    progress.CompletedPixel();
+      }
+    if( progress )
+      {
+      progress->CompletedPixel();
+      }
+    }
+}
+
+// the slabs have at least two slices, so the slice read by a thread is
+// not written by the thread of the neighbor slab, and each fifo is filled
+// by a single thread
+template <class TInputImage, class TOutputImage, class TCompare>
+void
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::PropagateSlabBorder(unsigned long s, bool forward)
+{
+  const InputImagePixelType * maskBuffer = this->GetMaskImage()->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+  const unsigned int last = OutputImageDimension - 1;
+  SlabType & slab = m_Slabs[s];
+
+  if( forward ? s + 1 < m_Slabs.size() : s > 0 )
+    {
+    SlabType & neighborSlab = m_Slabs[ forward ? s + 1 : s - 1 ];
+    const OffsetValueType borderSlice = forward ? slab.LastSlice : slab.FirstSlice;
+    LinearOffsetType position;
+    for( unsigned long b=0; b<slab.Border.size(); b++ )
+      {
+      const OffsetValueType p = slab.Border[b];
+      m_Neighborhood.ComputePosition( p, position );
+      if( position[last] != borderSlice )
+        { continue; }
+      const OutputImagePixelType V = outputBuffer[p];
+      for( unsigned int i=0; i<m_Neighborhood.GetNumberOfNeighbors(); i++ )
+        {
+        // only the neighbors in the neighbor slab
+        if( !m_Neighborhood.IsInside( position, i ) || this->IsInSlab( slab, position, i ) )
+          { continue; }
+        const OffsetValueType q = p + m_Neighborhood.GetLinearOffset( i );
+        const OutputImagePixelType VN = outputBuffer[q];
+        const OutputImagePixelType iN = static_cast<OutputImagePixelType>( maskBuffer[q] );
+        if (compare(V, VN) && (iN != VN))
+          {
+          if (compare(iN, V)) 
+            {
+            outputBuffer[q] = V;
+            }
+          else
+            {
+            outputBuffer[q] = iN;
+            }
+          neighborSlab.Fifo.push( q );
+          }
+        }
+      }
     }
 
-    typedef typename itk::CropImageFilter<InputImageType, OutputImageType> CropType;
-    typename CropType::Pointer crop = CropType::New();
-    crop->SetInput( markerImageP );
-    crop->SetUpperBoundaryCropSize( padSize );
-    crop->SetLowerBoundaryCropSize( padSize );
-    crop->GraftOutput( this->GetOutput() );
-    /** execute the minipipeline */
-    crop->Update();
+  if( !forward )
+    {
+    // both borders are done
+    slab.Border.clear();
+    }
+}
 
-    /** graft the minipipeline output back into this filter's output */
-    this->GraftOutput( crop->GetOutput() );
-  
+template <class TInputImage, class TOutputImage, class TCompare>
+ITK_THREAD_RETURN_TYPE
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::SlabThreaderCallback( void * arg )
+{
+  MultiThreader::ThreadInfoStruct * info = static_cast< MultiThreader::ThreadInfoStruct * >( arg );
+  const int threadId = info->ThreadID;
+  const int threadCount = info->NumberOfThreads;
+  Self * self = static_cast< Self * >( info->UserData );
+
+  for( unsigned long s=threadId; s<self->m_Slabs.size(); s+=threadCount )
+    {
+    switch( self->m_SlabStep )
+      {
+      case SCAN_SLABS:
+        self->ScanSlab( self->m_Slabs[s] );
+        break;
+      case PROCESS_SLAB_FIFOS:
+        self->ProcessSlabFifo( self->m_Slabs[s] );
+        break;
+      case PROPAGATE_FORWARD:
+        self->PropagateSlabBorder( s, true );
+        break;
+      case PROPAGATE_BACKWARD:
+        self->PropagateSlabBorder( s, false );
+        break;
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+// the downhill filter: the pixels are propagated in the order of their
+// values, so each pixel is propagated only once
+template <class TInputImage, class TOutputImage, class TCompare>
+void
+ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
+::GenerateDataDownhill(ProgressReporter &progress)
+{
+  const OutputImageRegionType region = this->GetOutput()->GetRequestedRegion();
+  const InputImagePixelType * markerBuffer = this->GetMarkerImage()->GetBufferPointer();
+  const InputImagePixelType * maskBuffer = this->GetMaskImage()->GetBufferPointer();
+  OutputImagePixelType * outputBuffer = this->GetOutput()->GetBufferPointer();
+  const OffsetValueType nbOfPixels = region.GetNumberOfPixels();
+
+  typename ConnectivityType::Pointer connectivity = ConnectivityType::New();
+  connectivity->SetFullyConnected( m_FullyConnected );
+  m_Neighborhood.Initialize( region.GetSize(), connectivity->GetNeighbors() );
+  const unsigned int nbOfNeighbors = m_Neighborhood.GetNumberOfNeighbors();
+
+  // the queue returns first the values which are propagated by the
+  // comparison: the highest ones for a dilation
+  typedef HierarchicalQueue< OutputImagePixelType, OffsetValueType, TCompare > HierarchicalQueueType;
+  HierarchicalQueueType queue;
+
+  // copy the marker clamped by the mask
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    OutputImagePixelType V = static_cast<OutputImagePixelType>( markerBuffer[p] );
+    OutputImagePixelType iV = static_cast<OutputImagePixelType>( maskBuffer[p] );
+    if (compare(V, iV))
+      {
+      V = iV;
+      }
+    outputBuffer[p] = V;
+    }
+  this->ApplyMarkerValue( 0, nbOfPixels );
+
+  // put in the queue the pixels which can propagate their value to one of
+  // their neighbors
+  LinearOffsetType position;
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    const bool onBorder = m_Neighborhood.IsOnBorder( p, position );
+    const OutputImagePixelType V = outputBuffer[p];
+    for( unsigned int i=0; i<nbOfNeighbors; i++ )
+      {
+      if( onBorder && !m_Neighborhood.IsInside( position, i ) )
+        { continue; }
+      const OffsetValueType q = p + m_Neighborhood.GetLinearOffset( i );
+      const OutputImagePixelType VN = outputBuffer[q];
+      if (compare(V, VN) && (static_cast<OutputImagePixelType>(maskBuffer[q]) != VN))
+        {
+        queue.Push( V, p );
+        break;
+        }
+      }
+    progress.CompletedPixel();
+    }
+
+  while( !queue.Empty() )
+    {
+    const OffsetValueType p = queue.FrontValue();
+    const OutputImagePixelType V = queue.FrontKey();
+    queue.Pop();
+    if( outputBuffer[p] != V )
+      {
+      // the pixel has been raised after being put in the queue, and is
+      // also in the queue at its new value
+      continue;
+      }
+    const bool onBorder = m_Neighborhood.IsOnBorder( p, position );
+    for( unsigned int i=0; i<nbOfNeighbors; i++ )
+      {
+      if( onBorder && !m_Neighborhood.IsInside( position, i ) )
+        { continue; }
+      const OffsetValueType q = p + m_Neighborhood.GetLinearOffset( i );
+      const OutputImagePixelType VN = outputBuffer[q];
+      const OutputImagePixelType iN = static_cast<OutputImagePixelType>( maskBuffer[q] );
+      if (compare(V, VN) && (iN != VN))
+        {
+        // the new value is never propagated before the current one, so the
+        // neighbor is processed later
+        OutputImagePixelType NV = V;
+        if (!compare(iN, V))
+          {
+          // apply the clamping
+          NV = iN;
+          }
+        outputBuffer[q] = NV;
+        queue.Push( NV, q );
+        }
+      }
+    progress.CompletedPixel();
+    }
 }
-#endif
 
 template <class TInputImage, class TOutputImage, class TCompare>
 void
@@ -842,6 +1299,7 @@ ReconstructionImageFilter<TInputImage, TOutputImage, TCompare>
 
   os << indent << "FullyConnected: "  << m_FullyConnected << std::endl;
   os << indent << "boundary value: " << m_MarkerValue << std::endl;
+  os << indent << "Algorithm: " << m_Algorithm << std::endl;
 }
 }
 #endif
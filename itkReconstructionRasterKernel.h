@@ -0,0 +1,816 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkReconstructionRasterKernel.h,v $
+  Language:  C++
+  Date:      $Date: 2007/02/12 10:12:31 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkReconstructionRasterKernel_h
+#define __itkReconstructionRasterKernel_h
+
+#include "itkOffset.h"
+#include <functional>
+#include <algorithm>
+
+// SSE2 is always available on x86_64, and is used when the compiler is
+// allowed to use it. AVX2 is only used after a check of the processor, and
+// needs a compiler able to compile a function for a given instruction set.
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define ITK_RECONSTRUCTION_RASTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(ITK_RECONSTRUCTION_RASTER_SSE2) && ( defined(__clang__) || ( defined(__GNUC__) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) ) ) )
+#define ITK_RECONSTRUCTION_RASTER_AVX2
+#define ITK_RECONSTRUCTION_RASTER_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+namespace itk
+{
+
+/** \class ReconstructionRasterInstructionSet
+ *  \brief Instruction set used by the raster passes of ReconstructionImageFilter
+ *
+ * The best instruction set supported by both the compiler and the
+ * processor is detected at run time. SetGlobalMaximum() can be used to
+ * restrict the instruction set, to compare the results or the timings of
+ * the different versions.
+ */
+class ReconstructionRasterInstructionSet
+{
+public:
+  enum InstructionSetType {
+    SCALAR = 0,
+    SSE2 = 1,
+    AVX2 = 2 } ;
+
+  /** return the best instruction set available */
+  static int GetAvailable()
+    {
+    static const int available = Detect();
+    return available;
+    }
+
+  /** Set/Get the best instruction set which can be used. Default is AVX2. */
+  static void SetGlobalMaximum( int instructionSet )
+    {
+    GlobalMaximum() = instructionSet;
+    }
+  static int GetGlobalMaximum()
+    {
+    return GlobalMaximum();
+    }
+
+  /** return the instruction set to use */
+  static int Get()
+    {
+    return std::min( GetAvailable(), GetGlobalMaximum() );
+    }
+
+private:
+  static int & GlobalMaximum()
+    {
+    static int maximum = AVX2;
+    return maximum;
+    }
+
+  static int Detect()
+    {
+#if defined(ITK_RECONSTRUCTION_RASTER_AVX2)
+    if( __builtin_cpu_supports( "avx2" ) )
+      {
+      return AVX2;
+      }
+#endif
+#if defined(ITK_RECONSTRUCTION_RASTER_SSE2)
+    return SSE2;
+#else
+    return SCALAR;
+#endif
+    }
+};
+
+
+/** \class ReconstructionRasterScalarKernel
+ *  \brief Operations on the rows of the raster passes of ReconstructionImageFilter
+ *
+ * With the face connectivity, the neighbors of a pixel in the other rows
+ * are at the same position in those rows: a whole row can be propagated
+ * from another one with DominateRow(), and only the propagation along the
+ * row, done by ForwardRow() and BackwardRow(), depends on the previous
+ * pixels of the row.
+ *
+ * The value propagated between two pixels is the one which is first for
+ * TCompare, and the value is clamped by the mask.
+ */
+template <class TInputPixel, class TOutputPixel, class TCompare>
+class ReconstructionRasterScalarKernel
+{
+public:
+  typedef TInputPixel  InputPixelType;
+  typedef TOutputPixel OutputPixelType;
+  typedef Offset<1>::OffsetValueType OffsetValueType;
+
+  /** return true if SIMD instructions are used with that instruction set */
+  static bool IsVectorized( int itkNotUsed(instructionSet) )
+    {
+    return false;
+    }
+
+  /** copy the marker clamped by the mask */
+  static void ClampRow( OutputPixelType * row, const InputPixelType * marker, const InputPixelType * mask,
+                        OffsetValueType n, int itkNotUsed(instructionSet) )
+    {
+    TCompare compare;
+    for( OffsetValueType x=0; x<n; x++ )
+      {
+      OutputPixelType V = static_cast<OutputPixelType>( marker[x] );
+      const OutputPixelType iV = static_cast<OutputPixelType>( mask[x] );
+      if( compare( V, iV ) )
+        {
+        V = iV;
+        }
+      row[x] = V;
+      }
+    }
+
+  /** propagate the values of another row, without clamping */
+  static void DominateRow( OutputPixelType * row, const OutputPixelType * other,
+                           OffsetValueType n, int itkNotUsed(instructionSet) )
+    {
+    TCompare compare;
+    for( OffsetValueType x=0; x<n; x++ )
+      {
+      if( compare( other[x], row[x] ) )
+        {
+        row[x] = other[x];
+        }
+      }
+    }
+
+  /** propagate the values from the start to the end of the row, and clamp
+   * them by the mask */
+  static void ForwardRow( OutputPixelType * row, const InputPixelType * mask, OffsetValueType n )
+    {
+    TCompare compare;
+    OutputPixelType previous = row[0];
+    for( OffsetValueType x=0; x<n; x++ )
+      {
+      OutputPixelType V = row[x];
+      if( compare( previous, V ) )
+        {
+        V = previous;
+        }
+      const OutputPixelType iV = static_cast<OutputPixelType>( mask[x] );
+      if( compare( V, iV ) )
+        {
+        V = iV;
+        }
+      row[x] = V;
+      previous = V;
+      }
+    }
+
+  /** propagate the values from the end to the start of the row, and clamp
+   * them by the mask */
+  static void BackwardRow( OutputPixelType * row, const InputPixelType * mask, OffsetValueType n )
+    {
+    TCompare compare;
+    OutputPixelType next = row[n-1];
+    for( OffsetValueType x=n-1; x>=0; x-- )
+      {
+      OutputPixelType V = row[x];
+      if( compare( next, V ) )
+        {
+        V = next;
+        }
+      const OutputPixelType iV = static_cast<OutputPixelType>( mask[x] );
+      if( compare( V, iV ) )
+        {
+        V = iV;
+        }
+      row[x] = V;
+      next = V;
+      }
+    }
+
+  /** push in the fifo, from the end to the start of the row, the pixels
+   * which can propagate their value to one of their later neighbors: the
+   * next pixel of the row, or the pixels at the same position in the later
+   * rows and in their masks. The offset of the row is added to the
+   * positions pushed in the fifo. */
+  template <class TFifo>
+  static void PushCandidates( const OutputPixelType * row, const InputPixelType * mask,
+                              const OutputPixelType * const * later, const InputPixelType * const * laterMask,
+                              unsigned int nbOfLater, OffsetValueType n, OffsetValueType offset, TFifo & fifo,
+                              int itkNotUsed(instructionSet) )
+    {
+    for( OffsetValueType x=n-1; x>=0; x-- )
+      {
+      if( IsCandidate( row, mask, later, laterMask, nbOfLater, n, x ) )
+        {
+        fifo.push( offset + x );
+        }
+      }
+    }
+
+protected:
+  static inline bool IsCandidate( const OutputPixelType * row, const InputPixelType * mask,
+                                  const OutputPixelType * const * later, const InputPixelType * const * laterMask,
+                                  unsigned int nbOfLater, OffsetValueType n, OffsetValueType x )
+    {
+    TCompare compare;
+    const OutputPixelType V = row[x];
+    if( x + 1 < n
+        && compare( V, row[x+1] )
+        && compare( static_cast<OutputPixelType>( mask[x+1] ), row[x+1] ) )
+      {
+      return true;
+      }
+    for( unsigned int k=0; k<nbOfLater; k++ )
+      {
+      const OutputPixelType VN = later[k][x];
+      if( compare( V, VN ) && compare( static_cast<OutputPixelType>( laterMask[k][x] ), VN ) )
+        {
+        return true;
+        }
+      }
+    return false;
+    }
+};
+
+
+/** \class ReconstructionRasterPixelTraits
+ *  \brief Pixel types supported by the SIMD versions of the raster passes
+ */
+template <class TPixel>
+class ReconstructionRasterPixelTraits
+{
+public:
+  enum { Supported = 0 };
+};
+
+template <>
+class ReconstructionRasterPixelTraits<unsigned char>
+{
+public:
+  enum { Supported = 1 };
+};
+
+template <>
+class ReconstructionRasterPixelTraits<signed char>
+{
+public:
+  enum { Supported = 1 };
+};
+
+template <>
+class ReconstructionRasterPixelTraits<unsigned short>
+{
+public:
+  enum { Supported = 1 };
+};
+
+template <>
+class ReconstructionRasterPixelTraits<short>
+{
+public:
+  enum { Supported = 1 };
+};
+
+template <>
+class ReconstructionRasterPixelTraits<float>
+{
+public:
+  enum { Supported = 1 };
+};
+
+
+#if defined(ITK_RECONSTRUCTION_RASTER_SSE2)
+
+/** \class ReconstructionSSE2Operations
+ *  \brief SSE2 operations on the vectors of pixels
+ *
+ * The signed 8 bits and unsigned 16 bits minimum and maximum are not in
+ * SSE2: the sign bit is flipped to use the other signedness.
+ */
+template <class TPixel>
+class ReconstructionSSE2Operations
+{
+};
+
+template <>
+class ReconstructionSSE2Operations<unsigned char>
+{
+public:
+  typedef unsigned char PixelType;
+  typedef __m128i VectorType;
+  typedef __m128i MaskType;
+  enum { Width = 16 };
+  static inline VectorType Load( const PixelType * p ) { return _mm_loadu_si128( (const __m128i *)p ); }
+  static inline void Store( PixelType * p, VectorType v ) { _mm_storeu_si128( (__m128i *)p, v ); }
+  static inline VectorType Max( VectorType a, VectorType b ) { return _mm_max_epu8( a, b ); }
+  static inline VectorType Min( VectorType a, VectorType b ) { return _mm_min_epu8( a, b ); }
+  static inline MaskType Equal( VectorType a, VectorType b ) { return _mm_cmpeq_epi8( a, b ); }
+  static inline MaskType And( MaskType a, MaskType b ) { return _mm_and_si128( a, b ); }
+  static inline MaskType Or( MaskType a, MaskType b ) { return _mm_or_si128( a, b ); }
+  static inline bool All( MaskType m ) { return _mm_movemask_epi8( m ) == 0xFFFF; }
+  static inline unsigned int Bits( MaskType m ) { return _mm_movemask_epi8( m ); }
+};
+
+template <>
+class ReconstructionSSE2Operations<signed char>
+{
+public:
+  typedef signed char PixelType;
+  typedef __m128i VectorType;
+  typedef __m128i MaskType;
+  enum { Width = 16 };
+  static inline VectorType Load( const PixelType * p ) { return _mm_loadu_si128( (const __m128i *)p ); }
+  static inline void Store( PixelType * p, VectorType v ) { _mm_storeu_si128( (__m128i *)p, v ); }
+  static inline VectorType Max( VectorType a, VectorType b )
+    {
+    const __m128i sign = _mm_set1_epi8( (char)0x80 );
+    return _mm_xor_si128( _mm_max_epu8( _mm_xor_si128( a, sign ), _mm_xor_si128( b, sign ) ), sign );
+    }
+  static inline VectorType Min( VectorType a, VectorType b )
+    {
+    const __m128i sign = _mm_set1_epi8( (char)0x80 );
+    return _mm_xor_si128( _mm_min_epu8( _mm_xor_si128( a, sign ), _mm_xor_si128( b, sign ) ), sign );
+    }
+  static inline MaskType Equal( VectorType a, VectorType b ) { return _mm_cmpeq_epi8( a, b ); }
+  static inline MaskType And( MaskType a, MaskType b ) { return _mm_and_si128( a, b ); }
+  static inline MaskType Or( MaskType a, MaskType b ) { return _mm_or_si128( a, b ); }
+  static inline bool All( MaskType m ) { return _mm_movemask_epi8( m ) == 0xFFFF; }
+  static inline unsigned int Bits( MaskType m ) { return _mm_movemask_epi8( m ); }
+};
+
+template <>
+class ReconstructionSSE2Operations<unsigned short>
+{
+public:
+  typedef unsigned short PixelType;
+  typedef __m128i VectorType;
+  typedef __m128i MaskType;
+  enum { Width = 8 };
+  static inline VectorType Load( const PixelType * p ) { return _mm_loadu_si128( (const __m128i *)p ); }
+  static inline void Store( PixelType * p, VectorType v ) { _mm_storeu_si128( (__m128i *)p, v ); }
+  static inline VectorType Max( VectorType a, VectorType b )
+    {
+    const __m128i sign = _mm_set1_epi16( (short)0x8000 );
+    return _mm_xor_si128( _mm_max_epi16( _mm_xor_si128( a, sign ), _mm_xor_si128( b, sign ) ), sign );
+    }
+  static inline VectorType Min( VectorType a, VectorType b )
+    {
+    const __m128i sign = _mm_set1_epi16( (short)0x8000 );
+    return _mm_xor_si128( _mm_min_epi16( _mm_xor_si128( a, sign ), _mm_xor_si128( b, sign ) ), sign );
+    }
+  static inline MaskType Equal( VectorType a, VectorType b ) { return _mm_cmpeq_epi16( a, b ); }
+  static inline MaskType And( MaskType a, MaskType b ) { return _mm_and_si128( a, b ); }
+  static inline MaskType Or( MaskType a, MaskType b ) { return _mm_or_si128( a, b ); }
+  static inline bool All( MaskType m ) { return _mm_movemask_epi8( m ) == 0xFFFF; }
+  static inline unsigned int Bits( MaskType m ) { return _mm_movemask_epi8( m ); }
+};
+
+template <>
+class ReconstructionSSE2Operations<short>
+{
+public:
+  typedef short PixelType;
+  typedef __m128i VectorType;
+  typedef __m128i MaskType;
+  enum { Width = 8 };
+  static inline VectorType Load( const PixelType * p ) { return _mm_loadu_si128( (const __m128i *)p ); }
+  static inline void Store( PixelType * p, VectorType v ) { _mm_storeu_si128( (__m128i *)p, v ); }
+  static inline VectorType Max( VectorType a, VectorType b ) { return _mm_max_epi16( a, b ); }
+  static inline VectorType Min( VectorType a, VectorType b ) { return _mm_min_epi16( a, b ); }
+  static inline MaskType Equal( VectorType a, VectorType b ) { return _mm_cmpeq_epi16( a, b ); }
+  static inline MaskType And( MaskType a, MaskType b ) { return _mm_and_si128( a, b ); }
+  static inline MaskType Or( MaskType a, MaskType b ) { return _mm_or_si128( a, b ); }
+  static inline bool All( MaskType m ) { return _mm_movemask_epi8( m ) == 0xFFFF; }
+  static inline unsigned int Bits( MaskType m ) { return _mm_movemask_epi8( m ); }
+};
+
+template <>
+class ReconstructionSSE2Operations<float>
+{
+public:
+  typedef float PixelType;
+  typedef __m128 VectorType;
+  typedef __m128 MaskType;
+  enum { Width = 4 };
+  static inline VectorType Load( const PixelType * p ) { return _mm_loadu_ps( p ); }
+  static inline void Store( PixelType * p, VectorType v ) { _mm_storeu_ps( p, v ); }
+  static inline VectorType Max( VectorType a, VectorType b ) { return _mm_max_ps( a, b ); }
+  static inline VectorType Min( VectorType a, VectorType b ) { return _mm_min_ps( a, b ); }
+  static inline MaskType Equal( VectorType a, VectorType b ) { return _mm_cmpeq_ps( a, b ); }
+  static inline MaskType And( MaskType a, MaskType b ) { return _mm_and_ps( a, b ); }
+  static inline MaskType Or( MaskType a, MaskType b ) { return _mm_or_ps( a, b ); }
+  static inline bool All( MaskType m ) { return _mm_movemask_ps( m ) == 0xF; }
+  static inline unsigned int Bits( MaskType m ) { return _mm_movemask_epi8( _mm_castps_si128( m ) ); }
+};
+
+#endif
+
+
+#if defined(ITK_RECONSTRUCTION_RASTER_AVX2)
+
+/** \class ReconstructionAVX2Operations
+ *  \brief AVX2 operations on the vectors of pixels
+ *
+ * The functions are compiled for AVX2 even when the rest of the program is
+ * not, and must only be called after a check of the processor.
+ */
+template <class TPixel>
+class ReconstructionAVX2Operations
+{
+};
+
+template <>
+class ReconstructionAVX2Operations<unsigned char>
+{
+public:
+  typedef unsigned char PixelType;
+  typedef __m256i VectorType;
+  typedef __m256i MaskType;
+  enum { Width = 32 };
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Load( const PixelType * p ) { return _mm256_loadu_si256( (const __m256i *)p ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET void Store( PixelType * p, VectorType v ) { _mm256_storeu_si256( (__m256i *)p, v ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Max( VectorType a, VectorType b ) { return _mm256_max_epu8( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Min( VectorType a, VectorType b ) { return _mm256_min_epu8( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Equal( VectorType a, VectorType b ) { return _mm256_cmpeq_epi8( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType And( MaskType a, MaskType b ) { return _mm256_and_si256( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Or( MaskType a, MaskType b ) { return _mm256_or_si256( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET bool All( MaskType m ) { return _mm256_movemask_epi8( m ) == -1; }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET unsigned int Bits( MaskType m ) { return _mm256_movemask_epi8( m ); }
+};
+
+template <>
+class ReconstructionAVX2Operations<signed char>
+{
+public:
+  typedef signed char PixelType;
+  typedef __m256i VectorType;
+  typedef __m256i MaskType;
+  enum { Width = 32 };
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Load( const PixelType * p ) { return _mm256_loadu_si256( (const __m256i *)p ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET void Store( PixelType * p, VectorType v ) { _mm256_storeu_si256( (__m256i *)p, v ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Max( VectorType a, VectorType b ) { return _mm256_max_epi8( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Min( VectorType a, VectorType b ) { return _mm256_min_epi8( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Equal( VectorType a, VectorType b ) { return _mm256_cmpeq_epi8( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType And( MaskType a, MaskType b ) { return _mm256_and_si256( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Or( MaskType a, MaskType b ) { return _mm256_or_si256( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET bool All( MaskType m ) { return _mm256_movemask_epi8( m ) == -1; }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET unsigned int Bits( MaskType m ) { return _mm256_movemask_epi8( m ); }
+};
+
+template <>
+class ReconstructionAVX2Operations<unsigned short>
+{
+public:
+  typedef unsigned short PixelType;
+  typedef __m256i VectorType;
+  typedef __m256i MaskType;
+  enum { Width = 16 };
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Load( const PixelType * p ) { return _mm256_loadu_si256( (const __m256i *)p ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET void Store( PixelType * p, VectorType v ) { _mm256_storeu_si256( (__m256i *)p, v ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Max( VectorType a, VectorType b ) { return _mm256_max_epu16( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Min( VectorType a, VectorType b ) { return _mm256_min_epu16( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Equal( VectorType a, VectorType b ) { return _mm256_cmpeq_epi16( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType And( MaskType a, MaskType b ) { return _mm256_and_si256( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Or( MaskType a, MaskType b ) { return _mm256_or_si256( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET bool All( MaskType m ) { return _mm256_movemask_epi8( m ) == -1; }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET unsigned int Bits( MaskType m ) { return _mm256_movemask_epi8( m ); }
+};
+
+template <>
+class ReconstructionAVX2Operations<short>
+{
+public:
+  typedef short PixelType;
+  typedef __m256i VectorType;
+  typedef __m256i MaskType;
+  enum { Width = 16 };
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Load( const PixelType * p ) { return _mm256_loadu_si256( (const __m256i *)p ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET void Store( PixelType * p, VectorType v ) { _mm256_storeu_si256( (__m256i *)p, v ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Max( VectorType a, VectorType b ) { return _mm256_max_epi16( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Min( VectorType a, VectorType b ) { return _mm256_min_epi16( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Equal( VectorType a, VectorType b ) { return _mm256_cmpeq_epi16( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType And( MaskType a, MaskType b ) { return _mm256_and_si256( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Or( MaskType a, MaskType b ) { return _mm256_or_si256( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET bool All( MaskType m ) { return _mm256_movemask_epi8( m ) == -1; }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET unsigned int Bits( MaskType m ) { return _mm256_movemask_epi8( m ); }
+};
+
+template <>
+class ReconstructionAVX2Operations<float>
+{
+public:
+  typedef float PixelType;
+  typedef __m256 VectorType;
+  typedef __m256 MaskType;
+  enum { Width = 8 };
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Load( const PixelType * p ) { return _mm256_loadu_ps( p ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET void Store( PixelType * p, VectorType v ) { _mm256_storeu_ps( p, v ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Max( VectorType a, VectorType b ) { return _mm256_max_ps( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET VectorType Min( VectorType a, VectorType b ) { return _mm256_min_ps( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Equal( VectorType a, VectorType b ) { return _mm256_cmp_ps( a, b, _CMP_EQ_OQ ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType And( MaskType a, MaskType b ) { return _mm256_and_ps( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET MaskType Or( MaskType a, MaskType b ) { return _mm256_or_ps( a, b ); }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET bool All( MaskType m ) { return _mm256_movemask_ps( m ) == 0xFF; }
+  static inline ITK_RECONSTRUCTION_RASTER_AVX2_TARGET unsigned int Bits( MaskType m ) { return _mm256_movemask_epi8( _mm256_castps_si256( m ) ); }
+};
+
+#endif
+
+
+/** \class ReconstructionRasterVectorKernel
+ *  \brief SIMD versions of the operations of ReconstructionRasterScalarKernel
+ *
+ * DominateRow() and ClampRow() are done on whole vectors of pixels.
+ * PushCandidates() checks a whole vector of pixels at once, and the
+ * candidates are found in the bits of the comparison, which has one bit
+ * per byte of the vector. ForwardRow() and BackwardRow() are not
+ * vectorized: each pixel depends on the previous one.
+ *
+ * VDilation is true when the first value for TCompare is the maximum.
+ */
+template <class TPixel, class TCompare, bool VDilation, bool VSupported=ReconstructionRasterPixelTraits<TPixel>::Supported>
+class ReconstructionRasterVectorKernel
+  : public ReconstructionRasterScalarKernel<TPixel, TPixel, TCompare>
+{
+};
+
+template <class TPixel, class TCompare, bool VDilation>
+class ReconstructionRasterVectorKernel<TPixel, TCompare, VDilation, true>
+  : public ReconstructionRasterScalarKernel<TPixel, TPixel, TCompare>
+{
+public:
+  typedef ReconstructionRasterScalarKernel<TPixel, TPixel, TCompare> Superclass;
+  typedef typename Superclass::OffsetValueType OffsetValueType;
+
+  static bool IsVectorized( int instructionSet )
+    {
+    return instructionSet != ReconstructionRasterInstructionSet::SCALAR;
+    }
+
+  static void ClampRow( TPixel * row, const TPixel * marker, const TPixel * mask,
+                        OffsetValueType n, int instructionSet )
+    {
+#if defined(ITK_RECONSTRUCTION_RASTER_AVX2)
+    if( instructionSet >= ReconstructionRasterInstructionSet::AVX2 )
+      {
+      AVX2ClampRow< ReconstructionAVX2Operations<TPixel> >( row, marker, mask, n );
+      return;
+      }
+#endif
+#if defined(ITK_RECONSTRUCTION_RASTER_SSE2)
+    if( instructionSet >= ReconstructionRasterInstructionSet::SSE2 )
+      {
+      SSE2ClampRow< ReconstructionSSE2Operations<TPixel> >( row, marker, mask, n );
+      return;
+      }
+#endif
+    Superclass::ClampRow( row, marker, mask, n, instructionSet );
+    }
+
+  static void DominateRow( TPixel * row, const TPixel * other,
+                           OffsetValueType n, int instructionSet )
+    {
+#if defined(ITK_RECONSTRUCTION_RASTER_AVX2)
+    if( instructionSet >= ReconstructionRasterInstructionSet::AVX2 )
+      {
+      AVX2DominateRow< ReconstructionAVX2Operations<TPixel> >( row, other, n );
+      return;
+      }
+#endif
+#if defined(ITK_RECONSTRUCTION_RASTER_SSE2)
+    if( instructionSet >= ReconstructionRasterInstructionSet::SSE2 )
+      {
+      SSE2DominateRow< ReconstructionSSE2Operations<TPixel> >( row, other, n );
+      return;
+      }
+#endif
+    Superclass::DominateRow( row, other, n, instructionSet );
+    }
+
+  template <class TFifo>
+  static void PushCandidates( const TPixel * row, const TPixel * mask,
+                              const TPixel * const * later, const TPixel * const * laterMask,
+                              unsigned int nbOfLater, OffsetValueType n, OffsetValueType offset, TFifo & fifo,
+                              int instructionSet )
+    {
+    if( n == 0 )
+      {
+      return;
+      }
+    // the last pixel of the row has no next pixel in the row, and the
+    // vectors are taken from the end of the row, before the last pixel
+    OffsetValueType x = n - 1;
+    if( Superclass::IsCandidate( row, mask, later, laterMask, nbOfLater, n, x ) )
+      {
+      fifo.push( offset + x );
+      }
+#if defined(ITK_RECONSTRUCTION_RASTER_AVX2)
+    if( instructionSet >= ReconstructionRasterInstructionSet::AVX2 )
+      {
+      x = AVX2PushCandidates< ReconstructionAVX2Operations<TPixel> >( row, mask, later, laterMask, nbOfLater, n, offset, fifo );
+      }
+    else
+#endif
+#if defined(ITK_RECONSTRUCTION_RASTER_SSE2)
+    if( instructionSet >= ReconstructionRasterInstructionSet::SSE2 )
+      {
+      x = SSE2PushCandidates< ReconstructionSSE2Operations<TPixel> >( row, mask, later, laterMask, nbOfLater, n, offset, fifo );
+      }
+#endif
+    // the start of the row
+    for( x--; x>=0; x-- )
+      {
+      if( Superclass::IsCandidate( row, mask, later, laterMask, nbOfLater, n, x ) )
+        {
+        fifo.push( offset + x );
+        }
+      }
+    }
+
+private:
+#if defined(ITK_RECONSTRUCTION_RASTER_SSE2)
+  template <class TOps>
+  static void SSE2ClampRow( TPixel * row, const TPixel * marker, const TPixel * mask, OffsetValueType n )
+    {
+    OffsetValueType x = 0;
+    for( ; x + TOps::Width <= n; x += TOps::Width )
+      {
+      const typename TOps::VectorType V = TOps::Load( marker + x );
+      const typename TOps::VectorType iV = TOps::Load( mask + x );
+      TOps::Store( row + x, VDilation ? TOps::Min( V, iV ) : TOps::Max( V, iV ) );
+      }
+    Superclass::ClampRow( row + x, marker + x, mask + x, n - x, ReconstructionRasterInstructionSet::SCALAR );
+    }
+
+  template <class TOps>
+  static void SSE2DominateRow( TPixel * row, const TPixel * other, OffsetValueType n )
+    {
+    OffsetValueType x = 0;
+    for( ; x + TOps::Width <= n; x += TOps::Width )
+      {
+      const typename TOps::VectorType V = TOps::Load( row + x );
+      const typename TOps::VectorType VN = TOps::Load( other + x );
+      TOps::Store( row + x, VDilation ? TOps::Max( V, VN ) : TOps::Min( V, VN ) );
+      }
+    Superclass::DominateRow( row + x, other + x, n - x, ReconstructionRasterInstructionSet::SCALAR );
+    }
+
+  // check the vectors which end before the last pixel of the row, from the
+  // end of the row, and return the position of the first pixel checked
+  template <class TOps, class TFifo>
+  static OffsetValueType SSE2PushCandidates( const TPixel * row, const TPixel * mask,
+                                             const TPixel * const * later, const TPixel * const * laterMask,
+                                             unsigned int nbOfLater, OffsetValueType n, OffsetValueType offset, TFifo & fifo )
+    {
+    OffsetValueType x = n - 1;
+    while( x >= TOps::Width )
+      {
+      x -= TOps::Width;
+      const typename TOps::VectorType V = TOps::Load( row + x );
+      // the pixels which can't propagate their value to a neighbor VN,
+      // because V or the mask of the neighbor is not first for TCompare
+      typename TOps::VectorType VN = TOps::Load( row + x + 1 );
+      typename TOps::VectorType iN = TOps::Load( mask + x + 1 );
+      typename TOps::MaskType stable =
+        TOps::Or( TOps::Equal( VDilation ? TOps::Max( V, VN ) : TOps::Min( V, VN ), VN ),
+                  TOps::Equal( VDilation ? TOps::Max( iN, VN ) : TOps::Min( iN, VN ), VN ) );
+      for( unsigned int k=0; k<nbOfLater; k++ )
+        {
+        VN = TOps::Load( later[k] + x );
+        iN = TOps::Load( laterMask[k] + x );
+        stable = TOps::And( stable,
+          TOps::Or( TOps::Equal( VDilation ? TOps::Max( V, VN ) : TOps::Min( V, VN ), VN ),
+                    TOps::Equal( VDilation ? TOps::Max( iN, VN ) : TOps::Min( iN, VN ), VN ) ) );
+        }
+      if( !TOps::All( stable ) )
+        {
+        const unsigned int bits = TOps::Bits( stable );
+        for( OffsetValueType i=TOps::Width-1; i>=0; i-- )
+          {
+          if( !( ( bits >> ( i * sizeof(TPixel) ) ) & 1 ) )
+            {
+            fifo.push( offset + x + i );
+            }
+          }
+        }
+      }
+    return x;
+    }
+#endif
+
+#if defined(ITK_RECONSTRUCTION_RASTER_AVX2)
+  template <class TOps>
+  static ITK_RECONSTRUCTION_RASTER_AVX2_TARGET void AVX2ClampRow( TPixel * row, const TPixel * marker, const TPixel * mask, OffsetValueType n )
+    {
+    OffsetValueType x = 0;
+    for( ; x + TOps::Width <= n; x += TOps::Width )
+      {
+      const typename TOps::VectorType V = TOps::Load( marker + x );
+      const typename TOps::VectorType iV = TOps::Load( mask + x );
+      TOps::Store( row + x, VDilation ? TOps::Min( V, iV ) : TOps::Max( V, iV ) );
+      }
+    Superclass::ClampRow( row + x, marker + x, mask + x, n - x, ReconstructionRasterInstructionSet::SCALAR );
+    }
+
+  template <class TOps>
+  static ITK_RECONSTRUCTION_RASTER_AVX2_TARGET void AVX2DominateRow( TPixel * row, const TPixel * other, OffsetValueType n )
+    {
+    OffsetValueType x = 0;
+    for( ; x + TOps::Width <= n; x += TOps::Width )
+      {
+      const typename TOps::VectorType V = TOps::Load( row + x );
+      const typename TOps::VectorType VN = TOps::Load( other + x );
+      TOps::Store( row + x, VDilation ? TOps::Max( V, VN ) : TOps::Min( V, VN ) );
+      }
+    Superclass::DominateRow( row + x, other + x, n - x, ReconstructionRasterInstructionSet::SCALAR );
+    }
+
+  template <class TOps, class TFifo>
+  static ITK_RECONSTRUCTION_RASTER_AVX2_TARGET OffsetValueType AVX2PushCandidates( const TPixel * row, const TPixel * mask,
+                                             const TPixel * const * later, const TPixel * const * laterMask,
+                                             unsigned int nbOfLater, OffsetValueType n, OffsetValueType offset, TFifo & fifo )
+    {
+    OffsetValueType x = n - 1;
+    while( x >= TOps::Width )
+      {
+      x -= TOps::Width;
+      const typename TOps::VectorType V = TOps::Load( row + x );
+      typename TOps::VectorType VN = TOps::Load( row + x + 1 );
+      typename TOps::VectorType iN = TOps::Load( mask + x + 1 );
+      typename TOps::MaskType stable =
+        TOps::Or( TOps::Equal( VDilation ? TOps::Max( V, VN ) : TOps::Min( V, VN ), VN ),
+                  TOps::Equal( VDilation ? TOps::Max( iN, VN ) : TOps::Min( iN, VN ), VN ) );
+      for( unsigned int k=0; k<nbOfLater; k++ )
+        {
+        VN = TOps::Load( later[k] + x );
+        iN = TOps::Load( laterMask[k] + x );
+        stable = TOps::And( stable,
+          TOps::Or( TOps::Equal( VDilation ? TOps::Max( V, VN ) : TOps::Min( V, VN ), VN ),
+                    TOps::Equal( VDilation ? TOps::Max( iN, VN ) : TOps::Min( iN, VN ), VN ) ) );
+        }
+      if( !TOps::All( stable ) )
+        {
+        const unsigned int bits = TOps::Bits( stable );
+        for( OffsetValueType i=TOps::Width-1; i>=0; i-- )
+          {
+          if( !( ( bits >> ( i * sizeof(TPixel) ) ) & 1 ) )
+            {
+            fifo.push( offset + x + i );
+            }
+          }
+        }
+      }
+    return x;
+    }
+#endif
+};
+
+
+/** \class ReconstructionRasterKernel
+ *  \brief Operations on the rows used by the raster passes of ReconstructionImageFilter
+ *
+ * The SIMD versions are used for the reconstructions by dilation and by
+ * erosion, when the marker, the mask and the output have the same pixel
+ * type, and that type is supported - the 8 and 16 bits integers and float.
+ * The scalar versions are used otherwise.
+ *
+ * \sa ReconstructionRasterScalarKernel, ReconstructionRasterInstructionSet
+ */
+template <class TInputPixel, class TOutputPixel, class TCompare>
+class ReconstructionRasterKernel
+  : public ReconstructionRasterScalarKernel<TInputPixel, TOutputPixel, TCompare>
+{
+};
+
+template <class TPixel>
+class ReconstructionRasterKernel<TPixel, TPixel, std::greater<TPixel> >
+  : public ReconstructionRasterVectorKernel<TPixel, std::greater<TPixel>, true>
+{
+};
+
+template <class TPixel>
+class ReconstructionRasterKernel<TPixel, TPixel, std::less<TPixel> >
+  : public ReconstructionRasterVectorKernel<TPixel, std::less<TPixel>, false>
+{
+};
+
+} // end namespace itk
+
+#endif
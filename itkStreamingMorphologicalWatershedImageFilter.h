@@ -0,0 +1,184 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkStreamingMorphologicalWatershedImageFilter.h,v $
+  Language:  C++
+  Date:      $Date: 2007/01/22 09:12:40 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even 
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR 
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkStreamingMorphologicalWatershedImageFilter_h
+#define __itkStreamingMorphologicalWatershedImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include <vector>
+
+namespace itk {
+
+/** \class StreamingMorphologicalWatershedImageFilter
+ * \brief Morphological watershed transform computed slab by slab
+ *
+ * MorphologicalWatershedImageFilter needs the whole input image, and
+ * allocates several images of the size of the input. This filter is able to
+ * produce only a part of the output, and so can be used in a streamed
+ * pipeline - for example with the NumberOfStreamDivisions of the
+ * ImageFileWriter - to segment the images which don't fit in memory.
+ *
+ * The output is produced by slabs along the last dimension. For each slab,
+ * the input slab, with Overlap more slices before and after it, is copied
+ * and segmented with MorphologicalWatershedImageFilter. Only the slab and
+ * its overlap are in memory at a given time.
+ *
+ * The labels are stitched across the slab borders with the last slice of
+ * the previous slab: a label of the new slab and a label of that slice are
+ * the same basin when each one is the label the other shares the most
+ * pixels with. The other labels get a new label, so two basins of a slab
+ * never get the same label. A basin which joins several basins of the
+ * previous slab - the two arms of a U, for example - keeps the label of
+ * one of them only: the labels of the slabs already produced can't be
+ * changed.
+ * This requires the slabs to be produced in order, as done by the streaming
+ * of the ImageFileWriter or of the StreamingImageFilter; the labels are
+ * restarted from 1 when a slab is not the next one.
+ *
+ * The watershed transform is a global operation, so the result is exactly
+ * the same than the one of MorphologicalWatershedImageFilter only when the
+ * overlap covers all the input. With a smaller overlap, the regions which
+ * are far from a slab can't be seen from that slab, and the watershed
+ * lines may be different. In practice, an overlap larger than the size of
+ * the objects gives the same segmentation for the objects.
+ *
+ * Watershed pixel are labeled 0. The labels are consecutive, in the order
+ * they are found in the slabs.
+ *
+ * \author Gatan Lehmann. Biologie du Dveloppement et de la Reproduction, INRA de Jouy-en-Josas, France.
+ *
+ * \sa MorphologicalWatershedImageFilter
+ * \ingroup ImageEnhancement  MathematicalMorphologyImageFilters
+ */
+template<class TInputImage, class TOutputImage>
+class ITK_EXPORT StreamingMorphologicalWatershedImageFilter : 
+    public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef StreamingMorphologicalWatershedImageFilter Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage>
+  Superclass;
+  typedef SmartPointer<Self>        Pointer;
+  typedef SmartPointer<const Self>  ConstPointer;
+
+  /** Some convenient typedefs. */
+  typedef TInputImage InputImageType;
+  typedef TOutputImage OutputImageType;
+  typedef typename InputImageType::Pointer         InputImagePointer;
+  typedef typename InputImageType::ConstPointer    InputImageConstPointer;
+  typedef typename InputImageType::RegionType      InputImageRegionType;
+  typedef typename InputImageType::PixelType       InputImagePixelType;
+  typedef typename OutputImageType::Pointer        OutputImagePointer;
+  typedef typename OutputImageType::ConstPointer   OutputImageConstPointer;
+  typedef typename OutputImageType::RegionType     OutputImageRegionType;
+  typedef typename OutputImageType::PixelType      OutputImagePixelType;
+  typedef typename OutputImageType::IndexType      IndexType;
+  typedef typename IndexType::IndexValueType       IndexValueType;
+  
+  /** ImageDimension constants */
+  itkStaticConstMacro(InputImageDimension, unsigned int,
+                      TInputImage::ImageDimension);
+  itkStaticConstMacro(OutputImageDimension, unsigned int,
+                      TOutputImage::ImageDimension);
+
+  /** Standard New method. */
+  itkNewMacro(Self);  
+
+  /** Runtime information support. */
+  itkTypeMacro(StreamingMorphologicalWatershedImageFilter, 
+               ImageToImageFilter);
+
+  /**
+   * Set/Get whether the connected components are defined strictly by
+   * face connectivity or by face+edge+vertex connectivity.  Default is
+   * FullyConnectedOff.  For objects that are 1 pixel wide, use
+   * FullyConnectedOn.
+   */
+  itkSetMacro(FullyConnected, bool);
+  itkGetConstReferenceMacro(FullyConnected, bool);
+  itkBooleanMacro(FullyConnected);
+
+  /**
+   * Set/Get whether the watershed pixel must be marked or not. Default
+   * is true.
+   */
+  itkSetMacro(MarkWatershedLine, bool);
+  itkGetConstReferenceMacro(MarkWatershedLine, bool);
+  itkBooleanMacro(MarkWatershedLine);
+
+  /**
+   * Set/Get the height of the minima removed before the watershed
+   * transform. Default is 0.
+   */
+  itkSetMacro(Level, InputImagePixelType);
+  itkGetMacro(Level, InputImagePixelType);
+
+  /**
+   * Set/Get the number of slices of the input used before and after each
+   * slab of the output. It must be at least 1 to be able to stitch the
+   * labels. Default is 16.
+   */
+  itkSetMacro(Overlap, unsigned long);
+  itkGetConstReferenceMacro(Overlap, unsigned long);
+
+protected:
+  StreamingMorphologicalWatershedImageFilter();
+  ~StreamingMorphologicalWatershedImageFilter() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  /** The input requested region is the output requested region with
+   * Overlap slices more on each side in the last dimension. */
+  void GenerateInputRequestedRegion() ;
+
+  /** The output is produced by full slabs along the last dimension. */
+  void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
+  
+  /** Single-threaded version of GenerateData.  This filter delegates
+   * to MorphologicalWatershedImageFilter for each slab. */
+  void GenerateData();
+  
+
+private:
+  StreamingMorphologicalWatershedImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  bool m_FullyConnected;
+
+  bool m_MarkWatershedLine;
+
+  InputImagePixelType m_Level;
+
+  unsigned long m_Overlap;
+
+  // the state kept between two slabs: the labels of the last slice of the
+  // previous slab, the first slice expected in the next slab, and the next
+  // label to use
+  std::vector< OutputImagePixelType > m_Seam;
+  IndexValueType m_NextSlabIndex;
+  OutputImagePixelType m_NextLabel;
+
+} ; // end of class
+
+} // end namespace itk
+  
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkStreamingMorphologicalWatershedImageFilter.txx"
+#endif
+
+#endif
+
+
@@ -0,0 +1,264 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkStreamingMorphologicalWatershedImageFilter.txx,v $
+  Language:  C++
+  Date:      $Date: 2007/01/22 09:12:40 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even 
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR 
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkStreamingMorphologicalWatershedImageFilter_txx
+#define __itkStreamingMorphologicalWatershedImageFilter_txx
+
+#include "itkStreamingMorphologicalWatershedImageFilter.h"
+#include "itkMorphologicalWatershedImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkProgressAccumulator.h"
+#include "itkNumericTraits.h"
+#include <map>
+#include <algorithm>
+
+namespace itk {
+
+template <class TInputImage, class TOutputImage>
+StreamingMorphologicalWatershedImageFilter<TInputImage, TOutputImage>
+::StreamingMorphologicalWatershedImageFilter()
+{
+  m_FullyConnected = false;
+  m_MarkWatershedLine = true;
+  m_Level = NumericTraits< InputImagePixelType >::Zero;
+  m_Overlap = 16;
+  m_NextSlabIndex = 0;
+  m_NextLabel = NumericTraits< OutputImagePixelType >::One;
+}
+
+template <class TInputImage, class TOutputImage>
+void 
+StreamingMorphologicalWatershedImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  // call the superclass' implementation of this method
+  Superclass::GenerateInputRequestedRegion();
+  
+  InputImagePointer input = const_cast<InputImageType *>(this->GetInput());
+  if ( !input )
+    { return; }
+
+  // the slab of the output, with the overlap in the last dimension. The
+  // overlap is clamped on both sides to the largest possible region, so the
+  // computation is done on signed indexes and never wraps around.
+  const OutputImageRegionType & outputRegion = this->GetOutput()->GetRequestedRegion();
+  const InputImageRegionType & largest = input->GetLargestPossibleRegion();
+  const unsigned int last = InputImageDimension - 1;
+  const IndexValueType overlap = static_cast< IndexValueType >( m_Overlap );
+  const IndexValueType largestBegin = largest.GetIndex( last );
+  const IndexValueType largestEnd = largestBegin + static_cast< IndexValueType >( largest.GetSize( last ) );
+  const IndexValueType outputBegin = outputRegion.GetIndex( last );
+  const IndexValueType outputEnd = outputBegin + static_cast< IndexValueType >( outputRegion.GetSize( last ) );
+  const IndexValueType begin = std::max( outputBegin - overlap, largestBegin );
+  const IndexValueType end = std::min( outputEnd + overlap, largestEnd );
+  InputImageRegionType region;
+  region.SetIndex( outputRegion.GetIndex() );
+  region.SetSize( outputRegion.GetSize() );
+  region.SetIndex( last, begin );
+  region.SetSize( last, end - begin );
+  region.Crop( largest );
+  input->SetRequestedRegion( region );
+}
+
+
+template <class TInputImage, class TOutputImage>
+void 
+StreamingMorphologicalWatershedImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion(DataObject *)
+{
+  // only the last dimension can be split
+  OutputImageType * output = this->GetOutput();
+  OutputImageRegionType region = output->GetRequestedRegion();
+  const OutputImageRegionType & largest = output->GetLargestPossibleRegion();
+  for( unsigned int d=0; d<OutputImageDimension - 1; d++ )
+    {
+    region.SetIndex( d, largest.GetIndex( d ) );
+    region.SetSize( d, largest.GetSize( d ) );
+    }
+  output->SetRequestedRegion( region );
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+StreamingMorphologicalWatershedImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  if( m_Overlap == 0 )
+    { itkExceptionMacro( << "Overlap must be at least 1 to stitch the labels of the slabs." ); }
+
+  // Create a process accumulator for tracking the progress of this minipipeline
+  ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
+  progress->SetMiniPipelineFilter(this);
+
+  // Allocate the output
+  this->AllocateOutputs();
+
+  const InputImageType * input = this->GetInput();
+  OutputImageType * output = this->GetOutput();
+  const OutputImageRegionType & outputRegion = output->GetRequestedRegion();
+  const unsigned int last = OutputImageDimension - 1;
+  const OutputImagePixelType wsLabel = NumericTraits< OutputImagePixelType >::Zero;
+
+  // the labels can only be stitched with the previous slab
+  if( outputRegion.GetIndex( last ) == output->GetLargestPossibleRegion().GetIndex( last )
+      || outputRegion.GetIndex( last ) != m_NextSlabIndex )
+    {
+    m_Seam.clear();
+    m_NextLabel = NumericTraits< OutputImagePixelType >::One;
+    }
+
+  // copy the slab of the input in an image of its own, so the watershed
+  // filter, which needs its whole input, doesn't request the whole image
+  const InputImageRegionType & slabRegion = input->GetRequestedRegion();
+  InputImagePointer slab = InputImageType::New();
+  slab->CopyInformation( input );
+  slab->SetRegions( slabRegion );
+  slab->Allocate();
+  ImageRegionConstIterator< InputImageType > inIt( input, slabRegion );
+  ImageRegionIterator< InputImageType > slabIt( slab, slabRegion );
+  for( inIt.GoToBegin(), slabIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt, ++slabIt )
+    {
+    slabIt.Set( inIt.Get() );
+    }
+
+  // the watershed of the slab
+  typedef MorphologicalWatershedImageFilter< InputImageType, OutputImageType > WatershedType;
+  typename WatershedType::Pointer wshed = WatershedType::New();
+  wshed->SetInput( slab );
+  wshed->SetFullyConnected( m_FullyConnected );
+  wshed->SetMarkWatershedLine( m_MarkWatershedLine );
+  wshed->SetLevel( m_Level );
+  wshed->SetWatershedLabel( wsLabel );
+  progress->RegisterInternalFilter( wshed, 1.0f );
+  wshed->Update();
+  const OutputImageType * local = wshed->GetOutput();
+
+  // a label of the slab and a label of the last slice of the previous slab
+  // are stitched when each one is the label the other shares the most
+  // pixels with on that slice
+  typedef std::map< OutputImagePixelType, unsigned long > CountMapType;
+  typedef std::map< OutputImagePixelType, CountMapType > ContactMapType;
+  typedef std::map< OutputImagePixelType, OutputImagePixelType > TranslationMapType;
+  ContactMapType contacts;
+  TranslationMapType translation;
+
+  OutputImageRegionType seamRegion = outputRegion;
+  seamRegion.SetIndex( last, outputRegion.GetIndex( last ) + outputRegion.GetSize( last ) - 1 );
+  seamRegion.SetSize( last, 1 );
+
+  if( !m_Seam.empty() )
+    {
+    OutputImageRegionType previousSeamRegion = outputRegion;
+    previousSeamRegion.SetIndex( last, outputRegion.GetIndex( last ) - 1 );
+    previousSeamRegion.SetSize( last, 1 );
+    ImageRegionConstIterator< OutputImageType > lIt( local, previousSeamRegion );
+    typename std::vector< OutputImagePixelType >::const_iterator sIt = m_Seam.begin();
+    for( lIt.GoToBegin(); !lIt.IsAtEnd(); ++lIt, ++sIt )
+      {
+      const OutputImagePixelType & l = lIt.Get();
+      const OutputImagePixelType & g = *sIt;
+      if( l != wsLabel && g != wsLabel )
+        {
+        contacts[ l ][ g ]++;
+        }
+      }
+
+    // the best match of the labels of the slab, and the best match of the
+    // labels of the previous slab
+    TranslationMapType bestGlobal;
+    TranslationMapType bestLocal;
+    CountMapType bestLocalCount;
+    for( typename ContactMapType::const_iterator it = contacts.begin(); it != contacts.end(); it++ )
+      {
+      unsigned long max = 0;
+      for( typename CountMapType::const_iterator cit = it->second.begin(); cit != it->second.end(); cit++ )
+        {
+        if( cit->second > max )
+          {
+          max = cit->second;
+          bestGlobal[ it->first ] = cit->first;
+          }
+        typename CountMapType::iterator bit = bestLocalCount.find( cit->first );
+        if( bit == bestLocalCount.end() || cit->second > bit->second )
+          {
+          bestLocalCount[ cit->first ] = cit->second;
+          bestLocal[ cit->first ] = it->first;
+          }
+        }
+      }
+
+    // only the mutual best matches are stitched, so two basins of the slab
+    // never get the same label
+    for( typename TranslationMapType::const_iterator it = bestGlobal.begin(); it != bestGlobal.end(); it++ )
+      {
+      if( bestLocal[ it->second ] == it->first )
+        {
+        translation[ it->first ] = it->second;
+        }
+      }
+    }
+
+  // copy the slab to the output with the global labels. The labels which
+  // are not stitched to the previous slab get a new label.
+  ImageRegionConstIterator< OutputImageType > lIt( local, outputRegion );
+  ImageRegionIterator< OutputImageType > oIt( output, outputRegion );
+  for( lIt.GoToBegin(), oIt.GoToBegin(); !lIt.IsAtEnd(); ++lIt, ++oIt )
+    {
+    const OutputImagePixelType & l = lIt.Get();
+    if( l == wsLabel )
+      {
+      oIt.Set( wsLabel );
+      continue;
+      }
+    typename TranslationMapType::iterator it = translation.find( l );
+    if( it == translation.end() )
+      {
+      if( m_NextLabel == NumericTraits< OutputImagePixelType >::max() )
+        { itkExceptionMacro( << "The output pixel type is too small for the number of labels." ); }
+      it = translation.insert( typename TranslationMapType::value_type( l, m_NextLabel ) ).first;
+      m_NextLabel++;
+      }
+    oIt.Set( it->second );
+    }
+
+  // keep the last slice for the next slab
+  m_Seam.clear();
+  ImageRegionConstIterator< OutputImageType > seamIt( output, seamRegion );
+  for( seamIt.GoToBegin(); !seamIt.IsAtEnd(); ++seamIt )
+    {
+    m_Seam.push_back( seamIt.Get() );
+    }
+  m_NextSlabIndex = outputRegion.GetIndex( last ) + outputRegion.GetSize( last );
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+StreamingMorphologicalWatershedImageFilter<TInputImage, TOutputImage>
+::PrintSelf(std::ostream &os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "FullyConnected: "  << m_FullyConnected << std::endl;
+  os << indent << "MarkWatershedLine: "  << m_MarkWatershedLine << std::endl;
+  os << indent << "Level: "  << static_cast<typename NumericTraits<InputImagePixelType>::PrintType>(m_Level) << std::endl;
+  os << indent << "Overlap: "  << m_Overlap << std::endl;
+}
+  
+}// end namespace itk
+#endif
@@ -0,0 +1,219 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkWatershedMergeTree.h,v $
+  Language:  C++
+  Date:      $Date: 2007/01/29 10:21:54 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkWatershedMergeTree_h
+#define __itkWatershedMergeTree_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkConnectivity.h"
+#include "itkLinearNeighborhood.h"
+#include <vector>
+
+namespace itk {
+
+/** \class WatershedMergeTree
+ * \brief Merge tree of the catchment basins of a watershed transform
+ *
+ * The tree is built from the catchment basins of all the regional minima
+ * of an image - the output of MorphologicalWatershedImageFilter with a
+ * Level of 0. The leaves of the tree are the basins, and each other node
+ * is the merge of two nodes at the level of the lowest pass between them,
+ * as if the image was flooded from the minima. When two nodes are merged,
+ * the one with the lowest minimum survives; the other one dies, and its
+ * dynamics is the level of the merge minus its minimum. The dynamics of
+ * a surviving node is the one of the node it survives in.
+ *
+ * Each node has the area and the volume of the lake of its basins at its
+ * level: the number of pixels flooded from the minima of its basins up to
+ * that level, and the sum of the differences between the level and the
+ * values of those pixels. The watershed pixels are in the lake of the
+ * basin which floods them first.
+ *
+ * ComputeMarkers() produces the markers of the segmentation at a given
+ * level: the minima with a dynamics greater than the level, each one
+ * extended to the lake of its basins at its minimum plus the level. They
+ * are the regional minima of the output of HMinimaImageFilter with that
+ * level as height, so flooding the input from them with
+ * MorphologicalWatershedFromMarkersImageFilter gives the same
+ * segmentation than HMinimaImageFilter followed by the watershed, without
+ * computing the h-minima transform. The labels of the markers are the
+ * ones of the basin with the lowest minimum.
+ *
+ * Cut() produces a segmentation at a given level without flooding the
+ * image again: the basins with a dynamics lower or equal to the level are
+ * merged with their neighbor, and the watershed pixels between two merged
+ * basins are given the label of the merged basin. The watershed lines
+ * are not moved, so this is only an approximation of the segmentation
+ * with the h-minima: the pixels flooded by a removed minimum before the
+ * water of the surviving minima reaches them stay in its basin, where the
+ * flooding from the markers may give them to another basin. For example,
+ * with the profile 0 3 1 3 0 and a level of 2, the cut gives A A A L C,
+ * and the flooding from the markers gives A A L C C.
+ *
+ * The basins must be labeled with small positive integers, as done by
+ * MorphologicalWatershedImageFilter.
+ *
+ * \author Gatan Lehmann. Biologie du Dveloppement et de la Reproduction, INRA de Jouy-en-Josas, France.
+ *
+ * \sa MorphologicalWatershedImageFilter, HMinimaImageFilter
+ * \ingroup ImageEnhancement  MathematicalMorphologyImageFilters
+ */
+template<class TInputImage, class TLabelImage>
+class ITK_EXPORT WatershedMergeTree : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef WatershedMergeTree        Self;
+  typedef Object                    Superclass;
+  typedef SmartPointer<Self>        Pointer;
+  typedef SmartPointer<const Self>  ConstPointer;
+
+  /** Some convenient typedefs. */
+  typedef TInputImage InputImageType;
+  typedef TLabelImage LabelImageType;
+  typedef typename InputImageType::PixelType      LevelType;
+  typedef typename LabelImageType::PixelType      LabelType;
+  typedef typename LabelImageType::Pointer        LabelImagePointer;
+
+  /** ImageDimension constants */
+  itkStaticConstMacro(ImageDimension, unsigned int,
+                      TInputImage::ImageDimension);
+
+  typedef Connectivity< ImageDimension > ConnectivityType;
+
+  typedef unsigned long NodeIdentifierType;
+
+  /** a node of the tree. The leaves are the first nodes, and a node is
+   * always after its children. The first child of a merge node is the
+   * surviving one. The roots are their own parent. */
+  struct NodeType
+    {
+    NodeIdentifierType Parent;
+    NodeIdentifierType Children[2];
+    // the minimum of the basin for a leaf, the level of the merge otherwise
+    LevelType Level;
+    LevelType Minimum;
+    LevelType Dynamics;
+    unsigned long Area;
+    double Volume;
+    // the label of the basin with the lowest minimum
+    LabelType Label;
+    };
+
+  /** Standard New method. */
+  itkNewMacro(Self);
+
+  /** Runtime information support. */
+  itkTypeMacro(WatershedMergeTree, Object);
+
+  /** build the tree from an image and its catchment basins. The image and
+   * the basins are copied in the tree, so they can be released after
+   * that. */
+  void Build( const InputImageType * input, const LabelImageType * basins,
+              const ConnectivityType * connectivity, const LabelType & watershedLabel );
+
+  /** write the markers of the segmentation at the given level in the
+   * output, which must have the same buffered region than the basins. The
+   * pixels outside the markers are set to the watershed label. */
+  void ComputeMarkers( const LevelType & level, LabelImageType * output ) const;
+
+  /** write the merge of the basins at the given level in the output, which
+   * must have the same buffered region than the basins */
+  void Cut( const LevelType & level, LabelImageType * output ) const;
+
+  /** return the number of nodes */
+  NodeIdentifierType GetNumberOfNodes() const
+    {
+    return m_Nodes.size();
+    }
+
+  /** return the number of leaves, which are the catchment basins */
+  NodeIdentifierType GetNumberOfBasins() const
+    {
+    return m_NumberOfBasins;
+    }
+
+  /** return a node */
+  const NodeType & GetNode( NodeIdentifierType id ) const
+    {
+    return m_Nodes[id];
+    }
+
+  /** return the leaf of a catchment basin */
+  NodeIdentifierType GetBasinNode( const LabelType & label ) const
+    {
+    return m_LeafOfLabel[ label - m_MinimumLabel ];
+    }
+
+  /** return true if the node is a root of the tree. There is more than one
+   * root when some basins are not connected. */
+  bool IsRoot( NodeIdentifierType id ) const
+    {
+    return m_Nodes[id].Parent == id;
+    }
+
+  /** Get the label used for the watershed pixels */
+  itkGetConstReferenceMacro(WatershedLabel, LabelType);
+
+protected:
+  WatershedMergeTree();
+  ~WatershedMergeTree() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+private:
+  WatershedMergeTree(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  typedef LinearNeighborhood< ImageDimension > LinearNeighborhoodType;
+  typedef typename LinearNeighborhoodType::OffsetType OffsetType;
+  typedef typename LinearNeighborhoodType::OffsetValueType OffsetValueType;
+
+  // find the current component of a leaf during the build
+  NodeIdentifierType FindComponent( NodeIdentifierType leaf );
+
+  // the label of each node in the segmentation at a level
+  void ComputeLabels( const LevelType & level, std::vector< LabelType > & labels ) const;
+
+  std::vector< NodeType > m_Nodes;
+  NodeIdentifierType m_NumberOfBasins;
+
+  // the leaf of each label, indexed by label - m_MinimumLabel
+  std::vector< NodeIdentifierType > m_LeafOfLabel;
+  LabelType m_MinimumLabel;
+
+  LabelType m_WatershedLabel;
+  LabelImagePointer m_Basins;
+  typename InputImageType::Pointer m_Input;
+
+  // a pixel of the minimum of each leaf, where its marker is grown from
+  std::vector< OffsetValueType > m_MinimumPixels;
+  LinearNeighborhoodType m_Neighborhood;
+
+  // union-find structure used during the build
+  std::vector< NodeIdentifierType > m_Components;
+
+} ; // end of class
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkWatershedMergeTree.txx"
+#endif
+
+#endif
+
+
@@ -0,0 +1,536 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkWatershedMergeTree.txx,v $
+  Language:  C++
+  Date:      $Date: 2007/01/29 10:21:54 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkWatershedMergeTree_txx
+#define __itkWatershedMergeTree_txx
+
+#include "itkWatershedMergeTree.h"
+#include "itkNumericTraits.h"
+#include "itkHierarchicalQueue.h"
+#include <map>
+#include <algorithm>
+#include <utility>
+
+namespace itk {
+
+template <class TInputImage, class TLabelImage>
+WatershedMergeTree<TInputImage, TLabelImage>
+::WatershedMergeTree()
+{
+  m_NumberOfBasins = 0;
+  m_MinimumLabel = NumericTraits< LabelType >::Zero;
+  m_WatershedLabel = NumericTraits< LabelType >::Zero;
+}
+
+
+template <class TInputImage, class TLabelImage>
+typename WatershedMergeTree<TInputImage, TLabelImage>::NodeIdentifierType
+WatershedMergeTree<TInputImage, TLabelImage>
+::FindComponent( NodeIdentifierType leaf )
+{
+  while( m_Components[leaf] != leaf )
+    {
+    // path halving
+    m_Components[leaf] = m_Components[ m_Components[leaf] ];
+    leaf = m_Components[leaf];
+    }
+  return leaf;
+}
+
+
+template <class TInputImage, class TLabelImage>
+void
+WatershedMergeTree<TInputImage, TLabelImage>
+::Build( const InputImageType * input, const LabelImageType * basins,
+         const ConnectivityType * connectivity, const LabelType & watershedLabel )
+{
+  if ( input->GetBufferedRegion().GetSize() != basins->GetBufferedRegion().GetSize() )
+    { itkExceptionMacro( << "Input and basins must have the same size." ); }
+
+  m_WatershedLabel = watershedLabel;
+  m_Nodes.clear();
+  m_LeafOfLabel.clear();
+  m_NumberOfBasins = 0;
+
+  const OffsetValueType nbOfPixels = basins->GetBufferedRegion().GetNumberOfPixels();
+  const LevelType * inputBuffer = input->GetBufferPointer();
+
+  // keep a copy of the basins for the cuts, and of the input for the
+  // markers
+  m_Basins = LabelImageType::New();
+  m_Basins->CopyInformation( basins );
+  m_Basins->SetRegions( basins->GetBufferedRegion() );
+  m_Basins->Allocate();
+  std::copy( basins->GetBufferPointer(), basins->GetBufferPointer() + nbOfPixels, m_Basins->GetBufferPointer() );
+  const LabelType * basinBuffer = m_Basins->GetBufferPointer();
+  m_Input = InputImageType::New();
+  m_Input->CopyInformation( input );
+  m_Input->SetRegions( input->GetBufferedRegion() );
+  m_Input->Allocate();
+  std::copy( inputBuffer, inputBuffer + nbOfPixels, m_Input->GetBufferPointer() );
+
+  m_Neighborhood.Initialize( basins->GetBufferedRegion().GetSize(), connectivity->GetNeighbors() );
+  const unsigned int nbOfNeighbors = m_Neighborhood.GetNumberOfNeighbors();
+  OffsetType position;
+
+  // find the range of the labels
+  bool found = false;
+  LabelType minLabel = NumericTraits< LabelType >::Zero;
+  LabelType maxLabel = NumericTraits< LabelType >::Zero;
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    const LabelType & l = basinBuffer[p];
+    if( l == m_WatershedLabel )
+      { continue; }
+    if( !found || l < minLabel )
+      { minLabel = l; }
+    if( !found || l > maxLabel )
+      { maxLabel = l; }
+    found = true;
+    }
+  m_MinimumLabel = minLabel;
+  if( !found )
+    {
+    this->Modified();
+    return;
+    }
+
+  // create the leaves in the order of the labels
+  const NodeIdentifierType noLeaf = NumericTraits< NodeIdentifierType >::max();
+  m_LeafOfLabel.assign( static_cast< unsigned long >( maxLabel - minLabel ) + 1, noLeaf );
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    const LabelType & l = basinBuffer[p];
+    if( l != m_WatershedLabel )
+      { m_LeafOfLabel[ l - minLabel ] = 0; }
+    }
+  for( unsigned long i=0; i<m_LeafOfLabel.size(); i++ )
+    {
+    if( m_LeafOfLabel[i] == noLeaf )
+      { continue; }
+    NodeType node;
+    node.Parent = m_Nodes.size();
+    node.Children[0] = node.Parent;
+    node.Children[1] = node.Parent;
+    node.Level = NumericTraits< LevelType >::max();
+    node.Minimum = NumericTraits< LevelType >::max();
+    node.Dynamics = NumericTraits< LevelType >::max();
+    node.Area = 0;
+    node.Volume = 0;
+    node.Label = static_cast< LabelType >( minLabel + i );
+    m_LeafOfLabel[i] = m_Nodes.size();
+    m_Nodes.push_back( node );
+    }
+  m_NumberOfBasins = m_Nodes.size();
+  m_MinimumPixels.assign( m_NumberOfBasins, -1 );
+
+  // the image is flooded again from the regional minima of the basins, but
+  // without watershed line, so each pixel is owned by the basin which
+  // floods it first, and at a level which may be higher than its value when
+  // it is only reached through higher pixels. The passes computed on that
+  // partition are the lowest ones, even when the watershed lines of the
+  // basins are thick, or go around some pixels lower than the pass. The
+  // regional minima are the plateaus without lower neighbor; they are
+  // entirely in their basin.
+  typedef HierarchicalQueue< LevelType, OffsetValueType > HierarchicalQueueType;
+  HierarchicalQueueType fah;
+  std::vector< LevelType > levels( nbOfPixels );
+  std::vector< NodeIdentifierType > owners( nbOfPixels, noLeaf );
+  std::vector< bool > visited( nbOfPixels, false );
+  std::vector< OffsetValueType > plateau;
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    const LabelType & l = basinBuffer[p];
+    if( visited[p] || l == m_WatershedLabel )
+      { continue; }
+    bool isMinimum = true;
+    plateau.clear();
+    plateau.push_back( p );
+    visited[p] = true;
+    for( unsigned long k=0; k<plateau.size(); k++ )
+      {
+      const OffsetValueType q = plateau[k];
+      const bool onBorder = m_Neighborhood.IsOnBorder( q, position );
+      for( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !m_Neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType r = q + m_Neighborhood.GetLinearOffset( i );
+        if( inputBuffer[r] < inputBuffer[p] )
+          { isMinimum = false; }
+        else if( inputBuffer[r] == inputBuffer[p] && !visited[r] )
+          {
+          if( basinBuffer[r] != l )
+            { isMinimum = false; }
+          visited[r] = true;
+          plateau.push_back( r );
+          }
+        }
+      }
+    const NodeIdentifierType n = m_LeafOfLabel[ l - minLabel ];
+    NodeType & node = m_Nodes[n];
+    if( isMinimum && inputBuffer[p] <= node.Minimum )
+      {
+      // the lake of the leaf is its regional minimum
+      if( inputBuffer[p] < node.Minimum || m_MinimumPixels[n] < 0 )
+        {
+        node.Area = 0;
+        m_MinimumPixels[n] = p;
+        }
+      node.Minimum = inputBuffer[p];
+      node.Area += plateau.size();
+      for( unsigned long k=0; k<plateau.size(); k++ )
+        {
+        owners[ plateau[k] ] = m_LeafOfLabel[ l - minLabel ];
+        levels[ plateau[k] ] = inputBuffer[p];
+        }
+      }
+    }
+  visited.clear();
+
+  // a basin without regional minimum is flooded from its lowest pixels
+  std::vector< bool > hasMinimum( m_NumberOfBasins );
+  for( NodeIdentifierType n=0; n<m_NumberOfBasins; n++ )
+    {
+    hasMinimum[n] = m_MinimumPixels[n] >= 0;
+    }
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    const LabelType & l = basinBuffer[p];
+    if( l != m_WatershedLabel && !hasMinimum[ m_LeafOfLabel[ l - minLabel ] ] )
+      {
+      NodeType & node = m_Nodes[ m_LeafOfLabel[ l - minLabel ] ];
+      node.Minimum = std::min( node.Minimum, inputBuffer[p] );
+      }
+    }
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    const LabelType & l = basinBuffer[p];
+    if( l == m_WatershedLabel )
+      { continue; }
+    const NodeIdentifierType n = m_LeafOfLabel[ l - minLabel ];
+    if( !hasMinimum[n] && inputBuffer[p] == m_Nodes[n].Minimum )
+      {
+      if( m_MinimumPixels[n] < 0 )
+        { m_MinimumPixels[n] = p; }
+      m_Nodes[n].Area++;
+      owners[p] = n;
+      levels[p] = inputBuffer[p];
+      }
+    if( owners[p] != noLeaf )
+      { fah.Push( levels[p], p ); }
+    }
+  for( NodeIdentifierType n=0; n<m_NumberOfBasins; n++ )
+    {
+    m_Nodes[n].Level = m_Nodes[n].Minimum;
+    }
+
+  while( !fah.Empty() )
+    {
+    const LevelType level = fah.FrontKey();
+    const OffsetValueType p = fah.FrontValue();
+    fah.Pop();
+    const bool onBorder = m_Neighborhood.IsOnBorder( p, position );
+    for( unsigned int i=0; i<nbOfNeighbors; i++ )
+      {
+      if( onBorder && !m_Neighborhood.IsInside( position, i ) )
+        { continue; }
+      const OffsetValueType q = p + m_Neighborhood.GetLinearOffset( i );
+      if( owners[q] == noLeaf )
+        {
+        owners[q] = owners[p];
+        levels[q] = std::max( level, inputBuffer[q] );
+        fah.Push( levels[q], q );
+        }
+      }
+    }
+
+  // the lowest pass between each pair of neighbor basins
+  typedef std::pair< NodeIdentifierType, NodeIdentifierType > PairType;
+  typedef std::map< PairType, LevelType > PassMapType;
+  PassMapType passes;
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    const NodeIdentifierType & o = owners[p];
+    if( o == noLeaf )
+      { continue; }
+    const LevelType & v = levels[p];
+    const bool onBorder = m_Neighborhood.IsOnBorder( p, position );
+    for( unsigned int i=0; i<nbOfNeighbors; i++ )
+      {
+      if( onBorder && !m_Neighborhood.IsInside( position, i ) )
+        { continue; }
+      const OffsetValueType q = p + m_Neighborhood.GetLinearOffset( i );
+      const NodeIdentifierType & on = owners[q];
+      if( on == noLeaf || on <= o )
+        { continue; }
+      const PairType pair( o, on );
+      const LevelType pass = std::max( v, levels[q] );
+      typename PassMapType::iterator it = passes.find( pair );
+      if( it == passes.end() )
+        { passes[pair] = pass; }
+      else if( pass < it->second )
+        { it->second = pass; }
+      }
+    }
+
+  // the passes are used in the order of their level, like in the flooding
+  typedef std::pair< LevelType, PairType > EdgeType;
+  std::vector< EdgeType > edges;
+  edges.reserve( passes.size() );
+  for( typename PassMapType::const_iterator it=passes.begin(); it!=passes.end(); it++ )
+    {
+    edges.push_back( EdgeType( it->second, it->first ) );
+    }
+  passes.clear();
+  std::sort( edges.begin(), edges.end() );
+
+  // the pixels in the order of their flooding level, to compute the area
+  // and the volume of the lakes
+  typedef std::pair< LevelType, OffsetValueType > PixelType;
+  std::vector< PixelType > pixels;
+  pixels.reserve( nbOfPixels );
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    if( owners[p] != noLeaf )
+      { pixels.push_back( PixelType( levels[p], p ) ); }
+    }
+  std::vector< LevelType >().swap( levels );
+  std::sort( pixels.begin(), pixels.end() );
+
+  // the union-find of the leaves, with the current node, the area and the
+  // sum of the values of the lake of each component
+  m_Components.resize( m_NumberOfBasins );
+  std::vector< NodeIdentifierType > componentNode( m_NumberOfBasins );
+  std::vector< unsigned long > area( m_NumberOfBasins, 0 );
+  std::vector< double > sum( m_NumberOfBasins, 0 );
+  for( NodeIdentifierType n=0; n<m_NumberOfBasins; n++ )
+    {
+    m_Components[n] = n;
+    componentNode[n] = n;
+    }
+
+  unsigned long k = 0;
+  for( typename std::vector< EdgeType >::const_iterator it=edges.begin(); it!=edges.end(); it++ )
+    {
+    const LevelType & level = it->first;
+    // fill the lakes up to the level of the pass
+    while( k < pixels.size() && pixels[k].first <= level )
+      {
+      const NodeIdentifierType c = this->FindComponent( owners[ pixels[k].second ] );
+      area[c]++;
+      sum[c] += inputBuffer[ pixels[k].second ];
+      k++;
+      }
+
+    NodeIdentifierType c0 = this->FindComponent( it->second.first );
+    NodeIdentifierType c1 = this->FindComponent( it->second.second );
+    if( c0 == c1 )
+      { continue; }
+
+    // the node with the lowest minimum survives
+    NodeIdentifierType survivor = componentNode[c0];
+    NodeIdentifierType dying = componentNode[c1];
+    if( m_Nodes[dying].Minimum < m_Nodes[survivor].Minimum
+        || ( m_Nodes[dying].Minimum == m_Nodes[survivor].Minimum && m_Nodes[dying].Label < m_Nodes[survivor].Label ) )
+      { std::swap( survivor, dying ); }
+
+    NodeType node;
+    node.Parent = m_Nodes.size();
+    node.Children[0] = survivor;
+    node.Children[1] = dying;
+    node.Level = level;
+    node.Minimum = m_Nodes[survivor].Minimum;
+    node.Dynamics = NumericTraits< LevelType >::max();
+    node.Area = area[c0] + area[c1];
+    node.Volume = static_cast< double >( level ) * node.Area - ( sum[c0] + sum[c1] );
+    node.Label = m_Nodes[survivor].Label;
+    m_Nodes[survivor].Parent = node.Parent;
+    m_Nodes[dying].Parent = node.Parent;
+
+    m_Components[c1] = c0;
+    area[c0] += area[c1];
+    sum[c0] += sum[c1];
+    componentNode[c0] = node.Parent;
+    m_Nodes.push_back( node );
+    }
+  m_Components.clear();
+
+  // the dynamics, from the roots to the leaves
+  for( NodeIdentifierType n=m_Nodes.size(); n>0; n-- )
+    {
+    NodeType & node = m_Nodes[n-1];
+    if( node.Parent == n-1 )
+      { continue; }
+    const NodeType & parent = m_Nodes[ node.Parent ];
+    if( parent.Children[0] == n-1 )
+      { node.Dynamics = parent.Dynamics; }
+    else
+      { node.Dynamics = parent.Level - node.Minimum; }
+    }
+
+  this->Modified();
+}
+
+
+template <class TInputImage, class TLabelImage>
+void
+WatershedMergeTree<TInputImage, TLabelImage>
+::ComputeLabels( const LevelType & level, std::vector< LabelType > & labels ) const
+{
+  // the label of each node: a node takes the label of its parent if it
+  // survives in the parent, or if it dies with a dynamics lower or equal to
+  // the level
+  labels.resize( m_Nodes.size() );
+  for( NodeIdentifierType n=m_Nodes.size(); n>0; n-- )
+    {
+    const NodeType & node = m_Nodes[n-1];
+    if( node.Parent == n-1 )
+      { labels[n-1] = node.Label; }
+    else if( m_Nodes[ node.Parent ].Children[0] == n-1 || node.Dynamics <= level )
+      { labels[n-1] = labels[ node.Parent ]; }
+    else
+      { labels[n-1] = node.Label; }
+    }
+}
+
+
+template <class TInputImage, class TLabelImage>
+void
+WatershedMergeTree<TInputImage, TLabelImage>
+::ComputeMarkers( const LevelType & level, LabelImageType * output ) const
+{
+  if( m_Basins.IsNull() )
+    { itkExceptionMacro( << "The tree must be built before being cut." ); }
+  if ( output->GetBufferedRegion().GetSize() != m_Basins->GetBufferedRegion().GetSize() )
+    { itkExceptionMacro( << "Output and basins must have the same size." ); }
+
+  std::vector< LabelType > labels;
+  this->ComputeLabels( level, labels );
+
+  const OffsetValueType nbOfPixels = m_Basins->GetBufferedRegion().GetNumberOfPixels();
+  const unsigned int nbOfNeighbors = m_Neighborhood.GetNumberOfNeighbors();
+  const LevelType * inputBuffer = m_Input->GetBufferPointer();
+  LabelType * outputBuffer = output->GetBufferPointer();
+  OffsetType position;
+  std::fill( outputBuffer, outputBuffer + nbOfPixels, m_WatershedLabel );
+
+  // the leaves which keep their own label are the minima with a dynamics
+  // greater than the level. In the h-minima transform, their regional
+  // minimum is the connected component of the pixels lower or equal to
+  // the minimum plus the level which contains the minimum of the leaf: it
+  // is filled up to that level without reaching a lower minimum. Two of
+  // those components can't touch, because the pass between their minima
+  // would be lower than the dynamics of one of them.
+  std::vector< OffsetValueType > fifo;
+  for( NodeIdentifierType n=0; n<m_NumberOfBasins; n++ )
+    {
+    const NodeType & node = m_Nodes[n];
+    if( labels[n] != node.Label )
+      { continue; }
+    const double top = static_cast< double >( node.Minimum ) + static_cast< double >( level );
+    fifo.clear();
+    fifo.push_back( m_MinimumPixels[n] );
+    outputBuffer[ m_MinimumPixels[n] ] = node.Label;
+    for( unsigned long k=0; k<fifo.size(); k++ )
+      {
+      const OffsetValueType p = fifo[k];
+      const bool onBorder = m_Neighborhood.IsOnBorder( p, position );
+      for( unsigned int i=0; i<nbOfNeighbors; i++ )
+        {
+        if( onBorder && !m_Neighborhood.IsInside( position, i ) )
+          { continue; }
+        const OffsetValueType q = p + m_Neighborhood.GetLinearOffset( i );
+        if( outputBuffer[q] == m_WatershedLabel && static_cast< double >( inputBuffer[q] ) <= top )
+          {
+          outputBuffer[q] = node.Label;
+          fifo.push_back( q );
+          }
+        }
+      }
+    }
+}
+
+
+template <class TInputImage, class TLabelImage>
+void
+WatershedMergeTree<TInputImage, TLabelImage>
+::Cut( const LevelType & level, LabelImageType * output ) const
+{
+  if( m_Basins.IsNull() )
+    { itkExceptionMacro( << "The tree must be built before being cut." ); }
+  if ( output->GetBufferedRegion().GetSize() != m_Basins->GetBufferedRegion().GetSize() )
+    { itkExceptionMacro( << "Output and basins must have the same size." ); }
+
+  std::vector< LabelType > labels;
+  this->ComputeLabels( level, labels );
+
+  const OffsetValueType nbOfPixels = m_Basins->GetBufferedRegion().GetNumberOfPixels();
+  const unsigned int nbOfNeighbors = m_Neighborhood.GetNumberOfNeighbors();
+  const LabelType * basinBuffer = m_Basins->GetBufferPointer();
+  LabelType * outputBuffer = output->GetBufferPointer();
+  OffsetType position;
+
+  for( OffsetValueType p=0; p<nbOfPixels; p++ )
+    {
+    const LabelType & l = basinBuffer[p];
+    if( l != m_WatershedLabel )
+      {
+      outputBuffer[p] = labels[ m_LeafOfLabel[ l - m_MinimumLabel ] ];
+      continue;
+      }
+    // a watershed pixel stays a watershed pixel only if it is still
+    // between two regions
+    LabelType marker = m_WatershedLabel;
+    bool collision = false;
+    const bool onBorder = m_Neighborhood.IsOnBorder( p, position );
+    for( unsigned int i=0; i<nbOfNeighbors; i++ )
+      {
+      if( onBorder && !m_Neighborhood.IsInside( position, i ) )
+        { continue; }
+      const LabelType & ln = basinBuffer[ p + m_Neighborhood.GetLinearOffset( i ) ];
+      if( ln == m_WatershedLabel )
+        { continue; }
+      const LabelType & o = labels[ m_LeafOfLabel[ ln - m_MinimumLabel ] ];
+      if( marker != m_WatershedLabel && o != marker )
+        {
+        collision = true;
+        break;
+        }
+      marker = o;
+      }
+    if( collision )
+      { outputBuffer[p] = m_WatershedLabel; }
+    else
+      { outputBuffer[p] = marker; }
+    }
+}
+
+
+template <class TInputImage, class TLabelImage>
+void
+WatershedMergeTree<TInputImage, TLabelImage>
+::PrintSelf(std::ostream &os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "NumberOfBasins: "  << m_NumberOfBasins << std::endl;
+  os << indent << "NumberOfNodes: "  << m_Nodes.size() << std::endl;
+  os << indent << "WatershedLabel: "  << static_cast<typename NumericTraits<LabelType>::PrintType>(m_WatershedLabel) << std::endl;
+}
+
+}// end namespace itk
+#endif
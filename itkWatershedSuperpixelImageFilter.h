@@ -0,0 +1,240 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkWatershedSuperpixelImageFilter.h,v $
+  Language:  C++
+  Date:      $Date: 2007/02/05 10:12:31 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkWatershedSuperpixelImageFilter_h
+#define __itkWatershedSuperpixelImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkLabelMap.h"
+#include "itkLabelObject.h"
+#include "itkMultiThreader.h"
+#include <vector>
+#include <string>
+
+namespace itk {
+
+/** \class WatershedSuperpixelImageFilter
+ * \brief Superpixels from a watershed flooded from the nodes of a regular grid
+ *
+ * The input image - usually a gradient image - is flooded from markers
+ * placed on a regular grid, with GridSpacing pixels between two markers.
+ * Each marker is a single pixel at the center of its cell of the grid,
+ * moved to the lowest pixel of the input at most SnapRadius pixels away
+ * when it is lower than the center, so the markers are in the local minima
+ * of the gradient rather than on the edges. The radius is reduced when
+ * needed so the markers can't meet. The markers are labeled from 1, in the
+ * raster order of the cells of the grid. With a Compactness greater than 0,
+ * the basins are more regular - see
+ * MorphologicalWatershedFromMarkersImageFilter.
+ *
+ * No marker image is given to the filter, and the output is a LabelMap,
+ * so no label image of the size of the input is needed.
+ *
+ * The image is split in tiles of TileSize slices along the last dimension,
+ * flooded in parallel with MorphologicalWatershedFromMarkersImageFilter.
+ * Each tile is flooded with Overlap more slices before and after it, and
+ * with all the markers in that region, and only the labels of the tile are
+ * kept. The slabs are contiguous in the input buffer, so the flooding of a
+ * tile reads the input in place, and the markers are sorted by tile once,
+ * so a tile only looks at the markers of the tiles its overlap covers. The result is an approximation of the flooding of the whole
+ * image: a tile only sees the input and the markers of its overlap, so a
+ * basin can be different near the border of the tile when a marker outside
+ * the overlap would have reached it. A basin usually
+ * doesn't go very far from its marker, especially with the compactness, so
+ * an overlap of a few grid spacings makes the differences rare. The tiles
+ * don't depend on the number of threads, so the output is the same with
+ * any number of threads.
+ *
+ * The watershed pixels are in the background of the output, which is 0.
+ *
+ * \author Gatan Lehmann. Biologie du Dveloppement et de la Reproduction, INRA de Jouy-en-Josas, France.
+ *
+ * \sa MorphologicalWatershedFromMarkersImageFilter, LabelMap
+ * \ingroup ImageEnhancement  MathematicalMorphologyImageFilters
+ */
+template<class TInputImage, class TOutputImage=LabelMap< LabelObject< unsigned long, TInputImage::ImageDimension > > >
+class ITK_EXPORT WatershedSuperpixelImageFilter :
+    public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef WatershedSuperpixelImageFilter Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage>
+  Superclass;
+  typedef SmartPointer<Self>        Pointer;
+  typedef SmartPointer<const Self>  ConstPointer;
+
+  /** Some convenient typedefs. */
+  typedef TInputImage InputImageType;
+  typedef TOutputImage OutputImageType;
+  typedef typename InputImageType::Pointer         InputImagePointer;
+  typedef typename InputImageType::ConstPointer    InputImageConstPointer;
+  typedef typename InputImageType::RegionType      InputImageRegionType;
+  typedef typename InputImageType::PixelType       InputImagePixelType;
+  typedef typename InputImageType::SizeType        SizeType;
+  typedef typename InputImageType::IndexType       IndexType;
+  typedef typename OutputImageType::Pointer        OutputImagePointer;
+  typedef typename OutputImageType::RegionType     OutputImageRegionType;
+  typedef typename OutputImageType::PixelType      OutputImagePixelType;
+  typedef typename OutputImageType::LabelObjectType LabelObjectType;
+
+  /** ImageDimension constants */
+  itkStaticConstMacro(InputImageDimension, unsigned int,
+                      TInputImage::ImageDimension);
+  itkStaticConstMacro(OutputImageDimension, unsigned int,
+                      TOutputImage::ImageDimension);
+  itkStaticConstMacro(ImageDimension, unsigned int,
+                      TInputImage::ImageDimension);
+
+  /** the label image flooded in each tile */
+  typedef Image< OutputImagePixelType, ImageDimension > LabelImageType;
+
+  /** Standard New method. */
+  itkNewMacro(Self);
+
+  /** Runtime information support. */
+  itkTypeMacro(WatershedSuperpixelImageFilter,
+               ImageToImageFilter);
+
+  /**
+   * Set/Get the number of pixels between two markers in each dimension.
+   * Default is 16.
+   */
+  itkSetMacro(GridSpacing, SizeType);
+  itkGetConstReferenceMacro(GridSpacing, SizeType);
+
+  /**
+   * Set/Get the maximum distance, in pixels and in each dimension, between
+   * the center of a cell of the grid and its marker. 0 keeps the markers at
+   * the center of the cells. Default is 1.
+   */
+  itkSetMacro(SnapRadius, unsigned long);
+  itkGetConstReferenceMacro(SnapRadius, unsigned long);
+
+  /**
+   * Set/Get the compactness of the basins - see
+   * MorphologicalWatershedFromMarkersImageFilter. Default is 0.
+   */
+  itkSetMacro(Compactness, double);
+  itkGetConstReferenceMacro(Compactness, double);
+
+  /**
+   * Set/Get whether the connected components are defined strictly by
+   * face connectivity or by face+edge+vertex connectivity.  Default is
+   * FullyConnectedOff.  For objects that are 1 pixel wide, use
+   * FullyConnectedOn.
+   */
+  itkSetMacro(FullyConnected, bool);
+  itkGetConstReferenceMacro(FullyConnected, bool);
+  itkBooleanMacro(FullyConnected);
+
+  /**
+   * Set/Get whether the watershed pixel must be marked or not. Default
+   * is false, so all the pixels are in a superpixel.
+   */
+  itkSetMacro(MarkWatershedLine, bool);
+  itkGetConstReferenceMacro(MarkWatershedLine, bool);
+  itkBooleanMacro(MarkWatershedLine);
+
+  /**
+   * Set/Get the number of slices of a tile, along the last dimension.
+   * Default is 64.
+   */
+  itkSetMacro(TileSize, unsigned long);
+  itkGetConstReferenceMacro(TileSize, unsigned long);
+
+  /**
+   * Set/Get the number of slices flooded before and after each tile. The
+   * output is exactly the flooding of the whole image only when the overlap
+   * covers the whole image. Default is 32.
+   */
+  itkSetMacro(Overlap, unsigned long);
+  itkGetConstReferenceMacro(Overlap, unsigned long);
+
+protected:
+  WatershedSuperpixelImageFilter();
+  ~WatershedSuperpixelImageFilter() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  /** WatershedSuperpixelImageFilter needs the entire input be
+   * available. Thus, it needs to provide an implementation of
+   * GenerateInputRequestedRegion(). */
+  void GenerateInputRequestedRegion() ;
+
+  /** WatershedSuperpixelImageFilter will produce the entire output. */
+  void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
+
+  /** The tiles are flooded by the threads of the filter's MultiThreader. */
+  void GenerateData();
+
+
+private:
+  WatershedSuperpixelImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  SizeType m_GridSpacing;
+
+  unsigned long m_SnapRadius;
+
+  double m_Compactness;
+
+  bool m_FullyConnected;
+
+  bool m_MarkWatershedLine;
+
+  unsigned long m_TileSize;
+
+  unsigned long m_Overlap;
+
+  // a line of a superpixel in a tile
+  struct LineType
+    {
+    IndexType Index;
+    unsigned long Length;
+    OutputImagePixelType Label;
+    };
+  typedef std::vector< LineType > LineContainerType;
+
+  // the markers - the label of a marker is its position plus 1 - the
+  // tiles, and the lines and the error found in each tile, used only
+  // during the update
+  std::vector< IndexType > m_Seeds;
+  std::vector< InputImageRegionType > m_Tiles;
+  // the positions in m_Seeds of the markers of each tile
+  std::vector< std::vector< unsigned long > > m_TileSeeds;
+  std::vector< LineContainerType > m_TileLines;
+  std::vector< std::string > m_TileErrors;
+
+  // place the markers on the grid
+  void ComputeSeeds();
+
+  // flood a tile and store its lines
+  void FloodTile( unsigned long tile );
+
+  // flood the tiles associated to a thread
+  static ITK_THREAD_RETURN_TYPE TileThreaderCallback( void * arg );
+
+} ; // end of class
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkWatershedSuperpixelImageFilter.txx"
+#endif
+
+#endif
+
+
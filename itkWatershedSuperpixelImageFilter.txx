@@ -0,0 +1,358 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkWatershedSuperpixelImageFilter.txx,v $
+  Language:  C++
+  Date:      $Date: 2007/02/05 10:12:31 $
+  Version:   $Revision: 1.1 $
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkWatershedSuperpixelImageFilter_txx
+#define __itkWatershedSuperpixelImageFilter_txx
+
+#include "itkWatershedSuperpixelImageFilter.h"
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageLinearConstIteratorWithIndex.h"
+#include "itkNumericTraits.h"
+#include <algorithm>
+
+namespace itk {
+
+template <class TInputImage, class TOutputImage>
+WatershedSuperpixelImageFilter<TInputImage, TOutputImage>
+::WatershedSuperpixelImageFilter()
+{
+  m_GridSpacing.Fill( 16 );
+  m_SnapRadius = 1;
+  m_Compactness = 0;
+  m_FullyConnected = false;
+  m_MarkWatershedLine = false;
+  m_TileSize = 64;
+  m_Overlap = 32;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+WatershedSuperpixelImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  // call the superclass' implementation of this method
+  Superclass::GenerateInputRequestedRegion();
+
+  // We need all the input.
+  InputImagePointer input = const_cast<InputImageType *>(this->GetInput());
+  if ( !input )
+    { return; }
+  input->SetRequestedRegion( input->GetLargestPossibleRegion() );
+}
+
+
+template <class TInputImage, class TOutputImage>
+void
+WatershedSuperpixelImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion(DataObject *)
+{
+  this->GetOutput()
+    ->SetRequestedRegion( this->GetOutput()->GetLargestPossibleRegion() );
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+WatershedSuperpixelImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  if( m_TileSize == 0 )
+    { itkExceptionMacro( << "TileSize must be at least 1." ); }
+
+  // Allocate the output
+  this->AllocateOutputs();
+  OutputImageType * output = this->GetOutput();
+  output->SetBackgroundValue( NumericTraits< OutputImagePixelType >::Zero );
+
+  this->ComputeSeeds();
+
+  // the slabs of TileSize slices along the last dimension
+  const InputImageRegionType & region = this->GetInput()->GetLargestPossibleRegion();
+  const unsigned int last = ImageDimension - 1;
+  m_Tiles.clear();
+  for( unsigned long s=0; s<region.GetSize( last ); s+=m_TileSize )
+    {
+    InputImageRegionType tile = region;
+    tile.SetIndex( last, region.GetIndex( last ) + s );
+    tile.SetSize( last, std::min( m_TileSize, region.GetSize( last ) - s ) );
+    m_Tiles.push_back( tile );
+    }
+  m_TileLines.clear();
+  m_TileLines.resize( m_Tiles.size() );
+  m_TileErrors.assign( m_Tiles.size(), std::string() );
+
+  // the markers of each tile
+  m_TileSeeds.clear();
+  m_TileSeeds.resize( m_Tiles.size() );
+  for( unsigned long i=0; i<m_Seeds.size(); i++ )
+    {
+    m_TileSeeds[ ( m_Seeds[i][last] - region.GetIndex( last ) ) / m_TileSize ].push_back( i );
+    }
+
+  this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+  this->GetMultiThreader()->SetSingleMethod( this->TileThreaderCallback, this );
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  for( unsigned long t=0; t<m_Tiles.size(); t++ )
+    {
+    if( !m_TileErrors[t].empty() )
+      {
+      const std::string error = m_TileErrors[t];
+      m_TileErrors.clear();
+      itkExceptionMacro( << error );
+      }
+    }
+
+  // the lines are added in the order of the tiles
+  for( unsigned long t=0; t<m_Tiles.size(); t++ )
+    {
+    const LineContainerType & lines = m_TileLines[t];
+    for( typename LineContainerType::const_iterator it=lines.begin(); it!=lines.end(); it++ )
+      {
+      output->SetLine( it->Index, it->Length, it->Label );
+      }
+    }
+
+  // release the memory used during the update
+  m_Seeds.clear();
+  m_Tiles.clear();
+  m_TileSeeds.clear();
+  m_TileLines.clear();
+  m_TileErrors.clear();
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+WatershedSuperpixelImageFilter<TInputImage, TOutputImage>
+::ComputeSeeds()
+{
+  const InputImageType * input = this->GetInput();
+  const InputImageRegionType & region = input->GetLargestPossibleRegion();
+  const IndexType & start = region.GetIndex();
+  const SizeType & size = region.GetSize();
+
+  // the number of cells in each dimension, and the radius used to move the
+  // markers. The centers of two cells are at least one cell size apart, so
+  // the markers can't meet with a radius lower than half the cell size.
+  unsigned long nbOfCells[ImageDimension];
+  SizeType radius;
+  for( unsigned int d=0; d<ImageDimension; d++ )
+    {
+    if( m_GridSpacing[d] == 0 )
+      { itkExceptionMacro( << "GridSpacing must be at least 1 in each dimension." ); }
+    nbOfCells[d] = std::max( size[d] / m_GridSpacing[d], 1UL );
+    const unsigned long cellSize = size[d] / nbOfCells[d];
+    radius[d] = std::min( m_SnapRadius, ( cellSize - 1 ) / 2 );
+    }
+
+  // the markers, in the raster order of the cells
+  m_Seeds.clear();
+  unsigned long cell[ImageDimension];
+  for( unsigned int d=0; d<ImageDimension; d++ )
+    {
+    cell[d] = 0;
+    }
+  bool done = false;
+  while( !done )
+    {
+    IndexType seed;
+    InputImageRegionType window;
+    for( unsigned int d=0; d<ImageDimension; d++ )
+      {
+      seed[d] = start[d] + ( ( 2 * cell[d] + 1 ) * size[d] ) / ( 2 * nbOfCells[d] );
+      window.SetIndex( d, seed[d] - radius[d] );
+      window.SetSize( d, 2 * radius[d] + 1 );
+      }
+    window.Crop( region );
+
+    // the first lowest pixel of the window in the raster order, if it is
+    // lower than the center
+    InputImagePixelType min = input->GetPixel( seed );
+    ImageRegionConstIteratorWithIndex< InputImageType > it( input, window );
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+      {
+      if( it.Get() < min )
+        {
+        min = it.Get();
+        seed = it.GetIndex();
+        }
+      }
+    m_Seeds.push_back( seed );
+
+    // next cell
+    unsigned int d = 0;
+    for( ; d<ImageDimension; d++ )
+      {
+      cell[d]++;
+      if( cell[d] < nbOfCells[d] )
+        { break; }
+      cell[d] = 0;
+      }
+    done = d == ImageDimension;
+    }
+
+  if( m_Seeds.size() >= (unsigned long)NumericTraits< OutputImagePixelType >::max() )
+    { itkExceptionMacro( << "The output pixel type is too small for the number of labels." ); }
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+WatershedSuperpixelImageFilter<TInputImage, TOutputImage>
+::FloodTile( unsigned long t )
+{
+  const InputImageType * input = this->GetInput();
+  const InputImageRegionType & tile = m_Tiles[t];
+  const unsigned int last = ImageDimension - 1;
+  const OutputImagePixelType bgLabel = NumericTraits< OutputImagePixelType >::Zero;
+  const long start = input->GetLargestPossibleRegion().GetIndex( last );
+
+  // the tile with the overlap
+  InputImageRegionType region = tile;
+  region.SetIndex( last, tile.GetIndex( last ) - (long)m_Overlap );
+  region.SetSize( last, tile.GetSize( last ) + 2 * m_Overlap );
+  region.Crop( input->GetLargestPossibleRegion() );
+
+  // the input in an image of its own, so the watershed filter, which
+  // needs its whole input, doesn't request the whole image. The region is
+  // a slab, so its pixels are contiguous in the input buffer and are used
+  // without a copy.
+  InputImagePointer local = InputImageType::New();
+  local->CopyInformation( input );
+  local->SetRegions( region );
+  local->GetPixelContainer()->SetImportPointer(
+    const_cast< InputImagePixelType * >( input->GetBufferPointer() ) + input->ComputeOffset( region.GetIndex() ),
+    region.GetNumberOfPixels(), false );
+
+  // the markers are written in the label image, and the flooding is done
+  // in the same buffer - see MorphologicalWatershedImageFilter
+  typename LabelImageType::Pointer labels = LabelImageType::New();
+  labels->CopyInformation( local );
+  labels->SetRegions( region );
+  labels->Allocate();
+  labels->FillBuffer( bgLabel );
+  const unsigned long firstTile = ( region.GetIndex( last ) - start ) / m_TileSize;
+  const unsigned long lastTile = ( region.GetIndex( last ) + region.GetSize( last ) - 1 - start ) / m_TileSize;
+  for( unsigned long s=firstTile; s<=lastTile; s++ )
+    {
+    const std::vector< unsigned long > & seeds = m_TileSeeds[s];
+    for( unsigned long i=0; i<seeds.size(); i++ )
+      {
+      if( region.IsInside( m_Seeds[ seeds[i] ] ) )
+        {
+        labels->SetPixel( m_Seeds[ seeds[i] ], seeds[i] + 1 );
+        }
+      }
+    }
+  typename LabelImageType::Pointer markers = LabelImageType::New();
+  markers->CopyInformation( labels );
+  markers->SetRegions( region );
+  markers->SetPixelContainer( labels->GetPixelContainer() );
+
+  // the tiles are already flooded in parallel
+  typedef MorphologicalWatershedFromMarkersImageFilter< InputImageType, LabelImageType > WatershedType;
+  typename WatershedType::Pointer wshed = WatershedType::New();
+  wshed->SetInput( local );
+  wshed->SetMarkerImage( markers );
+  wshed->SetFullyConnected( m_FullyConnected );
+  wshed->SetMarkWatershedLine( m_MarkWatershedLine );
+  wshed->SetCompactness( m_Compactness );
+  wshed->SetBackgroundValue( bgLabel );
+  wshed->SetNumberOfThreads( 1 );
+  wshed->GraftOutput( labels );
+  wshed->Update();
+
+  // the lines of the superpixels in the tile
+  LineContainerType & lines = m_TileLines[t];
+  typedef ImageLinearConstIteratorWithIndex< LabelImageType > LineIteratorType;
+  LineIteratorType it( wshed->GetOutput(), tile );
+  it.SetDirection( 0 );
+  for( it.GoToBegin(); !it.IsAtEnd(); it.NextLine() )
+    {
+    it.GoToBeginOfLine();
+    while( !it.IsAtEndOfLine() )
+      {
+      const OutputImagePixelType v = it.Get();
+      if( v != bgLabel )
+        {
+        LineType line;
+        line.Index = it.GetIndex();
+        line.Length = 1;
+        line.Label = v;
+        ++it;
+        while( !it.IsAtEndOfLine() && it.Get() == v )
+          {
+          line.Length++;
+          ++it;
+          }
+        lines.push_back( line );
+        }
+      else
+        {
+        ++it;
+        }
+      }
+    }
+}
+
+
+template<class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+WatershedSuperpixelImageFilter<TInputImage, TOutputImage>
+::TileThreaderCallback( void * arg )
+{
+  MultiThreader::ThreadInfoStruct * info = static_cast< MultiThreader::ThreadInfoStruct * >( arg );
+  const int threadId = info->ThreadID;
+  const int threadCount = info->NumberOfThreads;
+  Self * self = static_cast< Self * >( info->UserData );
+
+  // the tiles are distributed in turn to the threads. An exception can't
+  // go out of a thread, so its message is kept with the tile.
+  for( unsigned long t=threadId; t<self->m_Tiles.size(); t+=threadCount )
+    {
+    try
+      {
+      self->FloodTile( t );
+      }
+    catch( ExceptionObject & e )
+      {
+      self->m_TileErrors[t] = e.GetDescription();
+      }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+template<class TInputImage, class TOutputImage>
+void
+WatershedSuperpixelImageFilter<TInputImage, TOutputImage>
+::PrintSelf(std::ostream &os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+
+  os << indent << "GridSpacing: "  << m_GridSpacing << std::endl;
+  os << indent << "SnapRadius: "  << m_SnapRadius << std::endl;
+  os << indent << "Compactness: "  << m_Compactness << std::endl;
+  os << indent << "FullyConnected: "  << m_FullyConnected << std::endl;
+  os << indent << "MarkWatershedLine: "  << m_MarkWatershedLine << std::endl;
+  os << indent << "TileSize: "  << m_TileSize << std::endl;
+  os << indent << "Overlap: "  << m_Overlap << std::endl;
+}
+
+}// end namespace itk
+#endif
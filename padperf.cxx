@@ -0,0 +1,108 @@
+#include "itkImageFileReader.h"
+
+#include "itkRegionalMinimaImageFilter.h"
+#include "itkHMinimaImageFilter.h"
+#include "itkConnectedComponentImageFilter.h"
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkInvertIntensityImageFilter.h"
+
+#include "itkTimeProbe.h"
+#include "itkMultiThreader.h"
+#include <iomanip>
+
+// compare the time of the flooding with and without the padded buffers
+template < unsigned int dim >
+void perf( const char * fileName )
+{
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim >    IType;
+  typedef unsigned long LType;
+  typedef itk::Image< LType, dim >    LImageType;
+  
+  // read the input image
+  typedef itk::ImageFileReader< IType > ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( fileName );
+  
+  // the image is more interesting inverted 
+  typedef itk::InvertIntensityImageFilter< IType, IType > InvertType;
+  typename InvertType::Pointer invert = InvertType::New();
+  invert->SetInput( reader->GetOutput() );
+
+  // remove some minima
+  typedef itk::HMinimaImageFilter< IType, IType > MinimaType;
+  typename MinimaType::Pointer minima = MinimaType::New();
+  minima->SetInput( invert->GetOutput() );
+  minima->SetHeight( 30 );
+
+  typedef itk::RegionalMinimaImageFilter< IType, LImageType > RMinType;
+  typename RMinType::Pointer rmin = RMinType::New();
+  rmin->SetInput( minima->GetOutput() );
+  
+  typedef itk::ConnectedComponentImageFilter< LImageType, LImageType > ConnectedCompType;
+  typename ConnectedCompType::Pointer label = ConnectedCompType::New();
+  label->SetInput( rmin->GetOutput() );
+  label->Update();
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, LImageType > MMWatershedType;
+  typename MMWatershedType::Pointer mmws = MMWatershedType::New();
+  mmws->SetInput( invert->GetOutput() );
+  mmws->SetMarkerImage( label->GetOutput() );
+
+  for(int F=0; F<=1; F++ )
+    {
+    for(int M=0; M<=1; M++ )
+      {
+      mmws->SetFullyConnected( F );
+      mmws->SetMarkWatershedLine( M );
+
+      itk::TimeProbe ptime;
+      itk::TimeProbe ctime;
+      for( int i=0; i<10; i++ )
+        {
+        mmws->SetPadImageBoundary( true );
+        ptime.Start();
+        mmws->Update();
+        ptime.Stop();
+        mmws->Modified();
+
+        mmws->SetPadImageBoundary( false );
+        ctime.Start();
+        mmws->Update();
+        ctime.Stop();
+        mmws->Modified();
+        }
+        
+      std::cout << std::setprecision(3)
+                << dim << "\t" 
+                << F << "\t" 
+                << M << "\t" 
+                << ptime.GetMeanTime() << "\t" 
+                << ctime.GetMeanTime() << "\t" 
+                << std::endl;
+      }
+    }
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 3 )
+    {
+    std::cerr << "usage: " << argv[0] << " input2D input3D" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(1);
+
+  std::cout << "#D" << "\t" 
+            << "F" << "\t" 
+            << "M" << "\t" 
+            << "padded" << "\t" 
+            << "checked" << "\t" 
+            << std::endl;
+
+  perf< 2 >( argv[1] );
+  perf< 3 >( argv[2] );
+
+  return 0;
+}
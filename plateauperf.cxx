@@ -0,0 +1,121 @@
+#include "itkImageFileReader.h"
+
+#include "itkRegionalMinimaImageFilter.h"
+#include "itkHMinimaImageFilter.h"
+#include "itkConnectedComponentImageFilter.h"
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkInvertIntensityImageFilter.h"
+
+#include "itkTimeProbe.h"
+#include "itkMultiThreader.h"
+#include <iomanip>
+
+// compare the time of the usual flooding, of the flooding with the image
+// spacing and of the flooding with the geodesic plateaus. The h-minima
+// transform leaves large plateaus in the image.
+template < unsigned int dim >
+void perf( const char * fileName )
+{
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim >    IType;
+  typedef unsigned long LType;
+  typedef itk::Image< LType, dim >    LImageType;
+  
+  // read the input image
+  typedef itk::ImageFileReader< IType > ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( fileName );
+  
+  // the image is more interesting inverted 
+  typedef itk::InvertIntensityImageFilter< IType, IType > InvertType;
+  typename InvertType::Pointer invert = InvertType::New();
+  invert->SetInput( reader->GetOutput() );
+
+  // remove some minima
+  typedef itk::HMinimaImageFilter< IType, IType > MinimaType;
+  typename MinimaType::Pointer minima = MinimaType::New();
+  minima->SetInput( invert->GetOutput() );
+  minima->SetHeight( 30 );
+
+  typedef itk::RegionalMinimaImageFilter< IType, LImageType > RMinType;
+  typename RMinType::Pointer rmin = RMinType::New();
+  rmin->SetInput( minima->GetOutput() );
+  
+  typedef itk::ConnectedComponentImageFilter< LImageType, LImageType > ConnectedCompType;
+  typename ConnectedCompType::Pointer label = ConnectedCompType::New();
+  label->SetInput( rmin->GetOutput() );
+  label->Update();
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, LImageType > MMWatershedType;
+  typename MMWatershedType::Pointer mmws = MMWatershedType::New();
+  mmws->SetInput( minima->GetOutput() );
+  mmws->SetMarkerImage( label->GetOutput() );
+
+  for(int F=0; F<=1; F++ )
+    {
+    for(int M=0; M<=1; M++ )
+      {
+      mmws->SetFullyConnected( F );
+      mmws->SetMarkWatershedLine( M );
+
+      itk::TimeProbe ltime;
+      itk::TimeProbe stime;
+      itk::TimeProbe gtime;
+      for( int i=0; i<10; i++ )
+        {
+        mmws->SetUseImageSpacing( false );
+        mmws->SetGeodesicPlateaus( false );
+        ltime.Start();
+        mmws->Update();
+        ltime.Stop();
+        mmws->Modified();
+
+        mmws->SetUseImageSpacing( true );
+        stime.Start();
+        mmws->Update();
+        stime.Stop();
+        mmws->Modified();
+
+        mmws->SetUseImageSpacing( false );
+        mmws->SetGeodesicPlateaus( true );
+        gtime.Start();
+        mmws->Update();
+        gtime.Stop();
+        mmws->Modified();
+        }
+        
+      std::cout << std::setprecision(3)
+                << dim << "\t" 
+                << F << "\t" 
+                << M << "\t" 
+                << ltime.GetMeanTime() << "\t" 
+                << stime.GetMeanTime() << "\t" 
+                << gtime.GetMeanTime() << "\t" 
+                << std::endl;
+      }
+    }
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 3 )
+    {
+    std::cerr << "usage: " << argv[0] << " input2D input3D" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(1);
+
+  std::cout << "#D" << "\t" 
+            << "F" << "\t" 
+            << "M" << "\t" 
+            << "linear" << "\t" 
+            << "spacing" << "\t" 
+            << "geodesic" << "\t" 
+            << std::endl;
+
+  perf< 2 >( argv[1] );
+  perf< 3 >( argv[2] );
+
+  return 0;
+}
@@ -0,0 +1,265 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+
+#include "itkShiftScaleImageFilter.h"
+#include "itkGrayscaleGeodesicErodeImageFilter.h"
+#include "itkGrayscaleGeodesicDilateImageFilter.h"
+#include "itkReconstructionByErosionImageFilter.h"
+#include "itkReconstructionByDilationImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkSimpleFilterWatcher.h"
+#include <string>
+
+// reconstruction by erosion of the input raised by a height, as in the
+// h-minima transform, or reconstruction by dilation of the input lowered by
+// a height, as in the h-maxima transform. All the algorithms must produce
+// the same output as the geodesic erosion or dilation iterated until
+// stability. PARALLEL is also run on a corridor which crosses the borders
+// of its slabs back and forth.
+
+template < class TImage >
+unsigned long countDifferences( const TImage * image1, const TImage * image2 )
+{
+  typedef itk::ImageRegionConstIterator< TImage > IteratorType;
+  IteratorType it1( image1, image1->GetBufferedRegion() );
+  IteratorType it2( image2, image2->GetBufferedRegion() );
+  unsigned long differences = 0;
+  for( it1.GoToBegin(), it2.GoToBegin(); !it1.IsAtEnd(); ++it1, ++it2 )
+    {
+    if( it1.Get() != it2.Get() )
+      {
+      differences++;
+      }
+    }
+  return differences;
+}
+
+// the mask is a corridor which goes back and forth along the last
+// dimension, in an image of 64 by 64 pixels. The marker has the value of
+// the corridor at its first pixel only, and that value must reach the
+// whole corridor: the output is the mask. With 8 slabs, the value crosses
+// the borders of the slabs many more times than there are slabs.
+template < class TFilter >
+unsigned long serpentine( bool dilation, bool fullyConnected )
+{
+  typedef typename TFilter::InputImageType IType;
+  typedef typename IType::PixelType PType;
+  const unsigned int last = IType::ImageDimension - 1;
+  const PType corridor = dilation ? 200 : 0;
+  const PType wall = dilation ? 0 : 200;
+
+  typename IType::SizeType size;
+  size.Fill( 1 );
+  size[0] = 64;
+  size[last] = 64;
+  typename IType::Pointer mask = IType::New();
+  mask->SetRegions( size );
+  mask->Allocate();
+  typename IType::Pointer marker = IType::New();
+  marker->SetRegions( size );
+  marker->Allocate();
+
+  typedef itk::ImageRegionIteratorWithIndex< IType > IteratorType;
+  IteratorType mskIt( mask, mask->GetBufferedRegion() );
+  IteratorType mrkIt( marker, marker->GetBufferedRegion() );
+  for( ; !mskIt.IsAtEnd(); ++mskIt, ++mrkIt )
+    {
+    const long x = mskIt.GetIndex()[0];
+    const long y = mskIt.GetIndex()[last];
+    const bool inCorridor = x % 2 == 0
+      || ( x % 4 == 1 && y == (long)size[last] - 1 )
+      || ( x % 4 == 3 && y == 0 );
+    mskIt.Set( inCorridor ? corridor : wall );
+    mrkIt.Set( x == 0 && y == 0 ? corridor : wall );
+    }
+
+  typename TFilter::Pointer filter = TFilter::New();
+  filter->SetMarkerImage( marker );
+  filter->SetMaskImage( mask );
+  filter->SetFullyConnected( fullyConnected );
+  filter->SetAlgorithm( TFilter::PARALLEL );
+  filter->SetNumberOfThreads( 8 );
+  filter->Update();
+  return countDifferences< IType >( filter->GetOutput(), mask );
+}
+
+template < class TFilter, class TGeodesic >
+int recon( bool fullyConnected, int height, const char * input, const char * output )
+{
+  typedef typename TFilter::InputImageType IType;
+  typedef typename IType::PixelType PType;
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( input );
+
+  typedef itk::ShiftScaleImageFilter< IType, IType > ShiftType;
+  typename ShiftType::Pointer shift = ShiftType::New();
+  shift->SetInput( reader->GetOutput() );
+  shift->SetShift( height );
+
+  typedef TGeodesic GeodesicType;
+  typename GeodesicType::Pointer geodesic = GeodesicType::New();
+  geodesic->SetMarkerImage( shift->GetOutput() );
+  geodesic->SetMaskImage( reader->GetOutput() );
+  geodesic->SetFullyConnected( fullyConnected );
+  geodesic->SetRunOneIteration( false );
+  geodesic->Update();
+
+  typedef TFilter FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetMarkerImage( shift->GetOutput() );
+  filter->SetMaskImage( reader->GetOutput() );
+  filter->SetFullyConnected( fullyConnected );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  // the parallel algorithm is run with several numbers of slabs, and the
+  // raster passes of the buffer version with all the instruction sets
+  typedef itk::ReconstructionRasterInstructionSet InstructionSetType;
+  const int algorithms[] = { FilterType::BASIC, FilterType::FACES,
+                             FilterType::COPY, FilterType::COPY, FilterType::COPY,
+                             FilterType::PARALLEL, FilterType::PARALLEL, FilterType::PARALLEL,
+                             FilterType::DOWNHILL, FilterType::AUTO };
+  const int threads[] = { 1, 1, 1, 1, 1, 1, 3, 8, 1, 4 };
+  const int instructionSets[] = { InstructionSetType::AVX2, InstructionSetType::AVX2,
+                                  InstructionSetType::AVX2, InstructionSetType::SSE2, InstructionSetType::SCALAR,
+                                  InstructionSetType::AVX2, InstructionSetType::SSE2, InstructionSetType::AVX2,
+                                  InstructionSetType::AVX2, InstructionSetType::AVX2 };
+  for( unsigned int a=0; a<10; a++ )
+    {
+    filter->SetAlgorithm( algorithms[a] );
+    filter->SetNumberOfThreads( threads[a] );
+    InstructionSetType::SetGlobalMaximum( instructionSets[a] );
+    filter->Modified();
+    filter->Update();
+
+    const unsigned long differences = countDifferences< IType >( filter->GetOutput(), geodesic->GetOutput() );
+    std::cout << "algorithm " << algorithms[a] << " (" << filter->GetSelectedAlgorithm() << ") with "
+              << threads[a] << " threads and the instruction set "
+              << InstructionSetType::Get() << ": "
+              << differences << " different pixels" << std::endl;
+    if( differences != 0 )
+      {
+      std::cerr << "The reconstruction is not the same as the geodesic transform" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // a MarkerValue which is not the neutral value of the comparison is the
+  // value of the pixels outside the image: all the algorithms must produce
+  // the same output as BASIC, which reads it in its boundary condition
+  const PType markerValue = 100;
+  typename FilterType::Pointer basic = FilterType::New();
+  basic->SetMarkerImage( shift->GetOutput() );
+  basic->SetMaskImage( reader->GetOutput() );
+  basic->SetFullyConnected( fullyConnected );
+  basic->SetMarkerValue( markerValue );
+  basic->SetAlgorithm( FilterType::BASIC );
+  basic->Update();
+
+  const PType defaultMarkerValue = filter->GetMarkerValue();
+  filter->SetMarkerValue( markerValue );
+  for( unsigned int a=1; a<10; a++ )
+    {
+    filter->SetAlgorithm( algorithms[a] );
+    filter->SetNumberOfThreads( threads[a] );
+    InstructionSetType::SetGlobalMaximum( instructionSets[a] );
+    filter->Modified();
+    filter->Update();
+
+    const unsigned long differences = countDifferences< IType >( filter->GetOutput(), basic->GetOutput() );
+    std::cout << "algorithm " << algorithms[a] << " (" << filter->GetSelectedAlgorithm() << ") with "
+              << threads[a] << " threads, the instruction set "
+              << InstructionSetType::Get() << " and the marker value "
+              << static_cast< typename itk::NumericTraits< PType >::PrintType >( markerValue ) << ": "
+              << differences << " different pixels" << std::endl;
+    if( differences != 0 )
+      {
+      std::cerr << "The reconstruction is not the same as with the BASIC algorithm" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  const unsigned long serpentineDifferences = serpentine< FilterType >( height < 0, fullyConnected );
+  std::cout << "algorithm " << FilterType::PARALLEL << " with 8 threads on a corridor: "
+            << serpentineDifferences << " different pixels" << std::endl;
+  if( serpentineDifferences != 0 )
+    {
+    std::cerr << "The reconstruction doesn't propagate the whole corridor" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // write the output with the default MarkerValue
+  filter->SetMarkerValue( defaultMarkerValue );
+  typedef itk::ImageFileWriter< IType > WriterType;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( output );
+  writer->Update();
+
+  return 0;
+}
+
+template < class PType >
+int reconPixel( int dimension, bool dilation, bool fullyConnected, int height, const char * input, const char * output )
+{
+  typedef itk::Image< PType, 2 > I2Type;
+  typedef itk::Image< PType, 3 > I3Type;
+
+  if( dilation )
+    {
+    // the marker is lowered by the height
+    if( dimension == 3 )
+      {
+      return recon< itk::ReconstructionByDilationImageFilter< I3Type, I3Type >,
+        itk::GrayscaleGeodesicDilateImageFilter< I3Type, I3Type > >( fullyConnected, -height, input, output );
+      }
+    return recon< itk::ReconstructionByDilationImageFilter< I2Type, I2Type >,
+      itk::GrayscaleGeodesicDilateImageFilter< I2Type, I2Type > >( fullyConnected, -height, input, output );
+    }
+
+  if( dimension == 3 )
+    {
+    return recon< itk::ReconstructionByErosionImageFilter< I3Type, I3Type >,
+      itk::GrayscaleGeodesicErodeImageFilter< I3Type, I3Type > >( fullyConnected, height, input, output );
+    }
+  return recon< itk::ReconstructionByErosionImageFilter< I2Type, I2Type >,
+    itk::GrayscaleGeodesicErodeImageFilter< I2Type, I2Type > >( fullyConnected, height, input, output );
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 7 )
+    {
+    std::cerr << "usage: " << argv[0] << " dimension dilation fullyConnected height input output [pixelType]" << std::endl;
+    std::cerr << "  pixelType: uchar (default), ushort, short or float" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int dimension = atoi( argv[1] );
+  const bool dilation = atoi( argv[2] );
+  const bool fullyConnected = atoi( argv[3] );
+  const int height = atoi( argv[4] );
+  const std::string pixelType = arglen > 7 ? argv[7] : "uchar";
+
+  if( pixelType == "uchar" )
+    {
+    return reconPixel< unsigned char >( dimension, dilation, fullyConnected, height, argv[5], argv[6] );
+    }
+  if( pixelType == "ushort" )
+    {
+    return reconPixel< unsigned short >( dimension, dilation, fullyConnected, height, argv[5], argv[6] );
+    }
+  if( pixelType == "short" )
+    {
+    return reconPixel< short >( dimension, dilation, fullyConnected, height, argv[5], argv[6] );
+    }
+  if( pixelType == "float" )
+    {
+    return reconPixel< float >( dimension, dilation, fullyConnected, height, argv[5], argv[6] );
+    }
+  std::cerr << "Unknown pixel type: " << pixelType << std::endl;
+  return EXIT_FAILURE;
+}
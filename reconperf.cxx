@@ -0,0 +1,148 @@
+#include "itkImageFileReader.h"
+
+#include "itkShiftScaleImageFilter.h"
+#include "itkReconstructionByErosionImageFilter.h"
+#include "itkReconstructionByDilationImageFilter.h"
+#include "itkImageRegionIterator.h"
+
+#include "itkTimeProbe.h"
+#include "itkMultiThreader.h"
+#include <iomanip>
+#include <cmath>
+
+// compare the time of the algorithms of the reconstruction, by erosion on
+// the image raised by 30 as in the h-minima transform, and by dilation on
+// the image lowered by 30 as in the h-maxima transform
+template < class TImage, class TFilter >
+void perf( TImage * image, const char * name, int height )
+{
+  typedef TImage IType;
+  const unsigned int dim = IType::ImageDimension;
+
+  typedef itk::ShiftScaleImageFilter< IType, IType > ShiftType;
+  typename ShiftType::Pointer shift = ShiftType::New();
+  shift->SetInput( image );
+  shift->SetShift( height );
+  shift->Update();
+
+  typedef TFilter FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetMarkerImage( shift->GetOutput() );
+  filter->SetMaskImage( image );
+
+  // COPY is also run without the SIMD instructions
+  typedef itk::ReconstructionRasterInstructionSet InstructionSetType;
+  const int algorithms[] = { FilterType::BASIC, FilterType::FACES, FilterType::COPY,
+                             FilterType::PARALLEL, FilterType::DOWNHILL, FilterType::AUTO,
+                             FilterType::COPY };
+  const int instructionSets[] = { InstructionSetType::AVX2, InstructionSetType::AVX2, InstructionSetType::AVX2,
+                                  InstructionSetType::AVX2, InstructionSetType::AVX2, InstructionSetType::AVX2,
+                                  InstructionSetType::SCALAR };
+
+  for(int F=0; F<=1; F++ )
+    {
+    filter->SetFullyConnected( F );
+
+    std::cout << std::setprecision(3)
+              << name << "\t" 
+              << dim << "\t" 
+              << image->GetLargestPossibleRegion().GetSize() << "\t" 
+              << F << "\t";
+
+    for( unsigned int a=0; a<7; a++ )
+      {
+      filter->SetAlgorithm( algorithms[a] );
+      InstructionSetType::SetGlobalMaximum( instructionSets[a] );
+      itk::TimeProbe time;
+      for( int i=0; i<10; i++ )
+        {
+        time.Start();
+        filter->Update();
+        time.Stop();
+        filter->Modified();
+        }
+      std::cout << time.GetMeanTime() << "\t";
+      }
+    filter->SetAlgorithm( FilterType::AUTO );
+    InstructionSetType::SetGlobalMaximum( InstructionSetType::AVX2 );
+    filter->Update();
+    std::cout << filter->GetSelectedAlgorithm() << std::endl;
+    }
+}
+
+template < class TImage >
+void perf( TImage * image )
+{
+  perf< TImage, itk::ReconstructionByErosionImageFilter< TImage, TImage > >( image, "erosion", 30 );
+  perf< TImage, itk::ReconstructionByDilationImageFilter< TImage, TImage > >( image, "dilation", -30 );
+}
+
+template < unsigned int dim >
+void perfFile( const char * fileName )
+{
+  typedef itk::Image< unsigned char, dim > IType;
+  typedef itk::ImageFileReader< IType > ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( fileName );
+  reader->Update();
+  perf< IType >( reader->GetOutput() );
+}
+
+// a synthetic volume with some blobs and some noise
+void perfSynthetic( unsigned long x, unsigned long y, unsigned long z )
+{
+  typedef itk::Image< unsigned char, 3 > IType;
+  IType::SizeType size;
+  size[0] = x;
+  size[1] = y;
+  size[2] = z;
+  IType::RegionType region;
+  region.SetSize( size );
+  IType::Pointer image = IType::New();
+  image->SetRegions( region );
+  image->Allocate();
+
+  itk::ImageRegionIterator< IType > it( image, region );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const IType::IndexType & idx = it.GetIndex();
+    const double v = 120 + 80 * std::sin( idx[0] / 7.0 ) * std::cos( idx[1] / 5.0 ) * std::sin( idx[2] / 3.0 );
+    it.Set( static_cast< unsigned char >( v + std::rand() % 30 ) );
+    }
+
+  perf< IType >( image );
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 3 )
+    {
+    std::cerr << "usage: " << argv[0] << " input2D input3D" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(1);
+
+  std::cout << "#op" << "\t" 
+            << "D" << "\t" 
+            << "size" << "\t" 
+            << "F" << "\t" 
+            << "basic" << "\t" 
+            << "faces" << "\t" 
+            << "copy" << "\t" 
+            << "parallel" << "\t" 
+            << "downhill" << "\t" 
+            << "auto" << "\t" 
+            << "copy-scalar" << "\t" 
+            << "selected" << "\t" 
+            << std::endl;
+
+  perfFile< 2 >( argv[1] );
+  perfFile< 3 >( argv[2] );
+
+  perfSynthetic( 64, 64, 64 );
+  perfSynthetic( 128, 128, 128 );
+  perfSynthetic( 256, 256, 4 );
+
+  return 0;
+}
@@ -0,0 +1,147 @@
+#include "itkImageFileReader.h"
+
+#include "itkShiftScaleImageFilter.h"
+#include "itkReconstructionByErosionImageFilter.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIterator.h"
+
+#include "itkTimeProbe.h"
+#include "itkMultiThreader.h"
+#include <iomanip>
+#include <cmath>
+
+// the time of the parallel reconstruction with 1 to 32 threads, on the
+// image raised by 30 as in the h-minima transform. The output must be the
+// same with any number of threads.
+template < class TImage >
+void perf( TImage * image )
+{
+  typedef TImage IType;
+  const unsigned int dim = IType::ImageDimension;
+
+  typedef itk::ShiftScaleImageFilter< IType, IType > ShiftType;
+  typename ShiftType::Pointer shift = ShiftType::New();
+  shift->SetInput( image );
+  shift->SetShift( 30 );
+  shift->Update();
+
+  typedef itk::ReconstructionByErosionImageFilter< IType, IType > FilterType;
+  typename FilterType::Pointer basic = FilterType::New();
+  basic->SetMarkerImage( shift->GetOutput() );
+  basic->SetMaskImage( image );
+  basic->SetAlgorithm( FilterType::BASIC );
+
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetMarkerImage( shift->GetOutput() );
+  filter->SetMaskImage( image );
+  filter->SetAlgorithm( FilterType::PARALLEL );
+
+  for(int F=0; F<=1; F++ )
+    {
+    basic->SetFullyConnected( F );
+    basic->Update();
+    filter->SetFullyConnected( F );
+
+    double reference = 0;
+    for( int t=1; t<=32; t*=2 )
+      {
+      filter->SetNumberOfThreads( t );
+      itk::TimeProbe time;
+      for( int i=0; i<10; i++ )
+        {
+        time.Start();
+        filter->Update();
+        time.Stop();
+        filter->Modified();
+        }
+      if( t == 1 )
+        {
+        reference = time.GetMeanTime();
+        }
+
+      // check the output
+      typedef itk::ImageRegionConstIterator< IType > IteratorType;
+      IteratorType it( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+      IteratorType bIt( basic->GetOutput(), basic->GetOutput()->GetBufferedRegion() );
+      bool same = true;
+      for( it.GoToBegin(), bIt.GoToBegin(); !it.IsAtEnd(); ++it, ++bIt )
+        {
+        same = same && it.Get() == bIt.Get();
+        }
+
+      std::cout << std::setprecision(3)
+                << dim << "\t" 
+                << image->GetLargestPossibleRegion().GetSize() << "\t" 
+                << F << "\t" 
+                << t << "\t" 
+                << time.GetMeanTime() << "\t" 
+                << reference / time.GetMeanTime() << "\t" 
+                << same << "\t" 
+                << std::endl;
+      }
+    }
+}
+
+template < unsigned int dim >
+void perfFile( const char * fileName )
+{
+  typedef itk::Image< unsigned char, dim > IType;
+  typedef itk::ImageFileReader< IType > ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( fileName );
+  reader->Update();
+  perf< IType >( reader->GetOutput() );
+}
+
+// a synthetic volume with some blobs and some noise
+void perfSynthetic( unsigned long x, unsigned long y, unsigned long z )
+{
+  typedef itk::Image< unsigned char, 3 > IType;
+  IType::SizeType size;
+  size[0] = x;
+  size[1] = y;
+  size[2] = z;
+  IType::RegionType region;
+  region.SetSize( size );
+  IType::Pointer image = IType::New();
+  image->SetRegions( region );
+  image->Allocate();
+
+  itk::ImageRegionIterator< IType > it( image, region );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const IType::IndexType & idx = it.GetIndex();
+    const double v = 120 + 80 * std::sin( idx[0] / 7.0 ) * std::cos( idx[1] / 5.0 ) * std::sin( idx[2] / 3.0 );
+    it.Set( static_cast< unsigned char >( v + std::rand() % 30 ) );
+    }
+
+  perf< IType >( image );
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 3 )
+    {
+    std::cerr << "usage: " << argv[0] << " input2D input3D" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(32);
+
+  std::cout << "#D" << "\t" 
+            << "size" << "\t" 
+            << "F" << "\t" 
+            << "threads" << "\t" 
+            << "time" << "\t" 
+            << "speedup" << "\t" 
+            << "same" << "\t" 
+            << std::endl;
+
+  perfFile< 2 >( argv[1] );
+  perfFile< 3 >( argv[2] );
+
+  perfSynthetic( 128, 128, 128 );
+  perfSynthetic( 256, 256, 256 );
+
+  return 0;
+}
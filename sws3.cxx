@@ -0,0 +1,159 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkCommand.h"
+#include "itkNumericTraits.h"
+#include "itkStreamingMorphologicalWatershedImageFilter.h"
+#include "itkInvertIntensityImageFilter.h"
+#include "itkSimpleFilterWatcher.h"
+#include "itkMorphologicalWatershedImageFilter.h"
+#include "itkImageRegionSplitter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include <map>
+#include <set>
+#include <algorithm>
+
+// segment a 3D image slab by slab. The output is written by the writer in
+// several pieces, so, with a file format able to read and write the images
+// by pieces (like MetaImage), the whole image is never in memory.
+// With the check option, the output is read again, and the watershed of
+// each slab with its overlap is computed again to check the stitching:
+// two basins of a slab must never have the same label, and the slabs must
+// share some labels.
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 8 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected level overlap nbOfDivisions input output [check]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int dim = 3;
+  
+  typedef unsigned short PType;
+  typedef itk::Image< PType, dim > IType;
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[6] );
+
+  typedef itk::InvertIntensityImageFilter< IType, IType > InvertType;
+  InvertType::Pointer invert = InvertType::New();
+  invert->SetInput( reader->GetOutput() );
+
+  typedef itk::StreamingMorphologicalWatershedImageFilter< IType, IType > FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( invert->GetOutput() );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+  filter->SetLevel( atoi( argv[3] ) );
+  filter->SetOverlap( atoi( argv[4] ) );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[7] );
+  writer->SetNumberOfStreamDivisions( atoi( argv[5] ) );
+  writer->Update();
+
+  if( arglen < 9 || !atoi( argv[8] ) )
+    {
+    return 0;
+    }
+
+  ReaderType::Pointer outputReader = ReaderType::New();
+  outputReader->SetFileName( argv[7] );
+  outputReader->Update();
+  IType::ConstPointer output = outputReader->GetOutput();
+
+  // the writer has requested the last slab only
+  invert->GetOutput()->SetRequestedRegionToLargestPossibleRegion();
+  invert->Update();
+  IType::ConstPointer inverted = invert->GetOutput();
+  const IType::RegionType & largest = inverted->GetLargestPossibleRegion();
+
+  // the slabs produced by the writer
+  typedef itk::ImageRegionSplitter< dim > SplitterType;
+  SplitterType::Pointer splitter = SplitterType::New();
+  const unsigned int nbOfSlabs = splitter->GetNumberOfSplits( largest, atoi( argv[5] ) );
+
+  std::set< PType > previousLabels;
+  for( unsigned int i=0; i<nbOfSlabs; i++ )
+    {
+    const IType::RegionType slabRegion = splitter->GetSplit( i, nbOfSlabs, largest );
+
+    // the watershed of the slab with its overlap, as done by the filter
+    const long overlap = static_cast< long >( filter->GetOverlap() );
+    const long begin = std::max( slabRegion.GetIndex( dim-1 ) - overlap, largest.GetIndex( dim-1 ) );
+    const long end = std::min( slabRegion.GetIndex( dim-1 ) + static_cast< long >( slabRegion.GetSize( dim-1 ) ) + overlap,
+                               largest.GetIndex( dim-1 ) + static_cast< long >( largest.GetSize( dim-1 ) ) );
+    IType::RegionType region = slabRegion;
+    region.SetIndex( dim-1, begin );
+    region.SetSize( dim-1, end - begin );
+    IType::Pointer slab = IType::New();
+    slab->CopyInformation( inverted );
+    slab->SetRegions( region );
+    slab->Allocate();
+    itk::ImageRegionConstIterator< IType > inIt( inverted, region );
+    itk::ImageRegionIterator< IType > slabIt( slab, region );
+    for( inIt.GoToBegin(), slabIt.GoToBegin(); !inIt.IsAtEnd(); ++inIt, ++slabIt )
+      {
+      slabIt.Set( inIt.Get() );
+      }
+
+    typedef itk::MorphologicalWatershedImageFilter< IType, IType > WatershedType;
+    WatershedType::Pointer wshed = WatershedType::New();
+    wshed->SetInput( slab );
+    wshed->SetFullyConnected( filter->GetFullyConnected() );
+    wshed->SetMarkWatershedLine( filter->GetMarkWatershedLine() );
+    wshed->SetLevel( filter->GetLevel() );
+    wshed->Update();
+
+    // a label of the output must be the label of a single basin of the slab
+    typedef std::map< PType, PType > LabelMapType;
+    LabelMapType basins;
+    std::set< PType > labels;
+    unsigned long stitched = 0;
+    itk::ImageRegionConstIterator< IType > lIt( wshed->GetOutput(), slabRegion );
+    itk::ImageRegionConstIterator< IType > oIt( output, slabRegion );
+    for( lIt.GoToBegin(), oIt.GoToBegin(); !lIt.IsAtEnd(); ++lIt, ++oIt )
+      {
+      const PType l = lIt.Get();
+      const PType o = oIt.Get();
+      if( ( l == 0 ) != ( o == 0 ) )
+        {
+        std::cerr << "The watershed lines are different in the slab " << i << std::endl;
+        return EXIT_FAILURE;
+        }
+      if( o == 0 )
+        {
+        continue;
+        }
+      LabelMapType::iterator it = basins.find( o );
+      if( it == basins.end() )
+        {
+        basins[ o ] = l;
+        labels.insert( o );
+        stitched += previousLabels.count( o );
+        }
+      else if( it->second != l )
+        {
+        std::cerr << "The label " << o << " is given to two basins of the slab " << i << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    if( i > 0 && stitched == 0 )
+      {
+      std::cerr << "The slab " << i << " is not stitched to the previous one" << std::endl;
+      return EXIT_FAILURE;
+      }
+    std::cout << "slab " << i << ": " << labels.size() << " labels, "
+              << stitched << " stitched to the previous slab" << std::endl;
+    previousLabels = labels;
+    }
+
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include "itkImageFileReader.h"
+
+#include "itkRegionalMinimaImageFilter.h"
+#include "itkHMinimaImageFilter.h"
+#include "itkConnectedComponentImageFilter.h"
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkInvertIntensityImageFilter.h"
+
+#include "itkTimeProbe.h"
+#include "itkMultiThreader.h"
+#include <iomanip>
+
+// steady state throughput of the filter run many times on images of the
+// same size: a filter reused for all the runs, which keeps its workspace,
+// is compared to a new filter created for each run
+int main(int arglen, char * argv[])
+{
+  if( arglen < 2 )
+    {
+    std::cerr << "usage: " << argv[0] << " input2D [nbOfRuns]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  int nbOfRuns = 1000;
+  if( arglen > 2 )
+    {
+    nbOfRuns = atoi( argv[2] );
+    }
+
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(1);
+
+  const int dim = 2;
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim >    IType;
+  typedef unsigned short LType;
+  typedef itk::Image< LType, dim >    LImageType;
+
+  // read the input image
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[1] );
+
+  // the image is more interesting inverted
+  typedef itk::InvertIntensityImageFilter< IType, IType > InvertType;
+  InvertType::Pointer invert = InvertType::New();
+  invert->SetInput( reader->GetOutput() );
+
+  // remove some minima
+  typedef itk::HMinimaImageFilter< IType, IType > MinimaType;
+  MinimaType::Pointer minima = MinimaType::New();
+  minima->SetInput( invert->GetOutput() );
+  minima->SetHeight( 30 );
+
+  typedef itk::RegionalMinimaImageFilter< IType, LImageType > RMinType;
+  RMinType::Pointer rmin = RMinType::New();
+  rmin->SetInput( minima->GetOutput() );
+
+  typedef itk::ConnectedComponentImageFilter< LImageType, LImageType > ConnectedCompType;
+  ConnectedCompType::Pointer label = ConnectedCompType::New();
+  label->SetInput( rmin->GetOutput() );
+  label->Update();
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, LImageType > MMWatershedType;
+
+  std::cout << "F" << "\t"
+            << "M" << "\t"
+            << "reused" << "\t"
+            << "new" << "\t"
+            << std::endl;
+
+  for(int F=0; F<=1; F++ )
+    {
+    for(int M=0; M<=1; M++ )
+      {
+      itk::TimeProbe rtime;
+      itk::TimeProbe ntime;
+
+      MMWatershedType::Pointer mmws = MMWatershedType::New();
+      mmws->SetInput( invert->GetOutput() );
+      mmws->SetMarkerImage( label->GetOutput() );
+      mmws->SetFullyConnected( F );
+      mmws->SetMarkWatershedLine( M );
+      // a first run to get to the steady state
+      mmws->Update();
+
+      for( int i=0; i<nbOfRuns; i++ )
+        {
+        mmws->Modified();
+        rtime.Start();
+        mmws->Update();
+        rtime.Stop();
+
+        ntime.Start();
+        MMWatershedType::Pointer nmws = MMWatershedType::New();
+        nmws->SetInput( invert->GetOutput() );
+        nmws->SetMarkerImage( label->GetOutput() );
+        nmws->SetFullyConnected( F );
+        nmws->SetMarkWatershedLine( M );
+        nmws->Update();
+        ntime.Stop();
+        }
+
+      std::cout << std::setprecision(3)
+                << F << "\t"
+                << M << "\t"
+                << rtime.GetMeanTime() << "\t"
+                << ntime.GetMeanTime() << "\t"
+                << std::endl;
+      }
+    }
+
+  return 0;
+}
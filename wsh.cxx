@@ -0,0 +1,73 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkCommand.h"
+#include "itkNumericTraits.h"
+#include <itkIntensityWindowingImageFilter.h>
+#include <itkMinimumMaximumImageCalculator.h>
+#include "itkLabelOverlayImageFilter.h"
+
+#include "itkMorphologicalWatershedImageFilter.h"
+#include "itkSimpleFilterWatcher.h"
+
+
+int main(int arglen, char * argv[])
+{
+  const int dim = 2;
+  
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[2] );
+
+  typedef itk::MorphologicalWatershedImageFilter< IType, IType > FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMarkWatershedLine( true );
+  filter->SetFullyConnected( false );
+  filter->SetComputeMergeTree( true );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  // a first run at level 0 builds the merge tree, and the second one only
+  // floods the image from the markers of the tree at the requested level
+  filter->SetLevel( 0 );
+  filter->Update();
+  filter->SetLevel( atoi( argv[1] ) );
+  filter->Update();
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[3] );
+  writer->Update();
+
+  if( arglen > 4 )
+    {
+    typedef itk::RGBPixel<unsigned char>   RGBPixelType;
+    typedef itk::Image<RGBPixelType, dim>    RGBImageType;
+    
+    typedef itk::LabelOverlayImageFilter<IType, IType, RGBImageType> OverlayType;
+    OverlayType::Pointer overlay = OverlayType::New();
+    overlay->SetInput( reader->GetOutput() );
+    overlay->SetLabelImage( filter->GetOutput() );
+
+    typedef itk::ImageFileWriter< RGBImageType > RGBWriterType;
+    RGBWriterType::Pointer rgbwriter = RGBWriterType::New();
+    rgbwriter->SetInput( overlay->GetOutput() );
+    rgbwriter->SetFileName( argv[4] );
+    rgbwriter->Update();
+
+    if( arglen > 5 )
+      {
+      overlay->SetOpacity( atof( argv[5] ) );
+      }
+
+    rgbwriter->Update();
+
+    }
+
+  return 0;
+}
+
@@ -0,0 +1,246 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkLabelOverlayImageFilter.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkLinearNeighborhood.h"
+#include "itkSimpleFilterWatcher.h"
+#include "vcl_cmath.h"
+
+// compact watershed from markers. The basins must still be connected and
+// contain a pixel of their marker, whatever the compactness. A compactness
+// of 0 must give the regular watershed, a very small one must still flood
+// each pixel at the lowest level where a marker can reach it, and the
+// given compactness must give basins of more regular sizes than the
+// regular watershed.
+
+typedef unsigned char PType;
+typedef itk::LinearNeighborhood< 2 > NeighborhoodType;
+
+// the level at which each labeled pixel can be reached from a marker. The
+// paths only go through the labeled pixels, and only through the pixels of
+// the same basin when within is true. The pixels pushed by a marker are at
+// their own value with the watershed line.
+void ComputeLevels( const PType * buffer, const PType * input, const PType * markers,
+                    const NeighborhoodType & neighborhood, long nbOfPixels,
+                    PType bg, bool line, bool within, std::vector< int > & levels )
+{
+  levels.assign( nbOfPixels, 256 );
+  std::vector< std::vector< long > > queues( 257 );
+  for( long p=0; p<nbOfPixels; p++ )
+    {
+    if( markers[p] != bg )
+      {
+      levels[p] = line ? -1 : input[p];
+      queues[ levels[p] + 1 ].push_back( p );
+      }
+    }
+  std::vector< bool > done( nbOfPixels, false );
+  NeighborhoodType::OffsetType position;
+  for( int l=0; l<257; l++ )
+    {
+    for( unsigned long k=0; k<queues[l].size(); k++ )
+      {
+      const long p = queues[l][k];
+      if( done[p] )
+        { continue; }
+      done[p] = true;
+      const bool onBorder = neighborhood.IsOnBorder( p, position );
+      for( unsigned int i=0; i<neighborhood.GetNumberOfNeighbors(); i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const long q = p + neighborhood.GetLinearOffset( i );
+        if( done[q] || markers[q] != bg || buffer[q] == bg || ( within && buffer[q] != buffer[p] ) )
+          { continue; }
+        const int level = std::max( levels[p], (int)input[q] );
+        if( level < levels[q] )
+          {
+          levels[q] = level;
+          queues[ level + 1 ].push_back( q );
+          }
+        }
+      }
+    }
+}
+
+// the variance of the sizes of the basins
+double ComputeSizeVariance( const PType * buffer, long nbOfPixels, PType bg )
+{
+  std::map< PType, long > sizes;
+  for( long p=0; p<nbOfPixels; p++ )
+    {
+    if( buffer[p] != bg )
+      { sizes[ buffer[p] ]++; }
+    }
+  double mean = 0;
+  for( std::map< PType, long >::const_iterator it=sizes.begin(); it!=sizes.end(); it++ )
+    { mean += it->second; }
+  mean /= sizes.size();
+  double variance = 0;
+  for( std::map< PType, long >::const_iterator it=sizes.begin(); it!=sizes.end(); it++ )
+    { variance += ( it->second - mean ) * ( it->second - mean ); }
+  return variance / sizes.size();
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 7 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected compactness input markers output [rgb [alpha]]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int dim = 2;
+
+  typedef itk::Image< PType, dim > IType;
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[4] );
+
+  ReaderType::Pointer reader2 = ReaderType::New();
+  reader2->SetFileName( argv[5] );
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMarkerImage( reader2->GetOutput() );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+  filter->SetCompactness( atof( argv[3] ) );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[6] );
+  writer->Update();
+
+  // visit each connected component of each label, and check that it
+  // contains a marker pixel with the same label
+  NeighborhoodType neighborhood;
+  neighborhood.Initialize( filter->GetOutput()->GetBufferedRegion().GetSize(), filter->GetConnectivity()->GetNeighbors() );
+  const PType * buffer = filter->GetOutput()->GetBufferPointer();
+  const PType * markers = reader2->GetOutput()->GetBufferPointer();
+  const long nbOfPixels = filter->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
+  std::vector< bool > visited( nbOfPixels, false );
+  std::vector< long > stack;
+  NeighborhoodType::OffsetType position;
+  for( long p=0; p<nbOfPixels; p++ )
+    {
+    if( visited[p] || buffer[p] == filter->GetBackgroundValue() )
+      { continue; }
+    bool haveMarker = false;
+    visited[p] = true;
+    stack.push_back( p );
+    while( !stack.empty() )
+      {
+      const long r = stack.back();
+      stack.pop_back();
+      haveMarker = haveMarker || markers[r] == buffer[p];
+      const bool onBorder = neighborhood.IsOnBorder( r, position );
+      for( unsigned int i=0; i<neighborhood.GetNumberOfNeighbors(); i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const long q = r + neighborhood.GetLinearOffset( i );
+        if( !visited[q] && buffer[q] == buffer[p] )
+          {
+          visited[q] = true;
+          stack.push_back( q );
+          }
+        }
+      }
+    if( !haveMarker )
+      {
+      std::cerr << "A part of the basin " << (int)buffer[p] << " doesn't contain its marker" << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
+  // a compactness of 0 is the regular watershed
+  FilterType::Pointer regular = FilterType::New();
+  regular->SetInput( reader->GetOutput() );
+  regular->SetMarkerImage( reader2->GetOutput() );
+  regular->SetMarkWatershedLine( filter->GetMarkWatershedLine() );
+  regular->SetFullyConnected( filter->GetFullyConnected() );
+  regular->Update();
+  FilterType::Pointer zero = FilterType::New();
+  zero->SetInput( reader->GetOutput() );
+  zero->SetMarkerImage( reader2->GetOutput() );
+  zero->SetMarkWatershedLine( filter->GetMarkWatershedLine() );
+  zero->SetFullyConnected( filter->GetFullyConnected() );
+  zero->SetCompactness( 0 );
+  zero->Update();
+  const PType * regularBuffer = regular->GetOutput()->GetBufferPointer();
+  if( !std::equal( regularBuffer, regularBuffer + nbOfPixels, zero->GetOutput()->GetBufferPointer() ) )
+    {
+    std::cerr << "A compactness of 0 is not the regular watershed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // when the compactness times the largest distance is lower than 1, the
+  // distances only change the order of the pixels of the same level, so
+  // each pixel is still flooded at the lowest level a marker can reach it,
+  // from the marker of its basin
+  double diagonal = 0;
+  for( unsigned int d=0; d<dim; d++ )
+    {
+    const double length = filter->GetOutput()->GetBufferedRegion().GetSize()[d];
+    diagonal += length * length;
+    }
+  FilterType::Pointer small = FilterType::New();
+  small->SetInput( reader->GetOutput() );
+  small->SetMarkerImage( reader2->GetOutput() );
+  small->SetMarkWatershedLine( filter->GetMarkWatershedLine() );
+  small->SetFullyConnected( filter->GetFullyConnected() );
+  small->SetCompactness( 0.5 / vcl_sqrt( diagonal ) );
+  small->Update();
+  const PType * smallBuffer = small->GetOutput()->GetBufferPointer();
+  const PType * inputBuffer = reader->GetOutput()->GetBufferPointer();
+  std::vector< int > levels;
+  std::vector< int > basinLevels;
+  ComputeLevels( smallBuffer, inputBuffer, markers, neighborhood, nbOfPixels, filter->GetBackgroundValue(), filter->GetMarkWatershedLine(), false, levels );
+  ComputeLevels( smallBuffer, inputBuffer, markers, neighborhood, nbOfPixels, filter->GetBackgroundValue(), filter->GetMarkWatershedLine(), true, basinLevels );
+  if( levels != basinLevels )
+    {
+    std::cerr << "With a compactness of " << small->GetCompactness() << ", some pixels are not flooded at their lowest level" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the compactness gives basins of more regular sizes
+  const double variance = ComputeSizeVariance( buffer, nbOfPixels, filter->GetBackgroundValue() );
+  const double regularVariance = ComputeSizeVariance( regularBuffer, nbOfPixels, filter->GetBackgroundValue() );
+  std::cout << "variance of the sizes of the basins: " << variance << " with a compactness of " << filter->GetCompactness()
+            << ", " << regularVariance << " without" << std::endl;
+  if( !( variance < regularVariance / 2 ) )
+    {
+    std::cerr << "The compactness doesn't regularize the sizes of the basins" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  if( arglen > 7 )
+    {
+    typedef itk::RGBPixel<unsigned char>   RGBPixelType;
+    typedef itk::Image<RGBPixelType, dim>    RGBImageType;
+
+    typedef itk::LabelOverlayImageFilter<IType, IType, RGBImageType> OverlayType;
+    OverlayType::Pointer overlay = OverlayType::New();
+    overlay->SetInput( reader->GetOutput() );
+    overlay->SetLabelImage( filter->GetOutput() );
+    if( arglen > 8 )
+      {
+      overlay->SetOpacity( atof( argv[8] ) );
+      }
+
+    typedef itk::ImageFileWriter< RGBImageType > RGBWriterType;
+    RGBWriterType::Pointer rgbwriter = RGBWriterType::New();
+    rgbwriter->SetInput( overlay->GetOutput() );
+    rgbwriter->SetFileName( argv[7] );
+    rgbwriter->Update();
+    }
+
+  return 0;
+}
@@ -0,0 +1,225 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkLinearNeighborhood.h"
+#include "itkSimpleFilterWatcher.h"
+
+// collect the region adjacency graph during the watershed from markers,
+// and check that it is the same with one thread and without padding than
+// with several threads and the padding. The contacts and the passes are
+// also checked against a scan of the output.
+
+typedef std::pair< unsigned char, unsigned char > PairType;
+
+void AddContact( std::map< PairType, std::pair< unsigned long, int > > & contacts,
+                 const PairType & pair, int pass )
+{
+  std::map< PairType, std::pair< unsigned long, int > >::iterator it = contacts.find( pair );
+  if( it == contacts.end() )
+    {
+    contacts[ pair ] = std::make_pair( 1ul, pass );
+    }
+  else
+    {
+    it->second.first++;
+    it->second.second = std::min( it->second.second, pass );
+    }
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 6 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected input markers output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int dim = 2;
+
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[3] );
+
+  ReaderType::Pointer reader2 = ReaderType::New();
+  reader2->SetFileName( argv[4] );
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+  FilterType::Pointer serial = FilterType::New();
+  serial->SetInput( reader->GetOutput() );
+  serial->SetMarkerImage( reader2->GetOutput() );
+  serial->SetMarkWatershedLine( atoi( argv[1] ) );
+  serial->SetFullyConnected( atoi( argv[2] ) );
+  serial->SetNumberOfThreads( 1 );
+  serial->SetPadImageBoundary( false );
+  serial->SetComputeAdjacencyGraph( true );
+  serial->Update();
+
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMarkerImage( reader2->GetOutput() );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+  filter->SetNumberOfThreads( 4 );
+  filter->SetMinimumParallelBatchSize( 1 );
+  filter->SetMinimumParallelNumberOfThreads( 1 );
+  filter->SetComputeAdjacencyGraph( true );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[5] );
+  writer->Update();
+
+  typedef FilterType::AdjacencyGraphType GraphType;
+  const GraphType & graph = filter->GetAdjacencyGraph();
+  const GraphType & serialGraph = serial->GetAdjacencyGraph();
+
+  std::cout << "label1" << "\t" << "label2" << "\t" << "contacts" << "\t" << "pass" << std::endl;
+  for( GraphType::const_iterator it=graph.begin(); it!=graph.end(); it++ )
+    {
+    std::cout << (int)it->first.first << "\t"
+              << (int)it->first.second << "\t"
+              << it->second.ContactSize << "\t"
+              << (int)it->second.Pass << std::endl;
+    }
+
+  bool same = graph.size() == serialGraph.size();
+  for( GraphType::const_iterator it=graph.begin(), sIt=serialGraph.begin(); same && it!=graph.end(); it++, sIt++ )
+    {
+    same = it->first == sIt->first
+      && it->second.ContactSize == sIt->second.ContactSize
+      && it->second.Pass == sIt->second.Pass;
+    }
+  if( !same )
+    {
+    std::cerr << "The graphs are different with " << filter->GetNumberOfThreads() << " threads" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // compute the graph again from a scan of the output. The flooding level
+  // of a pixel is the lowest level at which it can be reached from the
+  // marker of its basin without leaving the basin - the pixels pushed by
+  // a marker are at their own value with the watershed line. The pixels
+  // are visited from the lowest level with a queue for each level.
+  typedef itk::LinearNeighborhood< dim > NeighborhoodType;
+  NeighborhoodType neighborhood;
+  neighborhood.Initialize( filter->GetOutput()->GetBufferedRegion().GetSize(), filter->GetConnectivity()->GetNeighbors() );
+  const PType * buffer = filter->GetOutput()->GetBufferPointer();
+  const PType * inputBuffer = reader->GetOutput()->GetBufferPointer();
+  const PType * markerBuffer = reader2->GetOutput()->GetBufferPointer();
+  const PType bg = filter->GetBackgroundValue();
+  const bool line = filter->GetMarkWatershedLine();
+  const long nbOfPixels = filter->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
+  NeighborhoodType::OffsetType position;
+  std::vector< int > levels( nbOfPixels, 256 );
+  std::vector< std::vector< long > > queues( 257 );
+  for( long p=0; p<nbOfPixels; p++ )
+    {
+    if( markerBuffer[p] != bg )
+      {
+      levels[p] = line ? -1 : inputBuffer[p];
+      queues[ levels[p] + 1 ].push_back( p );
+      }
+    }
+  std::vector< bool > done( nbOfPixels, false );
+  for( int l=0; l<257; l++ )
+    {
+    for( unsigned long k=0; k<queues[l].size(); k++ )
+      {
+      const long p = queues[l][k];
+      if( done[p] )
+        { continue; }
+      done[p] = true;
+      const bool onBorder = neighborhood.IsOnBorder( p, position );
+      for( unsigned int i=0; i<neighborhood.GetNumberOfNeighbors(); i++ )
+        {
+        if( onBorder && !neighborhood.IsInside( position, i ) )
+          { continue; }
+        const long q = p + neighborhood.GetLinearOffset( i );
+        const int level = std::max( levels[p], (int)inputBuffer[q] );
+        if( !done[q] && buffer[q] == buffer[p] && markerBuffer[q] == bg && level < levels[q] )
+          {
+          levels[q] = level;
+          queues[ level + 1 ].push_back( q );
+          }
+        }
+      }
+    }
+
+  // without watershed line, the contacts are the pairs of neighbor pixels
+  // of two basins, at the highest level of the two pixels. With the
+  // watershed line, they are the watershed pixels with both basins in their
+  // neighborhood, at the level where the second basin reaches the pixel,
+  // and the neighbor markers at the highest value of the two pixels.
+  typedef std::map< FilterType::LabelPairType, std::pair< unsigned long, int > > ContactMapType;
+  ContactMapType contacts;
+  std::map< PType, int > reached;
+  for( long p=0; p<nbOfPixels; p++ )
+    {
+    const bool onBorder = neighborhood.IsOnBorder( p, position );
+    reached.clear();
+    for( unsigned int i=0; i<neighborhood.GetNumberOfNeighbors(); i++ )
+      {
+      if( onBorder && !neighborhood.IsInside( position, i ) )
+        { continue; }
+      const long q = p + neighborhood.GetLinearOffset( i );
+      const PType & l = buffer[q];
+      if( l == bg )
+        { continue; }
+      if( buffer[p] != bg && buffer[p] < l )
+        {
+        const int pass = line ? std::max( inputBuffer[p], inputBuffer[q] ) : std::max( levels[p], levels[q] );
+        AddContact( contacts, FilterType::LabelPairType( buffer[p], l ), pass );
+        }
+      else if( buffer[p] == bg && line )
+        {
+        // the lowest level of the basin around the watershed pixel
+        if( reached.find( l ) == reached.end() || levels[q] < reached[l] )
+          { reached[l] = levels[q]; }
+        }
+      }
+    for( std::map< PType, int >::const_iterator rIt=reached.begin(); rIt!=reached.end(); rIt++ )
+      {
+      std::map< PType, int >::const_iterator rIt2 = rIt;
+      for( rIt2++; rIt2!=reached.end(); rIt2++ )
+        {
+        const int pass = std::max( (int)inputBuffer[p], std::max( rIt->second, rIt2->second ) );
+        AddContact( contacts, FilterType::LabelPairType( rIt->first, rIt2->first ), pass );
+        }
+      }
+    }
+
+  same = contacts.size() == graph.size();
+  GraphType::const_iterator it = graph.begin();
+  for( ContactMapType::const_iterator cIt=contacts.begin(); same && cIt!=contacts.end(); cIt++, it++ )
+    {
+    same = cIt->first == it->first
+      && cIt->second.first == it->second.ContactSize
+      && cIt->second.second == (int)it->second.Pass;
+    }
+  if( !same )
+    {
+    std::cerr << "The contacts or the passes of the graph are not the ones of the output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // the graph is not collected by the compact flooding
+  filter->SetCompactness( 0.5 );
+  try
+    {
+    filter->Update();
+    std::cerr << "No exception with the adjacency graph and a compactness" << std::endl;
+    return EXIT_FAILURE;
+    }
+  catch( itk::ExceptionObject & )
+    {
+    }
+
+  return 0;
+}
@@ -0,0 +1,172 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkSimpleFilterWatcher.h"
+
+// edit the markers between two runs of the watershed with the incremental
+// flooding, and check that the output is the same than the one of a new
+// filter which floods the whole image. The edits in the smallest basin must
+// only flood a part of the image.
+
+template < class TFilter, class TImage >
+bool CheckEdit( TFilter * filter, TImage * markers, const typename TImage::RegionType & editRegion, const char * name, bool local )
+{
+  markers->Modified();
+  filter->SetMarkerEditRegion( editRegion );
+  filter->Update();
+
+  typename TFilter::Pointer full = TFilter::New();
+  full->SetInput( filter->GetInput() );
+  full->SetMarkerImage( markers );
+  full->SetFullyConnected( filter->GetFullyConnected() );
+  full->SetMarkWatershedLine( filter->GetMarkWatershedLine() );
+  full->Update();
+
+  typedef itk::ImageRegionConstIterator< TImage > IteratorType;
+  IteratorType it( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+  IteratorType fIt( full->GetOutput(), full->GetOutput()->GetBufferedRegion() );
+  for( ; !it.IsAtEnd(); ++it, ++fIt )
+    {
+    if( it.Get() != fIt.Get() )
+      {
+      std::cerr << name << ": the incremental flooding is different of the full one at " << it.GetIndex() << std::endl;
+      return false;
+      }
+    }
+  const unsigned long nbOfPixels = filter->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
+  std::cout << name << ": " << filter->GetNumberOfFloodedPixels() << " pixels flooded on "
+            << nbOfPixels << std::endl;
+  if( local && filter->GetNumberOfFloodedPixels() >= nbOfPixels )
+    {
+    std::cerr << name << ": the whole image has been flooded again" << std::endl;
+    return false;
+    }
+  return true;
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 5 )
+    {
+    std::cerr << "usage: " << argv[0] << " fullyConnected input markers output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int dim = 2;
+
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[2] );
+
+  ReaderType::Pointer reader2 = ReaderType::New();
+  reader2->SetFileName( argv[3] );
+  reader2->Update();
+
+  // the markers are edited in place, so keep them out of the pipeline
+  IType::Pointer markers = reader2->GetOutput();
+  markers->DisconnectPipeline();
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMarkerImage( markers );
+  filter->SetMarkWatershedLine( false );
+  filter->SetFullyConnected( atoi( argv[1] ) );
+  filter->SetIncrementalFlooding( true );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  filter->Update();
+
+  // find an unused label
+  PType newLabel = 1;
+  PType removedLabel = 0;
+  typedef itk::ImageRegionIterator< IType > IteratorType;
+  IteratorType it( markers, markers->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    if( it.Get() >= newLabel )
+      {
+      newLabel = it.Get() + 1;
+      }
+    if( removedLabel == 0 )
+      {
+      removedLabel = it.Get();
+      }
+    }
+
+  // the smallest basin, and one of its pixels which is not a marker
+  std::vector< unsigned long > areas( itk::NumericTraits< PType >::max() + 1, 0 );
+  typedef itk::ImageRegionConstIteratorWithIndex< IType > IndexIteratorType;
+  IndexIteratorType oIt( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+  for( oIt.GoToBegin(); !oIt.IsAtEnd(); ++oIt )
+    {
+    areas[ oIt.Get() ]++;
+    }
+  PType smallest = 0;
+  IType::IndexType editIndex;
+  bool found = false;
+  for( oIt.GoToBegin(); !oIt.IsAtEnd(); ++oIt )
+    {
+    const PType l = oIt.Get();
+    if( markers->GetPixel( oIt.GetIndex() ) == filter->GetBackgroundValue()
+        && ( !found || areas[l] < areas[smallest] ) )
+      {
+      smallest = l;
+      editIndex = oIt.GetIndex();
+      found = true;
+      }
+    }
+  if( !found )
+    {
+    std::cerr << "no basin to edit" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "editing the basin " << (int)smallest << " of " << areas[smallest] << " pixels" << std::endl;
+
+  // add a marker pixel in that basin
+  IType::SizeType editSize;
+  editSize.Fill( 1 );
+  IType::RegionType edit( editIndex, editSize );
+  markers->SetPixel( editIndex, newLabel );
+  if( !CheckEdit( filter.GetPointer(), markers.GetPointer(), edit, "add", true ) )
+    {
+    return EXIT_FAILURE;
+    }
+
+  // remove it
+  markers->SetPixel( editIndex, filter->GetBackgroundValue() );
+  if( !CheckEdit( filter.GetPointer(), markers.GetPointer(), edit, "remove", true ) )
+    {
+    return EXIT_FAILURE;
+    }
+
+  // remove a marker of the input marker image, without giving the edited
+  // region, so the markers are compared on the whole image
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    if( it.Get() == removedLabel )
+      {
+      it.Set( filter->GetBackgroundValue() );
+      }
+    }
+  if( !CheckEdit( filter.GetPointer(), markers.GetPointer(), IType::RegionType(), "remove label", false ) )
+    {
+    return EXIT_FAILURE;
+    }
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[4] );
+  writer->Update();
+
+  return 0;
+}
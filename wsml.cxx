@@ -0,0 +1,112 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkMorphologicalWatershedImageFilter.h"
+#include "itkLabelImageToLabelMapFilter.h"
+#include "itkSimpleFilterWatcher.h"
+
+// produce the label map directly with the watershed filters, and check
+// that it is the same than the one built by LabelImageToLabelMapFilter from
+// the output, for all the kinds of flooding.
+
+typedef unsigned char PType;
+const int dim = 2;
+typedef itk::Image< PType, dim > IType;
+
+template< class TFilter >
+bool CheckLabelMap( TFilter * filter, const char * name )
+{
+  filter->SetComputeLabelMap( true );
+  filter->Update();
+
+  typedef typename TFilter::LabelMapType LabelMapType;
+  typedef itk::LabelImageToLabelMapFilter< IType, LabelMapType > I2LType;
+  typename I2LType::Pointer i2l = I2LType::New();
+  i2l->SetInput( filter->GetOutput() );
+  i2l->SetBackgroundValue( 0 );
+  i2l->SetNumberOfThreads( 1 );
+  i2l->Update();
+
+  typedef typename LabelMapType::LabelObjectContainerType ContainerType;
+  typedef typename LabelMapType::LabelObjectType::LineContainerType LineContainerType;
+  const ContainerType & objects = filter->GetLabelMap()->GetLabelObjectContainer();
+  const ContainerType & expected = i2l->GetOutput()->GetLabelObjectContainer();
+  bool same = objects.size() == expected.size()
+    && filter->GetLabelMap()->GetLargestPossibleRegion() == filter->GetOutput()->GetLargestPossibleRegion();
+  for( typename ContainerType::const_iterator it=objects.begin(), eIt=expected.begin(); same && it!=objects.end(); it++, eIt++ )
+    {
+    const LineContainerType & lines = it->second->GetLineContainer();
+    const LineContainerType & eLines = eIt->second->GetLineContainer();
+    same = it->first == eIt->first && lines.size() == eLines.size();
+    for( unsigned long i=0; same && i<lines.size(); i++ )
+      {
+      same = lines[i].GetIndex() == eLines[i].GetIndex() && lines[i].GetLength() == eLines[i].GetLength();
+      }
+    }
+  if( !same )
+    {
+    std::cerr << "The label map is not the one of the output with " << name << std::endl;
+    }
+  return same;
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 6 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected input markers output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[3] );
+
+  ReaderType::Pointer reader2 = ReaderType::New();
+  reader2->SetFileName( argv[4] );
+
+  bool ok = true;
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMarkerImage( reader2->GetOutput() );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+  ok = CheckLabelMap( filter.GetPointer(), "the padding" ) && ok;
+
+  filter->SetPadImageBoundary( false );
+  ok = CheckLabelMap( filter.GetPointer(), "no padding" ) && ok;
+
+  filter->SetUseImageSpacing( true );
+  ok = CheckLabelMap( filter.GetPointer(), "the image spacing" ) && ok;
+
+  filter->SetUseImageSpacing( false );
+  filter->SetCompactness( 1 );
+  ok = CheckLabelMap( filter.GetPointer(), "the compactness" ) && ok;
+
+  typedef itk::MorphologicalWatershedImageFilter< IType, IType > WatershedType;
+  WatershedType::Pointer wshed = WatershedType::New();
+  wshed->SetInput( reader->GetOutput() );
+  wshed->SetMarkWatershedLine( atoi( argv[1] ) );
+  wshed->SetFullyConnected( atoi( argv[2] ) );
+  wshed->SetLevel( 10 );
+  ok = CheckLabelMap( wshed.GetPointer(), "the minima" ) && ok;
+
+  wshed->SetComputeMergeTree( true );
+  ok = CheckLabelMap( wshed.GetPointer(), "the merge tree" ) && ok;
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[5] );
+  writer->Update();
+
+  if( !ok )
+    {
+    return EXIT_FAILURE;
+    }
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkLabelImageToLabelMapFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkSimpleFilterWatcher.h"
+
+// watershed from markers given as a label map. The output must be the same
+// than with the marker image, for all the kinds of flooding.
+
+typedef unsigned char PType;
+const int dim = 2;
+typedef itk::Image< PType, dim > IType;
+typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+
+bool CheckOutput( FilterType * filter, FilterType * labelMapFilter, const char * name )
+{
+  filter->Update();
+  labelMapFilter->Update();
+
+  itk::ImageRegionConstIterator< IType > it( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+  itk::ImageRegionConstIterator< IType > lIt( labelMapFilter->GetOutput(), labelMapFilter->GetOutput()->GetBufferedRegion() );
+  for( ; !it.IsAtEnd(); ++it, ++lIt )
+    {
+    if( it.Get() != lIt.Get() )
+      {
+      std::cerr << "The outputs are different with " << name << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 6 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected input markers output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[3] );
+
+  ReaderType::Pointer reader2 = ReaderType::New();
+  reader2->SetFileName( argv[4] );
+
+  typedef itk::LabelImageToLabelMapFilter< IType, FilterType::LabelMapType > I2LType;
+  I2LType::Pointer i2l = I2LType::New();
+  i2l->SetInput( reader2->GetOutput() );
+  i2l->SetBackgroundValue( 0 );
+
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMarkerImage( reader2->GetOutput() );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+
+  FilterType::Pointer labelMapFilter = FilterType::New();
+  labelMapFilter->SetInput( reader->GetOutput() );
+  labelMapFilter->SetMarkerLabelMap( i2l->GetOutput() );
+  labelMapFilter->SetMarkWatershedLine( atoi( argv[1] ) );
+  labelMapFilter->SetFullyConnected( atoi( argv[2] ) );
+  itk::SimpleFilterWatcher watcher(labelMapFilter, "filter");
+
+  bool ok = CheckOutput( filter, labelMapFilter, "the padding" );
+
+  filter->SetPadImageBoundary( false );
+  labelMapFilter->SetPadImageBoundary( false );
+  ok = CheckOutput( filter, labelMapFilter, "no padding" ) && ok;
+
+  filter->SetUseImageSpacing( true );
+  labelMapFilter->SetUseImageSpacing( true );
+  ok = CheckOutput( filter, labelMapFilter, "the image spacing" ) && ok;
+
+  filter->SetUseImageSpacing( false );
+  labelMapFilter->SetUseImageSpacing( false );
+  filter->SetCompactness( 1 );
+  labelMapFilter->SetCompactness( 1 );
+  ok = CheckOutput( filter, labelMapFilter, "the compactness" ) && ok;
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( labelMapFilter->GetOutput() );
+  writer->SetFileName( argv[5] );
+  writer->Update();
+
+  if( !ok )
+    {
+    return EXIT_FAILURE;
+    }
+  return 0;
+}
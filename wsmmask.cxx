@@ -0,0 +1,171 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkLabelImageToLabelMapFilter.h"
+#include "itkRegionOfInterestImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkSimpleFilterWatcher.h"
+
+// watershed from markers restricted to a mask. The pixels outside the mask
+// must be background, the mask can be given as an image or as a label map,
+// and with a rectangular mask, the output must be the one of the watershed
+// of the same rectangle extracted from the input and the markers.
+
+typedef unsigned char PType;
+const int dim = 2;
+typedef itk::Image< PType, dim > IType;
+typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+
+bool CheckOutput( FilterType * filter, FilterType * labelMapFilter, const IType * mask, const char * name )
+{
+  filter->Update();
+  labelMapFilter->Update();
+
+  itk::ImageRegionConstIterator< IType > it( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+  itk::ImageRegionConstIterator< IType > lIt( labelMapFilter->GetOutput(), labelMapFilter->GetOutput()->GetBufferedRegion() );
+  itk::ImageRegionConstIterator< IType > mIt( mask, mask->GetBufferedRegion() );
+  unsigned long nbOfMaskPixels = 0;
+  for( ; !it.IsAtEnd(); ++it, ++lIt, ++mIt )
+    {
+    if( it.Get() != lIt.Get() )
+      {
+      std::cerr << "The outputs are different with " << name << std::endl;
+      return false;
+      }
+    if( mIt.Get() == 0 && it.Get() != filter->GetBackgroundValue() )
+      {
+      std::cerr << "A pixel outside the mask is labeled with " << name << std::endl;
+      return false;
+      }
+    if( mIt.Get() != 0 )
+      {
+      nbOfMaskPixels++;
+      }
+    }
+  if( filter->GetNumberOfFloodedPixels() != nbOfMaskPixels )
+    {
+    std::cerr << "Wrong number of flooded pixels with " << name << std::endl;
+    return false;
+    }
+  return true;
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 7 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected input markers threshold output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[3] );
+
+  ReaderType::Pointer reader2 = ReaderType::New();
+  reader2->SetFileName( argv[4] );
+
+  // the mask is the part of the input above the threshold
+  typedef itk::BinaryThresholdImageFilter< IType, IType > ThresholdType;
+  ThresholdType::Pointer threshold = ThresholdType::New();
+  threshold->SetInput( reader->GetOutput() );
+  threshold->SetLowerThreshold( atoi( argv[5] ) );
+  threshold->SetInsideValue( 1 );
+  threshold->SetOutsideValue( 0 );
+  threshold->Update();
+
+  typedef itk::LabelImageToLabelMapFilter< IType, FilterType::LabelMapType > I2LType;
+  I2LType::Pointer i2l = I2LType::New();
+  i2l->SetInput( threshold->GetOutput() );
+  i2l->SetBackgroundValue( 0 );
+
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMarkerImage( reader2->GetOutput() );
+  filter->SetMaskImage( threshold->GetOutput() );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+
+  FilterType::Pointer labelMapFilter = FilterType::New();
+  labelMapFilter->SetInput( reader->GetOutput() );
+  labelMapFilter->SetMarkerImage( reader2->GetOutput() );
+  labelMapFilter->SetMaskLabelMap( i2l->GetOutput() );
+  labelMapFilter->SetMarkWatershedLine( atoi( argv[1] ) );
+  labelMapFilter->SetFullyConnected( atoi( argv[2] ) );
+  itk::SimpleFilterWatcher watcher(labelMapFilter, "filter");
+
+  bool ok = CheckOutput( filter, labelMapFilter, threshold->GetOutput(), "the padding" );
+
+  filter->SetPadImageBoundary( false );
+  labelMapFilter->SetPadImageBoundary( false );
+  ok = CheckOutput( filter, labelMapFilter, threshold->GetOutput(), "no padding" ) && ok;
+
+  filter->SetCompactness( 1 );
+  labelMapFilter->SetCompactness( 1 );
+  ok = CheckOutput( filter, labelMapFilter, threshold->GetOutput(), "the compactness" ) && ok;
+  filter->SetCompactness( 0 );
+  labelMapFilter->SetCompactness( 0 );
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( labelMapFilter->GetOutput() );
+  writer->SetFileName( argv[6] );
+  writer->Update();
+
+  // a rectangular mask in the middle of the image
+  IType::RegionType region = reader->GetOutput()->GetLargestPossibleRegion();
+  IType::RegionType rectangle = region;
+  for( int d=0; d<dim; d++ )
+    {
+    rectangle.SetIndex( d, region.GetIndex()[d] + region.GetSize()[d] / 4 );
+    rectangle.SetSize( d, region.GetSize()[d] / 2 );
+    }
+  IType::Pointer rectangleMask = IType::New();
+  rectangleMask->CopyInformation( reader->GetOutput() );
+  rectangleMask->SetRegions( region );
+  rectangleMask->Allocate();
+  rectangleMask->FillBuffer( 0 );
+  itk::ImageRegionIterator< IType > rIt( rectangleMask, rectangle );
+  for( ; !rIt.IsAtEnd(); ++rIt )
+    {
+    rIt.Set( 1 );
+    }
+  filter->SetMaskImage( rectangleMask );
+  filter->Update();
+
+  typedef itk::RegionOfInterestImageFilter< IType, IType > ROIType;
+  ROIType::Pointer roi = ROIType::New();
+  roi->SetInput( reader->GetOutput() );
+  roi->SetRegionOfInterest( rectangle );
+  ROIType::Pointer roi2 = ROIType::New();
+  roi2->SetInput( reader2->GetOutput() );
+  roi2->SetRegionOfInterest( rectangle );
+
+  FilterType::Pointer cropFilter = FilterType::New();
+  cropFilter->SetInput( roi->GetOutput() );
+  cropFilter->SetMarkerImage( roi2->GetOutput() );
+  cropFilter->SetMarkWatershedLine( atoi( argv[1] ) );
+  cropFilter->SetFullyConnected( atoi( argv[2] ) );
+  cropFilter->Update();
+
+  itk::ImageRegionConstIterator< IType > it( filter->GetOutput(), rectangle );
+  itk::ImageRegionConstIterator< IType > cIt( cropFilter->GetOutput(), cropFilter->GetOutput()->GetBufferedRegion() );
+  for( ; !it.IsAtEnd(); ++it, ++cIt )
+    {
+    if( it.Get() != cIt.Get() )
+      {
+      std::cerr << "The output with a rectangular mask is not the one of the extracted rectangle" << std::endl;
+      ok = false;
+      break;
+      }
+    }
+
+  if( !ok )
+    {
+    return EXIT_FAILURE;
+    }
+  return 0;
+}
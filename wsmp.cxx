@@ -0,0 +1,243 @@
+#include "itkImageFileWriter.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkSimpleFilterWatcher.h"
+#include "vcl_cmath.h"
+#include <algorithm>
+
+// watershed from markers on plateaus, with and without the geodesic
+// plateaus. The pixels must be in the basin of their nearest marker, except
+// a few pixels near the lines where the digital paths are not exact. The
+// first plateau is the whole image, and the geodesic distance is the
+// euclidean distance. The second one is cut by a wall with a gap, so the
+// shortest paths to the markers on the other side of the wall go around
+// the ends of the gap. In both cases, the usual flooding, which follows the
+// chessboard or the city block distance, must misplace more pixels.
+
+// the wall of the second plateau: the column WallX, except the rows from
+// GapBegin to GapEnd
+const long WallX = 100;
+const long GapBegin = 60;
+const long GapEnd = 69;
+
+template < class TIndex >
+double euclideanDistance( const TIndex & a, const TIndex & b )
+{
+  double distance = 0;
+  for( unsigned int d=0; d<TIndex::GetIndexDimension(); d++ )
+    {
+    const double v = a[d] - b[d];
+    distance += v * v;
+    }
+  return vcl_sqrt( distance );
+}
+
+template < class TIndex >
+double wallDistance( const TIndex & a, const TIndex & b )
+{
+  if( ( a[0] < WallX ) == ( b[0] < WallX ) )
+    {
+    return euclideanDistance( a, b );
+    }
+  // the row where the segment crosses the wall
+  const double y = a[1] + double( WallX - a[0] ) * ( b[1] - a[1] ) / ( b[0] - a[0] );
+  if( y >= GapBegin && y <= GapEnd )
+    {
+    return euclideanDistance( a, b );
+    }
+  // the shortest path goes around the nearest end of the gap
+  TIndex corner;
+  corner[0] = WallX;
+  corner[1] = y < GapBegin ? GapBegin : GapEnd;
+  return euclideanDistance( a, corner ) + euclideanDistance( corner, b );
+}
+
+// count the pixels whose marker is farther than the nearest marker by more
+// than margin. The pixels higher than the plateau are not counted.
+template < class TFilter, class TImage >
+unsigned long countMisplaced( const TFilter * filter, const TImage * input, const TImage * markers,
+                              double (*distanceFunction)( const typename TImage::IndexType &, const typename TImage::IndexType & ),
+                              double margin )
+{
+  typedef typename TImage::PixelType PType;
+  typedef typename TImage::IndexType IndexType;
+  typedef itk::ImageRegionConstIteratorWithIndex< TImage > IteratorType;
+
+  // the markers
+  std::vector< IndexType > indexes;
+  std::vector< PType > labels;
+  IteratorType mIt( markers, markers->GetBufferedRegion() );
+  for( mIt.GoToBegin(); !mIt.IsAtEnd(); ++mIt )
+    {
+    if( mIt.Get() != filter->GetBackgroundValue() )
+      {
+      indexes.push_back( mIt.GetIndex() );
+      labels.push_back( mIt.Get() );
+      }
+    }
+
+  unsigned long misplaced = 0;
+  IteratorType it( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    if( it.Get() == filter->GetBackgroundValue() || input->GetPixel( it.GetIndex() ) != 100 )
+      { continue; }
+    // the distance to the nearest marker, and to the marker of the pixel
+    double nearest = itk::NumericTraits< double >::max();
+    double own = itk::NumericTraits< double >::max();
+    for( unsigned int m=0; m<indexes.size(); m++ )
+      {
+      const double distance = distanceFunction( it.GetIndex(), indexes[m] );
+      nearest = std::min( nearest, distance );
+      if( labels[m] == it.Get() )
+        { own = std::min( own, distance ); }
+      }
+    if( own > nearest + margin )
+      { misplaced++; }
+    }
+  return misplaced;
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 5 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected output wallOutput" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int dim = 2;
+
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+
+  // a flat image, and a few markers
+  IType::SizeType size;
+  size[0] = 200;
+  size[1] = 150;
+  IType::RegionType region;
+  region.SetSize( size );
+
+  IType::Pointer input = IType::New();
+  input->SetRegions( region );
+  input->Allocate();
+  input->FillBuffer( 100 );
+
+  IType::Pointer markers = IType::New();
+  markers->SetRegions( region );
+  markers->Allocate();
+  markers->FillBuffer( 0 );
+  const long positions[][2] = { {20, 30}, {170, 20}, {100, 75}, {40, 130}, {180, 140}, {110, 10} };
+  for( unsigned int m=0; m<6; m++ )
+    {
+    IType::IndexType idx;
+    idx[0] = positions[m][0];
+    idx[1] = positions[m][1];
+    markers->SetPixel( idx, m + 1 );
+    }
+
+  // the same plateau cut by the wall, with other markers on both sides
+  IType::Pointer wall = IType::New();
+  wall->SetRegions( region );
+  wall->Allocate();
+  wall->FillBuffer( 100 );
+  for( long y=0; y<(long)size[1]; y++ )
+    {
+    if( y < GapBegin || y > GapEnd )
+      {
+      IType::IndexType idx;
+      idx[0] = WallX;
+      idx[1] = y;
+      wall->SetPixel( idx, 200 );
+      }
+    }
+
+  IType::Pointer wallMarkers = IType::New();
+  wallMarkers->SetRegions( region );
+  wallMarkers->Allocate();
+  wallMarkers->FillBuffer( 0 );
+  const long wallPositions[][2] = { {30, 20}, {170, 130}, {60, 140}, {150, 30} };
+  for( unsigned int m=0; m<4; m++ )
+    {
+    IType::IndexType idx;
+    idx[0] = wallPositions[m][0];
+    idx[1] = wallPositions[m][1];
+    wallMarkers->SetPixel( idx, m + 1 );
+    }
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+  FilterType::Pointer linear = FilterType::New();
+  linear->SetInput( input );
+  linear->SetMarkerImage( markers );
+  linear->SetMarkWatershedLine( atoi( argv[1] ) );
+  linear->SetFullyConnected( atoi( argv[2] ) );
+  linear->Update();
+
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( input );
+  filter->SetMarkerImage( markers );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+  filter->SetGeodesicPlateaus( true );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[3] );
+  writer->Update();
+
+  FilterType::Pointer wallLinear = FilterType::New();
+  wallLinear->SetInput( wall );
+  wallLinear->SetMarkerImage( wallMarkers );
+  wallLinear->SetMarkWatershedLine( atoi( argv[1] ) );
+  wallLinear->SetFullyConnected( atoi( argv[2] ) );
+  wallLinear->Update();
+
+  FilterType::Pointer wallFilter = FilterType::New();
+  wallFilter->SetInput( wall );
+  wallFilter->SetMarkerImage( wallMarkers );
+  wallFilter->SetMarkWatershedLine( atoi( argv[1] ) );
+  wallFilter->SetFullyConnected( atoi( argv[2] ) );
+  wallFilter->SetGeodesicPlateaus( true );
+
+  WriterType::Pointer wallWriter = WriterType::New();
+  wallWriter->SetInput( wallFilter->GetOutput() );
+  wallWriter->SetFileName( argv[4] );
+  wallWriter->Update();
+
+  int status = 0;
+
+  const unsigned long linearMisplaced =
+    countMisplaced( linear.GetPointer(), input.GetPointer(), markers.GetPointer(), &euclideanDistance< IType::IndexType >, 0 );
+  const unsigned long misplaced =
+    countMisplaced( filter.GetPointer(), input.GetPointer(), markers.GetPointer(), &euclideanDistance< IType::IndexType >, 0 );
+  std::cout << "flat plateau: misplaced pixels: " << linearMisplaced << " without and "
+            << misplaced << " with the geodesic plateaus" << std::endl;
+  if( misplaced >= linearMisplaced || misplaced * 100 > region.GetNumberOfPixels() )
+    {
+    std::cerr << "Too many pixels are not in the basin of their nearest marker on the flat plateau" << std::endl;
+    status = EXIT_FAILURE;
+    }
+
+  // the distance between the digital paths and the straight lines around
+  // the wall is below one pixel and a half
+  const unsigned long wallLinearMisplaced =
+    countMisplaced( wallLinear.GetPointer(), wall.GetPointer(), wallMarkers.GetPointer(), &wallDistance< IType::IndexType >, 0 );
+  const unsigned long wallMisplaced =
+    countMisplaced( wallFilter.GetPointer(), wall.GetPointer(), wallMarkers.GetPointer(), &wallDistance< IType::IndexType >, 0 );
+  const unsigned long wallFarMisplaced =
+    countMisplaced( wallFilter.GetPointer(), wall.GetPointer(), wallMarkers.GetPointer(), &wallDistance< IType::IndexType >, 1.5 );
+  std::cout << "plateau with a wall: misplaced pixels: " << wallLinearMisplaced << " without and "
+            << wallMisplaced << " with the geodesic plateaus, "
+            << wallFarMisplaced << " farther than 1.5 from the line" << std::endl;
+  if( wallMisplaced >= wallLinearMisplaced || wallFarMisplaced != 0 )
+    {
+    std::cerr << "The flooding doesn't follow the geodesic distance around the wall" << std::endl;
+    status = EXIT_FAILURE;
+    }
+
+  return status;
+}
@@ -0,0 +1,101 @@
+#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkSimpleFilterWatcher.h"
+#include "vcl_cmath.h"
+
+// flood a flat image with a non unit spacing from two markers: the first
+// column, labeled 1, and the first row, labeled 2. The pixels must go to
+// the marker at the smallest physical distance, so the watershed line is
+// at x * spacingX == y * spacingY, and not on the diagonal of the image.
+// The pixels near that line are not checked.
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 6 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected spacingX spacingY output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int dim = 2;
+
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+
+  IType::SizeType size;
+  size.Fill( 60 );
+  IType::SpacingType spacing;
+  spacing[0] = atof( argv[3] );
+  spacing[1] = atof( argv[4] );
+
+  IType::Pointer input = IType::New();
+  input->SetRegions( size );
+  input->SetSpacing( spacing );
+  input->Allocate();
+  input->FillBuffer( 0 );
+
+  IType::Pointer markers = IType::New();
+  markers->SetRegions( size );
+  markers->SetSpacing( spacing );
+  markers->Allocate();
+  markers->FillBuffer( 0 );
+  IType::IndexType idx;
+  for( unsigned long i=0; i<size[0]; i++ )
+    {
+    idx[0] = 0;
+    idx[1] = i;
+    markers->SetPixel( idx, 1 );
+    idx[0] = i + 1;
+    idx[1] = 0;
+    if( idx[0] < (long)size[0] )
+      {
+      markers->SetPixel( idx, 2 );
+      }
+    }
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( input );
+  filter->SetMarkerImage( markers );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+  filter->SetUseImageSpacing( true );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[5] );
+  writer->Update();
+
+  // the distance between two neighbors is at most the diagonal of a pixel
+  const double margin = 2 * vcl_sqrt( spacing[0] * spacing[0] + spacing[1] * spacing[1] );
+  unsigned long errors = 0;
+  typedef itk::ImageRegionConstIteratorWithIndex< IType > IteratorType;
+  IteratorType it( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const double dx = it.GetIndex()[0] * spacing[0];
+    const double dy = it.GetIndex()[1] * spacing[1];
+    if( vcl_abs( dx - dy ) <= margin )
+      {
+      continue;
+      }
+    const PType expected = dx < dy ? 1 : 2;
+    if( it.Get() != expected )
+      {
+      errors++;
+      }
+    }
+
+  std::cout << errors << " pixels in the wrong basin" << std::endl;
+  if( errors != 0 )
+    {
+    std::cerr << "The flooding doesn't use the physical distance on the plateau" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkSimpleFilterWatcher.h"
+#include "vcl_cmath.h"
+
+// flood a 3D image with a spacing of 0.2x0.2x1.0 and the same image
+// sampled with an isotropic spacing of 0.2, used as reference. The image is
+// made of concentric terraces along z, cut by a wall with a gap, so both the
+// plateaus and the levels are the same at both resolutions. The markers are
+// on the slices shared by both images. The voxels of the anisotropic image
+// must be in the same basin as the voxel at the same physical position in
+// the reference, except a few near the lines, and the flooding must be
+// closer to the reference with the spacing than without.
+
+typedef unsigned char PType;
+typedef itk::Image< PType, 3 > IType;
+
+const long SizeXY = 60;
+const long SizeZ = 12;
+const long Factor = 5;
+const long markerPositions[][3] = { {10, 10, 5}, {50, 12, 25}, {30, 50, 45}, {45, 45, 10}, {5, 40, 30} };
+
+// the level at a physical position
+PType level( double x, double y )
+{
+  PType l = (PType)( vcl_sqrt( ( x - 6 ) * ( x - 6 ) + ( y - 5 ) * ( y - 5 ) ) / 1.5 );
+  if( x >= 6 && x < 6.2 && ( y < 4 || y > 7 ) )
+    {
+    l += 10;
+    }
+  return l;
+}
+
+// build the input and the markers with sizeZ slices of thickness spacingZ
+void createImages( long sizeZ, double spacingZ, IType::Pointer & input, IType::Pointer & markers )
+{
+  IType::SizeType size;
+  size[0] = SizeXY;
+  size[1] = SizeXY;
+  size[2] = sizeZ;
+  IType::SpacingType spacing;
+  spacing[0] = 0.2;
+  spacing[1] = 0.2;
+  spacing[2] = spacingZ;
+
+  input = IType::New();
+  input->SetRegions( size );
+  input->SetSpacing( spacing );
+  input->Allocate();
+  typedef itk::ImageRegionIteratorWithIndex< IType > IteratorType;
+  IteratorType it( input, input->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    it.Set( level( it.GetIndex()[0] * spacing[0], it.GetIndex()[1] * spacing[1] ) );
+    }
+
+  markers = IType::New();
+  markers->SetRegions( size );
+  markers->SetSpacing( spacing );
+  markers->Allocate();
+  markers->FillBuffer( 0 );
+  const long zFactor = sizeZ == SizeZ ? Factor : 1;
+  for( unsigned int m=0; m<5; m++ )
+    {
+    IType::IndexType idx;
+    idx[0] = markerPositions[m][0];
+    idx[1] = markerPositions[m][1];
+    idx[2] = markerPositions[m][2] / zFactor;
+    markers->SetPixel( idx, m + 1 );
+    }
+}
+
+// the number of voxels labeled in both images, and in different basins
+unsigned long countDifferences( const IType * output, const IType * reference, unsigned long & count )
+{
+  unsigned long differences = 0;
+  count = 0;
+  typedef itk::ImageRegionConstIteratorWithIndex< IType > IteratorType;
+  IteratorType it( output, output->GetBufferedRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    IType::IndexType idx = it.GetIndex();
+    idx[2] *= Factor;
+    const PType r = reference->GetPixel( idx );
+    if( it.Get() == 0 || r == 0 )
+      { continue; }
+    count++;
+    if( it.Get() != r )
+      { differences++; }
+    }
+  return differences;
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 4 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  IType::Pointer isoInput;
+  IType::Pointer isoMarkers;
+  createImages( SizeZ * Factor, 0.2, isoInput, isoMarkers );
+  IType::Pointer input;
+  IType::Pointer markers;
+  createImages( SizeZ, 1.0, input, markers );
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+  FilterType::Pointer reference = FilterType::New();
+  reference->SetInput( isoInput );
+  reference->SetMarkerImage( isoMarkers );
+  reference->SetMarkWatershedLine( atoi( argv[1] ) );
+  reference->SetFullyConnected( atoi( argv[2] ) );
+  reference->SetUseImageSpacing( true );
+  reference->Update();
+
+  FilterType::Pointer noSpacing = FilterType::New();
+  noSpacing->SetInput( input );
+  noSpacing->SetMarkerImage( markers );
+  noSpacing->SetMarkWatershedLine( atoi( argv[1] ) );
+  noSpacing->SetFullyConnected( atoi( argv[2] ) );
+  noSpacing->Update();
+
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( input );
+  filter->SetMarkerImage( markers );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+  filter->SetUseImageSpacing( true );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[3] );
+  writer->Update();
+
+  unsigned long count;
+  unsigned long noSpacingCount;
+  const unsigned long differences = countDifferences( filter->GetOutput(), reference->GetOutput(), count );
+  const unsigned long noSpacingDifferences = countDifferences( noSpacing->GetOutput(), reference->GetOutput(), noSpacingCount );
+  std::cout << differences << " / " << count << " voxels in another basin than the reference with the spacing, "
+            << noSpacingDifferences << " / " << noSpacingCount << " without" << std::endl;
+
+  if( differences * 20 > count || differences >= noSpacingDifferences )
+    {
+    std::cerr << "The flooding with the spacing doesn't match the isotropic reference" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionConstIterator.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkSimpleFilterWatcher.h"
+
+// compare the output of the watershed from markers computed with a single
+// thread and with several threads. The threads are used even for the small
+// batches of pixels and with only a few threads, to test the parallel
+// flooding on small images.
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 7 )
+    {
+    std::cerr << "usage: " << argv[0] << " markWatershedLine fullyConnected nbOfThreads input markers output" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int dim = 2;
+  
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[4] );
+
+  ReaderType::Pointer reader2 = ReaderType::New();
+  reader2->SetFileName( argv[5] );
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, IType > FilterType;
+  FilterType::Pointer serial = FilterType::New();
+  serial->SetInput( reader->GetOutput() );
+  serial->SetMarkerImage( reader2->GetOutput() );
+  serial->SetMarkWatershedLine( atoi( argv[1] ) );
+  serial->SetFullyConnected( atoi( argv[2] ) );
+  serial->SetNumberOfThreads( 1 );
+  serial->Update();
+
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( reader->GetOutput() );
+  filter->SetMarkerImage( reader2->GetOutput() );
+  filter->SetMarkWatershedLine( atoi( argv[1] ) );
+  filter->SetFullyConnected( atoi( argv[2] ) );
+  filter->SetNumberOfThreads( atoi( argv[3] ) );
+  filter->SetMinimumParallelBatchSize( 1 );
+  filter->SetMinimumParallelNumberOfThreads( 1 );
+
+  itk::SimpleFilterWatcher watcher(filter, "filter");
+
+  typedef itk::ImageFileWriter< IType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( filter->GetOutput() );
+  writer->SetFileName( argv[6] );
+  writer->Update();
+
+  typedef itk::ImageRegionConstIterator< IType > IteratorType;
+  IteratorType sIt( serial->GetOutput(), serial->GetOutput()->GetBufferedRegion() );
+  IteratorType it( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+  unsigned long nbOfDifferences = 0;
+  for( sIt.GoToBegin(), it.GoToBegin(); !it.IsAtEnd(); ++sIt, ++it )
+    {
+    if( sIt.Get() != it.Get() )
+      {
+      nbOfDifferences++;
+      }
+    }
+
+  if( nbOfDifferences != 0 )
+    {
+    std::cerr << nbOfDifferences << " pixels are different with " << filter->GetNumberOfThreads() << " threads" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include "itkImageFileReader.h"
+
+#include "itkMorphologicalWatershedFromMarkersImageFilter.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionConstIterator.h"
+
+#include "itkTimeProbe.h"
+#include "itkMultiThreader.h"
+#include <iomanip>
+#include <cmath>
+
+// the time of the watershed from markers with 1 to 32 threads, with and
+// without the watershed line. The threads are used for all the numbers of
+// threads, and for the batches of the default size. The output must be the
+// same with any number of threads.
+template < class TImage, class TLabelImage >
+void perf( TImage * image, TLabelImage * markers )
+{
+  typedef TImage IType;
+  typedef TLabelImage LType;
+  const unsigned int dim = IType::ImageDimension;
+
+  typedef itk::MorphologicalWatershedFromMarkersImageFilter< IType, LType > FilterType;
+  typename FilterType::Pointer serial = FilterType::New();
+  serial->SetInput( image );
+  serial->SetMarkerImage( markers );
+  serial->SetNumberOfThreads( 1 );
+
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( image );
+  filter->SetMarkerImage( markers );
+  filter->SetMinimumParallelNumberOfThreads( 1 );
+
+  for(int M=0; M<=1; M++ )
+    {
+    serial->SetMarkWatershedLine( M );
+    serial->Update();
+    filter->SetMarkWatershedLine( M );
+
+    double reference = 0;
+    for( int t=1; t<=32; t*=2 )
+      {
+      filter->SetNumberOfThreads( t );
+      itk::TimeProbe time;
+      for( int i=0; i<10; i++ )
+        {
+        time.Start();
+        filter->Update();
+        time.Stop();
+        filter->Modified();
+        }
+      if( t == 1 )
+        {
+        reference = time.GetMeanTime();
+        }
+
+      // check the output
+      typedef itk::ImageRegionConstIterator< LType > IteratorType;
+      IteratorType it( filter->GetOutput(), filter->GetOutput()->GetBufferedRegion() );
+      IteratorType sIt( serial->GetOutput(), serial->GetOutput()->GetBufferedRegion() );
+      bool same = true;
+      for( it.GoToBegin(), sIt.GoToBegin(); !it.IsAtEnd(); ++it, ++sIt )
+        {
+        same = same && it.Get() == sIt.Get();
+        }
+
+      std::cout << std::setprecision(3)
+                << dim << "\t" 
+                << image->GetLargestPossibleRegion().GetSize() << "\t" 
+                << M << "\t" 
+                << t << "\t" 
+                << time.GetMeanTime() << "\t" 
+                << reference / time.GetMeanTime() << "\t" 
+                << same << "\t" 
+                << std::endl;
+      }
+    }
+}
+
+void perfFile( const char * fileName, const char * markerFileName )
+{
+  typedef itk::Image< unsigned char, 2 > IType;
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( fileName );
+  reader->Update();
+  ReaderType::Pointer reader2 = ReaderType::New();
+  reader2->SetFileName( markerFileName );
+  reader2->Update();
+  perf< IType, IType >( reader->GetOutput(), reader2->GetOutput() );
+}
+
+// a synthetic volume with some blobs and some noise, and some random
+// markers. The quantized volume has larger plateaus, so larger batches.
+void perfSynthetic( unsigned long x, unsigned long y, unsigned long z, bool quantized )
+{
+  typedef itk::Image< unsigned char, 3 > IType;
+  typedef itk::Image< unsigned short, 3 > LType;
+  IType::SizeType size;
+  size[0] = x;
+  size[1] = y;
+  size[2] = z;
+  IType::RegionType region;
+  region.SetSize( size );
+  IType::Pointer image = IType::New();
+  image->SetRegions( region );
+  image->Allocate();
+  LType::Pointer markers = LType::New();
+  markers->SetRegions( region );
+  markers->Allocate();
+  markers->FillBuffer( 0 );
+
+  itk::ImageRegionIterator< IType > it( image, region );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const IType::IndexType & idx = it.GetIndex();
+    const double v = 120 + 80 * std::sin( idx[0] / 7.0 ) * std::cos( idx[1] / 5.0 ) * std::sin( idx[2] / 3.0 );
+    int value = static_cast< int >( v ) + std::rand() % 30;
+    if( quantized )
+      {
+      value = value / 32 * 32;
+      }
+    it.Set( static_cast< unsigned char >( std::min( value, 255 ) ) );
+    }
+
+  for( unsigned short m=1; m<=2000; m++ )
+    {
+    LType::IndexType idx;
+    idx[0] = std::rand() % x;
+    idx[1] = std::rand() % y;
+    idx[2] = std::rand() % z;
+    markers->SetPixel( idx, m );
+    }
+
+  perf< IType, LType >( image, markers );
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 3 )
+    {
+    std::cerr << "usage: " << argv[0] << " input2D markers2D" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  itk::MultiThreader::SetGlobalMaximumNumberOfThreads(32);
+
+  std::cout << "#D" << "\t" 
+            << "size" << "\t" 
+            << "M" << "\t" 
+            << "threads" << "\t" 
+            << "time" << "\t" 
+            << "speedup" << "\t" 
+            << "same" << "\t" 
+            << std::endl;
+
+  perfFile( argv[1], argv[2] );
+
+  perfSynthetic( 128, 128, 128, false );
+  perfSynthetic( 128, 128, 128, true );
+  perfSynthetic( 256, 256, 256, false );
+  perfSynthetic( 256, 256, 256, true );
+
+  return 0;
+}
@@ -0,0 +1,132 @@
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkLabelOverlayImageFilter.h"
+
+#include "itkWatershedSuperpixelImageFilter.h"
+#include "itkLabelMapToLabelImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkSimpleFilterWatcher.h"
+
+// superpixels on a grid. The output must not depend on the number of
+// threads, and the tiles flooded with an overlap which covers the whole
+// image must give the same output as a single tile. With the default tile
+// size and overlap, less than 1% of the pixels may differ of a single tile.
+
+typedef unsigned char PType;
+typedef itk::Image< PType, 2 > IType;
+typedef unsigned short LType;
+typedef itk::Image< LType, 2 > LImageType;
+typedef itk::WatershedSuperpixelImageFilter< IType > FilterType;
+typedef itk::LabelMapToLabelImageFilter< FilterType::OutputImageType, LImageType > L2IType;
+
+LImageType::Pointer Superpixels( IType * input, char * argv[], int threads, unsigned long tileSize, unsigned long overlap )
+{
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( input );
+  FilterType::SizeType spacing;
+  spacing.Fill( atoi( argv[1] ) );
+  filter->SetGridSpacing( spacing );
+  filter->SetCompactness( atof( argv[2] ) );
+  filter->SetNumberOfThreads( threads );
+  filter->SetTileSize( tileSize );
+  filter->SetOverlap( overlap );
+
+  L2IType::Pointer l2i = L2IType::New();
+  l2i->SetInput( filter->GetOutput() );
+  l2i->Update();
+  std::cout << threads << " threads, tiles of " << tileSize << " slices with an overlap of " << overlap << ": "
+            << filter->GetOutput()->GetNumberOfLabelObjects() << " superpixels" << std::endl;
+  return l2i->GetOutput();
+}
+
+unsigned long Differences( const LImageType * a, const LImageType * b )
+{
+  unsigned long differences = 0;
+  itk::ImageRegionConstIterator< LImageType > aIt( a, a->GetBufferedRegion() );
+  itk::ImageRegionConstIterator< LImageType > bIt( b, b->GetBufferedRegion() );
+  for( ; !aIt.IsAtEnd(); ++aIt, ++bIt )
+    {
+    if( aIt.Get() != bIt.Get() )
+      {
+      differences++;
+      }
+    }
+  return differences;
+}
+
+bool Same( const LImageType * a, const LImageType * b )
+{
+  return Differences( a, b ) == 0;
+}
+
+int main(int arglen, char * argv[])
+{
+  if( arglen < 5 )
+    {
+    std::cerr << "usage: " << argv[0] << " gridSpacing compactness input output [rgb [alpha]]" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  typedef itk::ImageFileReader< IType > ReaderType;
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[3] );
+  reader->Update();
+  IType * input = reader->GetOutput();
+  const unsigned long size = input->GetLargestPossibleRegion().GetSize()[1];
+
+  LImageType::Pointer serial = Superpixels( input, argv, 1, 16, 16 );
+  LImageType::Pointer parallel = Superpixels( input, argv, 4, 16, 16 );
+  if( !Same( serial, parallel ) )
+    {
+    std::cerr << "The superpixels depend on the number of threads" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  LImageType::Pointer whole = Superpixels( input, argv, 1, size, 0 );
+  LImageType::Pointer tiles = Superpixels( input, argv, 4, 8, size );
+  if( !Same( whole, tiles ) )
+    {
+    std::cerr << "The tiles with a full overlap are different of a single tile" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  FilterType::Pointer defaults = FilterType::New();
+  LImageType::Pointer tiled = Superpixels( input, argv, 4, defaults->GetTileSize(), defaults->GetOverlap() );
+  const unsigned long differences = Differences( whole, tiled );
+  const unsigned long nbOfPixels = whole->GetBufferedRegion().GetNumberOfPixels();
+  std::cout << differences << " pixels out of " << nbOfPixels << " differ of a single tile" << std::endl;
+  if( differences * 100 > nbOfPixels )
+    {
+    std::cerr << "The tiles with the default overlap are too different of a single tile" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  typedef itk::ImageFileWriter< LImageType > WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput( parallel );
+  writer->SetFileName( argv[4] );
+  writer->Update();
+
+  if( arglen > 5 )
+    {
+    typedef itk::RGBPixel<unsigned char>   RGBPixelType;
+    typedef itk::Image<RGBPixelType, 2>    RGBImageType;
+
+    typedef itk::LabelOverlayImageFilter<IType, LImageType, RGBImageType> OverlayType;
+    OverlayType::Pointer overlay = OverlayType::New();
+    overlay->SetInput( input );
+    overlay->SetLabelImage( parallel );
+    if( arglen > 6 )
+      {
+      overlay->SetOpacity( atof( argv[6] ) );
+      }
+
+    typedef itk::ImageFileWriter< RGBImageType > RGBWriterType;
+    RGBWriterType::Pointer rgbwriter = RGBWriterType::New();
+    rgbwriter->SetInput( overlay->GetOutput() );
+    rgbwriter->SetFileName( argv[5] );
+    rgbwriter->Update();
+    }
+
+  return 0;
+}